@@ -140,3 +140,11 @@ function(target_add_sokol_for_tests TARGET)
   )
   target_sources(${TARGET} PRIVATE "${THIS_SOKOL_DIR}/sokol_for_tests.cpp")
 endfunction()
+
+# Adds sokol_gfx with the dummy backend, sokol_imgui and sokol_time for building benchmarks
+function(target_add_sokol_for_benchmarks TARGET)
+  target_include_directories(${TARGET} PRIVATE
+    ${SOKOL_INCLUDE_DIR}
+  )
+  target_sources(${TARGET} PRIVATE "${THIS_SOKOL_DIR}/sokol_for_benchmarks.cpp")
+endfunction()
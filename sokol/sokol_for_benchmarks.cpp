@@ -0,0 +1,12 @@
+// Sokol implementation for benchmarks: sokol_gfx runs on the dummy backend, so code which creates GPU resources and
+// renders ImGui can be measured without a window.
+
+#define SOKOL_DUMMY_BACKEND
+
+#include <imgui.h>
+
+#define SOKOL_IMPL
+#include <sokol_gfx.h>
+#include <sokol_log.h>
+#include <sokol_time.h>
+#include <util/sokol_imgui.h>
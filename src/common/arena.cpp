@@ -0,0 +1,101 @@
+#include "arena.h"
+
+#include <cstdlib>
+#include <utility>
+
+#include "bits.h"
+
+
+namespace {
+
+const size_t MAX_ALIGNMENT = 4096;
+
+size_t align_up(uintptr_t v, size_t alignment) {
+    return (v + alignment - 1) & ~uintptr_t(alignment - 1);
+}
+
+}  // namespace
+
+Arena::Arena(size_t block_size) : block_size(block_size) {
+}
+
+Arena::Arena(Arena&& other) noexcept
+    : block_size(other.block_size), blocks(std::move(other.blocks)), offset(other.offset), used(other.used) {
+    other.blocks.clear();
+    other.offset = 0;
+    other.used = 0;
+}
+
+Arena& Arena::operator=(Arena&& other) noexcept {
+    if (this != &other) {
+        block_size = other.block_size;
+        blocks = std::move(other.blocks);
+        offset = other.offset;
+        used = other.used;
+        other.blocks.clear();
+        other.offset = 0;
+        other.used = 0;
+    }
+    return *this;
+}
+
+uint8_t* Arena::allocate(size_t size, size_t alignment) {
+    if (!is_pow2(alignment) || alignment > MAX_ALIGNMENT) {
+        abort();
+    }
+
+    if (!blocks.empty()) {
+        Block& block = blocks.back();
+        uintptr_t base = uintptr_t(block.data.get());
+        size_t start = align_up(base + offset, alignment) - base;
+        if (start <= block.size && size <= block.size - start) {
+            used += start + size - offset;
+            offset = start + size;
+            return block.data.get() + start;
+        }
+    }
+
+    // The new block has room for the worst-case alignment padding.
+    add_block(size + alignment - 1);
+    Block& block = blocks.back();
+    uintptr_t base = uintptr_t(block.data.get());
+    size_t start = align_up(base, alignment) - base;
+    offset = start + size;
+    used += offset;
+    return block.data.get() + start;
+}
+
+void Arena::reserve(size_t size) {
+    if (!blocks.empty() && blocks.back().size - offset >= size + MAX_ALIGNMENT - 1) {
+        return;
+    }
+    add_block(size + MAX_ALIGNMENT - 1);
+}
+
+void Arena::clear() {
+    blocks.clear();
+    offset = 0;
+    used = 0;
+}
+
+size_t Arena::bytes_used() const {
+    return used;
+}
+
+size_t Arena::bytes_reserved() const {
+    size_t result = 0;
+    for (const Block& block : blocks) {
+        result += block.size;
+    }
+    return result;
+}
+
+void Arena::add_block(size_t min_size) {
+    size_t size = min_size > block_size ? min_size : block_size;
+    Block block;
+    // Intentionally leave the memory uninitialized.
+    block.data.reset(new uint8_t[size]);
+    block.size = size;
+    blocks.push_back(std::move(block));
+    offset = 0;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "span.h"
+#include "struct.h"
+
+
+// Bump allocator: allocations are served from large blocks and are all freed at once when the arena is cleared or
+// destroyed. Moving the arena does not invalidate the allocated memory. Not thread-safe.
+class Arena {
+public:
+    // Default alignment is the cache line size, which is enough for any SIMD loads.
+    static constexpr size_t DEFAULT_ALIGNMENT = 64;
+
+    // Initialize the arena. No memory is allocated until the first allocate() or reserve().
+    Arena(size_t block_size = 1 << 20);
+    Arena(Arena&& other) noexcept;
+    Arena& operator=(Arena&& other) noexcept;
+    DISABLE_COPY(Arena);
+
+    // Allocate uninitialized memory of given size. Alignment must be a power of two not greater than 4096.
+    uint8_t* allocate(size_t size, size_t alignment = DEFAULT_ALIGNMENT);
+
+    // Allocate uninitialized array of count elements, T must be trivial.
+    template <typename T>
+    Span<T> allocate_array(size_t count, size_t alignment = DEFAULT_ALIGNMENT) {
+        static_assert(std::is_trivial_v<T>, "Arena only supports trivial types");
+        return Span<T>(reinterpret_cast<T*>(allocate(count * sizeof(T), alignment)), count);
+    }
+
+    // Make sure that the next allocations with total size (including alignment padding) of at most size bytes are
+    // served from a single block.
+    void reserve(size_t size);
+
+    // Free all the memory allocated by arena.
+    void clear();
+
+    // Return the total size of allocations (including alignment padding).
+    size_t bytes_used() const;
+    // Return the total size of blocks allocated by arena.
+    size_t bytes_reserved() const;
+
+private:
+    struct Block {
+        std::unique_ptr<uint8_t[]> data;
+        size_t size = 0;
+    };
+
+    size_t block_size;
+    std::vector<Block> blocks;
+    // Offset of the free space in the last block.
+    size_t offset = 0;
+    size_t used = 0;
+
+    void add_block(size_t min_size);
+};
@@ -0,0 +1,255 @@
+#include "atlas.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+
+#include "bits.h"
+#include "thread.h"
+
+
+SkylinePacker::SkylinePacker(uint32_t width, uint32_t height) {
+    reset(width, height);
+}
+
+void SkylinePacker::reset(uint32_t width, uint32_t height) {
+    page_width = width;
+    page_height = height;
+    max_x = 0;
+    max_y = 0;
+    area = 0;
+    skyline.clear();
+    if (width > 0) {
+        skyline.push_back({0, 0, width});
+    }
+}
+
+uint32_t SkylinePacker::fit_at(size_t idx, uint32_t width) const {
+    uint32_t x = skyline[idx].x;
+    if (width > page_width - x) {
+        return UINT32_MAX;
+    }
+    uint32_t y = 0;
+    uint32_t remaining = width;
+    for (size_t i = idx; remaining > 0; i++) {
+        y = std::max(y, skyline[i].y);
+        remaining -= std::min(remaining, skyline[i].width);
+    }
+    return y;
+}
+
+bool SkylinePacker::insert(uint32_t width, uint32_t height, uint32_t& x, uint32_t& y) {
+    if (width == 0 || height == 0) {
+        x = 0;
+        y = 0;
+        return true;
+    }
+
+    // Bottom-left: choose the position with the lowest top edge, then the leftmost one.
+    size_t best_idx = SIZE_MAX;
+    uint32_t best_y = UINT32_MAX;
+    for (size_t i = 0; i < skyline.size(); i++) {
+        uint32_t fit_y = fit_at(i, width);
+        if (fit_y == UINT32_MAX || height > page_height - fit_y) {
+            continue;
+        }
+        if (fit_y < best_y) {
+            best_y = fit_y;
+            best_idx = i;
+        }
+    }
+    if (best_idx == SIZE_MAX) {
+        return false;
+    }
+
+    x = skyline[best_idx].x;
+    y = best_y;
+    Segment new_segment = {x, y + height, width};
+
+    // Cut the segments covered by the new one.
+    size_t end_idx = best_idx;
+    uint32_t new_end = x + width;
+    while (end_idx < skyline.size() && skyline[end_idx].x + skyline[end_idx].width <= new_end) {
+        end_idx++;
+    }
+    if (end_idx < skyline.size() && skyline[end_idx].x < new_end) {
+        Segment& partial = skyline[end_idx];
+        partial.width -= new_end - partial.x;
+        partial.x = new_end;
+    }
+    skyline.erase(skyline.begin() + ptrdiff_t(best_idx), skyline.begin() + ptrdiff_t(end_idx));
+    skyline.insert(skyline.begin() + ptrdiff_t(best_idx), new_segment);
+
+    // Merge neighbours of the same height.
+    for (size_t i = best_idx > 0 ? best_idx - 1 : 0; i + 1 < skyline.size() && i <= best_idx + 1;) {
+        if (skyline[i].y == skyline[i + 1].y) {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + ptrdiff_t(i) + 1);
+        } else {
+            i++;
+        }
+    }
+
+    max_x = std::max(max_x, x + width);
+    max_y = std::max(max_y, y + height);
+    area += uint64_t(width) * height;
+    return true;
+}
+
+uint32_t SkylinePacker::used_width() const {
+    return max_x;
+}
+
+uint32_t SkylinePacker::used_height() const {
+    return max_y;
+}
+
+uint64_t SkylinePacker::used_area() const {
+    return area;
+}
+
+double AtlasLayout::efficiency() const {
+    uint64_t total_area = 0;
+    for (const AtlasSize& page : pages) {
+        total_area += uint64_t(page.width) * page.height;
+    }
+    return total_area > 0 ? double(content_area) / double(total_area) : 0.0;
+}
+
+namespace {
+
+enum class SortOrder {
+    Height,
+    Area,
+    MaxSide,
+    Width,
+};
+const SortOrder SORT_ORDERS[] = {SortOrder::Height, SortOrder::Area, SortOrder::MaxSide, SortOrder::Width};
+const size_t NUM_SORT_ORDERS = sizeof(SORT_ORDERS) / sizeof(SORT_ORDERS[0]);
+
+uint64_t sort_key(const AtlasSize& size, SortOrder order) {
+    switch (order) {
+    case SortOrder::Height:
+        return (uint64_t(size.height) << 32) | size.width;
+    case SortOrder::Area:
+        return uint64_t(size.width) * size.height;
+    case SortOrder::MaxSide:
+        return (uint64_t(std::max(size.width, size.height)) << 32) | std::min(size.width, size.height);
+    case SortOrder::Width:
+        return (uint64_t(size.width) << 32) | size.height;
+    }
+    return 0;
+}
+
+struct PackAttempt {
+    bool ok = false;
+    std::vector<SkylinePacker> pages;
+    // Position of the padded rectangle for each input.
+    std::vector<AtlasRect> padded_rects;
+};
+
+void pack_with_order(const std::vector<AtlasSize>& padded_sizes, const AtlasPackOptions& options, SortOrder order,
+                     PackAttempt& attempt) {
+    std::vector<size_t> indices(padded_sizes.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    // Stable sort keeps the result deterministic for equal keys.
+    std::stable_sort(indices.begin(), indices.end(), [&](size_t a, size_t b) {
+        return sort_key(padded_sizes[a], order) > sort_key(padded_sizes[b], order);
+    });
+
+    attempt.padded_rects.resize(padded_sizes.size());
+    for (size_t idx : indices) {
+        const AtlasSize& size = padded_sizes[idx];
+        AtlasRect& rect = attempt.padded_rects[idx];
+        rect.width = size.width;
+        rect.height = size.height;
+        bool placed = false;
+        for (size_t page = 0; page < attempt.pages.size() && !placed; page++) {
+            if (attempt.pages[page].insert(size.width, size.height, rect.x, rect.y)) {
+                rect.page = uint32_t(page);
+                placed = true;
+            }
+        }
+        if (!placed) {
+            attempt.pages.emplace_back(options.page_width, options.page_height);
+            if (!attempt.pages.back().insert(size.width, size.height, rect.x, rect.y)) {
+                return;
+            }
+            rect.page = uint32_t(attempt.pages.size() - 1);
+        }
+    }
+    attempt.ok = true;
+}
+
+// Return true if a is a better packing than b.
+bool better_attempt(const PackAttempt& a, const PackAttempt& b) {
+    if (!b.ok) {
+        return a.ok;
+    }
+    if (!a.ok) {
+        return false;
+    }
+    if (a.pages.size() != b.pages.size()) {
+        return a.pages.size() < b.pages.size();
+    }
+    if (a.pages.empty()) {
+        return false;
+    }
+    const SkylinePacker& a_last = a.pages.back();
+    const SkylinePacker& b_last = b.pages.back();
+    return uint64_t(a_last.used_width()) * a_last.used_height() < uint64_t(b_last.used_width()) * b_last.used_height();
+}
+
+uint32_t align_up(uint32_t v, uint32_t alignment) {
+    return (v + alignment - 1) & ~(alignment - 1);
+}
+
+}  // namespace
+
+bool pack_atlas(const std::vector<AtlasSize>& sizes, const AtlasPackOptions& options, AtlasLayout& layout) {
+    layout = {};
+    if (!is_pow2(options.alignment)) {
+        return false;
+    }
+
+    std::vector<AtlasSize> padded_sizes(sizes.size());
+    for (size_t i = 0; i < sizes.size(); i++) {
+        padded_sizes[i].width = align_up(sizes[i].width + options.padding * 2, options.alignment);
+        padded_sizes[i].height = align_up(sizes[i].height + options.padding * 2, options.alignment);
+        layout.content_area += uint64_t(sizes[i].width) * sizes[i].height;
+    }
+
+    PackAttempt attempts[NUM_SORT_ORDERS];
+    auto run_attempt = [&](size_t i) { pack_with_order(padded_sizes, options, SORT_ORDERS[i], attempts[i]); };
+    if (options.parallel) {
+        thread_pool().run_for(run_attempt, NUM_SORT_ORDERS);
+    } else {
+        for (size_t i = 0; i < NUM_SORT_ORDERS; i++) {
+            run_attempt(i);
+        }
+    }
+
+    size_t best = 0;
+    for (size_t i = 1; i < NUM_SORT_ORDERS; i++) {
+        if (better_attempt(attempts[i], attempts[best])) {
+            best = i;
+        }
+    }
+    const PackAttempt& attempt = attempts[best];
+    if (!attempt.ok) {
+        layout.content_area = 0;
+        return false;
+    }
+
+    for (const SkylinePacker& page : attempt.pages) {
+        layout.pages.push_back({align_up(page.used_width(), options.alignment),
+                                align_up(page.used_height(), options.alignment)});
+    }
+    layout.rects.resize(sizes.size());
+    for (size_t i = 0; i < sizes.size(); i++) {
+        const AtlasRect& padded = attempt.padded_rects[i];
+        layout.rects[i] = {padded.page, padded.x + options.padding, padded.y + options.padding, sizes[i].width,
+                           sizes[i].height};
+    }
+    return true;
+}
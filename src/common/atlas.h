@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Skyline bottom-left rectangle packer for a single atlas page. Not thread-safe.
+class SkylinePacker {
+public:
+    SkylinePacker(uint32_t width = 0, uint32_t height = 0);
+
+    // Remove all rectangles and set the page size.
+    void reset(uint32_t width, uint32_t height);
+
+    // Find the lowest position for the rectangle and reserve it. Return false if the rectangle does not fit.
+    bool insert(uint32_t width, uint32_t height, uint32_t& x, uint32_t& y);
+
+    // Return the maximum x and y of the inserted rectangles.
+    uint32_t used_width() const;
+    uint32_t used_height() const;
+    // Return the total area of the inserted rectangles.
+    uint64_t used_area() const;
+
+private:
+    struct Segment {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+    };
+
+    uint32_t page_width = 0;
+    uint32_t page_height = 0;
+    uint32_t max_x = 0;
+    uint32_t max_y = 0;
+    uint64_t area = 0;
+    // Segments cover the page width without gaps, sorted by x.
+    std::vector<Segment> skyline;
+
+    // Return the y at which the rectangle of given width fits starting at segment idx or UINT32_MAX.
+    uint32_t fit_at(size_t idx, uint32_t width) const;
+};
+
+// Size of rectangle to pack.
+struct AtlasSize {
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+// Rectangle placed into atlas page, x and y point to the rectangle contents (the padding is around them).
+struct AtlasRect {
+    uint32_t page = 0;
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+// Options for pack_atlas().
+struct AtlasPackOptions {
+    // Maximum page size.
+    uint32_t page_width = 2048;
+    uint32_t page_height = 2048;
+    // Empty space around each rectangle.
+    uint32_t padding = 0;
+    // Padded rectangles (and therefore contents if padding is a multiple of alignment) are placed at multiples of
+    // alignment, page sizes are multiples of alignment as well. Must be a power of two.
+    uint32_t alignment = 1;
+    // Try several packing heuristics in parallel on thread_pool() instead of sequentially. The result is the same.
+    bool parallel = false;
+};
+
+// Result of pack_atlas().
+struct AtlasLayout {
+    // Size of each page. Pages are shrunk to their used area (rounded up to alignment).
+    std::vector<AtlasSize> pages;
+    // Placed rectangles in the same order as the input sizes.
+    std::vector<AtlasRect> rects;
+    // Total area of the input rectangles (excluding padding).
+    uint64_t content_area = 0;
+
+    // Return content area divided by total page area (0 if there are no pages).
+    double efficiency() const;
+};
+
+// Pack rectangles into as few pages as possible. Several heuristics (sort orders) are tried, the one with the fewest
+// pages and the smallest last page wins. Return false if a rectangle does not fit into an empty page.
+bool pack_atlas(const std::vector<AtlasSize>& sizes, const AtlasPackOptions& options, AtlasLayout& layout);
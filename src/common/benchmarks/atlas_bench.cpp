@@ -0,0 +1,36 @@
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "bench.h"
+#include "common/atlas.h"
+
+
+TEST_SUITE_BEGIN("atlas_bench");
+
+TEST_CASE("pack_atlas random texture sizes") {
+    for (size_t count : {1000, 10000}) {
+        std::vector<AtlasSize> sizes;
+        uint32_t state = 1;
+        for (size_t i = 0; i < count; i++) {
+            state = state * 1664525u + 1013904223u;
+            sizes.push_back({16u << ((state >> 24) % 5), 16u << ((state >> 16) % 5)});
+        }
+
+        for (bool parallel : {false, true}) {
+            AtlasPackOptions options;
+            options.padding = 16;
+            options.alignment = 16;
+            options.parallel = parallel;
+            AtlasLayout layout;
+            double seconds = bench_seconds_per_call([&] { pack_atlas(sizes, options, layout); });
+            printf("pack_atlas %zu rects, %s: %.2f ms, %zu pages, efficiency %.1f%%\n", count,
+                   parallel ? "parallel" : "sequential", seconds * 1000.0, layout.pages.size(),
+                   layout.efficiency() * 100.0);
+        }
+    }
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <sokol_time.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "common/io.h"
+
+
+// Benchmarks are doctest test cases in *_bench.cpp files, which are built into a separate benchmarks executable. Build
+// with -DENABLE_ASAN=OFF to get meaningful numbers.
+
+// Run f() repeatedly for at least min_seconds (and at least once), return the average time per call in seconds.
+template <typename F>
+double bench_seconds_per_call(F&& f, double min_seconds = 0.5) {
+    stm_setup();
+    uint64_t start = stm_now();
+    size_t num_calls = 0;
+    do {
+        f();
+        num_calls++;
+    } while (stm_sec(stm_since(start)) < min_seconds);
+    return stm_sec(stm_since(start)) / double(num_calls);
+}
+
+// Return the directory with HL1 data for benchmarks: HL1_DATA_DIR environment variable or data/hl1.
+inline const char* bench_data_dir() {
+    const char* dir = getenv("HL1_DATA_DIR");
+    return dir != nullptr ? dir : "data/hl1";
+}
+
+// Return the paths of the maps listed in maps.txt in bench_data_dir(), one per line relative to the directory. Print a
+// note and return no paths if there is no maps.txt.
+inline std::vector<std::string> bench_map_paths() {
+    const char* data_dir = bench_data_dir();
+    std::vector<std::string> paths;
+    if (!file_read_lines(path_join(data_dir, "maps.txt").c_str(), paths)) {
+        printf("Skipping: no maps.txt in %s\n", data_dir);
+        return {};
+    }
+    for (std::string& path : paths) {
+        path = path_join(data_dir, path.c_str());
+    }
+    return paths;
+}
@@ -0,0 +1,55 @@
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "bench.h"
+#include "common/frustum.h"
+#include "common/thread.h"
+
+
+TEST_SUITE_BEGIN("frustum_bench");
+
+TEST_CASE("cull_boxes random boxes") {
+    const float position[3] = {0.0f, 0.0f, 0.0f};
+    const float forward[3] = {0.6f, 0.8f, 0.0f};
+    const float right[3] = {0.8f, -0.6f, 0.0f};
+    const float up[3] = {0.0f, 0.0f, 1.0f};
+    Frustum frustum;
+    frustum.set_perspective(position, forward, right, up, 1.0f, 0.75f, 4.0f, 4096.0f);
+
+    for (size_t count : {1000, 10000, 100000, 1000000}) {
+        // Boxes of the size of leaves scattered around the camera like a large map.
+        FrustumBoxes boxes;
+        boxes.resize(count);
+        uint32_t state = 1;
+        auto random_float = [&](float lo, float hi) {
+            state = state * 1664525u + 1013904223u;
+            return lo + float(state >> 8) / float(1 << 24) * (hi - lo);
+        };
+        for (size_t i = 0; i < count; i++) {
+            float mins[3];
+            float maxs[3];
+            for (int axis = 0; axis < 3; axis++) {
+                mins[axis] = random_float(-4096.0f, 4096.0f);
+                maxs[axis] = mins[axis] + random_float(16.0f, 256.0f);
+            }
+            boxes.set(i, mins, maxs);
+        }
+
+        std::vector<uint32_t> visible(count);
+        size_t num_visible = 0;
+        double scalar_seconds =
+            bench_seconds_per_call([&] { num_visible = cull_boxes_scalar(frustum, boxes, visible.data()); });
+        double simd_seconds = bench_seconds_per_call([&] { cull_boxes(frustum, boxes, visible.data()); });
+        double parallel_seconds = bench_seconds_per_call([&] { cull_boxes(frustum, boxes, visible.data(), true); });
+        printf("cull_boxes %zu boxes, %.1f%% visible: scalar %.1f M boxes/s, SIMD %.1f M boxes/s, parallel (%zu "
+               "threads) %.1f M boxes/s\n",
+               count, 100.0 * double(num_visible) / double(count), 1e-6 * double(count) / scalar_seconds,
+               1e-6 * double(count) / simd_seconds, thread_pool().num_threads(),
+               1e-6 * double(count) / parallel_seconds);
+    }
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,44 @@
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "bench.h"
+#include "common/image.h"
+
+
+TEST_SUITE_BEGIN("image_bench");
+
+namespace {
+
+// Print the cost of downsampling a random 1024x1024 image per source megapixel.
+void bench_downsample(bool gamma_correct) {
+    const uint32_t size = 1024;
+    std::vector<uint8_t> src(size_t(size) * size * 4);
+    uint32_t state = 1;
+    for (uint8_t& v : src) {
+        state = state * 1664525u + 1013904223u;
+        v = uint8_t(state >> 24);
+    }
+    std::vector<uint8_t> dst(src.size() / 4);
+    double megapixels = double(size) * size / 1e6;
+
+    double seconds = bench_seconds_per_call(
+        [&] { downsample_rgba8(src.data(), size, size, dst.data(), gamma_correct); });
+    printf("downsample_rgba8 %ux%u %s: %.3f ms per source megapixel\n", size, size,
+           gamma_correct ? "gamma-correct" : "linear", seconds * 1000.0 / megapixels);
+    CHECK(dst[0] != 0);
+}
+
+}  // namespace
+
+TEST_CASE("downsample_rgba8 cost per megapixel") {
+    bench_downsample(false);
+}
+
+TEST_CASE("downsample_rgba8 gamma-correct cost per megapixel") {
+    bench_downsample(true);
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,46 @@
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "bench.h"
+#include "common/image.h"
+#include "common/texture_compression.h"
+
+
+TEST_SUITE_BEGIN("texture_compression_bench");
+
+TEST_CASE("compress_rgba8 throughput") {
+    const uint32_t size = 1024;
+    std::vector<uint8_t> src(size_t(size) * size * 4);
+    uint32_t state = 1;
+    for (uint32_t y = 0; y < size; y++) {
+        for (uint32_t x = 0; x < size; x++) {
+            state = state * 1664525u + 1013904223u;
+            uint8_t* pixel = &src[(size_t(y) * size + x) * 4];
+            pixel[0] = uint8_t(x / 4 + (state >> 29));
+            pixel[1] = uint8_t(y / 4 + (state >> 28));
+            pixel[2] = uint8_t(((x / 16) ^ (y / 16)) & 1 ? 200 : 60);
+            pixel[3] = 255;
+        }
+    }
+    double megapixels = double(size) * size / 1e6;
+    std::vector<uint8_t> decompressed(src.size());
+
+    for (TextureFormat format : {TextureFormat::BC1, TextureFormat::ETC2_RGB8}) {
+        const char* format_name = format == TextureFormat::BC1 ? "BC1" : "ETC2";
+        std::vector<uint8_t> dst(texture_image_size(format, size, size));
+        for (bool parallel : {false, true}) {
+            double seconds =
+                bench_seconds_per_call([&] { compress_rgba8(format, src.data(), size, size, dst.data(), parallel); });
+            printf("compress_rgba8 %s %ux%u %s: %.1f megapixels/s\n", format_name, size, size,
+                   parallel ? "parallel" : "sequential", megapixels / seconds);
+        }
+        decompress_rgba8(format, dst.data(), size, size, decompressed.data());
+        printf("compress_rgba8 %s PSNR: %.2f dB\n", format_name,
+               psnr_rgb8(src.data(), decompressed.data(), size_t(size) * size));
+    }
+}
+
+TEST_SUITE_END();
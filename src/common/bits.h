@@ -82,3 +82,37 @@ FORCE_INLINE int next_log2_inclusive(size_t v) {
 FORCE_INLINE size_t next_pow2_inclusive(size_t v) {
     return 1 << next_log2_inclusive(v);
 }
+
+// Return the number of zero bits below the lowest set bit of v, or 64 if v is 0.
+FORCE_INLINE int count_trailing_zeros(uint64_t v) {
+    if (v == 0) {
+        return 64;
+    }
+#if defined(__clang__) || defined(__GNUC__)
+    return __builtin_ctzll(v);
+#elif defined(_MSC_VER) && SIZE_T_IS_64_BIT
+    unsigned long index;
+    _BitScanForward64(&index, v);
+    return int(index);
+#else
+    int n = 0;
+    while ((v & 1) == 0) {
+        n++;
+        v >>= 1;
+    }
+    return n;
+#endif
+}
+
+// Return the number of set bits in v.
+FORCE_INLINE int count_set_bits(uint64_t v) {
+#if defined(__clang__) || defined(__GNUC__)
+    return __builtin_popcountll(v);
+#else
+    // __popcnt64 of MSVC needs a CPU with POPCNT, count in parallel within the bytes instead.
+    v = v - ((v >> 1) & 0x5555555555555555);
+    v = (v & 0x3333333333333333) + ((v >> 2) & 0x3333333333333333);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0F;
+    return int((v * 0x0101010101010101) >> 56);
+#endif
+}
@@ -0,0 +1,48 @@
+#include "bitset.h"
+
+#include "simd.h"
+
+
+void bitset_or(uint64_t* dst, const uint64_t* src, size_t num_words) {
+    size_t i = 0;
+#if defined(SIMD_USE_SSE2)
+    for (; i + 2 <= num_words; i += 2) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_or_si128(a, b));
+    }
+#elif defined(SIMD_USE_NEON)
+    for (; i + 2 <= num_words; i += 2) {
+        vst1q_u64(dst + i, vorrq_u64(vld1q_u64(dst + i), vld1q_u64(src + i)));
+    }
+#endif
+    for (; i < num_words; i++) {
+        dst[i] |= src[i];
+    }
+}
+
+void bitset_and(uint64_t* dst, const uint64_t* src, size_t num_words) {
+    size_t i = 0;
+#if defined(SIMD_USE_SSE2)
+    for (; i + 2 <= num_words; i += 2) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_and_si128(a, b));
+    }
+#elif defined(SIMD_USE_NEON)
+    for (; i + 2 <= num_words; i += 2) {
+        vst1q_u64(dst + i, vandq_u64(vld1q_u64(dst + i), vld1q_u64(src + i)));
+    }
+#endif
+    for (; i < num_words; i++) {
+        dst[i] &= src[i];
+    }
+}
+
+size_t bitset_count(const uint64_t* bits, size_t num_words) {
+    size_t result = 0;
+    for (size_t i = 0; i < num_words; i++) {
+        result += size_t(count_set_bits(bits[i]));
+    }
+    return result;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "bits.h"
+#include "common.h"
+
+
+// Operations on packed bitsets stored as arrays of 64-bit words, bit i is bit (i % 64) of word i / 64. The bits past
+// the end of the last word must be kept zero by the callers.
+
+// Return the number of words for num_bits bits.
+FORCE_INLINE size_t bitset_num_words(size_t num_bits) {
+    return (num_bits + 63) / 64;
+}
+
+FORCE_INLINE void bitset_set(uint64_t* bits, size_t i) {
+    bits[i / 64] |= uint64_t(1) << (i % 64);
+}
+
+FORCE_INLINE bool bitset_test(const uint64_t* bits, size_t i) {
+    return (bits[i / 64] >> (i % 64)) & 1;
+}
+
+// dst |= src for num_words words.
+void bitset_or(uint64_t* dst, const uint64_t* src, size_t num_words);
+// dst &= src for num_words words.
+void bitset_and(uint64_t* dst, const uint64_t* src, size_t num_words);
+// Return the number of set bits.
+size_t bitset_count(const uint64_t* bits, size_t num_words);
+
+// Call f(i) for each set bit i in ascending order. Zero words are skipped with a single test.
+template <typename F>
+void bitset_for_each(const uint64_t* bits, size_t num_words, F&& f) {
+    for (size_t word_idx = 0; word_idx < num_words; word_idx++) {
+        uint64_t word = bits[word_idx];
+        while (word != 0) {
+            f(word_idx * 64 + size_t(count_trailing_zeros(word)));
+            word &= word - 1;
+        }
+    }
+}
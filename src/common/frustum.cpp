@@ -0,0 +1,184 @@
+#include "frustum.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "bits.h"
+#include "simd.h"
+#include "thread.h"
+
+
+namespace {
+
+// Boxes per task of the parallel culling, a multiple of FrustumBoxes::BATCH.
+const size_t BOXES_PER_TASK = 4096;
+
+float plane_distance(const float normal[3], float dist, float x, float y, float z) {
+    return normal[0] * x + normal[1] * y + normal[2] * z - dist;
+}
+
+// Coordinate arrays of the corner of the boxes furthest along the normal of each plane. A box is outside of a plane
+// if that corner is.
+struct PlaneCorners {
+    const float* coords[Frustum::NUM_PLANES][3];
+
+    PlaneCorners(const Frustum& frustum, const FrustumBoxes& boxes) {
+        for (int plane = 0; plane < Frustum::NUM_PLANES; plane++) {
+            for (int axis = 0; axis < 3; axis++) {
+                coords[plane][axis] =
+                    frustum.normals[plane][axis] > 0.0f ? boxes.maxs[axis].data() : boxes.mins[axis].data();
+            }
+        }
+    }
+};
+
+// Return bit j set if box i + j is inside of all the planes, for the BATCH boxes from i.
+uint32_t test_batch(const Frustum& frustum, const PlaneCorners& corners, size_t i) {
+#if defined(SIMD_USE_SSE2)
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int plane = 0; plane < Frustum::NUM_PLANES; plane++) {
+        const float* normal = frustum.normals[plane];
+        __m128 x = _mm_mul_ps(_mm_set1_ps(normal[0]), _mm_loadu_ps(corners.coords[plane][0] + i));
+        __m128 y = _mm_mul_ps(_mm_set1_ps(normal[1]), _mm_loadu_ps(corners.coords[plane][1] + i));
+        __m128 z = _mm_mul_ps(_mm_set1_ps(normal[2]), _mm_loadu_ps(corners.coords[plane][2] + i));
+        __m128 distance = _mm_sub_ps(_mm_add_ps(_mm_add_ps(x, y), z), _mm_set1_ps(frustum.dists[plane]));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+    }
+    return movemask_u32(inside);
+#elif defined(SIMD_USE_NEON)
+    uint32x4_t inside = vdupq_n_u32(UINT32_MAX);
+    for (int plane = 0; plane < Frustum::NUM_PLANES; plane++) {
+        const float* normal = frustum.normals[plane];
+        float32x4_t x = vmulq_f32(vdupq_n_f32(normal[0]), vld1q_f32(corners.coords[plane][0] + i));
+        float32x4_t y = vmulq_f32(vdupq_n_f32(normal[1]), vld1q_f32(corners.coords[plane][1] + i));
+        float32x4_t z = vmulq_f32(vdupq_n_f32(normal[2]), vld1q_f32(corners.coords[plane][2] + i));
+        float32x4_t distance = vsubq_f32(vaddq_f32(vaddq_f32(x, y), z), vdupq_n_f32(frustum.dists[plane]));
+        inside = vandq_u32(inside, vcgeq_f32(distance, vdupq_n_f32(0.0f)));
+    }
+    return movemask_u32(inside);
+#else
+    uint32_t inside = (1u << FrustumBoxes::BATCH) - 1;
+    for (int plane = 0; plane < Frustum::NUM_PLANES; plane++) {
+        const float* const* coords = corners.coords[plane];
+        for (size_t lane = 0; lane < FrustumBoxes::BATCH; lane++) {
+            size_t box = i + lane;
+            float distance = plane_distance(frustum.normals[plane], frustum.dists[plane], coords[0][box],
+                                            coords[1][box], coords[2][box]);
+            inside &= distance >= 0.0f ? UINT32_MAX : ~(1u << lane);
+        }
+    }
+    return inside;
+#endif
+}
+
+// Cull the boxes [begin, end), begin a multiple of BATCH, into visible[0..).
+size_t cull_range(const Frustum& frustum, const PlaneCorners& corners, size_t begin, size_t end, uint32_t* visible) {
+    size_t num_visible = 0;
+    for (size_t i = begin; i < end; i += FrustumBoxes::BATCH) {
+        uint32_t inside = test_batch(frustum, corners, i);
+        // The padding boxes past the end are dropped.
+        if (end - i < FrustumBoxes::BATCH) {
+            inside &= (1u << (end - i)) - 1;
+        }
+        while (inside != 0) {
+            visible[num_visible++] = uint32_t(i) + uint32_t(count_trailing_zeros(inside));
+            inside &= inside - 1;
+        }
+    }
+    return num_visible;
+}
+
+}  // namespace
+
+void Frustum::set_perspective(const float position[3], const float forward[3], const float right[3],
+                              const float up[3], float tan_half_fov_x, float tan_half_fov_y, float near_dist,
+                              float far_dist) {
+    // The side planes go through the position, their normals point inwards.
+    for (int axis = 0; axis < 3; axis++) {
+        normals[0][axis] = forward[axis];
+        normals[1][axis] = -forward[axis];
+        normals[2][axis] = forward[axis] * tan_half_fov_x + right[axis];
+        normals[3][axis] = forward[axis] * tan_half_fov_x - right[axis];
+        normals[4][axis] = forward[axis] * tan_half_fov_y + up[axis];
+        normals[5][axis] = forward[axis] * tan_half_fov_y - up[axis];
+    }
+    for (int plane = 2; plane < NUM_PLANES; plane++) {
+        float* normal = normals[plane];
+        float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        for (int axis = 0; axis < 3; axis++) {
+            normal[axis] /= length;
+        }
+    }
+    for (int plane = 0; plane < NUM_PLANES; plane++) {
+        dists[plane] = normals[plane][0] * position[0] + normals[plane][1] * position[1] +
+                       normals[plane][2] * position[2];
+    }
+    dists[0] += near_dist;
+    dists[1] -= far_dist;
+}
+
+bool Frustum::test_box(const float mins[3], const float maxs[3]) const {
+    for (int plane = 0; plane < NUM_PLANES; plane++) {
+        const float* normal = normals[plane];
+        float corner[3];
+        for (int axis = 0; axis < 3; axis++) {
+            corner[axis] = normal[axis] > 0.0f ? maxs[axis] : mins[axis];
+        }
+        // Written as in the SIMD loop, so that both give the same results. NaN distances cull the box in both.
+        if (!(plane_distance(normal, dists[plane], corner[0], corner[1], corner[2]) >= 0.0f)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void FrustumBoxes::resize(size_t size) {
+    num_boxes = size;
+    size_t padded_size = (size + BATCH - 1) / BATCH * BATCH;
+    for (int axis = 0; axis < 3; axis++) {
+        mins[axis].resize(padded_size, 0.0f);
+        maxs[axis].resize(padded_size, 0.0f);
+    }
+}
+
+void FrustumBoxes::set(size_t i, const float box_mins[3], const float box_maxs[3]) {
+    for (int axis = 0; axis < 3; axis++) {
+        mins[axis][i] = box_mins[axis];
+        maxs[axis][i] = box_maxs[axis];
+    }
+}
+
+size_t cull_boxes(const Frustum& frustum, const FrustumBoxes& boxes, uint32_t* visible, bool parallel) {
+    PlaneCorners corners(frustum, boxes);
+    size_t num_boxes = boxes.size();
+    if (!parallel || num_boxes <= BOXES_PER_TASK) {
+        return cull_range(frustum, corners, 0, num_boxes, visible);
+    }
+
+    // Each task writes to the slice of visible at its first box, the slices are then moved together in order.
+    size_t num_tasks = (num_boxes + BOXES_PER_TASK - 1) / BOXES_PER_TASK;
+    std::vector<size_t> task_counts(num_tasks);
+    thread_pool().run_for_chunked(
+        [&](size_t begin, size_t end) {
+            task_counts[begin / BOXES_PER_TASK] = cull_range(frustum, corners, begin, end, visible + begin);
+        },
+        num_boxes, BOXES_PER_TASK);
+    size_t num_visible = task_counts[0];
+    for (size_t task = 1; task < num_tasks; task++) {
+        memmove(visible + num_visible, visible + task * BOXES_PER_TASK, task_counts[task] * sizeof(uint32_t));
+        num_visible += task_counts[task];
+    }
+    return num_visible;
+}
+
+size_t cull_boxes_scalar(const Frustum& frustum, const FrustumBoxes& boxes, uint32_t* visible) {
+    size_t num_visible = 0;
+    for (size_t i = 0; i < boxes.size(); i++) {
+        float box_mins[3] = {boxes.mins[0][i], boxes.mins[1][i], boxes.mins[2][i]};
+        float box_maxs[3] = {boxes.maxs[0][i], boxes.maxs[1][i], boxes.maxs[2][i]};
+        if (frustum.test_box(box_mins, box_maxs)) {
+            visible[num_visible++] = uint32_t(i);
+        }
+    }
+    return num_visible;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Convex view volume bounded by 6 planes. A point p is inside a plane if dot(normal, p) >= dist.
+struct Frustum {
+    static constexpr int NUM_PLANES = 6;
+
+    float normals[NUM_PLANES][3] = {};
+    float dists[NUM_PLANES] = {};
+
+    // Set the planes of a perspective view from position looking along forward, with right and up the axes of the
+    // image. forward, right and up must be orthonormal. tan_half_fov_x and tan_half_fov_y are the tangents of half the
+    // horizontal and vertical fields of view.
+    void set_perspective(const float position[3], const float forward[3], const float right[3], const float up[3],
+                         float tan_half_fov_x, float tan_half_fov_y, float near_dist, float far_dist);
+
+    // Return false if the box is entirely outside of a plane. Boxes outside of the frustum near its edges but inside
+    // of all the planes are kept, as usual for this test.
+    bool test_box(const float mins[3], const float maxs[3]) const;
+};
+
+// Axis-aligned boxes stored as a structure of arrays, so that the culling loads the same coordinate of several boxes
+// at once. The arrays are padded to a multiple of BATCH boxes.
+struct FrustumBoxes {
+    static constexpr size_t BATCH = 4;
+
+    // Set the number of boxes, the new boxes are empty at the origin.
+    void resize(size_t num_boxes);
+    void set(size_t i, const float mins[3], const float maxs[3]);
+    size_t size() const {
+        return num_boxes;
+    }
+
+    // mins[axis][i] and maxs[axis][i] for box i.
+    std::vector<float> mins[3];
+    std::vector<float> maxs[3];
+    size_t num_boxes = 0;
+};
+
+// Write the indices of the boxes passing Frustum::test_box() to visible in ascending order and return their number.
+// visible must have room for boxes.size() indices. Test BATCH boxes per iteration with SIMD and split the boxes
+// across thread_pool() if parallel.
+size_t cull_boxes(const Frustum& frustum, const FrustumBoxes& boxes, uint32_t* visible, bool parallel = false);
+// Same result one box at a time, as a reference.
+size_t cull_boxes_scalar(const Frustum& frustum, const FrustumBoxes& boxes, uint32_t* visible);
@@ -0,0 +1,97 @@
+#include "hash.h"
+
+#include <cstring>
+
+#include "common.h"
+
+
+namespace {
+
+const uint64_t PRIME1 = 0x9e3779b185ebca87ull;
+const uint64_t PRIME2 = 0xc2b2ae3d27d4eb4full;
+const uint64_t PRIME3 = 0x165667b19e3779f9ull;
+const uint64_t PRIME4 = 0x85ebca77c2b2ae63ull;
+const uint64_t PRIME5 = 0x27d4eb2f165667c5ull;
+
+FORCE_INLINE uint64_t rotl64(uint64_t v, int r) {
+    return (v << r) | (v >> (64 - r));
+}
+
+// Little-endian reads, all supported platforms are little-endian.
+FORCE_INLINE uint64_t read64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+FORCE_INLINE uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+FORCE_INLINE uint64_t accumulate(uint64_t acc, uint64_t input) {
+    acc += input * PRIME2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME1;
+}
+
+FORCE_INLINE uint64_t merge_round(uint64_t acc, uint64_t v) {
+    acc ^= accumulate(0, v);
+    return acc * PRIME1 + PRIME4;
+}
+
+}  // namespace
+
+uint64_t hash64(const void* data, size_t size, uint64_t seed) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint8_t* end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        // Four independent lanes, so that the multiplications of a stripe can run in parallel.
+        uint64_t v1 = seed + PRIME1 + PRIME2;
+        uint64_t v2 = seed + PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME1;
+        const uint8_t* limit = end - 32;
+        do {
+            v1 = accumulate(v1, read64(p));
+            v2 = accumulate(v2, read64(p + 8));
+            v3 = accumulate(v3, read64(p + 16));
+            v4 = accumulate(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = merge_round(h, v1);
+        h = merge_round(h, v2);
+        h = merge_round(h, v3);
+        h = merge_round(h, v4);
+    } else {
+        h = seed + PRIME5;
+    }
+    h += uint64_t(size);
+
+    while (p + 8 <= end) {
+        h ^= accumulate(0, read64(p));
+        h = rotl64(h, 27) * PRIME1 + PRIME4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= uint64_t(read32(p)) * PRIME1;
+        h = rotl64(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= uint64_t(*p) * PRIME5;
+        h = rotl64(h, 11) * PRIME1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Return 64-bit hash of the data. The result is identical to XXH64(data, size, seed), so it is stable across platforms
+// and can be stored in files.
+uint64_t hash64(const void* data, size_t size, uint64_t seed = 0);
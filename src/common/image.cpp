@@ -0,0 +1,242 @@
+#include "image.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "bits.h"
+#include "simd.h"
+
+
+namespace {
+
+// Linear values have 14 bits of precision: enough to keep the dark sRGB values distinct while keeping the inverse
+// table small.
+const int LINEAR_BITS = 14;
+const int LINEAR_MAX = (1 << LINEAR_BITS) - 1;
+
+struct GammaTables {
+    uint16_t srgb_to_linear[256];
+    uint8_t linear_to_srgb[LINEAR_MAX + 1];
+
+    GammaTables() {
+        for (int i = 0; i < 256; i++) {
+            double c = i / 255.0;
+            double linear = c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+            srgb_to_linear[i] = uint16_t(std::lround(linear * LINEAR_MAX));
+        }
+        for (int i = 0; i <= LINEAR_MAX; i++) {
+            double linear = double(i) / LINEAR_MAX;
+            double c = linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+            linear_to_srgb[i] = uint8_t(std::lround(c * 255.0));
+        }
+    }
+};
+
+const GammaTables& gamma_tables() {
+    static GammaTables tables;
+    return tables;
+}
+
+// Downsample pixels [dst_x_begin, dst_width) of one destination row. Rows row0 and row1 may be the same row if the
+// source has height 1.
+void downsample_row_scalar(const uint8_t* row0, const uint8_t* row1, uint32_t width, uint8_t* dst_row,
+                           uint32_t dst_x_begin, uint32_t dst_width) {
+    for (uint32_t x = dst_x_begin; x < dst_width; x++) {
+        uint32_t x0 = x * 2;
+        uint32_t x1 = x0 + 1 < width ? x0 + 1 : width - 1;
+        for (int c = 0; c < 4; c++) {
+            uint32_t sum = row0[x0 * 4 + c] + row0[x1 * 4 + c] + row1[x0 * 4 + c] + row1[x1 * 4 + c];
+            dst_row[x * 4 + c] = uint8_t((sum + 2) / 4);
+        }
+    }
+}
+
+void downsample_row_gamma(const uint8_t* row0, const uint8_t* row1, uint32_t width, uint8_t* dst_row,
+                          uint32_t dst_x_begin, uint32_t dst_width) {
+    const GammaTables& tables = gamma_tables();
+    for (uint32_t x = dst_x_begin; x < dst_width; x++) {
+        uint32_t x0 = x * 2;
+        uint32_t x1 = x0 + 1 < width ? x0 + 1 : width - 1;
+        for (int c = 0; c < 3; c++) {
+            uint32_t sum = tables.srgb_to_linear[row0[x0 * 4 + c]] + tables.srgb_to_linear[row0[x1 * 4 + c]] +
+                           tables.srgb_to_linear[row1[x0 * 4 + c]] + tables.srgb_to_linear[row1[x1 * 4 + c]];
+            dst_row[x * 4 + c] = tables.linear_to_srgb[(sum + 2) / 4];
+        }
+        uint32_t alpha_sum = row0[x0 * 4 + 3] + row0[x1 * 4 + 3] + row1[x0 * 4 + 3] + row1[x1 * 4 + 3];
+        dst_row[x * 4 + 3] = uint8_t((alpha_sum + 2) / 4);
+    }
+}
+
+// Expand RGBA8 pixels into 16-bit channels: colors are converted into linear space, alpha is kept as is.
+FORCE_INLINE void rgba8_to_linear16(const GammaTables& tables, const uint8_t* src, uint32_t num_pixels,
+                                    uint16_t* dst) {
+    for (uint32_t i = 0; i < num_pixels * 4; i += 4) {
+        dst[i] = tables.srgb_to_linear[src[i]];
+        dst[i + 1] = tables.srgb_to_linear[src[i + 1]];
+        dst[i + 2] = tables.srgb_to_linear[src[i + 2]];
+        dst[i + 3] = src[i + 3];
+    }
+}
+
+// Inverse of rgba8_to_linear16().
+FORCE_INLINE void linear16_to_rgba8(const GammaTables& tables, const uint16_t* src, uint32_t num_pixels,
+                                    uint8_t* dst) {
+    for (uint32_t i = 0; i < num_pixels * 4; i += 4) {
+        dst[i] = tables.linear_to_srgb[src[i]];
+        dst[i + 1] = tables.linear_to_srgb[src[i + 1]];
+        dst[i + 2] = tables.linear_to_srgb[src[i + 2]];
+        dst[i + 3] = uint8_t(src[i + 3]);
+    }
+}
+
+// Gamma-correct version of downsample_row_simd(): the table lookups stay scalar, the sums, the rounding and the
+// de-interleaving are vectorized. Four linear values fit into 16 bits: 4 * LINEAR_MAX < 65536.
+FORCE_INLINE uint32_t downsample_row_gamma_simd(const uint8_t* row0, const uint8_t* row1, uint8_t* dst_row,
+                                                uint32_t dst_width) {
+    uint32_t x = 0;
+#if defined(SIMD_USE_SSE2) || defined(SIMD_USE_NEON)
+    const GammaTables& tables = gamma_tables();
+    alignas(16) uint16_t linear0[32];
+    alignas(16) uint16_t linear1[32];
+    alignas(16) uint16_t averaged[16];
+#endif
+#if defined(SIMD_USE_SSE2)
+    const __m128i rounding = _mm_set1_epi16(2);
+    // 8 source pixels from each row produce 4 destination pixels.
+    for (; x + 4 <= dst_width; x += 4) {
+        rgba8_to_linear16(tables, row0 + x * 8, 8, linear0);
+        rgba8_to_linear16(tables, row1 + x * 8, 8, linear1);
+        for (int i = 0; i < 2; i++) {
+            // Vertical sums of two pixels per register, then horizontal sums of adjacent pixels: each 64-bit half
+            // contains one pixel.
+            __m128i lo = _mm_add_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(linear0 + i * 16)),
+                                       _mm_load_si128(reinterpret_cast<const __m128i*>(linear1 + i * 16)));
+            __m128i hi = _mm_add_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(linear0 + i * 16 + 8)),
+                                       _mm_load_si128(reinterpret_cast<const __m128i*>(linear1 + i * 16 + 8)));
+            __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+            sum = _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2);
+            _mm_store_si128(reinterpret_cast<__m128i*>(averaged + i * 8), sum);
+        }
+        linear16_to_rgba8(tables, averaged, 4, dst_row + x * 4);
+    }
+#elif defined(SIMD_USE_NEON)
+    // 8 source pixels from each row produce 4 destination pixels.
+    for (; x + 4 <= dst_width; x += 4) {
+        rgba8_to_linear16(tables, row0 + x * 8, 8, linear0);
+        rgba8_to_linear16(tables, row1 + x * 8, 8, linear1);
+        uint16x8x4_t p0 = vld4q_u16(linear0);
+        uint16x8x4_t p1 = vld4q_u16(linear1);
+        uint16x4x4_t result;
+        for (int c = 0; c < 4; c++) {
+            uint16x8_t sum = vaddq_u16(p0.val[c], p1.val[c]);
+            result.val[c] = vrshr_n_u16(vpadd_u16(vget_low_u16(sum), vget_high_u16(sum)), 2);
+        }
+        vst4_u16(averaged, result);
+        linear16_to_rgba8(tables, averaged, 4, dst_row + x * 4);
+    }
+#endif
+    return x;
+}
+
+// Downsample as many pixels as possible with SIMD, return the number of destination pixels processed. Width must be
+// even.
+FORCE_INLINE uint32_t downsample_row_simd(const uint8_t* row0, const uint8_t* row1, uint8_t* dst_row,
+                                          uint32_t dst_width) {
+    uint32_t x = 0;
+#if defined(SIMD_USE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rounding = _mm_set1_epi16(2);
+    // 8 source pixels from each row produce 4 destination pixels.
+    for (; x + 4 <= dst_width; x += 4) {
+        __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+        __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8 + 16));
+        __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+        __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8 + 16));
+        // Vertical sums of two pixels per register in 16-bit channels.
+        __m128i a_lo = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(a1, zero));
+        __m128i a_hi = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(a1, zero));
+        __m128i b_lo = _mm_add_epi16(_mm_unpacklo_epi8(b0, zero), _mm_unpacklo_epi8(b1, zero));
+        __m128i b_hi = _mm_add_epi16(_mm_unpackhi_epi8(b0, zero), _mm_unpackhi_epi8(b1, zero));
+        // Horizontal sums of adjacent pixels: each 64-bit half contains one pixel.
+        __m128i a_sum = _mm_add_epi16(_mm_unpacklo_epi64(a_lo, a_hi), _mm_unpackhi_epi64(a_lo, a_hi));
+        __m128i b_sum = _mm_add_epi16(_mm_unpacklo_epi64(b_lo, b_hi), _mm_unpackhi_epi64(b_lo, b_hi));
+        a_sum = _mm_srli_epi16(_mm_add_epi16(a_sum, rounding), 2);
+        b_sum = _mm_srli_epi16(_mm_add_epi16(b_sum, rounding), 2);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst_row + x * 4), _mm_packus_epi16(a_sum, b_sum));
+    }
+#elif defined(SIMD_USE_NEON)
+    // 16 source pixels from each row produce 8 destination pixels.
+    for (; x + 8 <= dst_width; x += 8) {
+        uint8x16x4_t p0 = vld4q_u8(row0 + x * 8);
+        uint8x16x4_t p1 = vld4q_u8(row1 + x * 8);
+        uint8x8x4_t result;
+        for (int c = 0; c < 4; c++) {
+            uint16x8_t sum = vpadalq_u8(vpaddlq_u8(p0.val[c]), p1.val[c]);
+            result.val[c] = vrshrn_n_u16(sum, 2);
+        }
+        vst4_u8(dst_row + x * 4, result);
+    }
+#endif
+    return x;
+}
+
+}  // namespace
+
+int mip_chain_length(uint32_t width, uint32_t height) {
+    return next_log2(width > height ? width : height);
+}
+
+void downsample_rgba8(const uint8_t* src, uint32_t width, uint32_t height, uint8_t* dst, bool gamma_correct) {
+    uint32_t dst_width = mip_level_dim(width, 1);
+    uint32_t dst_height = mip_level_dim(height, 1);
+    size_t src_stride = size_t(width) * 4;
+    for (uint32_t y = 0; y < dst_height; y++) {
+        uint32_t y0 = y * 2;
+        uint32_t y1 = y0 + 1 < height ? y0 + 1 : height - 1;
+        const uint8_t* row0 = src + y0 * src_stride;
+        const uint8_t* row1 = src + y1 * src_stride;
+        uint8_t* dst_row = dst + size_t(y) * dst_width * 4;
+        if (gamma_correct) {
+            uint32_t done = (width % 2) == 0 ? downsample_row_gamma_simd(row0, row1, dst_row, dst_width) : 0;
+            downsample_row_gamma(row0, row1, width, dst_row, done, dst_width);
+        } else {
+            uint32_t done = (width % 2) == 0 ? downsample_row_simd(row0, row1, dst_row, dst_width) : 0;
+            downsample_row_scalar(row0, row1, width, dst_row, done, dst_width);
+        }
+    }
+}
+
+void copy_rgba8_padded(const uint8_t* src, uint32_t width, uint32_t height, uint8_t* dst, uint32_t dst_width,
+                       uint32_t x, uint32_t y, uint32_t padding) {
+    size_t dst_stride = size_t(dst_width) * 4;
+    size_t src_stride = size_t(width) * 4;
+    for (uint32_t row = 0; row < height + padding * 2; row++) {
+        uint32_t src_row = row < padding ? 0 : (row - padding < height ? row - padding : height - 1);
+        const uint8_t* src_ptr = src + src_row * src_stride;
+        uint8_t* dst_ptr = dst + (y - padding + row) * dst_stride + size_t(x - padding) * 4;
+        for (uint32_t i = 0; i < padding; i++) {
+            memcpy(dst_ptr + i * 4, src_ptr, 4);
+        }
+        memcpy(dst_ptr + size_t(padding) * 4, src_ptr, src_stride);
+        for (uint32_t i = 0; i < padding; i++) {
+            memcpy(dst_ptr + (size_t(padding) + width + i) * 4, src_ptr + src_stride - 4, 4);
+        }
+    }
+}
+
+double psnr_rgb8(const uint8_t* a, const uint8_t* b, size_t num_pixels) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < num_pixels; i++) {
+        for (int c = 0; c < 3; c++) {
+            int d = int(a[i * 4 + c]) - int(b[i * 4 + c]);
+            sum += uint64_t(d * d);
+        }
+    }
+    if (sum == 0) {
+        return INFINITY;
+    }
+    double mse = double(sum) / double(num_pixels * 3);
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Return the dimension of the mip level: max(1, size >> mip_level).
+inline uint32_t mip_level_dim(uint32_t size, int mip_level) {
+    uint32_t result = size >> mip_level;
+    return result > 0 ? result : 1;
+}
+
+// Return the number of mip levels in the full chain from width x height down to 1x1.
+int mip_chain_length(uint32_t width, uint32_t height);
+
+// Downsample RGBA8 image by 2x in each dimension with a box filter. The dst image has mip_level_dim(width, 1) x
+// mip_level_dim(height, 1) pixels. If a dimension is 1, only the pixels along the other dimension are averaged. If
+// gamma_correct is true, the colors are averaged in linear space (assuming sRGB source), alpha is always averaged as
+// is.
+void downsample_rgba8(const uint8_t* src, uint32_t width, uint32_t height, uint8_t* dst, bool gamma_correct);
+
+// Copy RGBA8 image of width x height pixels into dst image (with dst_width pixels per row) at (x, y) and fill padding
+// pixels around it by replicating the edge pixels, so that the filtering does not bleed neighbouring images. The padded
+// rectangle must be inside dst.
+void copy_rgba8_padded(const uint8_t* src, uint32_t width, uint32_t height, uint8_t* dst, uint32_t dst_width,
+                       uint32_t x, uint32_t y, uint32_t padding);
+
+// Return the peak signal-to-noise ratio in dB of the RGB channels of two RGBA8 images with num_pixels pixels, or
+// infinity if the images are equal.
+double psnr_rgb8(const uint8_t* a, const uint8_t* b, size_t num_pixels);
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string_view>
+
+#include "common.h"
+#include "hash.h"
+#include "simd.h"
+
+
+namespace inline_string_detail {
+
+// Load 16 bytes, converting ASCII 'A'..'Z' to lowercase if lower is true, and store them into dst.
+FORCE_INLINE void copy_chunk(const uint8_t* src, uint8_t* dst, bool lower) {
+#if defined(SIMD_USE_SSE2)
+    __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(src));
+    if (lower) {
+        // Bytes >= 0x80 are negative in the signed compares, so only 'A'..'Z' are selected.
+        __m128i upper =
+            _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+        v = _mm_add_epi8(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+    }
+    _mm_store_si128(reinterpret_cast<__m128i*>(dst), v);
+#elif defined(SIMD_USE_NEON)
+    uint8x16_t v = vld1q_u8(src);
+    if (lower) {
+        uint8x16_t upper = vcltq_u8(vsubq_u8(v, vdupq_n_u8('A')), vdupq_n_u8(26));
+        v = vaddq_u8(v, vandq_u8(upper, vdupq_n_u8(0x20)));
+    }
+    vst1q_u8(dst, v);
+#else
+    for (int i = 0; i < 16; i++) {
+        uint8_t c = src[i];
+        dst[i] = lower && c >= 'A' && c <= 'Z' ? uint8_t(c + 0x20) : c;
+    }
+#endif
+}
+
+// Return true if the 16-byte chunks are equal.
+FORCE_INLINE bool chunks_equal(const uint8_t* a, const uint8_t* b) {
+#if defined(SIMD_USE_SSE2)
+    __m128i va = _mm_load_si128(reinterpret_cast<const __m128i*>(a));
+    __m128i vb = _mm_load_si128(reinterpret_cast<const __m128i*>(b));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) == 0xFFFF;
+#elif defined(SIMD_USE_NEON)
+    return vminvq_u8(vceqq_u8(vld1q_u8(a), vld1q_u8(b))) == 0xFF;
+#else
+    return memcmp(a, b, 16) == 0;
+#endif
+}
+
+}  // namespace inline_string_detail
+
+// String of up to N chars stored inline, for short asset names. The bytes after the string are always zero, so
+// copying, comparing and hashing work on whole 16-byte chunks without looking at the length. If N is a multiple of 16,
+// a string of N chars fills the chunks and has no terminator, so c_str() is only available for other sizes. The string
+// cannot contain NUL chars, longer strings are truncated to N chars.
+template <size_t N>
+class alignas(16) InlineString {
+public:
+    static constexpr size_t CAPACITY = N;
+
+    InlineString() = default;
+    InlineString(std::string_view str) {
+        assign(str);
+    }
+    InlineString(const char* str) : InlineString(std::string_view(str)) {
+    }
+
+    // Replace the contents with str, truncated to N chars. Return false if it was truncated.
+    bool assign(std::string_view str) {
+        size_t size = str.size() < N ? str.size() : N;
+        memset(bytes, 0, sizeof(bytes));
+        memcpy(bytes, str.data(), size);
+        return size == str.size();
+    }
+
+    FORCE_INLINE const char* c_str() const {
+        static_assert(N % 16 != 0, "InlineString of whole chunks has no terminator, use view()");
+        return data();
+    }
+
+    FORCE_INLINE size_t size() const {
+        return strnlen(data(), N);
+    }
+
+    FORCE_INLINE bool empty() const {
+        return bytes[0] == 0;
+    }
+
+    FORCE_INLINE std::string_view view() const {
+        return std::string_view(data(), size());
+    }
+
+    FORCE_INLINE operator std::string_view() const {
+        return view();
+    }
+
+    // Return a copy with ASCII letters converted to lowercase.
+    InlineString to_lower() const {
+        InlineString lower;
+        for (size_t i = 0; i < sizeof(bytes); i += 16) {
+            inline_string_detail::copy_chunk(bytes + i, lower.bytes + i, true);
+        }
+        return lower;
+    }
+
+    bool equals_ignore_case(const InlineString& other) const {
+        InlineString a = to_lower();
+        InlineString b = other.to_lower();
+        return a == b;
+    }
+
+    // Hash which is the same for strings which differ only in ASCII case.
+    size_t hash_ignore_case() const {
+        InlineString lower = to_lower();
+        return size_t(hash64(lower.bytes, sizeof(lower.bytes)));
+    }
+
+    size_t hash() const {
+        return size_t(hash64(bytes, sizeof(bytes)));
+    }
+
+    friend bool operator==(const InlineString& a, const InlineString& b) {
+        for (size_t i = 0; i < sizeof(bytes); i += 16) {
+            if (!inline_string_detail::chunks_equal(a.bytes + i, b.bytes + i)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    friend bool operator!=(const InlineString& a, const InlineString& b) {
+        return !(a == b);
+    }
+
+    friend bool operator==(const InlineString& a, std::string_view b) {
+        return a.view() == b;
+    }
+
+    friend bool operator!=(const InlineString& a, std::string_view b) {
+        return a.view() != b;
+    }
+
+    friend bool operator==(const InlineString& a, const char* b) {
+        return a.view() == b;
+    }
+
+    friend bool operator!=(const InlineString& a, const char* b) {
+        return a.view() != b;
+    }
+
+    // Functors for case-insensitive hash containers.
+    struct HashIgnoreCase {
+        size_t operator()(const InlineString& str) const {
+            return str.hash_ignore_case();
+        }
+    };
+    struct EqualIgnoreCase {
+        bool operator()(const InlineString& a, const InlineString& b) const {
+            return a.equals_ignore_case(b);
+        }
+    };
+
+private:
+    FORCE_INLINE const char* data() const {
+        return reinterpret_cast<const char*>(bytes);
+    }
+
+    // Room for the string, rounded up to whole 16-byte chunks.
+    uint8_t bytes[(N + 15) / 16 * 16] = {};
+};
+
+namespace std {
+
+template <size_t N>
+struct hash<InlineString<N>> {
+    size_t operator()(const InlineString<N>& str) const {
+        return str.hash();
+    }
+};
+
+}  // namespace std
@@ -1,6 +1,9 @@
 #include "io.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include <cerrno>
 #include <cstddef>
@@ -8,6 +11,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <utility>
 
 #include "defer.h"
 #include "slog.h"
@@ -168,3 +172,118 @@ bool file_write_contents(const char* path, const uint8_t* data, size_t size) {
 
     return true;
 }
+
+bool file_write_at(const char* path, size_t offset, const void* data, size_t size) {
+    FILE* f = fopen(path, "r+b");
+    if (f == nullptr) {
+        SLOG_ERROR("Could not open '%s' for writing: %s", path, strerror(errno));
+        return false;
+    }
+    DEFER(fclose(f));
+
+    if (fseek(f, long(offset), SEEK_SET) != 0) {
+        SLOG_ERROR("Could not seek to %zu in '%s': %s", offset, path, strerror(errno));
+        return false;
+    }
+    size_t bytes_written = fwrite(data, 1, size, f);
+    if (bytes_written != size) {
+        SLOG_ERROR("Failed to write all data to file: %s (wrote %zu of %zu bytes)", path, bytes_written, size);
+        return false;
+    }
+    return true;
+}
+
+bool file_rename(const char* from, const char* to) {
+    if (rename(from, to) != 0) {
+        SLOG_ERROR("Could not rename '%s' to '%s': %s", from, to, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool file_stat(const char* path, FileStat& out) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return false;
+    }
+    out.size = uint64_t(st.st_size);
+#if defined(__APPLE__)
+    out.mtime_ns = int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    out.mtime_ns = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+bool file_set_mtime(const char* path, int64_t mtime_ns) {
+    struct timespec times[2];
+    times[0].tv_sec = 0;
+    times[0].tv_nsec = UTIME_OMIT;
+    times[1].tv_sec = time_t(mtime_ns / 1000000000);
+    times[1].tv_nsec = long(mtime_ns % 1000000000);
+    if (utimensat(AT_FDCWD, path, times, 0) != 0) {
+        SLOG_ERROR("Could not set modification time of '%s': %s", path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : file_name(std::move(other.file_name)), data(other.data), size(other.size) {
+    other.data = nullptr;
+    other.size = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        file_name = std::move(other.file_name);
+        data = other.data;
+        size = other.size;
+        other.data = nullptr;
+        other.size = 0;
+    }
+    return *this;
+}
+
+bool MappedFile::open(const char* path) {
+    close();
+    file_name = path;
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        SLOG_ERROR("Could not open '%s': %s", path, strerror(errno));
+        return false;
+    }
+    DEFER(::close(fd));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        SLOG_ERROR("Could not get file size of '%s': %s", path, strerror(errno));
+        return false;
+    }
+    if (st.st_size == 0) {
+        // Empty files cannot be mapped.
+        return true;
+    }
+    void* mapping = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        SLOG_ERROR("Could not map '%s': %s", path, strerror(errno));
+        return false;
+    }
+    data = static_cast<const uint8_t*>(mapping);
+    size = size_t(st.st_size);
+    return true;
+}
+
+void MappedFile::close() {
+    if (data != nullptr) {
+        munmap(const_cast<uint8_t*>(data), size);
+        data = nullptr;
+        size = 0;
+    }
+}
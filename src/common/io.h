@@ -5,6 +5,9 @@
 #include <string>
 #include <vector>
 
+#include "span.h"
+#include "struct.h"
+
 // File byte contents + file name.
 struct FileContents {
     std::string name;
@@ -19,6 +22,18 @@ struct FileContents {
         memcpy(&dst, &contents[offset], sizeof(T));
         return true;
     }
+
+    // Copy count elements of type T from offset into dst or return false if the reads are out of bounds.
+    template <typename T>
+    bool read_array_at(size_t offset, size_t count, T* dst) const {
+        if (count > contents.size() / sizeof(T) || offset > contents.size() - count * sizeof(T)) {
+            return false;
+        }
+        if (count > 0) {
+            memcpy(dst, contents.data() + offset, count * sizeof(T));
+        }
+        return true;
+    }
 };
 
 
@@ -39,3 +54,47 @@ bool file_read_lines(const char* path, std::vector<std::string>& out);
 
 // Write data to file or return false.
 bool file_write_contents(const char* path, const uint8_t* data, size_t size);
+// Overwrite size bytes at offset of an existing file, keeping the rest of it, or return false.
+bool file_write_at(const char* path, size_t offset, const void* data, size_t size);
+
+// Rename file, replacing the destination if it exists. Return true on success.
+bool file_rename(const char* from, const char* to);
+
+// Size and modification time of a file.
+struct FileStat {
+    uint64_t size = 0;
+    // Modification time in nanoseconds since the epoch.
+    int64_t mtime_ns = 0;
+};
+
+// Get size and modification time of the file or return false if it does not exist. No error is logged.
+bool file_stat(const char* path, FileStat& out);
+// Set the modification time of the file in nanoseconds since the epoch, keeping its access time, or return false.
+bool file_set_mtime(const char* path, int64_t mtime_ns);
+
+// Read-only memory mapping of a whole file. The mapping is page-aligned.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    DISABLE_COPY(MappedFile);
+
+    // Map the file or return false. The previous mapping is released.
+    bool open(const char* path);
+    // Release the mapping.
+    void close();
+
+    const std::string& name() const {
+        return file_name;
+    }
+    Span<const uint8_t> contents() const {
+        return Span<const uint8_t>(data, size);
+    }
+
+private:
+    std::string file_name;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
@@ -0,0 +1,423 @@
+#include "occlusion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "simd.h"
+#include "thread.h"
+
+
+namespace {
+
+// Pixels per SIMD step.
+const int LANES = 4;
+// Margin of the edge tests in pixels, so that rounding errors never cover a pixel the polygon does not cover.
+const float EDGE_EPSILON = 1.0f / 64.0f;
+// Occluders are clipped to this many times the view size around its center.
+const float GUARD_BAND = 2.0f;
+// Relative margin of the depth tests.
+const float DEPTH_EPSILON = 1e-4f;
+// Projected polygons smaller than this many square pixels cover too little to be worth rasterizing.
+const float MIN_OCCLUDER_AREA = 1.0f;
+
+float min_depth(const float* values, int n) {
+    float result = INFINITY;
+    int i = 0;
+#if defined(SIMD_USE_SSE2)
+    __m128 lanes = _mm_set1_ps(INFINITY);
+    for (; i + LANES <= n; i += LANES) {
+        lanes = _mm_min_ps(lanes, _mm_loadu_ps(values + i));
+    }
+    lanes = _mm_min_ps(lanes, _mm_shuffle_ps(lanes, lanes, _MM_SHUFFLE(1, 0, 3, 2)));
+    lanes = _mm_min_ps(lanes, _mm_shuffle_ps(lanes, lanes, _MM_SHUFFLE(2, 3, 0, 1)));
+    result = _mm_cvtss_f32(lanes);
+#elif defined(SIMD_USE_NEON)
+    float32x4_t lanes = vdupq_n_f32(INFINITY);
+    for (; i + LANES <= n; i += LANES) {
+        lanes = vminq_f32(lanes, vld1q_f32(values + i));
+    }
+    result = vminvq_f32(lanes);
+#endif
+    for (; i < n; i++) {
+        result = std::min(result, values[i]);
+    }
+    return result;
+}
+
+}  // namespace
+
+void OcclusionBuffer::init(int new_width, int new_height) {
+    width = std::max(new_width, 0);
+    height = std::max(new_height, 0);
+    stride = size_t(width + TILE_WIDTH - 1) / TILE_WIDTH * TILE_WIDTH;
+    size_t num_rows = size_t(height + TILE_HEIGHT - 1) / TILE_HEIGHT * TILE_HEIGHT;
+    depth.assign(stride * num_rows, 0.0f);
+    tile_occluders.resize(stride / TILE_WIDTH * (num_rows / TILE_HEIGHT));
+    tile_mins.assign(tile_occluders.size(), 0.0f);
+    occluders.clear();
+    edges.clear();
+}
+
+void OcclusionBuffer::begin(const OcclusionView& new_view) {
+    view = new_view;
+    occluders.clear();
+    edges.clear();
+}
+
+void OcclusionBuffer::to_view(const float point[3], float out[3]) const {
+    float d[3] = {point[0] - view.position[0], point[1] - view.position[1], point[2] - view.position[2]};
+    out[0] = d[0] * view.right[0] + d[1] * view.right[1] + d[2] * view.right[2];
+    out[1] = d[0] * view.up[0] + d[1] * view.up[1] + d[2] * view.up[2];
+    out[2] = d[0] * view.forward[0] + d[1] * view.forward[1] + d[2] * view.forward[2];
+}
+
+float OcclusionBuffer::project(const float point[3], float& x, float& y) const {
+    float inv_z = 1.0f / point[2];
+    x = 0.5f * float(width) * (1.0f + point[0] * inv_z / view.tan_half_fov_x);
+    y = 0.5f * float(height) * (1.0f - point[1] * inv_z / view.tan_half_fov_y);
+    return inv_z;
+}
+
+void OcclusionBuffer::add_occluder(const float* vertices, size_t num_vertices, const uint8_t* interior_edges) {
+    if (num_vertices < 3 || width == 0 || height == 0) {
+        return;
+    }
+
+    // Clip the polygon in view space to z >= near_dist and to a guard band around the view, which keeps the pixel
+    // coordinates small enough for the edge functions to be precise. Each point is followed by the interior flag of
+    // the edge to the next point, the edges along the clip planes are not interior.
+    std::vector<float>* polygon = &clip_buffers[0];
+    std::vector<float>* clipped = &clip_buffers[1];
+    polygon->resize(num_vertices * 4);
+    for (size_t i = 0; i < num_vertices; i++) {
+        float* point = &(*polygon)[i * 4];
+        to_view(vertices + i * 3, point);
+        point[3] = interior_edges != nullptr && interior_edges[i] != 0 ? 1.0f : 0.0f;
+    }
+    float guard_x = GUARD_BAND * view.tan_half_fov_x;
+    float guard_y = GUARD_BAND * view.tan_half_fov_y;
+    // Points p are kept if dot(plane, (p, 1)) >= 0.
+    const float clip_planes[5][4] = {
+        {0.0f, 0.0f, 1.0f, -view.near_dist}, {-1.0f, 0.0f, guard_x, 0.0f}, {1.0f, 0.0f, guard_x, 0.0f},
+        {0.0f, -1.0f, guard_y, 0.0f},        {0.0f, 1.0f, guard_y, 0.0f},
+    };
+    for (const float* plane : clip_planes) {
+        size_t n = polygon->size() / 4;
+        const float* points = polygon->data();
+        clipped->clear();
+        for (size_t i = 0; i < n; i++) {
+            const float* p = &points[i * 4];
+            const float* q = &points[(i + 1) % n * 4];
+            float p_dist = plane[0] * p[0] + plane[1] * p[1] + plane[2] * p[2] + plane[3];
+            float q_dist = plane[0] * q[0] + plane[1] * q[1] + plane[2] * q[2] + plane[3];
+            if (p_dist >= 0.0f) {
+                clipped->insert(clipped->end(), p, p + 4);
+            }
+            if ((p_dist >= 0.0f) != (q_dist >= 0.0f)) {
+                float t = p_dist / (p_dist - q_dist);
+                for (int axis = 0; axis < 3; axis++) {
+                    clipped->push_back(p[axis] + t * (q[axis] - p[axis]));
+                }
+                // Leaving, the next edge is along the clip plane. Entering, it is the rest of the edge p, q.
+                clipped->push_back(p_dist >= 0.0f ? 0.0f : p[3]);
+            }
+        }
+        std::swap(polygon, clipped);
+    }
+    size_t n = polygon->size() / 4;
+    if (n < 3) {
+        return;
+    }
+    float* points = polygon->data();
+
+    // Plane of the polygon by Newell's method, through the centroid.
+    float normal[3] = {};
+    float centroid[3] = {};
+    for (size_t i = 0; i < n; i++) {
+        const float* p = &points[i * 4];
+        const float* q = &points[(i + 1) % n * 4];
+        normal[0] += (p[1] - q[1]) * (p[2] + q[2]);
+        normal[1] += (p[2] - q[2]) * (p[0] + q[0]);
+        normal[2] += (p[0] - q[0]) * (p[1] + q[1]);
+        for (int axis = 0; axis < 3; axis++) {
+            centroid[axis] += p[axis] / float(n);
+        }
+    }
+    float dist = normal[0] * centroid[0] + normal[1] * centroid[1] + normal[2] * centroid[2];
+
+    // The view space points are replaced by their pixel coordinates and inverse distances.
+    Occluder occluder = {};
+    occluder.min_depth = INFINITY;
+    occluder.max_depth = 0.0f;
+    float min_xy[2] = {INFINITY, INFINITY};
+    float max_xy[2] = {-INFINITY, -INFINITY};
+    for (size_t i = 0; i < n; i++) {
+        float* p = &points[i * 4];
+        float x;
+        float y;
+        p[2] = project(p, x, y);
+        p[0] = x;
+        p[1] = y;
+        occluder.min_depth = std::min(occluder.min_depth, p[2]);
+        occluder.max_depth = std::max(occluder.max_depth, p[2]);
+        for (int axis = 0; axis < 2; axis++) {
+            min_xy[axis] = std::min(min_xy[axis], p[axis]);
+            max_xy[axis] = std::max(max_xy[axis], p[axis]);
+        }
+    }
+    float area = 0.0f;
+    for (size_t i = 0; i < n; i++) {
+        const float* p = &points[i * 4];
+        const float* q = &points[(i + 1) % n * 4];
+        area += p[0] * q[1] - q[0] * p[1];
+    }
+    // Also rejects the polygons seen edge-on and NaNs.
+    if (!(std::fabs(area) * 0.5f >= MIN_OCCLUDER_AREA) || !(std::fabs(dist) > 0.0f)) {
+        return;
+    }
+
+    // Inverse distance at the pixel coordinates x, y: the inverse of the distance along the ray through x, y to the
+    // plane normal . p = dist. Fold the offset to the corner of the pixel where it is the least into c.
+    float scale_x = 0.5f * float(width) / view.tan_half_fov_x;
+    float scale_y = 0.5f * float(height) / view.tan_half_fov_y;
+    PixelFunction& depth_function = occluder.depth;
+    depth_function.a = normal[0] / (scale_x * dist);
+    depth_function.b = -normal[1] / (scale_y * dist);
+    depth_function.c = (normal[2] - normal[0] * view.tan_half_fov_x + normal[1] * view.tan_half_fov_y) / dist;
+    depth_function.c += std::min(depth_function.a, 0.0f) + std::min(depth_function.b, 0.0f);
+
+    // Edge functions positive inside. The silhouette edges are evaluated at the corner of the pixel where they are the
+    // least, the interior edges at the center of the pixel.
+    float sign = area > 0.0f ? 1.0f : -1.0f;
+    occluder.first_edge = uint32_t(edges.size());
+    occluder.num_edges = uint32_t(n);
+    for (size_t i = 0; i < n; i++) {
+        const float* p = &points[i * 4];
+        const float* q = &points[(i + 1) % n * 4];
+        PixelFunction edge;
+        edge.a = sign * (p[1] - q[1]);
+        edge.b = sign * (q[0] - p[0]);
+        edge.c = -(edge.a * p[0] + edge.b * p[1]);
+        if (p[3] != 0.0f) {
+            edge.c += 0.5f * (edge.a + edge.b);
+        } else {
+            edge.c += std::min(edge.a, 0.0f) + std::min(edge.b, 0.0f);
+            edge.c -= EDGE_EPSILON * (std::fabs(edge.a) + std::fabs(edge.b));
+        }
+        edges.push_back(edge);
+    }
+
+    for (int axis = 0; axis < 2; axis++) {
+        float size = float(axis == 0 ? width : height);
+        occluder.rect[axis] = int32_t(std::min(std::max(std::floor(min_xy[axis]), 0.0f), size));
+        occluder.rect[axis + 2] = int32_t(std::min(std::max(std::floor(max_xy[axis]) + 1.0f, 0.0f), size));
+    }
+    if (occluder.rect[0] >= occluder.rect[2] || occluder.rect[1] >= occluder.rect[3]) {
+        edges.resize(occluder.first_edge);
+        return;
+    }
+    occluders.push_back(occluder);
+}
+
+void OcclusionBuffer::render_tile(size_t tile) {
+    size_t tiles_x = stride / TILE_WIDTH;
+    int tile_x = int(tile % tiles_x) * TILE_WIDTH;
+    int tile_y = int(tile / tiles_x) * TILE_HEIGHT;
+    for (int y = tile_y; y < tile_y + TILE_HEIGHT; y++) {
+        memset(&depth[size_t(y) * stride + size_t(tile_x)], 0, TILE_WIDTH * sizeof(float));
+    }
+
+    // Least depth of each row of the tile within the buffer and of the whole tile. The occluders come nearest first,
+    // so an occluder whose nearest vertex is farther than a row or the tile cannot change them.
+    int row_width = std::min(TILE_WIDTH, width - tile_x);
+    float row_mins[TILE_HEIGHT];
+    for (int i = 0; i < TILE_HEIGHT; i++) {
+        row_mins[i] = tile_y + i < height ? 0.0f : INFINITY;
+    }
+    float tile_min = 0.0f;
+
+    for (uint32_t occluder_idx : tile_occluders[tile]) {
+        const Occluder& occluder = occluders[occluder_idx];
+        if (occluder.max_depth <= tile_min) {
+            continue;
+        }
+        const PixelFunction* occluder_edges = &edges[occluder.first_edge];
+        int y_end = std::min(tile_y + TILE_HEIGHT, occluder.rect[3]);
+        for (int y = std::max(tile_y, occluder.rect[1]); y < y_end; y++) {
+            float& row_min = row_mins[y - tile_y];
+            if (occluder.max_depth <= row_min) {
+                continue;
+            }
+            // The covered pixels of a row of a convex polygon are a span, narrowed down edge by edge. The division
+            // only gives a first guess, the span ends are moved to where the edge functions change sign.
+            float fy = float(y);
+            int x_begin = std::max(tile_x, occluder.rect[0]);
+            int x_end = std::min(tile_x + TILE_WIDTH, occluder.rect[2]);
+            for (uint32_t i = 0; i < occluder.num_edges && x_begin < x_end; i++) {
+                const PixelFunction& edge = occluder_edges[i];
+                float offset = edge.b * fy + edge.c;
+                auto inside = [&](int x) { return edge.a * float(x) + offset >= 0.0f; };
+                if (edge.a == 0.0f) {
+                    x_end = offset >= 0.0f ? x_end : x_begin;
+                    continue;
+                }
+                // Comparisons rather than std::clamp() so that NaNs fall back to the current span end.
+                float guess = -offset / edge.a;
+                int x = guess > float(x_begin) ? (guess < float(x_end) ? int(guess) : x_end) : x_begin;
+                if (edge.a > 0.0f) {
+                    while (x > x_begin && inside(x - 1)) {
+                        x--;
+                    }
+                    while (x < x_end && !inside(x)) {
+                        x++;
+                    }
+                    x_begin = x;
+                } else {
+                    while (x < x_end && inside(x)) {
+                        x++;
+                    }
+                    while (x > x_begin && !inside(x - 1)) {
+                        x--;
+                    }
+                    x_end = x;
+                }
+            }
+
+            float* row = &depth[size_t(y) * stride];
+            const PixelFunction& d = occluder.depth;
+            float offset = d.b * fy + d.c;
+            int x = x_begin;
+#if defined(SIMD_USE_SSE2)
+            for (; x + LANES <= x_end; x += LANES) {
+                __m128 fx = _mm_add_ps(_mm_set1_ps(float(x)), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+                __m128 value = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(d.a), fx), _mm_set1_ps(offset));
+                value = _mm_max_ps(value, _mm_set1_ps(occluder.min_depth));
+                _mm_storeu_ps(row + x, _mm_max_ps(_mm_loadu_ps(row + x), value));
+            }
+#elif defined(SIMD_USE_NEON)
+            const float lane_offsets[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+            for (; x + LANES <= x_end; x += LANES) {
+                float32x4_t fx = vaddq_f32(vdupq_n_f32(float(x)), vld1q_f32(lane_offsets));
+                float32x4_t value = vaddq_f32(vmulq_f32(vdupq_n_f32(d.a), fx), vdupq_n_f32(offset));
+                value = vmaxq_f32(value, vdupq_n_f32(occluder.min_depth));
+                vst1q_f32(row + x, vmaxq_f32(vld1q_f32(row + x), value));
+            }
+#endif
+            for (; x < x_end; x++) {
+                float value = std::max(d.a * float(x) + offset, occluder.min_depth);
+                row[x] = std::max(row[x], value);
+            }
+            if (x_begin < x_end) {
+                row_min = min_depth(row + tile_x, row_width);
+            }
+        }
+        tile_min = min_depth(row_mins, TILE_HEIGHT);
+    }
+    tile_mins[tile] = tile_min;
+}
+
+void OcclusionBuffer::render(bool parallel) {
+    // Bin the occluders by the tiles their bounds touch, nearest first.
+    std::stable_sort(occluders.begin(), occluders.end(),
+                     [](const Occluder& a, const Occluder& b) { return a.max_depth > b.max_depth; });
+    size_t tiles_x = stride / TILE_WIDTH;
+    for (std::vector<uint32_t>& tile : tile_occluders) {
+        tile.clear();
+    }
+    for (size_t i = 0; i < occluders.size(); i++) {
+        const int32_t* rect = occluders[i].rect;
+        for (int32_t tile_y = rect[1] / TILE_HEIGHT; tile_y <= (rect[3] - 1) / TILE_HEIGHT; tile_y++) {
+            for (int32_t tile_x = rect[0] / TILE_WIDTH; tile_x <= (rect[2] - 1) / TILE_WIDTH; tile_x++) {
+                tile_occluders[size_t(tile_y) * tiles_x + size_t(tile_x)].push_back(uint32_t(i));
+            }
+        }
+    }
+
+    // A task per row of tiles, a tile alone is too little work.
+    auto render_tile_row = [&](size_t tile_row) {
+        for (size_t tile = tile_row * tiles_x; tile < (tile_row + 1) * tiles_x; tile++) {
+            render_tile(tile);
+        }
+    };
+    size_t num_tile_rows = tiles_x > 0 ? tile_occluders.size() / tiles_x : 0;
+    if (parallel) {
+        thread_pool().run_for(render_tile_row, num_tile_rows);
+    } else {
+        for (size_t tile_row = 0; tile_row < num_tile_rows; tile_row++) {
+            render_tile_row(tile_row);
+        }
+    }
+}
+
+bool OcclusionBuffer::box_occluded(const float mins[3], const float maxs[3]) const {
+    float min_xy[2] = {INFINITY, INFINITY};
+    float max_xy[2] = {-INFINITY, -INFINITY};
+    float box_depth = 0.0f;
+    for (int corner = 0; corner < 8; corner++) {
+        float point[3] = {corner & 1 ? maxs[0] : mins[0], corner & 2 ? maxs[1] : mins[1],
+                          corner & 4 ? maxs[2] : mins[2]};
+        float view_point[3];
+        to_view(point, view_point);
+        // Also rejects NaNs.
+        if (!(view_point[2] >= view.near_dist)) {
+            return false;
+        }
+        float xy[2];
+        box_depth = std::max(box_depth, project(view_point, xy[0], xy[1]));
+        for (int axis = 0; axis < 2; axis++) {
+            min_xy[axis] = std::min(min_xy[axis], xy[axis]);
+            max_xy[axis] = std::max(max_xy[axis], xy[axis]);
+        }
+    }
+    int rect[4];
+    for (int axis = 0; axis < 2; axis++) {
+        float size = float(axis == 0 ? width : height);
+        rect[axis] = int(std::min(std::max(std::floor(min_xy[axis]), 0.0f), size));
+        rect[axis + 2] = int(std::min(std::max(std::floor(max_xy[axis]) + 1.0f, 0.0f), size));
+    }
+    if (rect[0] >= rect[2] || rect[1] >= rect[3]) {
+        return false;
+    }
+
+    // Occluded if every pixel has an occluder closer than the nearest corner, which is the case if every tile the rect
+    // touches is closer at its least. Otherwise the pixels are tested, the lanes outside of the rect are ignored.
+    float threshold = box_depth * (1.0f + DEPTH_EPSILON);
+    size_t tiles_x = stride / TILE_WIDTH;
+    bool tiles_closer = true;
+    for (int tile_y = rect[1] / TILE_HEIGHT; tile_y <= (rect[3] - 1) / TILE_HEIGHT && tiles_closer; tile_y++) {
+        for (int tile_x = rect[0] / TILE_WIDTH; tile_x <= (rect[2] - 1) / TILE_WIDTH; tile_x++) {
+            if (!(tile_mins[size_t(tile_y) * tiles_x + size_t(tile_x)] > threshold)) {
+                tiles_closer = false;
+                break;
+            }
+        }
+    }
+    if (tiles_closer) {
+        return true;
+    }
+    for (int y = rect[1]; y < rect[3]; y++) {
+        const float* row = &depth[size_t(y) * stride];
+        for (int x = rect[0] / LANES * LANES; x < rect[2]; x += LANES) {
+            uint32_t lanes = 0;
+            for (int lane = 0; lane < LANES; lane++) {
+                lanes |= (x + lane >= rect[0] && x + lane < rect[2] ? 1u : 0u) << lane;
+            }
+#if defined(SIMD_USE_SSE2)
+            __m128 closer = _mm_cmpgt_ps(_mm_loadu_ps(row + x), _mm_set1_ps(threshold));
+            uint32_t occluded = movemask_u32(closer);
+#elif defined(SIMD_USE_NEON)
+            uint32_t occluded = movemask_u32(vcgtq_f32(vld1q_f32(row + x), vdupq_n_f32(threshold)));
+#else
+            uint32_t occluded = 0;
+            for (int lane = 0; lane < LANES; lane++) {
+                occluded |= (row[x + lane] > threshold ? 1u : 0u) << lane;
+            }
+#endif
+            if ((occluded & lanes) != lanes) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Camera of an OcclusionBuffer, with the parameters of Frustum::set_perspective(). forward, right and up must be
+// orthonormal.
+struct OcclusionView {
+    float position[3] = {};
+    float forward[3] = {1.0f, 0.0f, 0.0f};
+    float right[3] = {0.0f, -1.0f, 0.0f};
+    float up[3] = {0.0f, 0.0f, 1.0f};
+    float tan_half_fov_x = 1.0f;
+    float tan_half_fov_y = 1.0f;
+    float near_dist = 4.0f;
+};
+
+// Coarse software depth buffer for occlusion culling: large occluder polygons are rasterized into it, then bounding
+// boxes are tested against it. Both are conservative: an occluder only covers the pixels it covers entirely, except
+// across the edges it shares with other occluders, with its farthest depth over each pixel. A box is only occluded if
+// its nearest point is behind the occluders over all the pixels it touches. The buffer is split into tiles which are
+// rasterized independently, several pixels at a time.
+class OcclusionBuffer {
+public:
+    static constexpr int TILE_WIDTH = 32;
+    static constexpr int TILE_HEIGHT = 16;
+
+    // Set the size in pixels and remove the occluders.
+    void init(int width, int height);
+
+    // Set the view of the next occluders and boxes and remove the occluders.
+    void begin(const OcclusionView& view);
+    // Add a convex planar polygon of num_vertices points, 3 floats each. The part closer than the near distance is
+    // clipped away. Polygons seen from both sides occlude. If interior_edges[i] is non-zero, the edge from point i to
+    // point i + 1 is shared with another occluder in the same plane: it covers the pixels whose centers it covers, so
+    // that no gap is left between the two.
+    void add_occluder(const float* vertices, size_t num_vertices, const uint8_t* interior_edges = nullptr);
+    // Rasterize the occluders added since begin() into depth, with the rows of tiles split across thread_pool() if
+    // parallel.
+    void render(bool parallel = false);
+    // Return true if the box is behind the rendered occluders. Boxes crossing the near plane or outside of the view are
+    // not occluded.
+    bool box_occluded(const float mins[3], const float maxs[3]) const;
+
+    size_t num_occluders() const {
+        return occluders.size();
+    }
+
+    int width = 0;
+    int height = 0;
+    // Floats per row of depth, a multiple of TILE_WIDTH.
+    size_t stride = 0;
+    // Inverse distance along the view of the nearest occluder covering each pixel entirely, 0 where there is none.
+    std::vector<float> depth;
+
+private:
+    // Linear function a * x + b * y + c of the pixel coordinates. It is evaluated at the integer coordinates, which
+    // stand for its minimum over the pixel: the offsets are folded into c.
+    struct PixelFunction {
+        float a;
+        float b;
+        float c;
+    };
+
+    struct Occluder {
+        PixelFunction depth;
+        // Inverse distances of the farthest and of the nearest vertex, the depth is never less than the first.
+        float min_depth;
+        float max_depth;
+        // Pixels inside of all the edges are covered.
+        uint32_t first_edge;
+        uint32_t num_edges;
+        // Pixel bounds, max exclusive.
+        int32_t rect[4];
+    };
+
+    OcclusionView view;
+    std::vector<Occluder> occluders;
+    std::vector<PixelFunction> edges;
+    // Occluders of each tile and least depth of each tile within the buffer.
+    std::vector<std::vector<uint32_t>> tile_occluders;
+    std::vector<float> tile_mins;
+    // Clipped polygons in view space, reused between the calls.
+    std::vector<float> clip_buffers[2];
+
+    // Transform the point to x right, y up and z forward.
+    void to_view(const float point[3], float out[3]) const;
+    // Project the view space point to pixel coordinates and return its inverse distance.
+    float project(const float point[3], float& x, float& y) const;
+    void render_tile(size_t tile);
+};
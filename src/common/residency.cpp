@@ -0,0 +1,126 @@
+#include "residency.h"
+
+
+ResidencyLRU::ResidencyLRU(size_t budget, size_t max_count) : budget_bytes(budget), max_count(max_count) {
+}
+
+uint32_t ResidencyLRU::add(size_t bytes) {
+    Entry entry;
+    entry.bytes = bytes;
+    entries.push_back(entry);
+    return uint32_t(entries.size() - 1);
+}
+
+bool ResidencyLRU::use(uint32_t id) {
+    Entry& entry = entries[id];
+    entry.last_used_frame = frame;
+    if (entry.resident) {
+        if (tail != id) {
+            unlink(id);
+            push_back(id);
+        }
+        return true;
+    }
+    entry.resident = true;
+    resident_size += entry.bytes;
+    resident_count++;
+    push_back(id);
+    return false;
+}
+
+void ResidencyLRU::evict(std::vector<uint32_t>& evicted) {
+    // The list is ordered by the last use, so once the head was used in this frame all the others were too.
+    while ((resident_size > budget_bytes || resident_count > max_count) && head != INVALID_ID &&
+           entries[head].last_used_frame != frame) {
+        uint32_t id = head;
+        Entry& entry = entries[id];
+        unlink(id);
+        entry.resident = false;
+        resident_size -= entry.bytes;
+        resident_count--;
+        evicted.push_back(id);
+    }
+}
+
+void ResidencyLRU::next_frame() {
+    frame++;
+}
+
+void ResidencyLRU::set_budget(size_t budget) {
+    budget_bytes = budget;
+}
+
+size_t ResidencyLRU::budget() const {
+    return budget_bytes;
+}
+
+void ResidencyLRU::set_max_resident(size_t count) {
+    max_count = count;
+}
+
+size_t ResidencyLRU::max_resident() const {
+    return max_count;
+}
+
+bool ResidencyLRU::is_resident(uint32_t id) const {
+    return entries[id].resident;
+}
+
+size_t ResidencyLRU::resident_bytes() const {
+    return resident_size;
+}
+
+size_t ResidencyLRU::num_resident() const {
+    return resident_count;
+}
+
+size_t ResidencyLRU::size() const {
+    return entries.size();
+}
+
+void ResidencyLRU::unlink(uint32_t id) {
+    Entry& entry = entries[id];
+    if (entry.prev != INVALID_ID) {
+        entries[entry.prev].next = entry.next;
+    } else {
+        head = entry.next;
+    }
+    if (entry.next != INVALID_ID) {
+        entries[entry.next].prev = entry.prev;
+    } else {
+        tail = entry.prev;
+    }
+    entry.prev = INVALID_ID;
+    entry.next = INVALID_ID;
+}
+
+void ResidencyLRU::push_back(uint32_t id) {
+    Entry& entry = entries[id];
+    entry.prev = tail;
+    entry.next = INVALID_ID;
+    if (tail != INVALID_ID) {
+        entries[tail].next = id;
+    } else {
+        head = id;
+    }
+    tail = id;
+}
+
+int next_mip_stage(const size_t* level_bytes, int num_levels, int uploaded_level, size_t budget, bool force) {
+    int stage = -1;
+    size_t stage_bytes = 0;
+    for (int level = num_levels - 1; level >= 0; level--) {
+        stage_bytes += level_bytes[level];
+        if (level >= uploaded_level) {
+            continue;
+        }
+        if (stage_bytes > budget) {
+            break;
+        }
+        stage = level;
+    }
+    if (stage < 0 && force && uploaded_level > 0) {
+        stage = uploaded_level - 1;
+    }
+    return stage;
+}
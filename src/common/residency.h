@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Least recently used residency of resources (e.g. GPU images) under a memory budget and a maximum count (e.g. the
+// size of a resource pool). The resources themselves are created and destroyed by the caller: use() tells when a
+// resource has to be created, and evict() returns the ones to destroy. Resources used in the current frame are never
+// evicted, so a frame which needs more than the budget goes over it instead of recreating resources within the frame.
+// Not thread-safe.
+class ResidencyLRU {
+public:
+    static constexpr uint32_t INVALID_ID = UINT32_MAX;
+
+    ResidencyLRU(size_t budget = SIZE_MAX, size_t max_count = SIZE_MAX);
+
+    // Register a resource of given size, it is not resident. Return its id, ids are consecutive from 0.
+    uint32_t add(size_t bytes);
+
+    // Mark the resource as used in the current frame. Return false if it was not resident: the caller has to create
+    // it, and it counts as resident from now on.
+    bool use(uint32_t id);
+
+    // Append the least recently used resources which have to go to fit into the budget and the maximum count to evicted
+    // and mark them as not resident.
+    void evict(std::vector<uint32_t>& evicted);
+
+    // Start the next frame.
+    void next_frame();
+
+    // Change the budget, it is applied by the next evict().
+    void set_budget(size_t budget);
+    size_t budget() const;
+    // Change the maximum number of resident resources, it is applied by the next evict(). A frame can go over it by the
+    // resources it makes resident.
+    void set_max_resident(size_t count);
+    size_t max_resident() const;
+
+    bool is_resident(uint32_t id) const;
+    // Return the total size and the number of resident resources.
+    size_t resident_bytes() const;
+    size_t num_resident() const;
+    // Return the number of registered resources.
+    size_t size() const;
+
+private:
+    struct Entry {
+        size_t bytes = 0;
+        uint64_t last_used_frame = 0;
+        // Links of the list of resident entries.
+        uint32_t prev = INVALID_ID;
+        uint32_t next = INVALID_ID;
+        bool resident = false;
+    };
+
+    std::vector<Entry> entries;
+    // Resident entries from the least to the most recently used.
+    uint32_t head = INVALID_ID;
+    uint32_t tail = INVALID_ID;
+    size_t budget_bytes;
+    size_t max_count;
+    size_t resident_size = 0;
+    size_t resident_count = 0;
+    uint64_t frame = 1;
+
+    void unlink(uint32_t id);
+    void push_back(uint32_t id);
+};
+
+// Select the next stage of a mip chain uploaded progressively, smallest levels first. Each stage uploads a level and
+// all the smaller ones, level_bytes are the sizes of the num_levels levels. Return the finest level below
+// uploaded_level (num_levels if nothing is uploaded) whose stage fits into budget. If none fits, return
+// uploaded_level - 1 when force is true, so that every stream makes progress, or -1 otherwise.
+int next_mip_stage(const size_t* level_bytes, int num_levels, int uploaded_level, size_t budget, bool force);
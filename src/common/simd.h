@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+// Set SIMD_USE_SSE2 or SIMD_USE_NEON to 1 for the vector paths, neither for the scalar fallbacks.
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SIMD_USE_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+// The horizontal reductions (vaddvq, vminvq) and vdivq_f32 are AArch64 only.
+#include <arm_neon.h>
+#define SIMD_USE_NEON 1
+#endif
+
+#include "common.h"
+
+
+// Return bit i set if lane i of the comparison mask is set, as _mm_movemask_ps.
+#if defined(SIMD_USE_SSE2)
+FORCE_INLINE uint32_t movemask_u32(__m128 mask) {
+    return uint32_t(_mm_movemask_ps(mask));
+}
+#elif defined(SIMD_USE_NEON)
+FORCE_INLINE uint32_t movemask_u32(uint32x4_t mask) {
+    const uint32_t lane_bits[4] = {1, 2, 4, 8};
+    return vaddvq_u32(vandq_u32(mask, vld1q_u32(lane_bits)));
+}
+#endif
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <type_traits>
+
+#include "common.h"
+
+
+// Non-owning view of a contiguous array, a minimal replacement for C++20 std::span. Element access is bounds-checked:
+// out of bounds access aborts.
+template <typename T>
+class Span {
+public:
+    Span() = default;
+    Span(T* data, size_t size) : ptr(data), count(size) {
+    }
+    // Allow implicit conversion from Span<U> to Span<const U>.
+    template <typename U, typename = std::enable_if_t<std::is_convertible_v<U (*)[], T (*)[]>>>
+    Span(const Span<U>& other) : ptr(other.data()), count(other.size()) {
+    }
+
+    FORCE_INLINE T* data() const {
+        return ptr;
+    }
+
+    FORCE_INLINE size_t size() const {
+        return count;
+    }
+
+    FORCE_INLINE size_t size_bytes() const {
+        return count * sizeof(T);
+    }
+
+    FORCE_INLINE bool empty() const {
+        return count == 0;
+    }
+
+    FORCE_INLINE T& operator[](size_t idx) const {
+        if (idx >= count) {
+            abort();
+        }
+        return ptr[idx];
+    }
+
+    FORCE_INLINE T* begin() const {
+        return ptr;
+    }
+
+    FORCE_INLINE T* end() const {
+        return ptr + count;
+    }
+
+    // Return a view of size elements starting from offset. Abort if the range is out of bounds.
+    Span subspan(size_t offset, size_t size) const {
+        if (offset > count || size > count - offset) {
+            abort();
+        }
+        return Span(ptr + offset, size);
+    }
+
+private:
+    T* ptr = nullptr;
+    size_t count = 0;
+};
@@ -0,0 +1,111 @@
+#include "common/arena.h"
+
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+
+TEST_SUITE_BEGIN("arena");
+
+TEST_CASE("Arena allocate") {
+    SUBCASE("new arena is empty") {
+        Arena arena;
+        CHECK(arena.bytes_used() == 0);
+        CHECK(arena.bytes_reserved() == 0);
+    }
+
+    SUBCASE("allocations are aligned") {
+        Arena arena(1024);
+        for (size_t alignment : {1, 2, 16, 64, 256, 4096}) {
+            uint8_t* ptr = arena.allocate(3, alignment);
+            CHECK(uintptr_t(ptr) % alignment == 0);
+        }
+    }
+
+    SUBCASE("allocations do not overlap") {
+        Arena arena(256);
+        uint8_t* ptrs[100];
+        for (int i = 0; i < 100; i++) {
+            ptrs[i] = arena.allocate(50, 16);
+            memset(ptrs[i], i, 50);
+        }
+        for (int i = 0; i < 100; i++) {
+            for (int j = 0; j < 50; j++) {
+                CHECK(ptrs[i][j] == i);
+            }
+        }
+        CHECK(arena.bytes_used() >= 5000);
+        CHECK(arena.bytes_reserved() >= arena.bytes_used());
+    }
+
+    SUBCASE("allocation larger than block size") {
+        Arena arena(64);
+        uint8_t* ptr = arena.allocate(1000);
+        memset(ptr, 1, 1000);
+        CHECK(arena.bytes_reserved() >= 1000);
+    }
+
+    SUBCASE("allocate_array") {
+        Arena arena;
+        Span<uint32_t> values = arena.allocate_array<uint32_t>(10, 4);
+        CHECK(values.size() == 10);
+        CHECK(uintptr_t(values.data()) % 4 == 0);
+    }
+}
+
+TEST_CASE("Arena reserve") {
+    SUBCASE("reserved allocations are in a single block") {
+        Arena arena(16);
+        arena.reserve(64 * 10 + 64);
+        size_t reserved = arena.bytes_reserved();
+        uint8_t* first = arena.allocate(60);
+        uint8_t* last = first;
+        for (int i = 0; i < 9; i++) {
+            last = arena.allocate(60);
+            CHECK(last == first + (i + 1) * 64);
+        }
+        CHECK(arena.bytes_reserved() == reserved);
+    }
+
+    SUBCASE("reserve with enough room does not allocate") {
+        Arena arena(1 << 16);
+        arena.allocate(16);
+        size_t reserved = arena.bytes_reserved();
+        arena.reserve(1024);
+        CHECK(arena.bytes_reserved() == reserved);
+    }
+}
+
+TEST_CASE("Arena move and clear") {
+    SUBCASE("move keeps allocations valid") {
+        Arena arena;
+        uint8_t* ptr = arena.allocate(100);
+        memset(ptr, 42, 100);
+        size_t used = arena.bytes_used();
+
+        Arena moved = std::move(arena);
+        CHECK(moved.bytes_used() == used);
+        CHECK(arena.bytes_used() == 0);
+        CHECK(arena.bytes_reserved() == 0);
+        CHECK(ptr[99] == 42);
+
+        Arena assigned;
+        assigned = std::move(moved);
+        CHECK(assigned.bytes_used() == used);
+        CHECK(ptr[0] == 42);
+    }
+
+    SUBCASE("clear frees everything") {
+        Arena arena;
+        arena.allocate(100);
+        arena.clear();
+        CHECK(arena.bytes_used() == 0);
+        CHECK(arena.bytes_reserved() == 0);
+        arena.allocate(100);
+        CHECK(arena.bytes_used() >= 100);
+    }
+}
+
+TEST_SUITE_END();
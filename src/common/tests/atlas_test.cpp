@@ -0,0 +1,182 @@
+#include "common/atlas.h"
+
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <vector>
+
+
+TEST_SUITE_BEGIN("atlas");
+
+namespace {
+
+bool rects_overlap(const AtlasRect& a, const AtlasRect& b, uint32_t padding) {
+    if (a.page != b.page) {
+        return false;
+    }
+    return a.x - padding < b.x + b.width + padding && b.x - padding < a.x + a.width + padding &&
+           a.y - padding < b.y + b.height + padding && b.y - padding < a.y + a.height + padding;
+}
+
+std::vector<AtlasSize> make_random_sizes(size_t count, uint32_t seed) {
+    std::vector<AtlasSize> sizes;
+    uint32_t state = seed;
+    for (size_t i = 0; i < count; i++) {
+        state = state * 1664525u + 1013904223u;
+        uint32_t width = 16u << ((state >> 24) % 5);
+        uint32_t height = 16u << ((state >> 16) % 5);
+        sizes.push_back({width, height});
+    }
+    return sizes;
+}
+
+// Check that all rects are inside their pages and do not overlap (including padding).
+void check_layout(const std::vector<AtlasSize>& sizes, const AtlasLayout& layout, uint32_t padding) {
+    REQUIRE(layout.rects.size() == sizes.size());
+    for (size_t i = 0; i < sizes.size(); i++) {
+        const AtlasRect& rect = layout.rects[i];
+        CHECK(rect.width == sizes[i].width);
+        CHECK(rect.height == sizes[i].height);
+        REQUIRE(rect.page < layout.pages.size());
+        CHECK(rect.x >= padding);
+        CHECK(rect.y >= padding);
+        CHECK(rect.x + rect.width + padding <= layout.pages[rect.page].width);
+        CHECK(rect.y + rect.height + padding <= layout.pages[rect.page].height);
+        for (size_t j = i + 1; j < sizes.size(); j++) {
+            CHECK(!rects_overlap(rect, layout.rects[j], padding));
+        }
+    }
+}
+
+}  // namespace
+
+TEST_CASE("SkylinePacker") {
+    SUBCASE("fill page with equal squares") {
+        SkylinePacker packer(64, 64);
+        for (uint32_t i = 0; i < 16; i++) {
+            uint32_t x = 0;
+            uint32_t y = 0;
+            CHECK(packer.insert(16, 16, x, y));
+            CHECK(x % 16 == 0);
+            CHECK(y % 16 == 0);
+        }
+        uint32_t x = 0;
+        uint32_t y = 0;
+        CHECK_FALSE(packer.insert(16, 16, x, y));
+        CHECK(packer.used_area() == 64 * 64);
+        CHECK(packer.used_width() == 64);
+        CHECK(packer.used_height() == 64);
+    }
+
+    SUBCASE("bottom-left placement fills the lowest gap") {
+        SkylinePacker packer(64, 64);
+        uint32_t x = 0;
+        uint32_t y = 0;
+        CHECK(packer.insert(32, 32, x, y));
+        CHECK((x == 0 && y == 0));
+        CHECK(packer.insert(16, 48, x, y));
+        CHECK((x == 32 && y == 0));
+        CHECK(packer.insert(16, 16, x, y));
+        CHECK((x == 48 && y == 0));
+        CHECK(packer.insert(32, 16, x, y));
+        CHECK((x == 0 && y == 32));
+    }
+
+    SUBCASE("too large rectangles") {
+        SkylinePacker packer(64, 64);
+        uint32_t x = 0;
+        uint32_t y = 0;
+        CHECK_FALSE(packer.insert(65, 1, x, y));
+        CHECK_FALSE(packer.insert(1, 65, x, y));
+        CHECK(packer.insert(64, 64, x, y));
+    }
+}
+
+TEST_CASE("pack_atlas") {
+    SUBCASE("empty input") {
+        AtlasLayout layout;
+        CHECK(pack_atlas({}, AtlasPackOptions(), layout));
+        CHECK(layout.pages.empty());
+        CHECK(layout.rects.empty());
+        CHECK(layout.efficiency() == 0.0);
+    }
+
+    SUBCASE("rectangles do not overlap and respect padding and alignment") {
+        std::vector<AtlasSize> sizes = make_random_sizes(300, 1);
+        AtlasPackOptions options;
+        options.page_width = 1024;
+        options.page_height = 1024;
+        options.padding = 16;
+        options.alignment = 16;
+        AtlasLayout layout;
+        REQUIRE(pack_atlas(sizes, options, layout));
+        CHECK(layout.pages.size() > 1);
+        check_layout(sizes, layout, options.padding);
+        for (const AtlasRect& rect : layout.rects) {
+            CHECK(rect.x % 16 == 0);
+            CHECK(rect.y % 16 == 0);
+        }
+        for (const AtlasSize& page : layout.pages) {
+            CHECK(page.width % 16 == 0);
+            CHECK(page.height % 16 == 0);
+            CHECK(page.width <= 1024);
+            CHECK(page.height <= 1024);
+        }
+    }
+
+    SUBCASE("small sets shrink the page") {
+        std::vector<AtlasSize> sizes = {{64, 64}, {32, 32}, {32, 32}};
+        AtlasLayout layout;
+        REQUIRE(pack_atlas(sizes, AtlasPackOptions(), layout));
+        REQUIRE(layout.pages.size() == 1);
+        CHECK(layout.pages[0].width <= 128);
+        CHECK(layout.pages[0].height == 64);
+        CHECK(layout.efficiency() >= 0.75);
+    }
+
+    SUBCASE("packing quality on equal squares") {
+        std::vector<AtlasSize> sizes(64, AtlasSize{64, 64});
+        AtlasPackOptions options;
+        options.page_width = 512;
+        options.page_height = 512;
+        AtlasLayout layout;
+        REQUIRE(pack_atlas(sizes, options, layout));
+        CHECK(layout.pages.size() == 1);
+        CHECK(layout.efficiency() == doctest::Approx(1.0));
+    }
+
+    SUBCASE("packing quality on random sizes") {
+        std::vector<AtlasSize> sizes = make_random_sizes(2000, 7);
+        AtlasLayout layout;
+        REQUIRE(pack_atlas(sizes, AtlasPackOptions(), layout));
+        check_layout(sizes, layout, 0);
+        CHECK(layout.efficiency() > 0.85);
+    }
+
+    SUBCASE("parallel packing gives the same result") {
+        std::vector<AtlasSize> sizes = make_random_sizes(500, 3);
+        AtlasPackOptions options;
+        options.padding = 4;
+        options.alignment = 4;
+        AtlasLayout sequential;
+        REQUIRE(pack_atlas(sizes, options, sequential));
+        options.parallel = true;
+        AtlasLayout parallel;
+        REQUIRE(pack_atlas(sizes, options, parallel));
+        REQUIRE(parallel.pages.size() == sequential.pages.size());
+        REQUIRE(parallel.rects.size() == sequential.rects.size());
+        for (size_t i = 0; i < parallel.rects.size(); i++) {
+            CHECK(parallel.rects[i].page == sequential.rects[i].page);
+            CHECK(parallel.rects[i].x == sequential.rects[i].x);
+            CHECK(parallel.rects[i].y == sequential.rects[i].y);
+        }
+    }
+
+    SUBCASE("rectangle larger than page") {
+        std::vector<AtlasSize> sizes = {{16, 16}, {4096, 16}};
+        AtlasLayout layout;
+        CHECK_FALSE(pack_atlas(sizes, AtlasPackOptions(), layout));
+    }
+}
+
+TEST_SUITE_END();
@@ -105,4 +105,27 @@ TEST_CASE("next_log2") {
     }
 }
 
+TEST_CASE("count_trailing_zeros") {
+    CHECK(count_trailing_zeros(0) == 64);
+    CHECK(count_trailing_zeros(1) == 0);
+    CHECK(count_trailing_zeros(0xFFFFFFFFFFFFFFFF) == 0);
+    CHECK(count_trailing_zeros(0x8000000000000000) == 63);
+    for (int i = 0; i < 64; i++) {
+        CHECK(count_trailing_zeros(uint64_t(1) << i) == i);
+        CHECK(count_trailing_zeros((uint64_t(1) << i) | 0x8000000000000000) == i);
+    }
+}
+
+TEST_CASE("count_set_bits") {
+    CHECK(count_set_bits(0) == 0);
+    CHECK(count_set_bits(0xFFFFFFFFFFFFFFFF) == 64);
+    CHECK(count_set_bits(0x8000000000000001) == 2);
+    uint64_t v = 0;
+    for (int i = 0; i < 64; i++) {
+        CHECK(count_set_bits(uint64_t(1) << i) == 1);
+        v |= uint64_t(1) << i;
+        CHECK(count_set_bits(v) == i + 1);
+    }
+}
+
 TEST_SUITE_END();
@@ -0,0 +1,65 @@
+#include "common/bitset.h"
+
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <vector>
+
+
+TEST_SUITE_BEGIN("bitset");
+
+TEST_CASE("bitset_num_words") {
+    CHECK(bitset_num_words(0) == 0);
+    CHECK(bitset_num_words(1) == 1);
+    CHECK(bitset_num_words(64) == 1);
+    CHECK(bitset_num_words(65) == 2);
+}
+
+TEST_CASE("bitset set and test") {
+    std::vector<uint64_t> bits(3, 0);
+    bitset_set(bits.data(), 0);
+    bitset_set(bits.data(), 63);
+    bitset_set(bits.data(), 64);
+    bitset_set(bits.data(), 130);
+    CHECK(bits[0] == 0x8000000000000001);
+    CHECK(bits[1] == 1);
+    CHECK(bits[2] == 4);
+    CHECK(bitset_test(bits.data(), 130));
+    CHECK_FALSE(bitset_test(bits.data(), 129));
+    CHECK(bitset_count(bits.data(), bits.size()) == 4);
+}
+
+TEST_CASE("bitset_or and bitset_and") {
+    // Odd word counts cover the SIMD loop and the scalar tail.
+    for (size_t num_words : {0, 1, 2, 5, 8}) {
+        CAPTURE(num_words);
+        std::vector<uint64_t> a(num_words);
+        std::vector<uint64_t> b(num_words);
+        for (size_t i = 0; i < num_words; i++) {
+            a[i] = 0x00FF00FF00FF00FFull * (i + 1);
+            b[i] = 0x0F0F0F0F0F0F0F0Full ^ (i << 8);
+        }
+        std::vector<uint64_t> or_bits = a;
+        std::vector<uint64_t> and_bits = a;
+        bitset_or(or_bits.data(), b.data(), num_words);
+        bitset_and(and_bits.data(), b.data(), num_words);
+        for (size_t i = 0; i < num_words; i++) {
+            CHECK(or_bits[i] == (a[i] | b[i]));
+            CHECK(and_bits[i] == (a[i] & b[i]));
+        }
+    }
+}
+
+TEST_CASE("bitset_for_each") {
+    std::vector<uint64_t> bits(4, 0);
+    std::vector<size_t> expected = {0, 5, 63, 64, 200, 255};
+    for (size_t i : expected) {
+        bitset_set(bits.data(), i);
+    }
+    std::vector<size_t> visited;
+    bitset_for_each(bits.data(), bits.size(), [&](size_t i) { visited.push_back(i); });
+    CHECK(visited == expected);
+    CHECK(bitset_count(bits.data(), bits.size()) == expected.size());
+}
+
+TEST_SUITE_END();
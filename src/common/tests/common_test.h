@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstdlib>
+#include <string>
+
 #include "common/struct.h"
 
 struct MoveOnly {
@@ -27,3 +30,13 @@ struct MoveOnly {
     ~MoveOnly() {
     }
 };
+
+// Create a new empty directory for the files of a test and return its path, or an empty string on error.
+inline std::string make_temp_directory() {
+    const char* tmp_dir = getenv("TMPDIR");
+    std::string path = std::string(tmp_dir != nullptr ? tmp_dir : "/tmp") + "/hl1_test_XXXXXX";
+    if (mkdtemp(path.data()) == nullptr) {
+        return "";
+    }
+    return path;
+}
@@ -0,0 +1,163 @@
+#include "common/frustum.h"
+
+#include <doctest/doctest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+
+TEST_SUITE_BEGIN("frustum");
+
+namespace {
+
+// View along +x with +y to the left, as in Quake, 90 degrees both ways.
+Frustum axis_frustum() {
+    const float position[3] = {0.0f, 0.0f, 0.0f};
+    const float forward[3] = {1.0f, 0.0f, 0.0f};
+    const float right[3] = {0.0f, -1.0f, 0.0f};
+    const float up[3] = {0.0f, 0.0f, 1.0f};
+    Frustum frustum;
+    frustum.set_perspective(position, forward, right, up, 1.0f, 0.5f, 4.0f, 1000.0f);
+    return frustum;
+}
+
+bool test_point_box(const Frustum& frustum, float x, float y, float z, float half_size = 0.5f) {
+    const float mins[3] = {x - half_size, y - half_size, z - half_size};
+    const float maxs[3] = {x + half_size, y + half_size, z + half_size};
+    return frustum.test_box(mins, maxs);
+}
+
+uint32_t next_random(uint32_t& rng) {
+    rng = rng * 1664525u + 1013904223u;
+    return rng >> 8;
+}
+
+float random_float(uint32_t& rng, float lo, float hi) {
+    return lo + float(next_random(rng)) / float(1 << 24) * (hi - lo);
+}
+
+// Return the smallest distance of the tested corners of the box to the planes, in double precision.
+double min_corner_distance(const Frustum& frustum, const float mins[3], const float maxs[3]) {
+    double result = INFINITY;
+    for (int plane = 0; plane < Frustum::NUM_PLANES; plane++) {
+        double distance = -double(frustum.dists[plane]);
+        for (int axis = 0; axis < 3; axis++) {
+            float corner = frustum.normals[plane][axis] > 0.0f ? maxs[axis] : mins[axis];
+            distance += double(frustum.normals[plane][axis]) * double(corner);
+        }
+        result = std::fmin(result, std::fabs(distance));
+    }
+    return result;
+}
+
+}  // namespace
+
+TEST_CASE("Frustum set_perspective") {
+    Frustum frustum = axis_frustum();
+    CHECK(test_point_box(frustum, 100.0f, 0.0f, 0.0f));
+    CHECK(test_point_box(frustum, 100.0f, 90.0f, 40.0f));
+    CHECK(test_point_box(frustum, 100.0f, -90.0f, -40.0f));
+    // Behind, left, right, above, below, before the near plane and past the far plane.
+    CHECK_FALSE(test_point_box(frustum, -100.0f, 0.0f, 0.0f));
+    CHECK_FALSE(test_point_box(frustum, 100.0f, 110.0f, 0.0f));
+    CHECK_FALSE(test_point_box(frustum, 100.0f, -110.0f, 0.0f));
+    CHECK_FALSE(test_point_box(frustum, 100.0f, 0.0f, 60.0f));
+    CHECK_FALSE(test_point_box(frustum, 100.0f, 0.0f, -60.0f));
+    CHECK_FALSE(test_point_box(frustum, 2.0f, 0.0f, 0.0f));
+    CHECK_FALSE(test_point_box(frustum, 1100.0f, 0.0f, 0.0f));
+    // Boxes crossing a plane and boxes containing the camera are kept.
+    CHECK(test_point_box(frustum, 100.0f, 110.0f, 0.0f, 20.0f));
+    CHECK(test_point_box(frustum, 0.0f, 0.0f, 0.0f, 10.0f));
+
+    // The side normals are unit vectors pointing inwards.
+    for (int plane = 2; plane < Frustum::NUM_PLANES; plane++) {
+        const float* n = frustum.normals[plane];
+        CHECK(n[0] * n[0] + n[1] * n[1] + n[2] * n[2] == doctest::Approx(1.0));
+        CHECK(n[0] > 0.0f);
+        CHECK(frustum.dists[plane] == 0.0f);
+    }
+}
+
+TEST_CASE("FrustumBoxes padding") {
+    FrustumBoxes boxes;
+    boxes.resize(5);
+    CHECK(boxes.size() == 5);
+    for (int axis = 0; axis < 3; axis++) {
+        CHECK(boxes.mins[axis].size() == 8);
+        CHECK(boxes.maxs[axis].size() == 8);
+    }
+
+    // The padding boxes at the origin are inside of a frustum containing it, and never reported.
+    const float position[3] = {-10.0f, 0.0f, 0.0f};
+    const float forward[3] = {1.0f, 0.0f, 0.0f};
+    const float right[3] = {0.0f, -1.0f, 0.0f};
+    const float up[3] = {0.0f, 0.0f, 1.0f};
+    Frustum frustum;
+    frustum.set_perspective(position, forward, right, up, 1.0f, 1.0f, 1.0f, 100.0f);
+    std::vector<uint32_t> visible(boxes.size());
+    for (bool parallel : {false, true}) {
+        CHECK(cull_boxes(frustum, boxes, visible.data(), parallel) == 5);
+        CHECK(visible == std::vector<uint32_t>{0, 1, 2, 3, 4});
+    }
+    const float mins[3] = {-20.0f, 0.0f, 0.0f};
+    const float maxs[3] = {-19.0f, 1.0f, 1.0f};
+    boxes.set(2, mins, maxs);
+    CHECK(cull_boxes(frustum, boxes, visible.data()) == 4);
+    CHECK(cull_boxes_scalar(frustum, boxes, visible.data()) == 4);
+    CHECK(visible[2] == 3);
+
+    FrustumBoxes empty;
+    CHECK(cull_boxes(frustum, empty, nullptr) == 0);
+    CHECK(cull_boxes(frustum, empty, nullptr, true) == 0);
+}
+
+TEST_CASE("cull_boxes random boxes") {
+    uint32_t rng = 7;
+    for (size_t num_boxes : {1, 3, 4, 7, 1000, 4096 * 3 + 5}) {
+        CAPTURE(num_boxes);
+        // A camera in a random direction in the middle of the boxes.
+        float yaw = random_float(rng, 0.0f, 6.2831853f);
+        float pitch = random_float(rng, -1.5f, 1.5f);
+        const float position[3] = {random_float(rng, -100.0f, 100.0f), random_float(rng, -100.0f, 100.0f), 0.0f};
+        const float forward[3] = {std::cos(yaw) * std::cos(pitch), std::sin(yaw) * std::cos(pitch), std::sin(pitch)};
+        const float right[3] = {std::sin(yaw), -std::cos(yaw), 0.0f};
+        const float up[3] = {-std::cos(yaw) * std::sin(pitch), -std::sin(yaw) * std::sin(pitch), std::cos(pitch)};
+        Frustum frustum;
+        frustum.set_perspective(position, forward, right, up, 1.2f, 0.7f, 4.0f, 2000.0f);
+
+        // Boxes too close to a plane are moved, so that rounding cannot change the expected result.
+        FrustumBoxes boxes;
+        boxes.resize(num_boxes);
+        std::vector<uint32_t> expected;
+        for (size_t i = 0; i < num_boxes; i++) {
+            float mins[3];
+            float maxs[3];
+            do {
+                for (int axis = 0; axis < 3; axis++) {
+                    mins[axis] = random_float(rng, -2500.0f, 2500.0f);
+                    maxs[axis] = mins[axis] + random_float(rng, 0.0f, 200.0f);
+                }
+            } while (min_corner_distance(frustum, mins, maxs) < 0.01);
+            boxes.set(i, mins, maxs);
+            if (frustum.test_box(mins, maxs)) {
+                expected.push_back(uint32_t(i));
+            }
+        }
+
+        std::vector<uint32_t> visible(num_boxes);
+        visible.resize(cull_boxes_scalar(frustum, boxes, visible.data()));
+        CHECK(visible == expected);
+        for (bool parallel : {false, true}) {
+            visible.resize(num_boxes);
+            visible.resize(cull_boxes(frustum, boxes, visible.data(), parallel));
+            CHECK(visible == expected);
+        }
+        if (num_boxes >= 1000) {
+            CHECK(expected.size() > num_boxes / 100);
+            CHECK(expected.size() < num_boxes / 2);
+        }
+    }
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,43 @@
+#include "common/hash.h"
+
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+
+TEST_SUITE_BEGIN("hash");
+
+TEST_CASE("hash64") {
+    SUBCASE("reference values") {
+        CHECK(hash64("", 0) == 0xef46db3751d8e999ull);
+        CHECK(hash64("a", 1) == 0xd24ec4f1a98c6e5bull);
+        CHECK(hash64("abc", 3) == 0x44bc2cf5ad770999ull);
+    }
+
+    SUBCASE("all tail lengths are hashed") {
+        std::vector<uint8_t> data(100);
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = uint8_t(i * 7 + 1);
+        }
+        for (size_t size = 1; size <= data.size(); size++) {
+            uint64_t h = hash64(data.data(), size);
+            CHECK(h != hash64(data.data(), size - 1));
+            // Flipping any single byte changes the hash.
+            for (size_t i = 0; i < size; i++) {
+                data[i] ^= 1;
+                CHECK(hash64(data.data(), size) != h);
+                data[i] ^= 1;
+            }
+        }
+    }
+
+    SUBCASE("seed") {
+        const char* text = "Half-Life texture";
+        CHECK(hash64(text, strlen(text), 1) != hash64(text, strlen(text), 0));
+        CHECK(hash64(text, strlen(text), 1) == hash64(text, strlen(text), 1));
+    }
+}
+
+TEST_SUITE_END();
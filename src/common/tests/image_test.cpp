@@ -0,0 +1,178 @@
+#include "common/image.h"
+
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+
+TEST_SUITE_BEGIN("image");
+
+namespace {
+
+std::vector<uint8_t> make_random_image(uint32_t width, uint32_t height, uint32_t seed) {
+    std::vector<uint8_t> result(size_t(width) * height * 4);
+    uint32_t state = seed * 2654435761u + 1;
+    for (uint8_t& v : result) {
+        state = state * 1664525u + 1013904223u;
+        v = uint8_t(state >> 24);
+    }
+    return result;
+}
+
+// Straightforward box filter for comparison with the optimized version.
+std::vector<uint8_t> reference_downsample(const std::vector<uint8_t>& src, uint32_t width, uint32_t height) {
+    uint32_t dst_width = mip_level_dim(width, 1);
+    uint32_t dst_height = mip_level_dim(height, 1);
+    std::vector<uint8_t> result(size_t(dst_width) * dst_height * 4);
+    for (uint32_t y = 0; y < dst_height; y++) {
+        for (uint32_t x = 0; x < dst_width; x++) {
+            uint32_t xs[2] = {x * 2, std::min(x * 2 + 1, width - 1)};
+            uint32_t ys[2] = {y * 2, std::min(y * 2 + 1, height - 1)};
+            for (int c = 0; c < 4; c++) {
+                uint32_t sum = 0;
+                for (uint32_t sy : ys) {
+                    for (uint32_t sx : xs) {
+                        sum += src[(sy * width + sx) * 4 + c];
+                    }
+                }
+                result[(y * dst_width + x) * 4 + c] = uint8_t((sum + 2) / 4);
+            }
+        }
+    }
+    return result;
+}
+
+}  // namespace
+
+TEST_CASE("mip_chain_length") {
+    CHECK(mip_chain_length(1, 1) == 1);
+    CHECK(mip_chain_length(2, 1) == 2);
+    CHECK(mip_chain_length(16, 16) == 5);
+    CHECK(mip_chain_length(64, 16) == 7);
+    CHECK(mip_chain_length(16, 256) == 9);
+    CHECK(mip_level_dim(64, 7) == 1);
+    CHECK(mip_level_dim(64, 3) == 8);
+}
+
+TEST_CASE("downsample_rgba8") {
+    SUBCASE("constant image stays constant") {
+        std::vector<uint8_t> src(32 * 16 * 4);
+        for (size_t i = 0; i < src.size(); i++) {
+            src[i] = uint8_t(10 + i % 4 * 50);
+        }
+        std::vector<uint8_t> dst(16 * 8 * 4);
+        downsample_rgba8(src.data(), 32, 16, dst.data(), false);
+        for (size_t i = 0; i < dst.size(); i++) {
+            CHECK(dst[i] == src[i % 4]);
+        }
+        downsample_rgba8(src.data(), 32, 16, dst.data(), true);
+        for (size_t i = 0; i < dst.size(); i++) {
+            CHECK(dst[i] == src[i % 4]);
+        }
+    }
+
+    SUBCASE("2x2 average with rounding") {
+        uint8_t src[16] = {0, 0, 0, 0, 1, 2, 3, 255, 0, 0, 0, 255, 1, 2, 3, 255};
+        uint8_t dst[4] = {};
+        downsample_rgba8(src, 2, 2, dst, false);
+        CHECK(dst[0] == 1);
+        CHECK(dst[1] == 1);
+        CHECK(dst[2] == 2);
+        CHECK(dst[3] == 191);
+    }
+
+    SUBCASE("single row and single column") {
+        uint8_t src[8] = {0, 100, 200, 255, 100, 200, 0, 255};
+        uint8_t dst[4] = {};
+        downsample_rgba8(src, 2, 1, dst, false);
+        CHECK(dst[0] == 50);
+        CHECK(dst[1] == 150);
+        CHECK(dst[2] == 100);
+        CHECK(dst[3] == 255);
+
+        downsample_rgba8(src, 1, 2, dst, false);
+        CHECK(dst[0] == 50);
+        CHECK(dst[1] == 150);
+        CHECK(dst[2] == 100);
+    }
+
+    SUBCASE("matches reference for various sizes") {
+        const uint32_t sizes[][2] = {{2, 2}, {4, 2}, {8, 8}, {10, 6}, {16, 1}, {1, 16}, {34, 18}, {64, 16}, {7, 5}};
+        for (const auto& size : sizes) {
+            std::vector<uint8_t> src = make_random_image(size[0], size[1], size[0] * 31 + size[1]);
+            std::vector<uint8_t> expected = reference_downsample(src, size[0], size[1]);
+            std::vector<uint8_t> dst(expected.size());
+            downsample_rgba8(src.data(), size[0], size[1], dst.data(), false);
+            CHECK(dst == expected);
+        }
+    }
+
+    SUBCASE("gamma-correct average of black and white") {
+        uint8_t src[16] = {0, 0, 0, 255, 255, 255, 255, 255, 0, 0, 0, 255, 255, 255, 255, 255};
+        uint8_t dst[4] = {};
+        downsample_rgba8(src, 2, 2, dst, true);
+        // 50% linear intensity is sRGB 188, the naive average is 128.
+        CHECK(dst[0] == 188);
+        CHECK(dst[1] == 188);
+        CHECK(dst[2] == 188);
+        CHECK(dst[3] == 255);
+    }
+
+    SUBCASE("gamma-correct matches per-block results for various sizes") {
+        // Downsampling each 2x2 block on its own goes through the scalar path.
+        const uint32_t sizes[][2] = {{8, 2}, {10, 6}, {16, 1}, {34, 18}, {64, 16}, {7, 5}};
+        for (const auto& size : sizes) {
+            uint32_t width = size[0];
+            uint32_t height = size[1];
+            std::vector<uint8_t> src = make_random_image(width, height, width * 17 + height);
+            uint32_t dst_width = mip_level_dim(width, 1);
+            std::vector<uint8_t> dst(size_t(dst_width) * mip_level_dim(height, 1) * 4);
+            downsample_rgba8(src.data(), width, height, dst.data(), true);
+            for (size_t i = 0; i < dst.size() / 4; i++) {
+                uint32_t x = uint32_t(i % dst_width);
+                uint32_t y = uint32_t(i / dst_width);
+                uint32_t xs[2] = {x * 2, std::min(x * 2 + 1, width - 1)};
+                uint32_t ys[2] = {y * 2, std::min(y * 2 + 1, height - 1)};
+                uint8_t block[16];
+                for (int j = 0; j < 4; j++) {
+                    memcpy(block + j * 4, &src[(ys[j / 2] * width + xs[j % 2]) * 4], 4);
+                }
+                uint8_t expected[4];
+                downsample_rgba8(block, 2, 2, expected, true);
+                CHECK(memcmp(&dst[i * 4], expected, 4) == 0);
+            }
+        }
+    }
+}
+
+TEST_CASE("copy_rgba8_padded") {
+    const uint32_t width = 3;
+    const uint32_t height = 2;
+    std::vector<uint8_t> src = make_random_image(width, height, 5);
+    const uint32_t dst_width = 9;
+    const uint32_t dst_height = 8;
+    std::vector<uint8_t> dst(dst_width * dst_height * 4, 0);
+    copy_rgba8_padded(src.data(), width, height, dst.data(), dst_width, 3, 4, 2);
+
+    auto dst_pixel = [&](uint32_t x, uint32_t y) { return &dst[(y * dst_width + x) * 4]; };
+    auto src_pixel = [&](uint32_t x, uint32_t y) { return &src[(y * width + x) * 4]; };
+    for (uint32_t y = 0; y < dst_height; y++) {
+        for (uint32_t x = 0; x < dst_width; x++) {
+            bool inside_padded = x >= 1 && x < 3 + width + 2 && y >= 2 && y < 4 + height + 2;
+            if (!inside_padded) {
+                CHECK(dst_pixel(x, y)[3] == 0);
+                continue;
+            }
+            // Padding replicates the nearest edge pixel.
+            uint32_t sx = std::min(std::max(x, 3u), 3u + width - 1) - 3;
+            uint32_t sy = std::min(std::max(y, 4u), 4u + height - 1) - 4;
+            CHECK(memcmp(dst_pixel(x, y), src_pixel(sx, sy), 4) == 0);
+        }
+    }
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,101 @@
+#include "common/inline_string.h"
+
+#include <doctest/doctest.h>
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+
+TEST_SUITE_BEGIN("inline_string");
+
+TEST_CASE("InlineString") {
+    SUBCASE("construction and conversions") {
+        InlineString<16> empty;
+        CHECK(empty.empty());
+        CHECK(empty.size() == 0);
+        CHECK(empty.view().empty());
+
+        InlineString<16> str = "wall01";
+        CHECK(!str.empty());
+        CHECK(str.size() == 6);
+        CHECK(str.view() == "wall01");
+        std::string_view view = str;
+        CHECK(view == "wall01");
+        CHECK(str == "wall01");
+        CHECK(str == std::string("wall01"));
+        CHECK(str != "wall0");
+        CHECK(str != std::string_view("wall011"));
+        CHECK(sizeof(str) == 16);
+        CHECK(sizeof(InlineString<15>) == 16);
+        CHECK(sizeof(InlineString<56>) == 64);
+
+        // Sizes which leave room for a terminator have c_str().
+        InlineString<15> terminated = "wall01";
+        CHECK(std::string(terminated.c_str()) == "wall01");
+        CHECK(InlineString<15>().c_str()[0] == '\0');
+    }
+
+    SUBCASE("full capacity and truncation") {
+        InlineString<16> full;
+        CHECK(full.assign("sixteen_chars_ab"));
+        CHECK(full.size() == 16);
+        CHECK(full == "sixteen_chars_ab");
+
+        InlineString<16> truncated;
+        CHECK_FALSE(truncated.assign("seventeen_chars_a"));
+        CHECK(truncated == "seventeen_chars_");
+
+        // Assigning a shorter string clears the old bytes.
+        full.assign("ab");
+        CHECK(full == InlineString<16>("ab"));
+        CHECK(full.size() == 2);
+
+        // A full string of several chunks has no terminator either.
+        InlineString<32> two_chunks = "0123456789abcdef0123456789abcdef";
+        CHECK(two_chunks.size() == 32);
+        CHECK(two_chunks.view() == "0123456789abcdef0123456789abcdef");
+        CHECK(two_chunks != InlineString<32>("0123456789abcdef0123456789abcde"));
+    }
+
+    SUBCASE("equality compares all chunks") {
+        InlineString<40> a = "0123456789abcdef0123456789abcdef01234567";
+        InlineString<40> b = "0123456789abcdef0123456789abcdef01234567";
+        CHECK(a == b);
+        for (size_t i = 0; i < 40; i++) {
+            std::string changed(a.view());
+            changed[i] = 'x';
+            CHECK(a != InlineString<40>(changed));
+        }
+    }
+
+    SUBCASE("case-insensitive compare and hash") {
+        InlineString<16> a = "{Fence_01";
+        InlineString<16> b = "{FENCE_01";
+        CHECK(a != b);
+        CHECK(a.equals_ignore_case(b));
+        CHECK(a.hash_ignore_case() == b.hash_ignore_case());
+        CHECK(a.to_lower() == "{fence_01");
+        CHECK(!a.equals_ignore_case("{fence_02"));
+        // Only ASCII letters are folded.
+        CHECK(!InlineString<16>("@[`{").equals_ignore_case("`{@["));
+        CHECK(!InlineString<16>("\xc0").equals_ignore_case("\xe0"));
+
+        std::unordered_map<InlineString<16>, int, InlineString<16>::HashIgnoreCase, InlineString<16>::EqualIgnoreCase>
+            map;
+        map["Wall"] = 1;
+        map["WALL"] = 2;
+        map["floor"] = 3;
+        CHECK(map.size() == 2);
+        CHECK(map["wall"] == 2);
+    }
+
+    SUBCASE("std::hash") {
+        std::unordered_set<InlineString<16>> set = {"a", "A", "b", "a"};
+        CHECK(set.size() == 3);
+        CHECK(set.count("A") == 1);
+    }
+}
+
+TEST_SUITE_END();
@@ -2,7 +2,16 @@
 
 #include <doctest/doctest.h>
 
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <string>
+#include <utility>
+#include <vector>
+
+#include "common_test.h"
 
 
 TEST_SUITE_BEGIN("io");
@@ -249,4 +258,78 @@ TEST_CASE("FileContents::read_at") {
     }
 }
 
+TEST_CASE("file_stat, file_rename and MappedFile") {
+    std::string dir = make_temp_directory();
+    REQUIRE(!dir.empty());
+    std::string path = path_join(dir.c_str(), "file.bin");
+    std::string renamed_path = path_join(dir.c_str(), "renamed.bin");
+    const uint8_t data[] = {1, 2, 3, 4, 5};
+    REQUIRE(file_write_contents(path.c_str(), data, sizeof(data)));
+
+    SUBCASE("file_stat") {
+        FileStat stat;
+        REQUIRE(file_stat(path.c_str(), stat));
+        CHECK(stat.size == sizeof(data));
+        CHECK(stat.mtime_ns > 0);
+        CHECK_FALSE(file_stat(renamed_path.c_str(), stat));
+    }
+
+    SUBCASE("file_set_mtime") {
+        const int64_t mtime_ns = 1500000000123456789;
+        REQUIRE(file_set_mtime(path.c_str(), mtime_ns));
+        FileStat stat;
+        REQUIRE(file_stat(path.c_str(), stat));
+        CHECK(stat.size == sizeof(data));
+        // Filesystems may store coarser times.
+        CHECK(stat.mtime_ns <= mtime_ns);
+        CHECK(stat.mtime_ns > mtime_ns - 2000000000);
+        CHECK_FALSE(file_set_mtime(renamed_path.c_str(), mtime_ns));
+    }
+
+    SUBCASE("file_rename") {
+        REQUIRE(file_rename(path.c_str(), renamed_path.c_str()));
+        FileStat stat;
+        CHECK_FALSE(file_stat(path.c_str(), stat));
+        CHECK(file_stat(renamed_path.c_str(), stat));
+        CHECK_FALSE(file_rename(path.c_str(), renamed_path.c_str()));
+    }
+
+    SUBCASE("file_write_at") {
+        const uint8_t patch[] = {7, 8};
+        REQUIRE(file_write_at(path.c_str(), 1, patch, sizeof(patch)));
+        FileContents contents;
+        REQUIRE(file_read_contents(path.c_str(), contents));
+        CHECK(contents.contents == std::vector<uint8_t>{1, 7, 8, 4, 5});
+        CHECK_FALSE(file_write_at(renamed_path.c_str(), 0, patch, sizeof(patch)));
+    }
+
+    SUBCASE("MappedFile") {
+        MappedFile file;
+        REQUIRE(file.open(path.c_str()));
+        CHECK(file.name() == path);
+        REQUIRE(file.contents().size() == sizeof(data));
+        CHECK(memcmp(file.contents().data(), data, sizeof(data)) == 0);
+
+        // Moving keeps the mapping.
+        MappedFile moved = std::move(file);
+        CHECK(file.contents().empty());
+        CHECK(moved.contents().size() == sizeof(data));
+
+        moved.close();
+        CHECK(moved.contents().empty());
+        CHECK_FALSE(moved.open(renamed_path.c_str()));
+    }
+
+    SUBCASE("MappedFile of empty file") {
+        REQUIRE(file_write_contents(path.c_str(), data, 0));
+        MappedFile file;
+        CHECK(file.open(path.c_str()));
+        CHECK(file.contents().empty());
+    }
+
+    remove(path.c_str());
+    remove(renamed_path.c_str());
+    rmdir(dir.c_str());
+}
+
 TEST_SUITE_END();
@@ -0,0 +1,172 @@
+#include "common/occlusion.h"
+
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <vector>
+
+
+TEST_SUITE_BEGIN("occlusion");
+
+namespace {
+
+// View along +x from the origin, 90 degrees both ways, with +y to the left as in Quake.
+OcclusionView axis_view() {
+    OcclusionView view;
+    view.tan_half_fov_x = 1.0f;
+    view.tan_half_fov_y = 1.0f;
+    view.near_dist = 4.0f;
+    return view;
+}
+
+// Square occluder facing the camera at distance x, with half size h.
+std::vector<float> wall(float x, float h, float center_y = 0.0f, float center_z = 0.0f) {
+    return {x, center_y - h, center_z - h, x, center_y + h, center_z - h,
+            x, center_y + h, center_z + h, x, center_y - h, center_z + h};
+}
+
+bool occluded(const OcclusionBuffer& buffer, float x0, float y0, float z0, float x1, float y1, float z1) {
+    const float mins[3] = {x0, y0, z0};
+    const float maxs[3] = {x1, y1, z1};
+    return buffer.box_occluded(mins, maxs);
+}
+
+}  // namespace
+
+TEST_CASE("OcclusionBuffer wall") {
+    OcclusionBuffer buffer;
+    buffer.init(100, 70);
+    CHECK(buffer.stride == 128);
+    CHECK(buffer.depth.size() == 128 * 80);
+    buffer.begin(axis_view());
+    std::vector<float> vertices = wall(100.0f, 50.0f);
+    buffer.add_occluder(vertices.data(), 4);
+    CHECK(buffer.num_occluders() == 1);
+    buffer.render();
+
+    // The wall covers the middle half of the view, with its inverse distance at most.
+    float center_depth = buffer.depth[35 * buffer.stride + 50];
+    CHECK(center_depth == doctest::Approx(0.01f).epsilon(0.001));
+    CHECK(buffer.depth[35 * buffer.stride + 10] == 0.0f);
+    CHECK(buffer.depth[5 * buffer.stride + 50] == 0.0f);
+
+    // Boxes behind the wall are occluded, boxes in front of it, around it or larger than it are not.
+    CHECK(occluded(buffer, 200.0f, -10.0f, -10.0f, 220.0f, 10.0f, 10.0f));
+    CHECK(occluded(buffer, 101.0f, -40.0f, -40.0f, 150.0f, 40.0f, 40.0f));
+    CHECK_FALSE(occluded(buffer, 50.0f, -10.0f, -10.0f, 60.0f, 10.0f, 10.0f));
+    CHECK_FALSE(occluded(buffer, 90.0f, -10.0f, -10.0f, 110.0f, 10.0f, 10.0f));
+    CHECK_FALSE(occluded(buffer, 200.0f, 80.0f, -10.0f, 220.0f, 120.0f, 10.0f));
+    CHECK_FALSE(occluded(buffer, 200.0f, -150.0f, -10.0f, 220.0f, 150.0f, 10.0f));
+    // Boxes crossing the near plane or outside of the view are never occluded.
+    CHECK_FALSE(occluded(buffer, -10.0f, -1.0f, -1.0f, 200.0f, 1.0f, 1.0f));
+    CHECK_FALSE(occluded(buffer, 200.0f, 500.0f, -10.0f, 220.0f, 520.0f, 10.0f));
+
+    // A new frame without occluders occludes nothing.
+    buffer.begin(axis_view());
+    buffer.render();
+    CHECK_FALSE(occluded(buffer, 200.0f, -10.0f, -10.0f, 220.0f, 10.0f, 10.0f));
+    CHECK(buffer.depth[35 * buffer.stride + 50] == 0.0f);
+}
+
+TEST_CASE("OcclusionBuffer conservative edges") {
+    OcclusionBuffer buffer;
+    buffer.init(64, 64);
+    buffer.begin(axis_view());
+    // Two halves of a wall leave no gap where they meet, a box behind the seam is occluded.
+    std::vector<float> left = {100.0f, 0.0f, -50.0f, 100.0f, 50.0f, -50.0f, 100.0f, 50.0f, 50.0f, 100.0f, 0.0f, 50.0f};
+    std::vector<float> right = {100.0f, -50.0f, -50.0f, 100.0f, 0.0f, -50.0f, 100.0f, 0.0f, 50.0f, 100.0f, -50.0f,
+                                50.0f};
+    buffer.add_occluder(left.data(), 4);
+    buffer.add_occluder(right.data(), 4);
+    buffer.render();
+    // The pixels of the seam are covered by neither half.
+    CHECK_FALSE(occluded(buffer, 200.0f, -10.0f, -10.0f, 220.0f, 10.0f, 10.0f));
+    CHECK(occluded(buffer, 200.0f, 10.0f, -10.0f, 220.0f, 40.0f, 10.0f));
+
+    // Marked as shared, the edges of the seam cover it.
+    buffer.begin(axis_view());
+    const uint8_t left_interior[4] = {0, 0, 0, 1};
+    const uint8_t right_interior[4] = {0, 1, 0, 0};
+    buffer.add_occluder(left.data(), 4, left_interior);
+    buffer.add_occluder(right.data(), 4, right_interior);
+    buffer.render();
+    CHECK(occluded(buffer, 200.0f, -10.0f, -10.0f, 220.0f, 10.0f, 10.0f));
+
+    // The pixels only partly covered by the wall are not covered.
+    for (int y = 0; y < buffer.height; y++) {
+        for (int x = 0; x < buffer.width; x++) {
+            if (buffer.depth[size_t(y) * buffer.stride + size_t(x)] == 0.0f) {
+                continue;
+            }
+            CAPTURE(x);
+            CAPTURE(y);
+            // Pixel centers of the wall from 16 to 48 (the wall spans 0.5 of the view).
+            CHECK(x >= 16);
+            CHECK(x < 48);
+            CHECK(y >= 16);
+            CHECK(y < 48);
+        }
+    }
+}
+
+TEST_CASE("OcclusionBuffer clipping") {
+    OcclusionBuffer buffer;
+    buffer.init(64, 48);
+    OcclusionView view = axis_view();
+    view.tan_half_fov_y = 0.75f;
+    buffer.begin(view);
+    // A floor from behind the camera to far away, clipped by the near plane and the guard band.
+    std::vector<float> floor = {-100.0f, -1000.0f, -10.0f, 1000.0f, -1000.0f, -10.0f,
+                                1000.0f, 1000.0f, -10.0f, -100.0f, 1000.0f, -10.0f};
+    buffer.add_occluder(floor.data(), 4);
+    // Polygons behind the camera, seen edge-on or too small are dropped.
+    std::vector<float> behind = wall(-100.0f, 50.0f);
+    buffer.add_occluder(behind.data(), 4);
+    std::vector<float> edge_on = {100.0f, 0.0f, -50.0f, 200.0f, 0.0f, -50.0f, 200.0f, 0.0f, 50.0f};
+    buffer.add_occluder(edge_on.data(), 3);
+    std::vector<float> tiny = wall(1000.0f, 1.0f);
+    buffer.add_occluder(tiny.data(), 4);
+    buffer.add_occluder(floor.data(), 2);
+    CHECK(buffer.num_occluders() == 1);
+
+    for (bool parallel : {false, true}) {
+        buffer.render(parallel);
+        // Boxes under the floor are occluded, boxes above it are not.
+        CHECK(occluded(buffer, 100.0f, -20.0f, -60.0f, 140.0f, 20.0f, -20.0f));
+        CHECK_FALSE(occluded(buffer, 100.0f, -20.0f, -9.0f, 140.0f, 20.0f, 20.0f));
+        CHECK_FALSE(occluded(buffer, 100.0f, -20.0f, -11.0f, 140.0f, 20.0f, -5.0f));
+    }
+}
+
+TEST_CASE("OcclusionBuffer parallel render") {
+    // Random walls in front of the camera, the parallel render is the same as the sequential one.
+    OcclusionBuffer buffer;
+    buffer.init(200, 150);
+    OcclusionView view = axis_view();
+    view.tan_half_fov_y = 0.75f;
+    uint32_t rng = 3;
+    auto random_float = [&](float lo, float hi) {
+        rng = rng * 1664525u + 1013904223u;
+        return lo + float(rng >> 8) / float(1 << 24) * (hi - lo);
+    };
+    buffer.begin(view);
+    for (int i = 0; i < 100; i++) {
+        std::vector<float> vertices = wall(random_float(10.0f, 1000.0f), random_float(1.0f, 100.0f),
+                                           random_float(-500.0f, 500.0f), random_float(-300.0f, 300.0f));
+        // Tilt the walls.
+        vertices[0] += random_float(-50.0f, 50.0f);
+        vertices[9] = vertices[0];
+        buffer.add_occluder(vertices.data(), 4);
+    }
+    buffer.render();
+    std::vector<float> sequential = buffer.depth;
+    buffer.render(true);
+    CHECK(buffer.depth == sequential);
+    size_t num_covered = 0;
+    for (float depth : sequential) {
+        num_covered += depth > 0.0f ? 1 : 0;
+    }
+    CHECK(num_covered > 1000);
+}
+
+TEST_SUITE_END();
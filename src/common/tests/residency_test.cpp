@@ -0,0 +1,176 @@
+#include "common/residency.h"
+
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <random>
+#include <vector>
+
+
+TEST_SUITE_BEGIN("residency");
+
+TEST_CASE("ResidencyLRU") {
+    ResidencyLRU residency(300);
+    std::vector<uint32_t> evicted;
+    for (uint32_t i = 0; i < 5; i++) {
+        CHECK(residency.add(100) == i);
+    }
+    CHECK(residency.size() == 5);
+    CHECK(residency.num_resident() == 0);
+
+    SUBCASE("first use creates") {
+        CHECK_FALSE(residency.use(0));
+        CHECK(residency.use(0));
+        CHECK(residency.is_resident(0));
+        CHECK_FALSE(residency.is_resident(1));
+        CHECK(residency.resident_bytes() == 100);
+    }
+
+    SUBCASE("least recently used is evicted") {
+        for (uint32_t i = 0; i < 3; i++) {
+            residency.use(i);
+            residency.next_frame();
+        }
+        // 0 becomes the most recently used.
+        residency.use(0);
+        residency.next_frame();
+        residency.use(3);
+        residency.evict(evicted);
+        CHECK(evicted == std::vector<uint32_t>{1});
+        CHECK_FALSE(residency.is_resident(1));
+        CHECK(residency.resident_bytes() == 300);
+        CHECK(residency.num_resident() == 3);
+
+        // An evicted resource has to be created again.
+        residency.next_frame();
+        CHECK_FALSE(residency.use(1));
+        evicted.clear();
+        residency.evict(evicted);
+        CHECK(evicted == std::vector<uint32_t>{2});
+    }
+
+    SUBCASE("resources used in the current frame are kept") {
+        for (uint32_t i = 0; i < 5; i++) {
+            residency.use(i);
+        }
+        residency.evict(evicted);
+        CHECK(evicted.empty());
+        CHECK(residency.resident_bytes() == 500);
+
+        residency.next_frame();
+        residency.use(0);
+        residency.evict(evicted);
+        CHECK(evicted == std::vector<uint32_t>{1, 2});
+        CHECK(residency.resident_bytes() == 300);
+    }
+
+    SUBCASE("lower budget") {
+        for (uint32_t i = 0; i < 3; i++) {
+            residency.use(i);
+        }
+        residency.next_frame();
+        residency.set_budget(100);
+        CHECK(residency.budget() == 100);
+        residency.evict(evicted);
+        CHECK(evicted == std::vector<uint32_t>{0, 1});
+        residency.set_budget(0);
+        residency.evict(evicted);
+        CHECK(evicted.size() == 3);
+        CHECK(residency.num_resident() == 0);
+        CHECK(residency.resident_bytes() == 0);
+    }
+
+    SUBCASE("maximum count") {
+        residency.set_budget(SIZE_MAX);
+        residency.set_max_resident(2);
+        CHECK(residency.max_resident() == 2);
+        for (uint32_t i = 0; i < 4; i++) {
+            residency.use(i);
+            residency.next_frame();
+        }
+        residency.evict(evicted);
+        CHECK(evicted == std::vector<uint32_t>{0, 1});
+        CHECK(residency.num_resident() == 2);
+
+        // A frame can go over the count by the resources it uses.
+        evicted.clear();
+        residency.use(0);
+        residency.use(1);
+        residency.use(2);
+        residency.evict(evicted);
+        CHECK(evicted == std::vector<uint32_t>{3});
+        CHECK(residency.num_resident() == 3);
+        residency.next_frame();
+        residency.evict(evicted);
+        CHECK(evicted == std::vector<uint32_t>{3, 0});
+        CHECK(residency.num_resident() == 2);
+    }
+}
+
+TEST_CASE("ResidencyLRU matches a reference LRU") {
+    std::mt19937 rng(7);
+    const uint32_t num_resources = 64;
+    const size_t budget = 4000;
+    ResidencyLRU residency(budget);
+    std::vector<size_t> sizes;
+    for (uint32_t i = 0; i < num_resources; i++) {
+        sizes.push_back(50 + rng() % 200);
+        residency.add(sizes.back());
+    }
+
+    // Reference: resident ids from the least to the most recently used.
+    std::list<uint32_t> lru;
+    std::vector<uint32_t> evicted;
+    for (int frame = 0; frame < 500; frame++) {
+        std::vector<uint32_t> used;
+        for (int i = 0; i < 10; i++) {
+            uint32_t id = rng() % num_resources;
+            used.push_back(id);
+            auto it = std::find(lru.begin(), lru.end(), id);
+            REQUIRE(residency.use(id) == (it != lru.end()));
+            if (it != lru.end()) {
+                lru.erase(it);
+            }
+            lru.push_back(id);
+        }
+
+        evicted.clear();
+        residency.evict(evicted);
+        size_t resident_bytes = 0;
+        for (uint32_t id : lru) {
+            resident_bytes += sizes[id];
+        }
+        std::vector<uint32_t> expected;
+        while (resident_bytes > budget && std::find(used.begin(), used.end(), lru.front()) == used.end()) {
+            expected.push_back(lru.front());
+            resident_bytes -= sizes[lru.front()];
+            lru.pop_front();
+        }
+        REQUIRE(evicted == expected);
+        CHECK(residency.resident_bytes() == resident_bytes);
+        CHECK(residency.num_resident() == lru.size());
+        residency.next_frame();
+    }
+}
+
+TEST_CASE("next_mip_stage") {
+    // A 64x64 RGBA8 chain.
+    const size_t level_bytes[] = {16384, 4096, 1024, 256};
+    // Nothing uploaded: the tail first, then as much as the budget allows.
+    CHECK(next_mip_stage(level_bytes, 4, 4, 0, false) == -1);
+    CHECK(next_mip_stage(level_bytes, 4, 4, 0, true) == 3);
+    CHECK(next_mip_stage(level_bytes, 4, 4, 256, false) == 3);
+    CHECK(next_mip_stage(level_bytes, 4, 4, 5375, false) == 2);
+    CHECK(next_mip_stage(level_bytes, 4, 4, 5376, false) == 1);
+    CHECK(next_mip_stage(level_bytes, 4, 4, 1 << 20, false) == 0);
+    // A stage uploads the whole chain up to its level again.
+    CHECK(next_mip_stage(level_bytes, 4, 2, 1279, false) == -1);
+    CHECK(next_mip_stage(level_bytes, 4, 2, 1279, true) == 1);
+    CHECK(next_mip_stage(level_bytes, 4, 2, 21760, false) == 0);
+    // Fully uploaded.
+    CHECK(next_mip_stage(level_bytes, 4, 0, 1 << 20, true) == -1);
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,24 @@
+#include "common/simd.h"
+
+#include <doctest/doctest.h>
+
+TEST_SUITE_BEGIN("simd");
+
+TEST_CASE("movemask_u32") {
+#if defined(SIMD_USE_SSE2)
+    __m128 values = _mm_setr_ps(1.0f, -2.0f, 3.0f, -4.0f);
+    CHECK(movemask_u32(_mm_cmpgt_ps(values, _mm_setzero_ps())) == 0x5);
+    CHECK(movemask_u32(_mm_cmplt_ps(values, _mm_setzero_ps())) == 0xA);
+    CHECK(movemask_u32(_mm_cmpeq_ps(values, values)) == 0xF);
+    CHECK(movemask_u32(_mm_setzero_ps()) == 0);
+#elif defined(SIMD_USE_NEON)
+    const float lanes[4] = {1.0f, -2.0f, 3.0f, -4.0f};
+    float32x4_t values = vld1q_f32(lanes);
+    CHECK(movemask_u32(vcgtq_f32(values, vdupq_n_f32(0.0f))) == 0x5);
+    CHECK(movemask_u32(vcltq_f32(values, vdupq_n_f32(0.0f))) == 0xA);
+    CHECK(movemask_u32(vceqq_f32(values, values)) == 0xF);
+    CHECK(movemask_u32(vdupq_n_u32(0)) == 0);
+#endif
+}
+
+TEST_SUITE_END();
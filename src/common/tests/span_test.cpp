@@ -0,0 +1,57 @@
+#include "common/span.h"
+
+#include <doctest/doctest.h>
+
+#include <vector>
+
+
+TEST_SUITE_BEGIN("span");
+
+TEST_CASE("Span basic operations") {
+    std::vector<int> values = {1, 2, 3, 4, 5};
+
+    SUBCASE("default span is empty") {
+        Span<int> span;
+        CHECK(span.empty());
+        CHECK(span.size() == 0);
+        CHECK(span.begin() == span.end());
+    }
+
+    SUBCASE("element access") {
+        Span<int> span(values.data(), values.size());
+        CHECK(!span.empty());
+        CHECK(span.size() == 5);
+        CHECK(span.size_bytes() == 5 * sizeof(int));
+        CHECK(span[0] == 1);
+        CHECK(span[4] == 5);
+        span[2] = 10;
+        CHECK(values[2] == 10);
+    }
+
+    SUBCASE("iteration") {
+        Span<int> span(values.data(), values.size());
+        int sum = 0;
+        for (int v : span) {
+            sum += v;
+        }
+        CHECK(sum == 15);
+    }
+
+    SUBCASE("subspan") {
+        Span<int> span(values.data(), values.size());
+        Span<int> sub = span.subspan(1, 3);
+        CHECK(sub.size() == 3);
+        CHECK(sub[0] == 2);
+        CHECK(sub[2] == 4);
+        CHECK(span.subspan(5, 0).empty());
+    }
+
+    SUBCASE("conversion to const span") {
+        Span<int> span(values.data(), values.size());
+        Span<const int> const_span = span;
+        CHECK(const_span.data() == values.data());
+        CHECK(const_span.size() == values.size());
+    }
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,151 @@
+#include "common/texture_compression.h"
+
+#include <doctest/doctest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "common/image.h"
+
+
+TEST_SUITE_BEGIN("texture_compression");
+
+namespace {
+
+// Gradients with 8x8 checker cells and some noise, roughly like a game texture.
+std::vector<uint8_t> make_test_image(uint32_t width, uint32_t height, uint32_t seed) {
+    std::vector<uint8_t> result(size_t(width) * height * 4);
+    uint32_t state = seed * 2654435761u + 1;
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            state = state * 1664525u + 1013904223u;
+            int noise = int(state >> 28) - 8;
+            int checker = ((x / 8) ^ (y / 8)) & 1 ? 40 : 0;
+            int color[3] = {int(x * 3 / 2) + checker, int(y * 3 / 2) + noise, 100 + checker / 2 + noise};
+            uint8_t* pixel = &result[(size_t(y) * width + x) * 4];
+            for (int c = 0; c < 3; c++) {
+                pixel[c] = uint8_t(std::min(std::max(color[c], 0), 255));
+            }
+            pixel[3] = 255;
+        }
+    }
+    return result;
+}
+
+double compress_psnr(TextureFormat format, const std::vector<uint8_t>& image, uint32_t width, uint32_t height) {
+    std::vector<uint8_t> compressed(texture_image_size(format, width, height));
+    compress_rgba8(format, image.data(), width, height, compressed.data());
+    std::vector<uint8_t> decompressed(image.size());
+    decompress_rgba8(format, compressed.data(), width, height, decompressed.data());
+    return psnr_rgb8(image.data(), decompressed.data(), size_t(width) * height);
+}
+
+// Round trip checks shared by the formats.
+void check_compress_rgba8(TextureFormat format) {
+    SUBCASE("solid colors") {
+        // ETC modifiers are added to all the channels, so 5-bit base colors cannot be fixed up per channel.
+        int tolerance = format == TextureFormat::BC1 ? 3 : 6;
+        for (uint32_t seed = 0; seed < 64; seed++) {
+            uint8_t color[4] = {uint8_t(seed * 37), uint8_t(seed * 91 + 5), uint8_t(255 - seed * 13), 255};
+            std::vector<uint8_t> image;
+            for (int i = 0; i < 16; i++) {
+                image.insert(image.end(), color, color + 4);
+            }
+            uint8_t compressed[8];
+            compress_rgba8(format, image.data(), 4, 4, compressed);
+            uint8_t decompressed[64];
+            decompress_rgba8(format, compressed, 4, 4, decompressed);
+            for (int i = 0; i < 16; i++) {
+                for (int c = 0; c < 3; c++) {
+                    CHECK(std::abs(int(decompressed[i * 4 + c]) - int(color[c])) <= tolerance);
+                }
+                CHECK(decompressed[i * 4 + 3] == 255);
+            }
+        }
+    }
+
+    SUBCASE("quality") {
+        const uint32_t size = 128;
+        double psnr = compress_psnr(format, make_test_image(size, size, 1), size, size);
+        CHECK(psnr > 32.0);
+    }
+
+    SUBCASE("partial blocks") {
+        for (uint32_t size : {1u, 2u, 3u, 5u, 7u, 13u}) {
+            std::vector<uint8_t> image = make_test_image(size, size + 1, size);
+            CHECK(compress_psnr(format, image, size, size + 1) > 30.0);
+        }
+    }
+
+    SUBCASE("parallel gives the same result") {
+        const uint32_t width = 96;
+        const uint32_t height = 72;
+        std::vector<uint8_t> image = make_test_image(width, height, 2);
+        std::vector<uint8_t> sequential(texture_image_size(format, width, height));
+        compress_rgba8(format, image.data(), width, height, sequential.data());
+        std::vector<uint8_t> parallel(sequential.size());
+        compress_rgba8(format, image.data(), width, height, parallel.data(), true);
+        CHECK(parallel == sequential);
+    }
+}
+
+}  // namespace
+
+TEST_CASE("texture_image_size") {
+    CHECK(texture_image_size(TextureFormat::RGBA8, 5, 3) == 60);
+    CHECK(texture_image_size(TextureFormat::BC1, 16, 16) == 128);
+    CHECK(texture_image_size(TextureFormat::BC1, 1, 1) == 8);
+    CHECK(texture_image_size(TextureFormat::ETC2_RGB8, 5, 9) == 2 * 3 * 8);
+}
+
+TEST_CASE("compress_rgba8 BC1") {
+    check_compress_rgba8(TextureFormat::BC1);
+}
+
+TEST_CASE("compress_rgba8 ETC2") {
+    check_compress_rgba8(TextureFormat::ETC2_RGB8);
+}
+
+TEST_CASE("compress_rgba8 BC1 uses the opaque mode") {
+    std::vector<uint8_t> image = make_test_image(64, 64, 3);
+    std::vector<uint8_t> compressed(texture_image_size(TextureFormat::BC1, 64, 64));
+    compress_rgba8(TextureFormat::BC1, image.data(), 64, 64, compressed.data());
+    for (size_t i = 0; i < compressed.size(); i += 8) {
+        uint16_t color0 = uint16_t(compressed[i] | (compressed[i + 1] << 8));
+        uint16_t color1 = uint16_t(compressed[i + 2] | (compressed[i + 3] << 8));
+        uint32_t indices = uint32_t(compressed[i + 4]) | (uint32_t(compressed[i + 5]) << 8) |
+                           (uint32_t(compressed[i + 6]) << 16) | (uint32_t(compressed[i + 7]) << 24);
+        // With color0 <= color1 the index 3 is transparent black.
+        CHECK((color0 > color1 || indices == 0));
+    }
+}
+
+TEST_CASE("compress_rgba8 ETC2 uses the ETC1-compatible modes") {
+    // Subblocks with very different colors push the differential mode to its limits.
+    std::vector<uint8_t> image(16 * 16 * 4, 255);
+    for (size_t i = 0; i < 16 * 16; i++) {
+        bool left = (i % 16) % 4 < 2;
+        image[i * 4] = left ? 0 : 255;
+        image[i * 4 + 1] = left ? 255 : 0;
+        image[i * 4 + 2] = uint8_t(i);
+    }
+    std::vector<uint8_t> compressed(texture_image_size(TextureFormat::ETC2_RGB8, 16, 16));
+    compress_rgba8(TextureFormat::ETC2_RGB8, image.data(), 16, 16, compressed.data());
+    for (size_t i = 0; i < compressed.size(); i += 8) {
+        if ((compressed[i + 3] & 2) == 0) {
+            continue;
+        }
+        // In the differential mode the second base color must not overflow, otherwise ETC2 decoders switch to the
+        // T, H or planar modes.
+        for (int c = 0; c < 3; c++) {
+            int base = compressed[i + c] >> 3;
+            int delta = compressed[i + c] & 7;
+            delta = delta >= 4 ? delta - 8 : delta;
+            CHECK(base + delta >= 0);
+            CHECK(base + delta <= 31);
+        }
+    }
+}
+
+TEST_SUITE_END();
@@ -2,12 +2,14 @@
 
 #include <doctest/doctest.h>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <mutex>
 #include <semaphore>
 #include <thread>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include "common/sync.h"
@@ -92,6 +94,124 @@ TEST_CASE("ThreadPool submit_for") {
     }
 }
 
+TEST_CASE("ThreadPool run_for") {
+    SUBCASE("all indices are processed before return") {
+        ThreadPool pool("", 4);
+        const size_t range_size = 1000;
+        std::vector<int> results(range_size, 0);
+
+        pool.run_for([&results](size_t index) { results[index] = int(index * 2); }, range_size);
+
+        for (size_t i = 0; i < range_size; i++) {
+            CHECK(results[i] == static_cast<int>(i * 2));
+        }
+    }
+
+    SUBCASE("empty and single element ranges") {
+        ThreadPool pool("", 2);
+        std::atomic<int> counter = 0;
+
+        pool.run_for([&counter](size_t) { counter.fetch_add(1); }, 0);
+        CHECK(counter.load() == 0);
+
+        pool.run_for([&counter](size_t index) { counter.fetch_add(int(index) + 1); }, 1);
+        CHECK(counter.load() == 1);
+    }
+
+    SUBCASE("calling thread takes part in the work") {
+        ThreadPool pool("", 1);
+        std::mutex mutex;
+        std::unordered_set<std::thread::id> thread_ids;
+
+        // Block the only worker until the calling thread has processed at least one index.
+        std::atomic_flag caller_ran = false;
+        pool.submit([&caller_ran] {
+            while (!caller_ran.test()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+        pool.run_for(
+            [&mutex, &thread_ids, &caller_ran](size_t) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    thread_ids.insert(std::this_thread::get_id());
+                }
+                caller_ran.test_and_set();
+            },
+            100);
+
+        CHECK(thread_ids.count(std::this_thread::get_id()) == 1);
+    }
+
+    SUBCASE("nested run_for inside the thread pool does not deadlock") {
+        ThreadPool pool("", 2);
+        const size_t num_outer = 8;
+        const size_t num_inner = 100;
+        std::atomic<size_t> sum = 0;
+        TaskLatch outer_complete(num_outer);
+
+        // Each outer task occupies a worker and waits for its inner range, which would deadlock with TaskLatch.
+        pool.submit_for(
+            [&sum, &outer_complete](size_t i) {
+                thread_pool().run_for([&sum, i](size_t j) { sum.fetch_add(i * num_inner + j); }, num_inner);
+                outer_complete.count_down();
+            },
+            num_outer);
+
+        outer_complete.wait();
+        pool.shutdown();
+
+        size_t total = num_outer * num_inner;
+        CHECK(sum.load() == total * (total - 1) / 2);
+    }
+
+    SUBCASE("run_for after shutdown runs on the calling thread") {
+        ThreadPool pool("", 2);
+        pool.shutdown();
+
+        std::atomic<int> counter = 0;
+        pool.run_for([&counter](size_t) { counter.fetch_add(1); }, 10);
+        CHECK(counter.load() == 10);
+    }
+}
+
+TEST_CASE("ThreadPool run_for_chunked") {
+    ThreadPool pool("", 4);
+    for (bool parallel : {false, true}) {
+        CAPTURE(parallel);
+        for (size_t n : {size_t(0), size_t(1), size_t(99), size_t(100), size_t(1001)}) {
+            CAPTURE(n);
+            std::vector<int> counts(n, 0);
+            std::mutex mutex;
+            std::vector<std::pair<size_t, size_t>> chunks;
+            pool.run_for_chunked(
+                [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; i++) {
+                        counts[i]++;
+                    }
+                    std::lock_guard<std::mutex> lock(mutex);
+                    chunks.push_back({begin, end});
+                },
+                n, 100, parallel);
+            CHECK(std::count(counts.begin(), counts.end(), 1) == int(n));
+            CHECK(chunks.size() == (n + 99) / 100);
+            std::sort(chunks.begin(), chunks.end());
+            for (size_t i = 0; i < chunks.size(); i++) {
+                CHECK(chunks[i].first == i * 100);
+                CHECK(chunks[i].second == std::min(n, (i + 1) * 100));
+            }
+        }
+    }
+
+    // A chunk size of 0 is taken as 1.
+    std::vector<int> counts(5, 0);
+    pool.run_for_chunked(
+        [&](size_t begin, size_t end) { counts[begin] += int(end - begin); },
+        counts.size(), 0);
+    CHECK(std::count(counts.begin(), counts.end(), 1) == 5);
+    pool.shutdown();
+}
+
 TEST_CASE("ThreadPool shutdown behavior") {
     SUBCASE("shutdown waits for tasks to complete") {
         ThreadPool pool("", 1);
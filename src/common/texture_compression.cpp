@@ -0,0 +1,642 @@
+#include "texture_compression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "simd.h"
+#include "thread.h"
+
+
+namespace {
+
+const size_t BLOCK_SIZE = 8;
+
+// 4x4 pixels as structure of arrays, so that 4 pixels can be processed at once.
+struct PixelBlock {
+    alignas(16) float r[16];
+    alignas(16) float g[16];
+    alignas(16) float b[16];
+};
+
+// Load the block at (block_x, block_y) in row-major order, the pixels outside of the image are clamped to the edge.
+void load_block(const uint8_t* src, uint32_t width, uint32_t height, uint32_t block_x, uint32_t block_y,
+                PixelBlock& block) {
+    for (uint32_t y = 0; y < 4; y++) {
+        uint32_t sy = std::min(block_y * 4 + y, height - 1);
+        for (uint32_t x = 0; x < 4; x++) {
+            uint32_t sx = std::min(block_x * 4 + x, width - 1);
+            const uint8_t* pixel = src + (size_t(sy) * width + sx) * 4;
+            block.r[y * 4 + x] = pixel[0];
+            block.g[y * 4 + x] = pixel[1];
+            block.b[y * 4 + x] = pixel[2];
+        }
+    }
+}
+
+// Select the closest of the 4 palette colors for count pixels (a multiple of 4) and return the sum of squared errors.
+// Arrays r, g, b must be 16-byte aligned.
+float select_indices(const float* r, const float* g, const float* b, int count, const float palette[4][3],
+                     uint8_t* indices) {
+#if defined(SIMD_USE_SSE2)
+    __m128 total = _mm_setzero_ps();
+    for (int i = 0; i < count; i += 4) {
+        __m128 pr = _mm_load_ps(r + i);
+        __m128 pg = _mm_load_ps(g + i);
+        __m128 pb = _mm_load_ps(b + i);
+        __m128 best = _mm_set1_ps(1e30f);
+        __m128i best_index = _mm_setzero_si128();
+        for (int k = 0; k < 4; k++) {
+            __m128 dr = _mm_sub_ps(pr, _mm_set1_ps(palette[k][0]));
+            __m128 dg = _mm_sub_ps(pg, _mm_set1_ps(palette[k][1]));
+            __m128 db = _mm_sub_ps(pb, _mm_set1_ps(palette[k][2]));
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+            __m128i less = _mm_castps_si128(_mm_cmplt_ps(d, best));
+            best = _mm_min_ps(d, best);
+            best_index = _mm_or_si128(_mm_andnot_si128(less, best_index), _mm_and_si128(less, _mm_set1_epi32(k)));
+        }
+        total = _mm_add_ps(total, best);
+        alignas(16) int32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), best_index);
+        for (int j = 0; j < 4; j++) {
+            indices[i + j] = uint8_t(lanes[j]);
+        }
+    }
+    alignas(16) float sums[4];
+    _mm_store_ps(sums, total);
+    return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+#elif defined(SIMD_USE_NEON)
+    float32x4_t total = vdupq_n_f32(0.0f);
+    for (int i = 0; i < count; i += 4) {
+        float32x4_t pr = vld1q_f32(r + i);
+        float32x4_t pg = vld1q_f32(g + i);
+        float32x4_t pb = vld1q_f32(b + i);
+        float32x4_t best = vdupq_n_f32(1e30f);
+        uint32x4_t best_index = vdupq_n_u32(0);
+        for (int k = 0; k < 4; k++) {
+            float32x4_t dr = vsubq_f32(pr, vdupq_n_f32(palette[k][0]));
+            float32x4_t dg = vsubq_f32(pg, vdupq_n_f32(palette[k][1]));
+            float32x4_t db = vsubq_f32(pb, vdupq_n_f32(palette[k][2]));
+            float32x4_t d = vaddq_f32(vaddq_f32(vmulq_f32(dr, dr), vmulq_f32(dg, dg)), vmulq_f32(db, db));
+            uint32x4_t less = vcltq_f32(d, best);
+            best = vminq_f32(d, best);
+            best_index = vbslq_u32(less, vdupq_n_u32(uint32_t(k)), best_index);
+        }
+        total = vaddq_f32(total, best);
+        uint32_t lanes[4];
+        vst1q_u32(lanes, best_index);
+        for (int j = 0; j < 4; j++) {
+            indices[i + j] = uint8_t(lanes[j]);
+        }
+    }
+    float sums[4];
+    vst1q_f32(sums, total);
+    return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+#else
+    float total = 0.0f;
+    for (int i = 0; i < count; i++) {
+        float best = 1e30f;
+        uint8_t best_index = 0;
+        for (int k = 0; k < 4; k++) {
+            float dr = r[i] - palette[k][0];
+            float dg = g[i] - palette[k][1];
+            float db = b[i] - palette[k][2];
+            float d = dr * dr + dg * dg + db * db;
+            if (d < best) {
+                best = d;
+                best_index = uint8_t(k);
+            }
+        }
+        total += best;
+        indices[i] = best_index;
+    }
+    return total;
+#endif
+}
+
+int quantize(float v, int max_value) {
+    int result = int(std::lround(v * float(max_value) / 255.0f));
+    return std::min(std::max(result, 0), max_value);
+}
+
+int expand4(int v) {
+    return (v << 4) | v;
+}
+
+int expand5(int v) {
+    return (v << 3) | (v >> 2);
+}
+
+int expand6(int v) {
+    return (v << 2) | (v >> 4);
+}
+
+// BC1
+
+uint16_t pack_565(const float color[3]) {
+    return uint16_t((quantize(color[0], 31) << 11) | (quantize(color[1], 63) << 5) | quantize(color[2], 31));
+}
+
+void unpack_565(uint16_t color, int rgb[3]) {
+    rgb[0] = expand5(color >> 11);
+    rgb[1] = expand6((color >> 5) & 63);
+    rgb[2] = expand5(color & 31);
+}
+
+// Palette of the 4-color mode, the interpolation matches the integer rounding of the common decoders.
+void bc1_palette(uint16_t color0, uint16_t color1, int palette[4][3]) {
+    unpack_565(color0, palette[0]);
+    unpack_565(color1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+}
+
+// Endpoints reproducing each 8-bit value as the palette entry 2 (2/3 * color0 + 1/3 * color1), used for blocks of a
+// single color.
+struct BC1SolidTables {
+    uint8_t endpoints5[256][2];
+    uint8_t endpoints6[256][2];
+
+    BC1SolidTables() {
+        build(endpoints5, 31, expand5);
+        build(endpoints6, 63, expand6);
+    }
+
+    static void build(uint8_t table[256][2], int max_value, int (*expand)(int)) {
+        for (int v = 0; v < 256; v++) {
+            int best_error = 256;
+            for (int a = 0; a <= max_value; a++) {
+                for (int b = 0; b <= max_value; b++) {
+                    int error = std::abs((2 * expand(a) + expand(b)) / 3 - v);
+                    if (error < best_error) {
+                        best_error = error;
+                        table[v][0] = uint8_t(a);
+                        table[v][1] = uint8_t(b);
+                    }
+                }
+            }
+        }
+    }
+};
+
+const BC1SolidTables& bc1_solid_tables() {
+    static BC1SolidTables tables;
+    return tables;
+}
+
+void write_bc1_block(uint16_t color0, uint16_t color1, uint32_t indices, uint8_t* dst) {
+    dst[0] = uint8_t(color0);
+    dst[1] = uint8_t(color0 >> 8);
+    dst[2] = uint8_t(color1);
+    dst[3] = uint8_t(color1 >> 8);
+    dst[4] = uint8_t(indices);
+    dst[5] = uint8_t(indices >> 8);
+    dst[6] = uint8_t(indices >> 16);
+    dst[7] = uint8_t(indices >> 24);
+}
+
+// Return the error of the 4-color palette from the endpoints and fill the pixel indices.
+float evaluate_bc1(const PixelBlock& block, uint16_t color0, uint16_t color1, uint8_t indices[16]) {
+    int palette[4][3];
+    bc1_palette(color0, color1, palette);
+    float palette_f[4][3];
+    for (int k = 0; k < 4; k++) {
+        for (int c = 0; c < 3; c++) {
+            palette_f[k][c] = float(palette[k][c]);
+        }
+    }
+    return select_indices(block.r, block.g, block.b, 16, palette_f, indices);
+}
+
+// Least squares fit of the endpoints for the given indices. Return false if all the pixels use the same weight.
+bool fit_bc1_endpoints(const PixelBlock& block, const uint8_t indices[16], float color0[3], float color1[3]) {
+    static const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    float aa = 0.0f;
+    float ab = 0.0f;
+    float bb = 0.0f;
+    float ax[3] = {};
+    float bx[3] = {};
+    const float* channels[3] = {block.r, block.g, block.b};
+    for (int i = 0; i < 16; i++) {
+        float a = weights[indices[i]];
+        float b = 1.0f - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < 3; c++) {
+            ax[c] += a * channels[c][i];
+            bx[c] += b * channels[c][i];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (std::fabs(det) < 1e-6f) {
+        return false;
+    }
+    for (int c = 0; c < 3; c++) {
+        color0[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / det, 0.0f), 255.0f);
+        color1[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / det, 0.0f), 255.0f);
+    }
+    return true;
+}
+
+void encode_bc1_block(const PixelBlock& block, uint8_t* dst) {
+    const float* channels[3] = {block.r, block.g, block.b};
+    float mean[3] = {};
+    float min_value[3] = {255.0f, 255.0f, 255.0f};
+    float max_value[3] = {};
+    for (int c = 0; c < 3; c++) {
+        for (int i = 0; i < 16; i++) {
+            mean[c] += channels[c][i];
+            min_value[c] = std::min(min_value[c], channels[c][i]);
+            max_value[c] = std::max(max_value[c], channels[c][i]);
+        }
+        mean[c] /= 16.0f;
+    }
+
+    if (min_value[0] == max_value[0] && min_value[1] == max_value[1] && min_value[2] == max_value[2]) {
+        const BC1SolidTables& tables = bc1_solid_tables();
+        int r = int(max_value[0]);
+        int g = int(max_value[1]);
+        int b = int(max_value[2]);
+        uint16_t color0 = uint16_t((tables.endpoints5[r][0] << 11) | (tables.endpoints6[g][0] << 5) |
+                                   tables.endpoints5[b][0]);
+        uint16_t color1 = uint16_t((tables.endpoints5[r][1] << 11) | (tables.endpoints6[g][1] << 5) |
+                                   tables.endpoints5[b][1]);
+        if (color0 > color1) {
+            write_bc1_block(color0, color1, 0xaaaaaaaau, dst);
+        } else if (color0 < color1) {
+            // The palette entry 3 of the swapped endpoints is the same color.
+            write_bc1_block(color1, color0, 0xffffffffu, dst);
+        } else {
+            write_bc1_block(color0, color1, 0, dst);
+        }
+        return;
+    }
+
+    // Principal axis of the colors by power iteration over the covariance matrix.
+    float cov[6] = {};
+    for (int i = 0; i < 16; i++) {
+        float r = block.r[i] - mean[0];
+        float g = block.g[i] - mean[1];
+        float b = block.b[i] - mean[2];
+        cov[0] += r * r;
+        cov[1] += r * g;
+        cov[2] += r * b;
+        cov[3] += g * g;
+        cov[4] += g * b;
+        cov[5] += b * b;
+    }
+    float axis[3] = {max_value[0] - min_value[0], max_value[1] - min_value[1], max_value[2] - min_value[2]};
+    for (int iteration = 0; iteration < 4; iteration++) {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        float norm = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+        if (norm < 1e-6f) {
+            break;
+        }
+        axis[0] = x / norm;
+        axis[1] = y / norm;
+        axis[2] = z / norm;
+    }
+
+    // The extreme pixels along the axis are the initial endpoints.
+    int min_index = 0;
+    int max_index = 0;
+    float min_dot = 1e30f;
+    float max_dot = -1e30f;
+    for (int i = 0; i < 16; i++) {
+        float dot = block.r[i] * axis[0] + block.g[i] * axis[1] + block.b[i] * axis[2];
+        if (dot < min_dot) {
+            min_dot = dot;
+            min_index = i;
+        }
+        if (dot > max_dot) {
+            max_dot = dot;
+            max_index = i;
+        }
+    }
+    float endpoint0[3] = {block.r[max_index], block.g[max_index], block.b[max_index]};
+    float endpoint1[3] = {block.r[min_index], block.g[min_index], block.b[min_index]};
+
+    uint16_t best_color0 = pack_565(endpoint0);
+    uint16_t best_color1 = pack_565(endpoint1);
+    uint8_t best_indices[16];
+    float best_error = evaluate_bc1(block, best_color0, best_color1, best_indices);
+    for (int iteration = 0; iteration < 2; iteration++) {
+        if (!fit_bc1_endpoints(block, best_indices, endpoint0, endpoint1)) {
+            break;
+        }
+        uint16_t color0 = pack_565(endpoint0);
+        uint16_t color1 = pack_565(endpoint1);
+        uint8_t indices[16];
+        float error = evaluate_bc1(block, color0, color1, indices);
+        if (error >= best_error) {
+            break;
+        }
+        best_error = error;
+        best_color0 = color0;
+        best_color1 = color1;
+        memcpy(best_indices, indices, sizeof(indices));
+    }
+
+    // The 4-color mode requires color0 > color1, swapping the endpoints swaps the indices 0 <-> 1 and 2 <-> 3.
+    uint32_t swap = 0;
+    if (best_color0 < best_color1) {
+        std::swap(best_color0, best_color1);
+        swap = 1;
+    }
+    uint32_t packed_indices = 0;
+    if (best_color0 != best_color1) {
+        for (int i = 0; i < 16; i++) {
+            packed_indices |= (best_indices[i] ^ swap) << (i * 2);
+        }
+    }
+    write_bc1_block(best_color0, best_color1, packed_indices, dst);
+}
+
+void decode_bc1_block(const uint8_t* src, uint8_t pixels[16][4]) {
+    uint16_t color0 = uint16_t(src[0] | (src[1] << 8));
+    uint16_t color1 = uint16_t(src[2] | (src[3] << 8));
+    uint32_t indices = uint32_t(src[4]) | (uint32_t(src[5]) << 8) | (uint32_t(src[6]) << 16) |
+                       (uint32_t(src[7]) << 24);
+    int palette[4][3];
+    bc1_palette(color0, color1, palette);
+    if (color0 <= color1) {
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    for (int i = 0; i < 16; i++) {
+        const int* color = palette[(indices >> (i * 2)) & 3];
+        pixels[i][0] = uint8_t(color[0]);
+        pixels[i][1] = uint8_t(color[1]);
+        pixels[i][2] = uint8_t(color[2]);
+        pixels[i][3] = 255;
+    }
+}
+
+// ETC1-compatible modes of ETC2
+
+// Modifiers for the pixel index values 0..3 of each table.
+const int ETC_MODIFIERS[8][4] = {
+    {2, 8, -2, -8},
+    {5, 17, -5, -17},
+    {9, 29, -9, -29},
+    {13, 42, -13, -42},
+    {18, 60, -18, -60},
+    {24, 80, -24, -80},
+    {33, 106, -33, -106},
+    {47, 183, -47, -183},
+};
+
+// Pixel positions (row-major index in the block) of the two subblocks, for flip 0 (2x4 side by side) and flip 1 (4x2
+// on top of each other).
+const uint8_t ETC_SUBBLOCK_PIXELS[2][2][8] = {
+    {{0, 1, 4, 5, 8, 9, 12, 13}, {2, 3, 6, 7, 10, 11, 14, 15}},
+    {{0, 1, 2, 3, 4, 5, 6, 7}, {8, 9, 10, 11, 12, 13, 14, 15}},
+};
+
+struct SubBlock {
+    alignas(16) float r[8];
+    alignas(16) float g[8];
+    alignas(16) float b[8];
+    float mean[3];
+};
+
+struct SubBlockEncoding {
+    int table = 0;
+    float error = 0.0f;
+    uint8_t indices[8] = {};
+};
+
+// Select the best modifier table for the base color.
+SubBlockEncoding encode_etc_subblock(const SubBlock& subblock, const int base[3]) {
+    SubBlockEncoding result;
+    result.error = 1e30f;
+    for (int table = 0; table < 8; table++) {
+        float palette[4][3];
+        for (int k = 0; k < 4; k++) {
+            for (int c = 0; c < 3; c++) {
+                palette[k][c] = float(std::min(std::max(base[c] + ETC_MODIFIERS[table][k], 0), 255));
+            }
+        }
+        uint8_t indices[8];
+        float error = select_indices(subblock.r, subblock.g, subblock.b, 8, palette, indices);
+        if (error < result.error) {
+            result.table = table;
+            result.error = error;
+            memcpy(result.indices, indices, sizeof(indices));
+        }
+    }
+    return result;
+}
+
+struct ETCBlockEncoding {
+    float error = 1e30f;
+    uint32_t high = 0;
+    uint32_t low = 0;
+};
+
+// Pixel index bits are stored per column: the pixel (x, y) has bit x * 4 + y, the most significant bits of the index
+// values are in the upper half of the word.
+uint32_t pack_etc_indices(int flip, const SubBlockEncoding subblocks[2]) {
+    uint32_t result = 0;
+    for (int s = 0; s < 2; s++) {
+        for (int i = 0; i < 8; i++) {
+            int pixel = ETC_SUBBLOCK_PIXELS[flip][s][i];
+            int bit = (pixel & 3) * 4 + (pixel >> 2);
+            uint32_t value = subblocks[s].indices[i];
+            result |= ((value >> 1) << (bit + 16)) | ((value & 1) << bit);
+        }
+    }
+    return result;
+}
+
+void try_etc_flip(const PixelBlock& block, int flip, ETCBlockEncoding& best) {
+    SubBlock subblocks[2];
+    for (int s = 0; s < 2; s++) {
+        SubBlock& subblock = subblocks[s];
+        float sum[3] = {};
+        for (int i = 0; i < 8; i++) {
+            int pixel = ETC_SUBBLOCK_PIXELS[flip][s][i];
+            subblock.r[i] = block.r[pixel];
+            subblock.g[i] = block.g[pixel];
+            subblock.b[i] = block.b[pixel];
+            sum[0] += block.r[pixel];
+            sum[1] += block.g[pixel];
+            sum[2] += block.b[pixel];
+        }
+        for (int c = 0; c < 3; c++) {
+            subblock.mean[c] = sum[c] / 8.0f;
+        }
+    }
+
+    // Individual mode: two 4-bit base colors.
+    {
+        int quantized[2][3];
+        SubBlockEncoding encodings[2];
+        for (int s = 0; s < 2; s++) {
+            int base[3];
+            for (int c = 0; c < 3; c++) {
+                quantized[s][c] = quantize(subblocks[s].mean[c], 15);
+                base[c] = expand4(quantized[s][c]);
+            }
+            encodings[s] = encode_etc_subblock(subblocks[s], base);
+        }
+        float error = encodings[0].error + encodings[1].error;
+        if (error < best.error) {
+            best.error = error;
+            best.high = (uint32_t(quantized[0][0]) << 28) | (uint32_t(quantized[1][0]) << 24) |
+                        (uint32_t(quantized[0][1]) << 20) | (uint32_t(quantized[1][1]) << 16) |
+                        (uint32_t(quantized[0][2]) << 12) | (uint32_t(quantized[1][2]) << 8) |
+                        (uint32_t(encodings[0].table) << 5) | (uint32_t(encodings[1].table) << 2) | uint32_t(flip);
+            best.low = pack_etc_indices(flip, encodings);
+        }
+    }
+
+    // Differential mode: 5-bit base color and 3-bit signed delta for the second subblock. The delta is clamped, so the
+    // second color never overflows into the ETC2-only modes.
+    {
+        int quantized[3];
+        int delta[3];
+        int bases[2][3];
+        for (int c = 0; c < 3; c++) {
+            quantized[c] = quantize(subblocks[0].mean[c], 31);
+            delta[c] = std::min(std::max(quantize(subblocks[1].mean[c], 31) - quantized[c], -4), 3);
+            bases[0][c] = expand5(quantized[c]);
+            bases[1][c] = expand5(quantized[c] + delta[c]);
+        }
+        SubBlockEncoding encodings[2];
+        encodings[0] = encode_etc_subblock(subblocks[0], bases[0]);
+        encodings[1] = encode_etc_subblock(subblocks[1], bases[1]);
+        float error = encodings[0].error + encodings[1].error;
+        if (error < best.error) {
+            best.error = error;
+            best.high = (uint32_t(quantized[0]) << 27) | (uint32_t(delta[0] & 7) << 24) |
+                        (uint32_t(quantized[1]) << 19) | (uint32_t(delta[1] & 7) << 16) |
+                        (uint32_t(quantized[2]) << 11) | (uint32_t(delta[2] & 7) << 8) |
+                        (uint32_t(encodings[0].table) << 5) | (uint32_t(encodings[1].table) << 2) | (1u << 1) |
+                        uint32_t(flip);
+            best.low = pack_etc_indices(flip, encodings);
+        }
+    }
+}
+
+void encode_etc_block(const PixelBlock& block, uint8_t* dst) {
+    ETCBlockEncoding best;
+    try_etc_flip(block, 0, best);
+    try_etc_flip(block, 1, best);
+    // Blocks are stored big-endian.
+    for (int i = 0; i < 4; i++) {
+        dst[i] = uint8_t(best.high >> (24 - i * 8));
+        dst[i + 4] = uint8_t(best.low >> (24 - i * 8));
+    }
+}
+
+int sign_extend3(uint32_t v) {
+    return (v & 4) ? int(v) - 8 : int(v);
+}
+
+void decode_etc_block(const uint8_t* src, uint8_t pixels[16][4]) {
+    uint32_t high = (uint32_t(src[0]) << 24) | (uint32_t(src[1]) << 16) | (uint32_t(src[2]) << 8) | src[3];
+    uint32_t low = (uint32_t(src[4]) << 24) | (uint32_t(src[5]) << 16) | (uint32_t(src[6]) << 8) | src[7];
+    int flip = int(high & 1);
+    int bases[2][3];
+    if (high & 2) {
+        for (int c = 0; c < 3; c++) {
+            int shift = 27 - c * 8;
+            int base = int((high >> shift) & 31);
+            bases[0][c] = expand5(base);
+            bases[1][c] = expand5((base + sign_extend3((high >> (shift - 3)) & 7)) & 31);
+        }
+    } else {
+        for (int c = 0; c < 3; c++) {
+            int shift = 28 - c * 8;
+            bases[0][c] = expand4(int((high >> shift) & 15));
+            bases[1][c] = expand4(int((high >> (shift - 4)) & 15));
+        }
+    }
+    int tables[2] = {int((high >> 5) & 7), int((high >> 2) & 7)};
+    for (int s = 0; s < 2; s++) {
+        for (int i = 0; i < 8; i++) {
+            int pixel = ETC_SUBBLOCK_PIXELS[flip][s][i];
+            int bit = (pixel & 3) * 4 + (pixel >> 2);
+            uint32_t value = (((low >> (bit + 16)) & 1) << 1) | ((low >> bit) & 1);
+            int modifier = ETC_MODIFIERS[tables[s]][value];
+            for (int c = 0; c < 3; c++) {
+                pixels[pixel][c] = uint8_t(std::min(std::max(bases[s][c] + modifier, 0), 255));
+            }
+            pixels[pixel][3] = 255;
+        }
+    }
+}
+
+}  // namespace
+
+size_t texture_image_size(TextureFormat format, uint32_t width, uint32_t height) {
+    if (!texture_format_is_compressed(format)) {
+        return size_t(width) * height * 4;
+    }
+    return size_t((width + 3) / 4) * ((height + 3) / 4) * BLOCK_SIZE;
+}
+
+void compress_rgba8(TextureFormat format, const uint8_t* src, uint32_t width, uint32_t height, uint8_t* dst,
+                    bool parallel) {
+    if (!texture_format_is_compressed(format)) {
+        abort();
+    }
+    uint32_t blocks_x = (width + 3) / 4;
+    uint32_t blocks_y = (height + 3) / 4;
+    auto compress_row = [&](size_t block_y) {
+        uint8_t* dst_row = dst + block_y * blocks_x * BLOCK_SIZE;
+        PixelBlock block;
+        for (uint32_t block_x = 0; block_x < blocks_x; block_x++) {
+            load_block(src, width, height, block_x, uint32_t(block_y), block);
+            if (format == TextureFormat::BC1) {
+                encode_bc1_block(block, dst_row + block_x * BLOCK_SIZE);
+            } else {
+                encode_etc_block(block, dst_row + block_x * BLOCK_SIZE);
+            }
+        }
+    };
+    if (format == TextureFormat::BC1) {
+        // Build the tables before the threads race for them.
+        bc1_solid_tables();
+    }
+    if (parallel && blocks_y > 1) {
+        thread_pool().run_for(compress_row, blocks_y);
+    } else {
+        for (uint32_t block_y = 0; block_y < blocks_y; block_y++) {
+            compress_row(block_y);
+        }
+    }
+}
+
+void decompress_rgba8(TextureFormat format, const uint8_t* src, uint32_t width, uint32_t height, uint8_t* dst) {
+    if (!texture_format_is_compressed(format)) {
+        abort();
+    }
+    uint32_t blocks_x = (width + 3) / 4;
+    uint32_t blocks_y = (height + 3) / 4;
+    for (uint32_t block_y = 0; block_y < blocks_y; block_y++) {
+        for (uint32_t block_x = 0; block_x < blocks_x; block_x++) {
+            uint8_t pixels[16][4];
+            const uint8_t* block = src + (size_t(block_y) * blocks_x + block_x) * BLOCK_SIZE;
+            if (format == TextureFormat::BC1) {
+                decode_bc1_block(block, pixels);
+            } else {
+                decode_etc_block(block, pixels);
+            }
+            for (uint32_t y = 0; y < 4 && block_y * 4 + y < height; y++) {
+                for (uint32_t x = 0; x < 4 && block_x * 4 + x < width; x++) {
+                    memcpy(dst + (size_t(block_y * 4 + y) * width + block_x * 4 + x) * 4, pixels[y * 4 + x], 4);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Pixel formats of the textures prepared on the CPU.
+enum class TextureFormat {
+    // 4 bytes per pixel.
+    RGBA8,
+    // Opaque BC1 (DXT1): 8 bytes per 4x4 block, desktop GPUs.
+    BC1,
+    // Opaque ETC2: 8 bytes per 4x4 block, GLES3 / WebGL2. Only the ETC1-compatible modes are produced.
+    ETC2_RGB8,
+};
+
+// Return true if the format is made of 4x4 blocks.
+inline bool texture_format_is_compressed(TextureFormat format) {
+    return format != TextureFormat::RGBA8;
+}
+
+// Return the size in bytes of a width x height image, compressed images are padded to whole 4x4 blocks.
+size_t texture_image_size(TextureFormat format, uint32_t width, uint32_t height);
+
+// Compress RGBA8 image of width x height pixels into dst of texture_image_size(format, width, height) bytes. Alpha is
+// ignored. The blocks on the right and bottom edges are padded by replicating the edge pixels. If parallel is true, the
+// rows of blocks are compressed on thread_pool(). The format must be compressed.
+void compress_rgba8(TextureFormat format, const uint8_t* src, uint32_t width, uint32_t height, uint8_t* dst,
+                    bool parallel = false);
+
+// Decompress image produced by compress_rgba8() into RGBA8 pixels with alpha 255. For ETC2_RGB8 only the
+// ETC1-compatible modes are decoded.
+void decompress_rgba8(TextureFormat format, const uint8_t* src, uint32_t width, uint32_t height, uint8_t* dst);
@@ -1,5 +1,6 @@
 #include "thread.h"
 
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
 #include <cstddef>
@@ -142,6 +143,42 @@ struct ThreadPool::Impl {
     }
 };
 
+// Shared between run_for() and the helper tasks. The helper tasks may start after run_for() has returned, so the state
+// is reference-counted and func is only accessed by the helpers which claimed an index before the range was exhausted.
+struct ThreadPool::RunForState {
+    const std::function<void(size_t)>* func = nullptr;
+    size_t n = 0;
+    std::atomic<size_t> next = 0;
+    std::atomic<size_t> completed = 0;
+
+    std::mutex mutex;
+    std::condition_variable condvar;
+
+    void run() {
+        size_t num_completed = 0;
+        while (true) {
+            size_t idx = next.fetch_add(1);
+            if (idx >= n) {
+                break;
+            }
+            (*func)(idx);
+            num_completed++;
+        }
+        if (num_completed > 0 && completed.fetch_add(num_completed) + num_completed == n) {
+            {
+                // See TaskLatch::count_down() for the reason of the empty lock.
+                std::lock_guard<std::mutex> lock(mutex);
+            }
+            condvar.notify_all();
+        }
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        condvar.wait(lock, [this] { return completed.load() == n; });
+    }
+};
+
 
 ThreadPool::ThreadPool(const char* name, size_t num_threads) : impl(new Impl()) {
     impl->init(name, num_threads, this);
@@ -167,6 +204,47 @@ const char* ThreadPool::name() const {
     return impl->name.c_str();
 }
 
+void ThreadPool::run_for(const std::function<void(size_t)>& f, size_t n) {
+    if (n == 0) {
+        return;
+    }
+    if (n == 1) {
+        f(0);
+        return;
+    }
+
+    std::shared_ptr<RunForState> state = std::make_shared<RunForState>();
+    state->func = &f;
+    state->n = n;
+    // The calling thread takes part in the work, so at most n - 1 helpers are required.
+    size_t num_helpers = std::min(num_threads(), n - 1);
+    for (size_t i = 0; i < num_helpers; i++) {
+        if (!submit([state] { state->run(); })) {
+            break;
+        }
+    }
+    state->run();
+    // All indices have been claimed at this point, wait for the calls running on the workers.
+    state->wait();
+}
+
+void ThreadPool::run_for_chunked(const std::function<void(size_t begin, size_t end)>& f, size_t n, size_t chunk_size,
+                                 bool parallel) {
+    chunk_size = std::max(chunk_size, size_t(1));
+    size_t num_chunks = (n + chunk_size - 1) / chunk_size;
+    auto run_chunk = [&](size_t chunk) {
+        size_t begin = chunk * chunk_size;
+        f(begin, std::min(begin + chunk_size, n));
+    };
+    if (parallel) {
+        run_for(run_chunk, num_chunks);
+    } else {
+        for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+            run_chunk(chunk);
+        }
+    }
+}
+
 bool ThreadPool::submit_impl(Task&& task) {
     return impl->submit(std::move(task));
 }
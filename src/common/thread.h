@@ -35,6 +35,19 @@ public:
         return submit_impl({nullptr, std::forward<F>(f), 0, n});
     }
 
+    // Run f(index) for each index in the range 0..n-1 (inclusive) on the pool workers and the calling thread, return
+    // after all the calls have completed. Unlike waiting for submit_for() with TaskLatch, this can be called from
+    // ThreadPool tasks: the calling thread runs the indices which have not been picked up by the workers and then
+    // waits only for the calls which are already running. If the pool has been shutdown, all calls are run on the
+    // calling thread.
+    void run_for(const std::function<void(size_t)>& f, size_t n);
+
+    // Split the range 0..n-1 into chunks of chunk_size indices, at least 1, and call f(begin, end) for each chunk with
+    // run_for(), so that tasks are not scheduled per index. If parallel is false, the chunks are run in order on the
+    // calling thread.
+    void run_for_chunked(const std::function<void(size_t begin, size_t end)>& f, size_t n, size_t chunk_size,
+                         bool parallel = true);
+
     // Return the number of tasks added to the pool and not complete.
     size_t num_inflight_tasks();
 
@@ -51,6 +64,7 @@ private:
     std::unique_ptr<Impl> impl;
 
     struct TaskLatch;
+    struct RunForState;
 
     struct Task {
         // This could've been a union, but making unions in C++ sucks and std::function is 32 bytes anyway.
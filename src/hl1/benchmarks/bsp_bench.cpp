@@ -0,0 +1,69 @@
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/benchmarks/bench.h"
+#include "common/io.h"
+#include "hl1/bsp.h"
+#include "hl1/tests/bsp_test_map.h"
+
+
+TEST_SUITE_BEGIN("bsp_bench");
+
+namespace {
+
+void bench_parse(const char* name, const std::vector<FileContents>& files) {
+    if (files.empty()) {
+        return;
+    }
+    size_t total_bytes = 0;
+    size_t num_faces = 0;
+    for (const FileContents& file : files) {
+        BSPParser bsp;
+        if (bsp.parse(file)) {
+            num_faces += bsp.faces.size();
+        }
+        total_bytes += file.contents.size();
+    }
+    double seconds = bench_seconds_per_call([&] {
+        for (const FileContents& file : files) {
+            BSPParser bsp;
+            bsp.parse(file);
+        }
+    });
+    printf("BSPParser %s: %zu maps, %.1f MiB, %zu faces: %.3f us per map, %.1f GiB/s\n", name, files.size(),
+           double(total_bytes) / (1024 * 1024), num_faces, seconds * 1e6 / double(files.size()),
+           double(total_bytes) / seconds / (1024.0 * 1024 * 1024));
+}
+
+}  // namespace
+
+TEST_CASE("BSPParser synthetic") {
+    std::vector<FileContents> files;
+    for (uint32_t seed = 0; seed < 4; seed++) {
+        TestBSPOptions options;
+        options.size[0] = 32;
+        options.size[1] = 32;
+        options.size[2] = 6;
+        options.seed = seed;
+        files.push_back(make_test_bsp(options).file);
+    }
+    bench_parse("synthetic", files);
+}
+
+TEST_CASE("BSPParser data set") {
+    std::vector<FileContents> files;
+    for (const std::string& path : bench_map_paths()) {
+        FileContents file;
+        if (file_read_contents(path.c_str(), file)) {
+            files.push_back(std::move(file));
+        }
+    }
+    bench_parse("data set", files);
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,85 @@
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/benchmarks/bench.h"
+#include "common/io.h"
+#include "common/thread.h"
+#include "hl1/bsp_decode.h"
+#include "hl1/tests/bsp_test_map.h"
+
+
+TEST_SUITE_BEGIN("bsp_decode_bench");
+
+namespace {
+
+// Compare the time of the concurrent decoding with the sum of the task times, which is what decoding the lumps one
+// after another costs.
+void bench_decode(const char* name, const std::vector<FileContents>& files) {
+    std::vector<BSPParser> maps;
+    for (const FileContents& file : files) {
+        BSPParser bsp;
+        if (bsp.parse(file)) {
+            maps.push_back(std::move(bsp));
+        }
+    }
+    if (maps.empty()) {
+        return;
+    }
+
+    double task_ms[BSP_NUM_DECODE_TASKS] = {};
+    double sum_ms = 0;
+    double total_ms = 0;
+    size_t num_decoded = 0;
+    double seconds = bench_seconds_per_call([&] {
+        for (const BSPParser& bsp : maps) {
+            BSPDecodedLumps lumps;
+            decode_bsp_lumps(bsp, lumps);
+            for (int task = 0; task < BSP_NUM_DECODE_TASKS; task++) {
+                task_ms[task] += lumps.task_ms[task];
+                sum_ms += lumps.task_ms[task];
+            }
+            total_ms += lumps.total_ms;
+            num_decoded++;
+        }
+    });
+    printf("decode_bsp_lumps %s: %zu maps, %zu threads: %.3f ms per map, sum of tasks %.3f ms\n", name, maps.size(),
+           thread_pool().num_threads(), seconds * 1e3 / double(maps.size()), sum_ms / double(num_decoded));
+    for (int task = 0; task < BSP_NUM_DECODE_TASKS; task++) {
+        printf("    %-10s %.3f ms\n", bsp_decode_task_name(BSPDecodeTask(task)), task_ms[task] / double(num_decoded));
+    }
+}
+
+}  // namespace
+
+TEST_CASE("decode_bsp_lumps synthetic") {
+    std::vector<FileContents> files;
+    for (uint32_t seed = 0; seed < 4; seed++) {
+        TestBSPOptions options;
+        options.size[0] = 32;
+        options.size[1] = 32;
+        options.size[2] = 6;
+        options.seed = seed;
+        options.num_textures = 16;
+        options.num_styles = 2;
+        files.push_back(make_test_bsp(options).file);
+    }
+    bench_decode("synthetic", files);
+}
+
+TEST_CASE("decode_bsp_lumps data set") {
+    std::vector<FileContents> files;
+    for (const std::string& path : bench_map_paths()) {
+        FileContents file;
+        if (file_read_contents(path.c_str(), file)) {
+            files.push_back(std::move(file));
+        }
+    }
+    bench_decode("data set", files);
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,141 @@
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "common/benchmarks/bench.h"
+#include "common/io.h"
+#include "common/thread.h"
+#include "hl1/bsp_entities.h"
+#include "hl1/tests/bsp_test_map.h"
+
+
+TEST_SUITE_BEGIN("bsp_entities_bench");
+
+namespace {
+
+// Entity with a copy of each key and value, as a naive parser builds them.
+using CopiedEntity = std::vector<std::pair<std::string, std::string>>;
+
+// Split the text into entities copying the keys and the values, without the error checks.
+size_t parse_copying(std::string_view text, std::vector<CopiedEntity>& out) {
+    out.clear();
+    std::string strings[2];
+    int num_strings = 0;
+    for (size_t pos = 0; pos < text.size(); pos++) {
+        if (text[pos] == '{') {
+            out.emplace_back();
+        } else if (text[pos] == '"' && !out.empty()) {
+            size_t end = text.find('"', pos + 1);
+            if (end == std::string_view::npos) {
+                break;
+            }
+            strings[num_strings++] = std::string(text.substr(pos + 1, end - pos - 1));
+            if (num_strings == 2) {
+                out.back().emplace_back(std::move(strings[0]), std::move(strings[1]));
+                num_strings = 0;
+            }
+            pos = end;
+        }
+    }
+    return out.size();
+}
+
+// Compare the copying parser with BSPEntities on the entities of all the maps, then look up the classname, the
+// origin and the angles of all the entities.
+void bench_entities(const char* name, const std::vector<FileContents>& files) {
+    std::vector<BSPParser> maps;
+    size_t num_chars = 0;
+    for (const FileContents& file : files) {
+        BSPParser bsp;
+        if (bsp.parse(file)) {
+            num_chars += bsp.entities.size();
+            maps.push_back(std::move(bsp));
+        }
+    }
+    if (maps.empty()) {
+        return;
+    }
+    double mb = double(num_chars) / (1024.0 * 1024.0);
+    printf("BSPEntities %s: %zu maps, %.2f MB of entities, %zu threads\n", name, maps.size(), mb,
+           thread_pool().num_threads());
+
+    std::vector<CopiedEntity> copied;
+    size_t num_entities = 0;
+    double seconds = bench_seconds_per_call([&] {
+        num_entities = 0;
+        for (const BSPParser& bsp : maps) {
+            num_entities += parse_copying(bsp.entities, copied);
+        }
+    });
+    printf("    copying strings: %.3f ms, %.1f MB/s, %zu entities\n", seconds * 1e3, mb / seconds, num_entities);
+
+    BSPEntities entities;
+    for (bool parallel : {false, true}) {
+        seconds = bench_seconds_per_call([&] {
+            for (const BSPParser& bsp : maps) {
+                entities.parse(bsp.entities, bsp.name.c_str(), parallel);
+            }
+        });
+        printf("    BSPEntities %s: %.3f ms, %.1f MB/s\n", parallel ? "parallel" : "sequential", seconds * 1e3,
+               mb / seconds);
+    }
+
+    size_t num_lookups = 0;
+    size_t num_found = 0;
+    std::vector<BSPEntities> parsed(maps.size());
+    for (size_t i = 0; i < maps.size(); i++) {
+        parsed[i].parse(maps[i].entities, maps[i].name.c_str());
+    }
+    seconds = bench_seconds_per_call([&] {
+        for (const BSPEntities& map_entities : parsed) {
+            for (size_t entity = 0; entity < map_entities.size(); entity++) {
+                float origin[3];
+                float angles[3];
+                num_found += map_entities.classname(entity).empty() ? 0 : 1;
+                num_found += map_entities.origin(entity, origin) ? 1 : 0;
+                num_found += map_entities.angles(entity, angles) ? 1 : 0;
+                num_lookups += 3;
+            }
+            num_found += map_entities.find_classname("light").empty() ? 0 : 1;
+            num_lookups++;
+        }
+    });
+    size_t total_entities = 0;
+    for (const BSPEntities& map_entities : parsed) {
+        total_entities += map_entities.size();
+    }
+    printf("    classname, origin and angles of %zu entities and lights: %.3f ms, %.1f ns per lookup, %.0f%% found\n",
+           total_entities, seconds * 1e3, seconds * 1e9 / double(total_entities * 3 + parsed.size()),
+           100.0 * double(num_found) / double(num_lookups));
+}
+
+}  // namespace
+
+TEST_CASE("BSPEntities synthetic") {
+    std::vector<FileContents> files;
+    for (uint32_t seed = 0; seed < 4; seed++) {
+        TestBSPOptions options;
+        options.seed = seed;
+        options.num_entities = 5000;
+        files.push_back(make_test_bsp(options).file);
+    }
+    bench_entities("synthetic", files);
+}
+
+TEST_CASE("BSPEntities data set") {
+    std::vector<FileContents> files;
+    for (const std::string& path : bench_map_paths()) {
+        FileContents file;
+        if (file_read_contents(path.c_str(), file)) {
+            files.push_back(std::move(file));
+        }
+    }
+    bench_entities("data set", files);
+}
+
+TEST_SUITE_END();
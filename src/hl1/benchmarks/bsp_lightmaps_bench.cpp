@@ -0,0 +1,38 @@
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "common/benchmarks/bench.h"
+#include "common/thread.h"
+#include "hl1/bsp_lightmaps.h"
+#include "hl1/tests/bsp_test_map.h"
+
+
+TEST_SUITE_BEGIN("bsp_lightmaps_bench");
+
+TEST_CASE("BSPLightmapAtlas synthetic") {
+    TestBSPOptions options;
+    options.size[0] = 48;
+    options.size[1] = 48;
+    options.size[2] = 6;
+    options.num_styles = 2;
+    TestBSP map = make_test_bsp(options);
+    BSPParser bsp;
+    BSPDecodedLumps lumps;
+    REQUIRE(bsp.parse(map.file));
+    REQUIRE(decode_bsp_lumps(bsp, lumps));
+
+    for (bool parallel : {false, true}) {
+        BSPLightmapAtlasOptions atlas_options;
+        atlas_options.parallel = parallel;
+        BSPLightmapAtlas atlas;
+        double seconds = bench_seconds_per_call([&] { atlas.build(bsp, lumps.lightmaps, atlas_options); });
+        printf("BSPLightmapAtlas %s (%zu threads): %zu faces, %zu pages, %.1f%% efficiency: %.3f ms\n",
+               parallel ? "parallel" : "sequential", parallel ? thread_pool().num_threads() : size_t(1),
+               bsp.faces.size(), atlas.pages.size(), atlas.efficiency * 100.0, seconds * 1e3);
+    }
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,40 @@
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "common/benchmarks/bench.h"
+#include "common/thread.h"
+#include "hl1/bsp_mesh.h"
+#include "hl1/tests/bsp_test_map.h"
+
+
+TEST_SUITE_BEGIN("bsp_mesh_bench");
+
+TEST_CASE("BSPMesh synthetic") {
+    TestBSPOptions options;
+    options.size[0] = 48;
+    options.size[1] = 48;
+    options.size[2] = 6;
+    options.num_textures = 32;
+    TestBSP map = make_test_bsp(options);
+    BSPParser bsp;
+    BSPDecodedLumps lumps;
+    BSPLightmapAtlas lightmaps;
+    REQUIRE(bsp.parse(map.file));
+    REQUIRE(decode_bsp_lumps(bsp, lumps));
+    REQUIRE(lightmaps.build(bsp, lumps.lightmaps));
+
+    for (bool parallel : {false, true}) {
+        BSPMeshOptions mesh_options;
+        mesh_options.parallel = parallel;
+        BSPMesh mesh;
+        double seconds = bench_seconds_per_call([&] { mesh.build(bsp, lumps, lightmaps, mesh_options); });
+        printf("BSPMesh %s (%zu threads): %zu faces, %zu vertices, %zu triangles, %zu batches: %.3f ms\n",
+               parallel ? "parallel" : "sequential", parallel ? thread_pool().num_threads() : size_t(1),
+               bsp.faces.size(), mesh.vertices.size(), mesh.indices.size() / 3, mesh.batches.size(), seconds * 1e3);
+    }
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,143 @@
+#include <doctest/doctest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "common/benchmarks/bench.h"
+#include "common/io.h"
+#include "hl1/bsp_occlusion.h"
+#include "hl1/tests/bsp_test_map.h"
+
+
+TEST_SUITE_BEGIN("bsp_occlusion_bench");
+
+namespace {
+
+const int BUFFER_WIDTH = 256;
+const int BUFFER_HEIGHT = 144;
+
+size_t num_triangles(const BSPVisibleSet& visible) {
+    size_t num_indices = 0;
+    for (const BSPMeshBatch& range : visible.ranges) {
+        num_indices += range.num_indices;
+    }
+    return num_indices / 3;
+}
+
+// Walk a fixed camera path through the leaf centers, turning a quarter per frame, and compare the frames culled by
+// the PVS and the frustum with the frames also culled by the occluders.
+void bench_occlusion(const char* name, const FileContents& file) {
+    BSPParser bsp;
+    BSPDecodedLumps lumps;
+    BSPLightmapAtlas lightmaps;
+    BSPMesh mesh;
+    BSPVisibility vis;
+    BSPOcclusion occlusion;
+    if (!bsp.parse(file) || !decode_bsp_lumps(bsp, lumps) || !lightmaps.build(bsp, lumps.lightmaps) ||
+        !mesh.build(bsp, lumps, lightmaps) || !vis.init(bsp, mesh, true)) {
+        return;
+    }
+    double init_seconds = bench_seconds_per_call([&] { occlusion.init(bsp, lumps); });
+    if (!occlusion.init(bsp, lumps)) {
+        return;
+    }
+
+    std::vector<OcclusionView> views;
+    for (size_t leaf_idx = 1; leaf_idx < bsp.leaves.size(); leaf_idx++) {
+        const BSPLeaf& leaf = bsp.leaves[leaf_idx];
+        OcclusionView view;
+        for (int i = 0; i < 3; i++) {
+            view.position[i] = (float(leaf.mins[i]) + float(leaf.maxs[i])) * 0.5f;
+        }
+        float yaw = float(leaf_idx % 4) * 1.5707963f + 0.4f;
+        view.forward[0] = std::cos(yaw);
+        view.forward[1] = std::sin(yaw);
+        view.forward[2] = 0.0f;
+        view.right[0] = std::sin(yaw);
+        view.right[1] = -std::cos(yaw);
+        view.right[2] = 0.0f;
+        view.tan_half_fov_y = 0.5625f;
+        // Skip the positions in solid space, where the PVS is everything.
+        if (vis.find_leaf(view.position) != 0) {
+            views.push_back(view);
+        }
+    }
+    if (views.empty()) {
+        return;
+    }
+    auto frustum_for = [](const OcclusionView& view) {
+        Frustum frustum;
+        frustum.set_perspective(view.position, view.forward, view.right, view.up, view.tan_half_fov_x,
+                                view.tan_half_fov_y, view.near_dist, 8192.0f);
+        return frustum;
+    };
+
+    BSPVisibleSet visible;
+    size_t num_frames = 0;
+    size_t num_visible = 0;
+    double seconds = bench_seconds_per_call([&] {
+        for (const OcclusionView& view : views) {
+            vis.find_visible_leaves(view.position, visible);
+            vis.cull_leaves(frustum_for(view), visible);
+            vis.find_visible_faces(visible);
+            num_visible += num_triangles(visible);
+            num_frames++;
+        }
+    });
+    double frustum_triangles = double(num_visible) / double(num_frames);
+    printf("BSPOcclusion %s: %zu faces, %zu occluders, init %.3f ms, PVS and frustum %.3f ms per frame, "
+           "%.0f triangles\n",
+           name, bsp.faces.size(), occlusion.first_vertices.size() - 1, init_seconds * 1e3,
+           seconds * 1e3 / double(views.size()), frustum_triangles);
+
+    OcclusionBuffer buffer;
+    buffer.init(BUFFER_WIDTH, BUFFER_HEIGHT);
+    for (bool parallel : {false, true}) {
+        num_frames = 0;
+        num_visible = 0;
+        size_t num_occluders = 0;
+        seconds = bench_seconds_per_call([&] {
+            for (const OcclusionView& view : views) {
+                vis.find_visible_leaves(view.position, visible);
+                vis.cull_leaves(frustum_for(view), visible);
+                vis.find_visible_faces(visible);
+                occlusion.render(view, visible, buffer, parallel);
+                vis.find_unoccluded_faces(buffer, visible);
+                num_occluders += buffer.num_occluders();
+                num_visible += num_triangles(visible);
+                num_frames++;
+            }
+        });
+        double triangles = double(num_visible) / double(num_frames);
+        printf("BSPOcclusion %s %s %dx%d: %.3f ms per frame, %.0f occluders, %.0f triangles, %.1f%% culled\n", name,
+               parallel ? "parallel" : "sequential", BUFFER_WIDTH, BUFFER_HEIGHT,
+               seconds * 1e3 / double(views.size()), double(num_occluders) / double(num_frames), triangles,
+               frustum_triangles > 0.0 ? 100.0 * (1.0 - triangles / frustum_triangles) : 0.0);
+    }
+}
+
+}  // namespace
+
+TEST_CASE("BSPOcclusion synthetic") {
+    TestBSPOptions options;
+    options.size[0] = 48;
+    options.size[1] = 48;
+    options.size[2] = 6;
+    options.num_textures = 32;
+    options.vis_radius = 8;
+    bench_occlusion("synthetic", make_test_bsp(options).file);
+}
+
+TEST_CASE("BSPOcclusion data set") {
+    for (const std::string& path : bench_map_paths()) {
+        FileContents file;
+        if (file_read_contents(path.c_str(), file)) {
+            bench_occlusion(path.c_str(), file);
+        }
+    }
+}
+
+TEST_SUITE_END();
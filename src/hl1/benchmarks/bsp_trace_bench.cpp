@@ -0,0 +1,91 @@
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "common/benchmarks/bench.h"
+#include "common/io.h"
+#include "common/thread.h"
+#include "hl1/bsp_trace.h"
+#include "hl1/tests/bsp_test_map.h"
+
+
+TEST_SUITE_BEGIN("bsp_trace_bench");
+
+namespace {
+
+const size_t NUM_MOVES = 1 << 14;
+
+// Moves between random points of the model bounds. Short moves cover a few units like the steps of the movement code,
+// long moves cross the map like picking.
+std::vector<BSPRay> random_moves(const BSPParser& bsp, float max_length) {
+    const BSPModel& world = bsp.models[0];
+    uint32_t rng = 12345;
+    auto random_float = [&]() {
+        rng = rng * 1664525u + 1013904223u;
+        return float(rng >> 8) / float(1 << 24);
+    };
+    std::vector<BSPRay> moves(NUM_MOVES);
+    for (BSPRay& move : moves) {
+        for (int i = 0; i < 3; i++) {
+            move.start[i] = world.mins[i] + random_float() * (world.maxs[i] - world.mins[i]);
+            move.end[i] = move.start[i] + (random_float() * 2.0f - 1.0f) * max_length;
+        }
+    }
+    return moves;
+}
+
+void bench_traces(const char* name, const FileContents& file) {
+    BSPParser bsp;
+    BSPHulls hulls;
+    if (!bsp.parse(file) || !hulls.build(bsp)) {
+        return;
+    }
+    double build_seconds = bench_seconds_per_call([&] { hulls.build(bsp); });
+    printf("BSPHulls %s: %zu nodes, %zu non-axial planes, build %.3f ms\n", name, hulls.nodes.size(),
+           hulls.normals.size() / 3, build_seconds * 1e3);
+
+    for (float max_length : {16.0f, 4096.0f}) {
+        std::vector<BSPRay> moves = random_moves(bsp, max_length);
+        std::vector<BSPTrace> traces(moves.size());
+        for (int hull = 0; hull < BSP_NUM_HULLS; hull++) {
+            double seconds = bench_seconds_per_call([&] {
+                hulls.trace_moves(hull, moves.data(), moves.size(), traces.data());
+            });
+            double parallel_seconds = bench_seconds_per_call([&] {
+                hulls.trace_moves(hull, moves.data(), moves.size(), traces.data(), true);
+            });
+            size_t num_impacts = 0;
+            for (const BSPTrace& trace : traces) {
+                num_impacts += trace.fraction < 1.0f && !trace.start_solid ? 1 : 0;
+            }
+            printf("    hull %d, moves up to %g units: %.2f M traces/s, parallel (%zu threads) %.2f M traces/s, "
+                   "%.1f%% impacts\n",
+                   hull, double(max_length), 1e-6 * double(moves.size()) / seconds, thread_pool().num_threads(),
+                   1e-6 * double(moves.size()) / parallel_seconds, 100.0 * double(num_impacts) / double(moves.size()));
+        }
+    }
+}
+
+}  // namespace
+
+TEST_CASE("BSPHulls synthetic") {
+    TestBSPOptions options;
+    options.size[0] = 48;
+    options.size[1] = 48;
+    options.size[2] = 6;
+    bench_traces("synthetic", make_test_bsp(options).file);
+}
+
+TEST_CASE("BSPHulls data set") {
+    for (const std::string& path : bench_map_paths()) {
+        FileContents file;
+        if (file_read_contents(path.c_str(), file)) {
+            bench_traces(path.c_str(), file);
+        }
+    }
+}
+
+TEST_SUITE_END();
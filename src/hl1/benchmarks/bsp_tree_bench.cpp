@@ -0,0 +1,134 @@
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "common/benchmarks/bench.h"
+#include "common/io.h"
+#include "common/thread.h"
+#include "hl1/bsp_tree.h"
+#include "hl1/tests/bsp_test_map.h"
+
+
+TEST_SUITE_BEGIN("bsp_tree_bench");
+
+namespace {
+
+const size_t NUM_QUERIES = 1 << 16;
+const size_t RAYS_PER_START = 16;
+
+// Leaf lookup on the on-disk nodes and planes, for comparison.
+int32_t find_leaf_on_disk(const BSPParser& bsp, const float point[3]) {
+    int32_t node_idx = bsp.models[0].head_nodes[0];
+    while (node_idx >= 0) {
+        const BSPNode& node = bsp.nodes[size_t(node_idx)];
+        const BSPPlane& plane = bsp.planes[node.plane];
+        float dist = uint32_t(plane.type) <= uint32_t(BSP_PLANE_Z)
+                         ? point[plane.type] - plane.dist
+                         : point[0] * plane.normal[0] + point[1] * plane.normal[1] + point[2] * plane.normal[2] -
+                               plane.dist;
+        node_idx = node.children[dist < 0.0f ? 1 : 0];
+    }
+    return -(node_idx + 1);
+}
+
+// Rays between random points of the model bounds, RAYS_PER_START rays from each start as from a camera. Coherent rays
+// end within a few units of each other like the rays of neighboring pixels.
+std::vector<BSPRay> random_rays(const BSPParser& bsp, size_t num_rays, bool coherent) {
+    const BSPModel& world = bsp.models[0];
+    uint32_t rng = 12345;
+    auto random_point = [&](float point[3]) {
+        for (int i = 0; i < 3; i++) {
+            rng = rng * 1664525u + 1013904223u;
+            point[i] = world.mins[i] + float(rng >> 8) / float(1 << 24) * (world.maxs[i] - world.mins[i]);
+        }
+    };
+    std::vector<BSPRay> rays(num_rays);
+    for (size_t i = 0; i < num_rays; i++) {
+        if (i % RAYS_PER_START == 0) {
+            random_point(rays[i].start);
+        } else {
+            memcpy(rays[i].start, rays[i - 1].start, sizeof(rays[i].start));
+        }
+        random_point(rays[i].end);
+        if (coherent && i % RAYS_PER_START != 0) {
+            for (int axis = 0; axis < 3; axis++) {
+                rays[i].end[axis] = rays[i - 1].end[axis] + (rays[i].end[axis] - rays[i - 1].end[axis]) / 256.0f;
+            }
+        }
+    }
+    return rays;
+}
+
+void bench_tree(const char* name, const FileContents& file) {
+    BSPParser bsp;
+    BSPTree tree;
+    if (!bsp.parse(file) || !tree.build(bsp)) {
+        return;
+    }
+    double build_seconds = bench_seconds_per_call([&] { tree.build(bsp); });
+    printf("BSPTree %s: %zu nodes, %zu non-axial planes, depth %zu, build %.3f ms\n", name, tree.nodes.size(),
+           tree.normals.size() / 3, tree.depth, build_seconds * 1e3);
+
+    std::vector<BSPRay> rays = random_rays(bsp, NUM_QUERIES, false);
+    uint32_t leaf_sum = 0;
+    double on_disk_seconds = bench_seconds_per_call([&] {
+        for (const BSPRay& ray : rays) {
+            leaf_sum += uint32_t(find_leaf_on_disk(bsp, ray.end));
+        }
+    });
+    double tree_seconds = bench_seconds_per_call([&] {
+        for (const BSPRay& ray : rays) {
+            leaf_sum -= uint32_t(tree.find_leaf(ray.end));
+        }
+    });
+    printf("    find_leaf: on-disk nodes %.2f M/s, tree %.2f M/s (%u)\n", 1e-6 * double(rays.size()) / on_disk_seconds,
+           1e-6 * double(rays.size()) / tree_seconds, leaf_sum);
+
+    for (bool coherent : {false, true}) {
+        rays = random_rays(bsp, NUM_QUERIES, coherent);
+        std::vector<BSPRayHit> hits(rays.size());
+        size_t num_hits = 0;
+        double single_seconds = bench_seconds_per_call([&] {
+            for (size_t i = 0; i < rays.size(); i++) {
+                hits[i] = tree.cast_ray(rays[i]);
+            }
+        });
+        for (const BSPRayHit& hit : hits) {
+            num_hits += hit.face >= 0 ? 1 : 0;
+        }
+        double packet_seconds =
+            bench_seconds_per_call([&] { tree.cast_rays(rays.data(), rays.size(), hits.data()); });
+        double parallel_seconds =
+            bench_seconds_per_call([&] { tree.cast_rays(rays.data(), rays.size(), hits.data(), true); });
+        printf("    cast_ray %s: %.2f M/s, packets %.2f M/s, parallel packets (%zu threads) %.2f M/s, %.1f%% hit "
+               "faces\n",
+               coherent ? "coherent" : "random", 1e-6 * double(rays.size()) / single_seconds,
+               1e-6 * double(rays.size()) / packet_seconds, thread_pool().num_threads(),
+               1e-6 * double(rays.size()) / parallel_seconds, 100.0 * double(num_hits) / double(rays.size()));
+    }
+}
+
+}  // namespace
+
+TEST_CASE("BSPTree synthetic") {
+    TestBSPOptions options;
+    options.size[0] = 48;
+    options.size[1] = 48;
+    options.size[2] = 6;
+    bench_tree("synthetic", make_test_bsp(options).file);
+}
+
+TEST_CASE("BSPTree data set") {
+    for (const std::string& path : bench_map_paths()) {
+        FileContents file;
+        if (file_read_contents(path.c_str(), file)) {
+            bench_tree(path.c_str(), file);
+        }
+    }
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,121 @@
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "common/benchmarks/bench.h"
+#include "common/bitset.h"
+#include "common/io.h"
+#include "hl1/bsp_vis.h"
+#include "hl1/tests/bsp_test_map.h"
+
+
+TEST_SUITE_BEGIN("bsp_vis_bench");
+
+namespace {
+
+// Query the visible set from the center of every leaf, with the PVS rows decompressed on first use or up front.
+void bench_vis(const char* name, const FileContents& file) {
+    BSPParser bsp;
+    BSPDecodedLumps lumps;
+    BSPLightmapAtlas lightmaps;
+    BSPMesh mesh;
+    if (!bsp.parse(file) || !decode_bsp_lumps(bsp, lumps) || !lightmaps.build(bsp, lumps.lightmaps) ||
+        !mesh.build(bsp, lumps, lightmaps)) {
+        return;
+    }
+    std::vector<float> positions;
+    for (size_t leaf_idx = 1; leaf_idx < bsp.leaves.size(); leaf_idx++) {
+        const BSPLeaf& leaf = bsp.leaves[leaf_idx];
+        for (int i = 0; i < 3; i++) {
+            positions.push_back((float(leaf.mins[i]) + float(leaf.maxs[i])) * 0.5f);
+        }
+    }
+    size_t num_positions = positions.size() / 3;
+    if (num_positions == 0) {
+        return;
+    }
+
+    for (bool decompress_all : {false, true}) {
+        BSPVisibility vis;
+        double init_seconds = bench_seconds_per_call([&] { vis.init(bsp, mesh, decompress_all); });
+        BSPVisibleSet visible;
+        size_t num_leaves = 0;
+        size_t num_faces = 0;
+        size_t num_ranges = 0;
+        size_t num_batches = 0;
+        size_t num_queries = 0;
+        double seconds = bench_seconds_per_call([&] {
+            for (size_t i = 0; i < num_positions; i++) {
+                vis.find_visible_set(&positions[i * 3], visible);
+                num_leaves += bitset_count(visible.leaves.data(), visible.leaves.size());
+                num_faces += visible.face_list.size();
+                num_ranges += visible.ranges.size();
+                num_batches += visible.num_batches;
+                num_queries++;
+            }
+        });
+        double n = double(num_queries);
+        printf("BSPVisibility %s %s: %zu leaves, %zu faces, init %.3f ms, %.2f us per position, visible %.0f leaves, "
+               "%.0f faces in %.0f ranges of %.1f batches\n",
+               name, decompress_all ? "eager" : "lazy", bsp.leaves.size(), bsp.faces.size(), init_seconds * 1e3,
+               seconds * 1e6 / double(num_positions), double(num_leaves) / n, double(num_faces) / n,
+               double(num_ranges) / n, double(num_batches) / n);
+    }
+
+    // Frustum culling of the PVS leaves and of the brush models, looking along +x from each position.
+    BSPVisibility vis;
+    vis.init(bsp, mesh, true);
+    BSPVisibleSet visible;
+    const float forward[3] = {1.0f, 0.0f, 0.0f};
+    const float right[3] = {0.0f, -1.0f, 0.0f};
+    const float up[3] = {0.0f, 0.0f, 1.0f};
+    for (bool parallel : {false, true}) {
+        size_t num_pvs_leaves = 0;
+        size_t num_leaves = 0;
+        size_t num_models = 0;
+        size_t num_queries = 0;
+        double seconds = bench_seconds_per_call([&] {
+            for (size_t i = 0; i < num_positions; i++) {
+                Frustum frustum;
+                frustum.set_perspective(&positions[i * 3], forward, right, up, 1.0f, 0.75f, 4.0f, 8192.0f);
+                vis.find_visible_leaves(&positions[i * 3], visible);
+                num_pvs_leaves += bitset_count(visible.leaves.data(), visible.leaves.size());
+                vis.cull_leaves(frustum, visible, parallel);
+                vis.cull_models(frustum, visible, parallel);
+                num_leaves += bitset_count(visible.leaves.data(), visible.leaves.size());
+                num_models += visible.models.size();
+                num_queries++;
+            }
+        });
+        double n = double(num_queries);
+        printf("BSPVisibility %s frustum %s: %.2f us per position, %.0f of %.0f PVS leaves, %.1f of %zu models\n", name,
+               parallel ? "parallel" : "sequential", seconds * 1e6 / double(num_positions), double(num_leaves) / n,
+               double(num_pvs_leaves) / n, double(num_models) / n, bsp.models.size() - 1);
+    }
+}
+
+}  // namespace
+
+TEST_CASE("BSPVisibility synthetic") {
+    TestBSPOptions options;
+    options.size[0] = 48;
+    options.size[1] = 48;
+    options.size[2] = 6;
+    options.num_textures = 32;
+    options.vis_radius = 4;
+    bench_vis("synthetic", make_test_bsp(options).file);
+}
+
+TEST_CASE("BSPVisibility data set") {
+    for (const std::string& path : bench_map_paths()) {
+        FileContents file;
+        if (file_read_contents(path.c_str(), file)) {
+            bench_vis(path.c_str(), file);
+        }
+    }
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,51 @@
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "common/benchmarks/bench.h"
+#include "hl1/texture_filter.h"
+
+
+TEST_SUITE_BEGIN("texture_filter_bench");
+
+TEST_CASE("filter_texture_names") {
+    std::vector<std::string> names;
+    std::vector<WAD3TextureName> lower_names;
+    for (uint32_t i = 0; i < 200000; i++) {
+        const char* prefixes[] = {"+0~Wall_", "{Fence", "Floor", "!water", "c1a0_"};
+        std::string name = prefixes[i % 5] + std::to_string(i * 7);
+        lower_names.push_back(WAD3TextureName(name).to_lower());
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return char(tolower(c)); });
+        names.push_back(name);
+    }
+
+    for (std::string_view pattern : {"w", "fence", "0~wall_12", "missing"}) {
+        std::vector<uint32_t> matches;
+        double string_seconds = bench_seconds_per_call([&] {
+            matches.clear();
+            for (size_t i = 0; i < names.size(); i++) {
+                if (names[i].find(pattern) != std::string::npos) {
+                    matches.push_back(uint32_t(i));
+                }
+            }
+        });
+        size_t num_matches = matches.size();
+        double sequential_seconds =
+            bench_seconds_per_call([&] { filter_texture_names(lower_names, pattern, matches); });
+        CHECK(matches.size() == num_matches);
+        double parallel_seconds =
+            bench_seconds_per_call([&] { filter_texture_names(lower_names, pattern, matches, true); });
+        CHECK(matches.size() == num_matches);
+        printf("%zu names, \"%.*s\" (%zu matches): std::string::find %.3f ms, sequential %.3f ms, parallel %.3f ms\n",
+               names.size(), int(pattern.size()), pattern.data(), num_matches, string_seconds * 1000.0,
+               sequential_seconds * 1000.0, parallel_seconds * 1000.0);
+    }
+}
+
+TEST_SUITE_END();
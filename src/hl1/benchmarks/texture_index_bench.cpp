@@ -0,0 +1,97 @@
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "common/benchmarks/bench.h"
+#include "hl1/texture_index.h"
+
+
+TEST_SUITE_BEGIN("texture_index_bench");
+
+namespace {
+
+bool equals_ignore_case(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](unsigned char x, unsigned char y) {
+               return tolower(x) == tolower(y);
+           });
+}
+
+std::string to_lower(std::string_view name) {
+    std::string lower(name);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return char(tolower(c)); });
+    return lower;
+}
+
+}  // namespace
+
+TEST_CASE("TextureNameIndex lookups") {
+    // Roughly the size of the HL1 WADs, and a map with a few thousand faces.
+    std::vector<std::vector<std::string>> wads(8);
+    for (size_t i = 0; i < 4000; i++) {
+        wads[i % wads.size()].push_back("+0~Tex_" + std::to_string(i));
+    }
+    std::vector<std::vector<std::string_view>> wad_names;
+    for (const std::vector<std::string>& names : wads) {
+        wad_names.emplace_back(names.begin(), names.end());
+    }
+    std::vector<std::string> face_names;
+    for (size_t i = 0; i < 5000; i++) {
+        face_names.push_back("+0~TEX_" + std::to_string((i * 37) % 4400));
+    }
+
+    TextureNameIndex index;
+    double build_seconds = bench_seconds_per_call([&] { index.build(wad_names); });
+
+    size_t found = 0;
+    double index_seconds = bench_seconds_per_call([&] {
+        found = 0;
+        TextureRef ref;
+        for (const std::string& name : face_names) {
+            found += index.find(name, ref);
+        }
+    });
+
+    std::unordered_map<std::string, TextureRef> map;
+    for (size_t wad_idx = 0; wad_idx < wads.size(); wad_idx++) {
+        for (size_t texture_idx = 0; texture_idx < wads[wad_idx].size(); texture_idx++) {
+            map.emplace(to_lower(wads[wad_idx][texture_idx]), TextureRef{uint32_t(wad_idx), uint32_t(texture_idx)});
+        }
+    }
+    size_t map_found = 0;
+    double map_seconds = bench_seconds_per_call([&] {
+        map_found = 0;
+        for (const std::string& name : face_names) {
+            map_found += map.count(to_lower(name));
+        }
+    });
+
+    size_t scan_found = 0;
+    double scan_seconds = bench_seconds_per_call([&] {
+        scan_found = 0;
+        for (const std::string& name : face_names) {
+            for (const std::vector<std::string_view>& names : wad_names) {
+                auto it = std::find_if(names.begin(), names.end(),
+                                       [&](std::string_view other) { return equals_ignore_case(name, other); });
+                if (it != names.end()) {
+                    scan_found++;
+                    break;
+                }
+            }
+        }
+    });
+    CHECK(found == map_found);
+    CHECK(found == scan_found);
+
+    printf("%zu names, build: %.3f ms\n", index.size(), build_seconds * 1000.0);
+    printf("%zu lookups, %zu found: index %.1f us, unordered_map %.1f us, linear scan %.1f us\n", face_names.size(),
+           found, index_seconds * 1e6, map_seconds * 1e6, scan_seconds * 1e6);
+}
+
+TEST_SUITE_END();
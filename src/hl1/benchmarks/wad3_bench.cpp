@@ -0,0 +1,92 @@
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "common/benchmarks/bench.h"
+#include "common/io.h"
+#include "hl1/tests/hl1_test.h"
+#include "hl1/wad3.h"
+
+
+TEST_SUITE_BEGIN("wad3_bench");
+
+namespace {
+
+void bench_parse(const char* name, const std::vector<FileContents>& files) {
+    size_t stored_pixels = 0;
+    size_t generated_pixels = 0;
+    {
+        WAD3ParseOptions options;
+        options.full_mip_chain = true;
+        for (const FileContents& file : files) {
+            WAD3Parser wad;
+            wad.parse(file, options);
+            for (const WAD3Miptex& miptex : wad.miptexs) {
+                for (int mip_level = 0; mip_level < miptex.num_levels; mip_level++) {
+                    size_t pixels = miptex.mipmaps[mip_level].data.size() / 4;
+                    (mip_level < WAD3Miptex::NUM_LEVELS ? stored_pixels : generated_pixels) += pixels;
+                }
+            }
+        }
+    }
+
+    for (bool parallel : {false, true}) {
+        for (int mode = 0; mode < 3; mode++) {
+            WAD3ParseOptions options;
+            options.parallel = parallel;
+            options.full_mip_chain = mode > 0;
+            options.gamma_correct_mips = mode > 1;
+            double seconds = bench_seconds_per_call([&] {
+                for (const FileContents& file : files) {
+                    WAD3Parser wad;
+                    wad.parse(file, options);
+                }
+            });
+            const char* mode_names[] = {"stored levels", "full chain", "full chain, gamma-correct"};
+            printf("%s, %s, %s: %.2f ms, %.3f ms per stored megapixel\n", name,
+                   parallel ? "parallel" : "sequential", mode_names[mode], seconds * 1000.0,
+                   seconds * 1000.0 / (double(stored_pixels) / 1e6));
+        }
+    }
+    printf("%s: %.2f stored megapixels, %.3f generated megapixels\n", name, double(stored_pixels) / 1e6,
+           double(generated_pixels) / 1e6);
+}
+
+}  // namespace
+
+TEST_CASE("WAD3Parser synthetic") {
+    std::vector<TestTexture> textures;
+    for (uint32_t i = 0; i < 2000; i++) {
+        TestTexture texture;
+        texture.name = "tex" + std::to_string(i);
+        texture.width = 16 << (i % 5);
+        texture.height = 16 << ((i / 5) % 4);
+        texture.seed = i;
+        textures.push_back(texture);
+    }
+    std::vector<FileContents> files;
+    files.push_back(make_test_wad(textures));
+    bench_parse("synthetic WAD", files);
+}
+
+TEST_CASE("WAD3Parser data set") {
+    std::string wad_dir = bench_data_dir();
+    std::vector<std::string> wad_file_list;
+    if (!file_read_lines(path_join(wad_dir.c_str(), "wads.txt").c_str(), wad_file_list)) {
+        printf("Skipping: no wads.txt in %s\n", wad_dir.c_str());
+        return;
+    }
+    std::vector<FileContents> files;
+    for (const std::string& wad_file : wad_file_list) {
+        FileContents file;
+        if (file_read_contents(path_join(wad_dir.c_str(), wad_file.c_str()).c_str(), file)) {
+            files.push_back(std::move(file));
+        }
+    }
+    bench_parse("data set", files);
+}
+
+TEST_SUITE_END();
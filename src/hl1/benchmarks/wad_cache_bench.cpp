@@ -0,0 +1,69 @@
+#include <doctest/doctest.h>
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "common/benchmarks/bench.h"
+#include "common/io.h"
+#include "common/tests/common_test.h"
+#include "hl1/tests/hl1_test.h"
+#include "hl1/wad_cache.h"
+
+
+TEST_SUITE_BEGIN("wad_cache_bench");
+
+TEST_CASE("WAD3Textures cold and warm start") {
+    std::vector<TestTexture> test_textures;
+    for (uint32_t i = 0; i < 1000; i++) {
+        test_textures.push_back({"tex" + std::to_string(i), 16u << (i % 4), 16u << ((i / 4) % 4), i});
+    }
+    std::string dir = make_temp_directory();
+    REQUIRE(!dir.empty());
+    std::string wad_path = path_join(dir.c_str(), "synthetic.wad");
+    std::string cache_path = wad3_cache_path(wad_path.c_str());
+    FileContents wad_data = make_test_wad(test_textures);
+    REQUIRE(file_write_contents(wad_path.c_str(), wad_data.contents.data(), wad_data.contents.size()));
+
+    for (TextureFormat format : {TextureFormat::RGBA8, TextureFormat::BC1}) {
+        const char* format_name = format == TextureFormat::RGBA8 ? "RGBA8" : "BC1";
+        WAD3ParseOptions parse_options;
+        parse_options.parallel = true;
+        parse_options.full_mip_chain = true;
+        parse_options.max_levels = WAD3Atlas::MAX_PAGE_LEVELS;
+        WAD3AtlasOptions atlas_options;
+        atlas_options.parallel = true;
+        atlas_options.format = format;
+
+        // Cold start: read, parse, pack and write the cache.
+        double cold_seconds = bench_seconds_per_call([&] {
+            FileContents file;
+            file_read_contents(wad_path.c_str(), file);
+            WAD3Textures textures;
+            textures.build(file, parse_options, atlas_options);
+            WAD3CacheKey key;
+            key.init(file, format);
+            textures.save_cache(cache_path.c_str(), key);
+        });
+        // Warm start: map the cache, the WAD is not read.
+        size_t loaded = 0;
+        double warm_seconds = bench_seconds_per_call([&] {
+            WAD3CacheKey key;
+            key.init(wad_path.c_str(), format);
+            WAD3Textures textures;
+            loaded += textures.load_cache(cache_path.c_str(), key) ? 1 : 0;
+        });
+        CHECK(loaded > 0);
+        printf("WAD3Textures %zu textures, %s: cold start %.2f ms, warm start %.2f ms\n", test_textures.size(),
+               format_name, cold_seconds * 1000.0, warm_seconds * 1000.0);
+    }
+
+    remove(cache_path.c_str());
+    remove(wad_path.c_str());
+    rmdir(dir.c_str());
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,107 @@
+#include <doctest/doctest.h>
+#include <imgui.h>
+#include <sokol_gfx.h>
+#include <sokol_log.h>
+#include <util/sokol_imgui.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/benchmarks/bench.h"
+#include "hl1/tests/hl1_test.h"
+#include "hl1/wad_display.h"
+
+
+TEST_SUITE_BEGIN("wad_display_bench");
+
+namespace {
+
+// Return the number of draw commands of the last ImGui::Render().
+int count_draw_commands() {
+    const ImDrawData* draw_data = ImGui::GetDrawData();
+    int num_commands = 0;
+    for (int i = 0; i < draw_data->CmdListsCount; i++) {
+        num_commands += draw_data->CmdLists[i]->CmdBuffer.Size;
+    }
+    return num_commands;
+}
+
+}  // namespace
+
+TEST_CASE("WAD3Display tree and grid frames") {
+    // The dummy backend creates no GPU resources, this measures building the ImGui frame.
+    sg_desc desc = {};
+    desc.logger.func = slog_func;
+    sg_setup(desc);
+    simgui_desc_t simgui_desc = {};
+    simgui_desc.logger.func = slog_func;
+    simgui_setup(simgui_desc);
+
+    WAD3Display display;
+    display.init();
+    const uint32_t num_wads = 8;
+    for (uint32_t wad_idx = 0; wad_idx < num_wads; wad_idx++) {
+        std::vector<TestTexture> test_textures;
+        for (uint32_t i = 0; i < 500; i++) {
+            test_textures.push_back(
+                {"tex" + std::to_string(wad_idx) + "_" + std::to_string(i), 16u << (i % 4), 16u << ((i / 4) % 4),
+                 wad_idx * 500 + i});
+        }
+        WAD3AtlasOptions atlas_options;
+        atlas_options.format = display.texture_format;
+        atlas_options.parallel = true;
+        FileContents file = make_test_wad(test_textures);
+        WAD3Textures textures;
+        REQUIRE(textures.build(file, {}, atlas_options));
+        textures.name = "synthetic" + std::to_string(wad_idx) + ".wad";
+        display.add_wad(std::move(textures), wad_idx);
+    }
+    // Textures are added and the indices and thumbnail pages are built in frame-sized steps, as in process_parsed().
+    int num_load_frames = 0;
+    double worst_load_ms = 0.0;
+    for (bool loaded = false; !loaded; num_load_frames++) {
+        uint64_t start = stm_now();
+        loaded = display.add_pending_textures(1 << 20, 4.0) && display.finish_loading(1 << 20, 4.0);
+        worst_load_ms = std::max(worst_load_ms, stm_ms(stm_since(start)));
+    }
+    printf("WAD3Display loading %zu textures: %d frames, worst frame %.2f ms\n", display.num_textures,
+           num_load_frames, worst_load_ms);
+    for (WAD3Display::WADEntry& wad : display.wads) {
+        wad.open = true;
+    }
+    display.tree_rows_dirty = true;
+
+    for (bool grid_view : {false, true}) {
+        display.grid_view = grid_view;
+        int num_commands = 0;
+        auto frame = [&] {
+            simgui_frame_desc_t frame_desc = {};
+            frame_desc.width = 1280;
+            frame_desc.height = 720;
+            frame_desc.delta_time = 1.0 / 60.0;
+            frame_desc.dpi_scale = 1.0f;
+            simgui_new_frame(frame_desc);
+            display.render();
+            ImGui::Render();
+            num_commands = count_draw_commands();
+        };
+        // Let ImGui settle the window and table layout first.
+        for (int i = 0; i < 3; i++) {
+            frame();
+        }
+        double seconds = bench_seconds_per_call(frame);
+        printf("WAD3Display %s, %zu textures, %zu thumbnail pages: %.3f ms per frame, %d draw commands\n",
+               grid_view ? "grid" : "tree", display.num_textures, display.thumbnail_pages.size(), seconds * 1000.0,
+               num_commands);
+    }
+
+    display.destroy();
+    simgui_shutdown();
+    sg_shutdown();
+}
+
+TEST_SUITE_END();
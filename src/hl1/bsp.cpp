@@ -1,7 +1,115 @@
 #include "bsp.h"
 
+#include <cstdint>
+#include <cstring>
+
+#include "common/slog.h"
+
+
+namespace {
+
+struct BSPLumpEntry {
+    int32_t offset;
+    int32_t length;
+};
+
+struct BSPHeader {
+    int32_t version;
+    BSPLumpEntry lumps[BSP_NUM_LUMPS];
+};
+
+// Names of the lumps in BSPLump order, for errors.
+const char* LUMP_NAMES[BSP_NUM_LUMPS] = {
+    "entities", "planes",    "textures", "vertices",     "visibility", "nodes",     "texinfo", "faces",
+    "lighting", "clipnodes", "leaves",   "marksurfaces", "edges",      "surfedges", "models",
+};
+
+// Point out at the elements of the lump. The lump must be in bounds, a whole number of elements and aligned for T, so
+// that the elements can be accessed in place.
+template <typename T>
+bool get_lump(const FileContents& file, const BSPHeader& header, BSPLump lump, Span<const T>& out) {
+    const BSPLumpEntry& entry = header.lumps[lump];
+    if (entry.offset < 0 || entry.length < 0 || size_t(entry.offset) > file.contents.size() ||
+        size_t(entry.length) > file.contents.size() - size_t(entry.offset)) {
+        SLOG_ERROR("%s: Lump %s (offset %d, length %d) out of bounds", file.name.c_str(), LUMP_NAMES[lump],
+                   entry.offset, entry.length);
+        return false;
+    }
+    if (size_t(entry.length) % sizeof(T) != 0) {
+        SLOG_ERROR("%s: Lump %s length %d is not a multiple of %zu", file.name.c_str(), LUMP_NAMES[lump],
+                   entry.length, sizeof(T));
+        return false;
+    }
+    const uint8_t* data = file.contents.data() + entry.offset;
+    if (reinterpret_cast<uintptr_t>(data) % alignof(T) != 0) {
+        SLOG_ERROR("%s: Lump %s at offset %d is not aligned to %zu", file.name.c_str(), LUMP_NAMES[lump],
+                   entry.offset, alignof(T));
+        return false;
+    }
+    out = Span<const T>(reinterpret_cast<const T*>(data), size_t(entry.length) / sizeof(T));
+    return true;
+}
+
+}  // namespace
 
 bool BSPParser::parse(const FileContents& file) {
+    // Drop the views of the previous file.
+    *this = BSPParser();
+    name = path_get_filename(file.name.c_str());
+
+    BSPHeader header = {};
+    if (!file.read_at(0, header)) {
+        SLOG_ERROR("%s: Insufficient data length for header", file.name.c_str());
+        return false;
+    }
+    if (header.version != VERSION) {
+        SLOG_ERROR("%s: Unsupported version %d (expected %d)", file.name.c_str(), header.version, VERSION);
+        return false;
+    }
+
+    Span<const char> entity_chars;
+    if (!get_lump(file, header, BSP_LUMP_ENTITIES, entity_chars) ||
+        !get_lump(file, header, BSP_LUMP_PLANES, planes) || !get_lump(file, header, BSP_LUMP_TEXTURES, textures) ||
+        !get_lump(file, header, BSP_LUMP_VERTICES, vertices) ||
+        !get_lump(file, header, BSP_LUMP_VISIBILITY, visdata) || !get_lump(file, header, BSP_LUMP_NODES, nodes) ||
+        !get_lump(file, header, BSP_LUMP_TEXINFO, texinfos) || !get_lump(file, header, BSP_LUMP_FACES, faces) ||
+        !get_lump(file, header, BSP_LUMP_LIGHTING, lighting) ||
+        !get_lump(file, header, BSP_LUMP_CLIPNODES, clipnodes) ||
+        !get_lump(file, header, BSP_LUMP_LEAVES, leaves) ||
+        !get_lump(file, header, BSP_LUMP_MARKSURFACES, marksurfaces) ||
+        !get_lump(file, header, BSP_LUMP_EDGES, edges) || !get_lump(file, header, BSP_LUMP_SURFEDGES, surfedges) ||
+        !get_lump(file, header, BSP_LUMP_MODELS, models)) {
+        return false;
+    }
+    if (models.empty()) {
+        SLOG_ERROR("%s: No world model", file.name.c_str());
+        return false;
+    }
+
+    // The entities text is usually NUL-terminated.
+    size_t entities_size = entity_chars.size();
+    while (entities_size > 0 && entity_chars[entities_size - 1] == '\0') {
+        entities_size--;
+    }
+    entities = std::string_view(entity_chars.data(), entities_size);
+
     valid = true;
     return true;
 }
+
+const float* BSPParser::face_vertex(const BSPFace& face, uint32_t i) const {
+    size_t surfedge_idx = size_t(face.first_edge) + i;
+    if (surfedge_idx >= surfedges.size()) {
+        return nullptr;
+    }
+    int32_t surfedge = surfedges[surfedge_idx];
+    size_t edge_idx = surfedge >= 0 ? size_t(surfedge) : size_t(-int64_t(surfedge));
+    if (edge_idx >= edges.size()) {
+        return nullptr;
+    }
+    uint16_t vertex_idx = edges[edge_idx].vertices[surfedge >= 0 ? 0 : 1];
+    if (vertex_idx >= vertices.size()) {
+        return nullptr;
+    }
+    return vertices[vertex_idx].point;
+}
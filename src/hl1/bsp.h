@@ -2,18 +2,176 @@
 
 #include <cstdint>
 #include <string>
-#include <vector>
+#include <string_view>
 
 #include "common/io.h"
+#include "common/span.h"
 
 
-// BSP parser for HL1.
+// See https://twhl.info/wiki/page/Specification:_Map_Compiling and
+// https://developer.valvesoftware.com/wiki/BSP_(GoldSrc) for details. The structs below are the on-disk layouts.
+
+// Lumps of BSP v30 in the order of the header.
+enum BSPLump {
+    BSP_LUMP_ENTITIES = 0,
+    BSP_LUMP_PLANES,
+    BSP_LUMP_TEXTURES,
+    BSP_LUMP_VERTICES,
+    BSP_LUMP_VISIBILITY,
+    BSP_LUMP_NODES,
+    BSP_LUMP_TEXINFO,
+    BSP_LUMP_FACES,
+    BSP_LUMP_LIGHTING,
+    BSP_LUMP_CLIPNODES,
+    BSP_LUMP_LEAVES,
+    BSP_LUMP_MARKSURFACES,
+    BSP_LUMP_EDGES,
+    BSP_LUMP_SURFEDGES,
+    BSP_LUMP_MODELS,
+    BSP_NUM_LUMPS,
+};
+
+// Leaf and clipnode contents.
+const int32_t BSP_CONTENTS_EMPTY = -1;
+const int32_t BSP_CONTENTS_SOLID = -2;
+const int32_t BSP_CONTENTS_WATER = -3;
+const int32_t BSP_CONTENTS_SLIME = -4;
+const int32_t BSP_CONTENTS_LAVA = -5;
+const int32_t BSP_CONTENTS_SKY = -6;
+
+// Plane types: axial planes have a normal along x, y or z.
+const int32_t BSP_PLANE_X = 0;
+const int32_t BSP_PLANE_Y = 1;
+const int32_t BSP_PLANE_Z = 2;
+
+// Texinfo flag of the faces without lightmaps (sky, water).
+const uint32_t BSP_TEX_SPECIAL = 1;
+// Texels per luxel along each axis of the lightmaps.
+const int BSP_LUXEL_SIZE = 16;
+
+struct BSPPlane {
+    float normal[3];
+    float dist;
+    int32_t type;
+};
+static_assert(sizeof(BSPPlane) == 20);
+
+struct BSPVertex {
+    float point[3];
+};
+static_assert(sizeof(BSPVertex) == 12);
+
+struct BSPNode {
+    uint32_t plane;
+    // Node index if >= 0, otherwise the leaf -(child + 1).
+    int16_t children[2];
+    int16_t mins[3];
+    int16_t maxs[3];
+    // Faces lying on the plane of the node.
+    uint16_t first_face;
+    uint16_t num_faces;
+};
+static_assert(sizeof(BSPNode) == 24);
+
+struct BSPTexinfo {
+    // Texture coordinates are (dot(point, s) + s[3], dot(point, t) + t[3]) in texels.
+    float s[4];
+    float t[4];
+    // Index in the textures lump.
+    uint32_t miptex;
+    uint32_t flags;
+};
+static_assert(sizeof(BSPTexinfo) == 40);
+
+struct BSPFace {
+    uint16_t plane;
+    // Non-zero if the face normal is the opposite of the plane normal.
+    uint16_t side;
+    uint32_t first_edge;
+    uint16_t num_edges;
+    uint16_t texinfo;
+    // Light styles of the lightmaps, 255 marks the unused ones.
+    uint8_t styles[4];
+    // Byte offset in the lighting lump or -1 if the face has no lightmap.
+    int32_t light_offset;
+};
+static_assert(sizeof(BSPFace) == 20);
+
+struct BSPClipnode {
+    int32_t plane;
+    // Clipnode index if >= 0, otherwise the contents.
+    int16_t children[2];
+};
+static_assert(sizeof(BSPClipnode) == 8);
+
+struct BSPLeaf {
+    int32_t contents;
+    // Byte offset of the compressed PVS in the visibility lump or -1 if there is none.
+    int32_t vis_offset;
+    int16_t mins[3];
+    int16_t maxs[3];
+    uint16_t first_mark_surface;
+    uint16_t num_mark_surfaces;
+    uint8_t ambient_levels[4];
+};
+static_assert(sizeof(BSPLeaf) == 28);
+
+struct BSPEdge {
+    uint16_t vertices[2];
+};
+static_assert(sizeof(BSPEdge) == 4);
+
+struct BSPModel {
+    float mins[3];
+    float maxs[3];
+    float origin[3];
+    // Root node for hull 0 and root clipnodes for hulls 1-3.
+    int32_t head_nodes[4];
+    // Number of leaves covered by the PVS, excluding the solid leaf 0.
+    int32_t vis_leaves;
+    int32_t first_face;
+    int32_t num_faces;
+};
+static_assert(sizeof(BSPModel) == 64);
+
+// Zero-copy parser for BSP v30 files from HL1: checks the header and the bounds of all lumps, and points typed views
+// into the file contents. Nothing is copied or allocated per element, so the FileContents must outlive the parser. The
+// references between lumps are not checked.
 struct BSPParser {
+    static constexpr int32_t VERSION = 30;
+
     // Parse file, set valid and other fields. Return false if parsing failed (valid will be false as well).
     bool parse(const FileContents& file);
 
+    // Return the position of vertex i of the face or nullptr if the surfedge, edge or vertex index on the way is out of
+    // bounds.
+    const float* face_vertex(const BSPFace& face, uint32_t i) const;
+
     // False if the parse() was not called or returned an error.
     bool valid = false;
     // File name.
     std::string name;
+
+    // Entity definitions text without the trailing NULs.
+    std::string_view entities;
+    Span<const BSPPlane> planes;
+    // Raw textures lump: the miptex count, the offsets and the miptexs.
+    Span<const uint8_t> textures;
+    Span<const BSPVertex> vertices;
+    // Run-length compressed PVS of all leaves.
+    Span<const uint8_t> visdata;
+    Span<const BSPNode> nodes;
+    Span<const BSPTexinfo> texinfos;
+    Span<const BSPFace> faces;
+    // RGB lightmaps of the faces.
+    Span<const uint8_t> lighting;
+    Span<const BSPClipnode> clipnodes;
+    Span<const BSPLeaf> leaves;
+    // Face indices referenced by the leaves.
+    Span<const uint16_t> marksurfaces;
+    Span<const BSPEdge> edges;
+    // Edge indices of the faces, negative for edges used from the second vertex to the first.
+    Span<const int32_t> surfedges;
+    // Model 0 is the world, the others are the brush entities.
+    Span<const BSPModel> models;
 };
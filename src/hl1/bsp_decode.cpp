@@ -0,0 +1,345 @@
+#include "bsp_decode.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <utility>
+
+#include "common/bits.h"
+#include "common/slog.h"
+#include "common/thread.h"
+
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Lightmap extents in luxels above which the texinfo is garbage. The engine limits them to 16, but some compilers
+// allow larger ones.
+const float MAX_LIGHTMAP_EXTENT = 1024.0f;
+
+const char* TASK_NAMES[BSP_NUM_DECODE_TASKS] = {"entities", "textures", "lighting", "visibility", "faces"};
+
+// Miptex header in the textures lump, the same as in WADs.
+struct BSPMiptexHeader {
+    char name[16];
+    uint32_t width;
+    uint32_t height;
+    uint32_t mip_offsets[4];
+};
+
+double ms_since(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Tokenize the entities text and count the entities.
+bool decode_entities(const BSPParser& bsp, BSPDecodedLumps& out) {
+    if (!out.entities.parse(bsp.entities, bsp.name.c_str(), true)) {
+        return false;
+    }
+    out.num_entities = out.entities.size();
+    return true;
+}
+
+// Index the miptexs of the textures lump and decode the embedded ones.
+bool decode_textures(const BSPParser& bsp, const WAD3ParseOptions& options, BSPDecodedLumps& out) {
+    Span<const uint8_t> lump = bsp.textures;
+    if (lump.empty()) {
+        return true;
+    }
+    uint32_t num_textures = 0;
+    if (lump.size() < sizeof(num_textures)) {
+        SLOG_ERROR("%s: Insufficient data length for textures", bsp.name.c_str());
+        return false;
+    }
+    memcpy(&num_textures, lump.data(), sizeof(num_textures));
+    if (num_textures > (lump.size() - sizeof(num_textures)) / sizeof(int32_t)) {
+        SLOG_ERROR("%s: Insufficient data length for %u texture offsets", bsp.name.c_str(), num_textures);
+        return false;
+    }
+
+    std::vector<WAD3ViewEntry> entries;
+    out.textures.resize(num_textures);
+    for (uint32_t i = 0; i < num_textures; i++) {
+        int32_t offset = 0;
+        memcpy(&offset, lump.data() + sizeof(num_textures) + i * sizeof(offset), sizeof(offset));
+        // Compilers write -1 for the textures they could not find, these stay without name.
+        if (offset == -1) {
+            continue;
+        }
+        BSPMiptexHeader header = {};
+        if (offset < 0 || size_t(offset) > lump.size() || lump.size() - size_t(offset) < sizeof(header)) {
+            SLOG_ERROR("%s: Texture %u at offset %d out of bounds", bsp.name.c_str(), i, offset);
+            return false;
+        }
+        memcpy(&header, lump.data() + offset, sizeof(header));
+
+        BSPTexture& texture = out.textures[i];
+        const char* name_ptr = reinterpret_cast<const char*>(lump.data() + offset);
+        std::string_view name(name_ptr, strnlen(name_ptr, sizeof(header.name)));
+        texture.name = name;
+        texture.width = header.width;
+        texture.height = header.height;
+        // The pixels of the textures from WADs are not stored.
+        if (header.mip_offsets[0] == 0) {
+            continue;
+        }
+
+        WAD3ViewEntry entry;
+        entry.name = name;
+        if (!entry.parse(lump, size_t(offset), bsp.name.c_str())) {
+            return false;
+        }
+        texture.embedded = int32_t(entries.size());
+        entries.push_back(entry);
+    }
+
+    out.embedded.name = bsp.name;
+    out.embedded.decode(entries, options);
+    return true;
+}
+
+// Compute the lightmap extents of the faces as the engine does and check that the lightmaps are in bounds.
+bool decode_lighting(const BSPParser& bsp, BSPDecodedLumps& out) {
+    out.lightmaps.resize(bsp.faces.size());
+    for (size_t face_idx = 0; face_idx < bsp.faces.size(); face_idx++) {
+        const BSPFace& face = bsp.faces[face_idx];
+        if (face.texinfo >= bsp.texinfos.size()) {
+            SLOG_ERROR("%s: Texinfo %u of face %zu out of bounds", bsp.name.c_str(), face.texinfo, face_idx);
+            return false;
+        }
+        const BSPTexinfo& texinfo = bsp.texinfos[face.texinfo];
+        if (face.light_offset < 0 || (texinfo.flags & BSP_TEX_SPECIAL) != 0) {
+            continue;
+        }
+        if (face.num_edges == 0) {
+            SLOG_ERROR("%s: Face %zu has no edges", bsp.name.c_str(), face_idx);
+            return false;
+        }
+
+        float min_st[2] = {INFINITY, INFINITY};
+        float max_st[2] = {-INFINITY, -INFINITY};
+        for (uint32_t i = 0; i < face.num_edges; i++) {
+            const float* point = bsp.face_vertex(face, i);
+            if (point == nullptr) {
+                SLOG_ERROR("%s: Edge %u of face %zu out of bounds", bsp.name.c_str(), i, face_idx);
+                return false;
+            }
+            for (int axis = 0; axis < 2; axis++) {
+                const float* vec = axis == 0 ? texinfo.s : texinfo.t;
+                float st = point[0] * vec[0] + point[1] * vec[1] + point[2] * vec[2] + vec[3];
+                min_st[axis] = st < min_st[axis] ? st : min_st[axis];
+                max_st[axis] = st > max_st[axis] ? st : max_st[axis];
+            }
+        }
+
+        BSPFaceLightmap& lightmap = out.lightmaps[face_idx];
+        uint32_t size[2] = {};
+        for (int axis = 0; axis < 2; axis++) {
+            float first = std::floor(min_st[axis] / BSP_LUXEL_SIZE);
+            float last = std::ceil(max_st[axis] / BSP_LUXEL_SIZE);
+            // Also rejects NaNs from garbage texinfos.
+            if (!(last - first <= MAX_LIGHTMAP_EXTENT)) {
+                SLOG_ERROR("%s: Bad lightmap extents of face %zu", bsp.name.c_str(), face_idx);
+                return false;
+            }
+            lightmap.mins[axis] = int32_t(first);
+            size[axis] = uint32_t(last - first) + 1;
+        }
+        lightmap.width = size[0];
+        lightmap.height = size[1];
+        while (lightmap.num_styles < 4 && face.styles[lightmap.num_styles] != 255) {
+            lightmap.num_styles++;
+        }
+        lightmap.offset = uint32_t(face.light_offset);
+
+        size_t lightmap_size = size_t(lightmap.width) * lightmap.height * 3 * size_t(lightmap.num_styles);
+        if (lightmap.offset > bsp.lighting.size() || bsp.lighting.size() - lightmap.offset < lightmap_size) {
+            SLOG_ERROR("%s: Lightmap of face %zu (offset %u, %ux%u, %d styles) out of bounds", bsp.name.c_str(),
+                       face_idx, lightmap.offset, lightmap.width, lightmap.height, lightmap.num_styles);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Walk the run-length compressed PVS of each leaf within the visibility lump and count the visible leaves.
+bool decode_visibility(const BSPParser& bsp, BSPDecodedLumps& out) {
+    int32_t vis_leaves = bsp.models[0].vis_leaves;
+    if (vis_leaves < 0 || bsp.leaves.empty() || size_t(vis_leaves) > bsp.leaves.size() - 1) {
+        SLOG_ERROR("%s: Invalid number of vis leaves %d for %zu leaves", bsp.name.c_str(), vis_leaves,
+                   bsp.leaves.size());
+        return false;
+    }
+    size_t row_bytes = (size_t(vis_leaves) + 7) / 8;
+    // Bits of the last byte past vis_leaves are padding.
+    uint8_t last_byte_mask = vis_leaves % 8 == 0 ? 0xFF : uint8_t((1 << (vis_leaves % 8)) - 1);
+
+    out.visible_leaves.assign(bsp.leaves.size(), 0);
+    for (size_t leaf_idx = 1; leaf_idx < bsp.leaves.size(); leaf_idx++) {
+        int32_t vis_offset = bsp.leaves[leaf_idx].vis_offset;
+        // Maps compiled without vis see everything.
+        if (vis_offset < 0 || bsp.visdata.empty()) {
+            out.visible_leaves[leaf_idx] = uint32_t(vis_leaves);
+            continue;
+        }
+
+        // A zero byte is followed by the number of zero bytes it stands for.
+        size_t pos = size_t(vis_offset);
+        size_t row_byte = 0;
+        uint32_t num_visible = 0;
+        while (row_byte < row_bytes) {
+            if (pos >= bsp.visdata.size()) {
+                SLOG_ERROR("%s: PVS of leaf %zu out of bounds", bsp.name.c_str(), leaf_idx);
+                return false;
+            }
+            uint8_t bits = bsp.visdata[pos++];
+            if (bits != 0) {
+                if (row_byte == row_bytes - 1) {
+                    bits &= last_byte_mask;
+                }
+                num_visible += uint32_t(count_set_bits(bits));
+                row_byte++;
+                continue;
+            }
+            if (pos >= bsp.visdata.size()) {
+                SLOG_ERROR("%s: PVS of leaf %zu out of bounds", bsp.name.c_str(), leaf_idx);
+                return false;
+            }
+            row_byte += bsp.visdata[pos++];
+        }
+        out.visible_leaves[leaf_idx] = num_visible;
+    }
+    return true;
+}
+
+// Check the references of the faces to planes, texinfos, edges and vertices and compute the face bounds.
+bool decode_faces(const BSPParser& bsp, BSPDecodedLumps& out) {
+    out.face_bounds.resize(bsp.faces.size());
+    for (size_t face_idx = 0; face_idx < bsp.faces.size(); face_idx++) {
+        const BSPFace& face = bsp.faces[face_idx];
+        if (face.plane >= bsp.planes.size() || face.texinfo >= bsp.texinfos.size()) {
+            SLOG_ERROR("%s: Plane %u or texinfo %u of face %zu out of bounds", bsp.name.c_str(), face.plane,
+                       face.texinfo, face_idx);
+            return false;
+        }
+        if (face.num_edges < 3) {
+            SLOG_ERROR("%s: Face %zu has %u edges", bsp.name.c_str(), face_idx, face.num_edges);
+            return false;
+        }
+
+        BSPFaceBounds& bounds = out.face_bounds[face_idx];
+        for (int axis = 0; axis < 3; axis++) {
+            bounds.mins[axis] = INFINITY;
+            bounds.maxs[axis] = -INFINITY;
+        }
+        for (uint32_t i = 0; i < face.num_edges; i++) {
+            const float* point = bsp.face_vertex(face, i);
+            if (point == nullptr) {
+                SLOG_ERROR("%s: Edge %u of face %zu out of bounds", bsp.name.c_str(), i, face_idx);
+                return false;
+            }
+            for (int axis = 0; axis < 3; axis++) {
+                bounds.mins[axis] = point[axis] < bounds.mins[axis] ? point[axis] : bounds.mins[axis];
+                bounds.maxs[axis] = point[axis] > bounds.maxs[axis] ? point[axis] : bounds.maxs[axis];
+            }
+        }
+    }
+    return true;
+}
+
+// Run the task and record its result and time. The tasks write disjoint fields of out.
+void run_task(const BSPParser& bsp, BSPDecodeTask task, const WAD3ParseOptions& options, BSPDecodedLumps& out) {
+    Clock::time_point start = Clock::now();
+    bool task_valid = false;
+    switch (task) {
+    case BSP_DECODE_ENTITIES:
+        task_valid = decode_entities(bsp, out);
+        break;
+    case BSP_DECODE_TEXTURES:
+        task_valid = decode_textures(bsp, options, out);
+        break;
+    case BSP_DECODE_LIGHTING:
+        task_valid = decode_lighting(bsp, out);
+        break;
+    case BSP_DECODE_VISIBILITY:
+        task_valid = decode_visibility(bsp, out);
+        break;
+    case BSP_DECODE_FACES:
+        task_valid = decode_faces(bsp, out);
+        break;
+    case BSP_NUM_DECODE_TASKS:
+        break;
+    }
+    out.task_valid[task] = task_valid;
+    out.task_ms[task] = ms_since(start);
+}
+
+void finish_decoding(Clock::time_point start, BSPDecodedLumps& out) {
+    out.total_ms = ms_since(start);
+    out.valid = true;
+    for (int task = 0; task < BSP_NUM_DECODE_TASKS; task++) {
+        out.valid = out.valid && out.task_valid[task];
+    }
+}
+
+// State shared by the tasks of decode_bsp_lumps_async(), the last task to complete calls done.
+struct AsyncDecoding {
+    const BSPParser* bsp = nullptr;
+    WAD3ParseOptions options;
+    std::function<void(BSPDecodedLumps&&)> done;
+    Clock::time_point start;
+    BSPDecodedLumps lumps;
+    std::atomic<int> num_remaining{BSP_NUM_DECODE_TASKS};
+};
+
+}  // namespace
+
+const char* bsp_decode_task_name(BSPDecodeTask task) {
+    return task >= 0 && task < BSP_NUM_DECODE_TASKS ? TASK_NAMES[task] : "unknown";
+}
+
+bool decode_bsp_lumps(const BSPParser& bsp, BSPDecodedLumps& out, const WAD3ParseOptions& texture_options) {
+    out = BSPDecodedLumps();
+    if (!bsp.valid) {
+        return false;
+    }
+    Clock::time_point start = Clock::now();
+    thread_pool().run_for([&](size_t task) { run_task(bsp, BSPDecodeTask(task), texture_options, out); },
+                          BSP_NUM_DECODE_TASKS);
+    finish_decoding(start, out);
+    return out.valid;
+}
+
+void decode_bsp_lumps_async(const BSPParser& bsp, std::function<void(BSPDecodedLumps&&)> done,
+                            const WAD3ParseOptions& texture_options) {
+    if (!bsp.valid) {
+        done(BSPDecodedLumps());
+        return;
+    }
+    std::shared_ptr<AsyncDecoding> state = std::make_shared<AsyncDecoding>();
+    state->bsp = &bsp;
+    state->options = texture_options;
+    state->done = std::move(done);
+    state->start = Clock::now();
+
+    auto task_func = [state](size_t task) {
+        run_task(*state->bsp, BSPDecodeTask(task), state->options, state->lumps);
+        // The release publishes the results of this task, the acquire of the last task sees all of them.
+        if (state->num_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            finish_decoding(state->start, state->lumps);
+            state->done(std::move(state->lumps));
+        }
+    };
+    if (!thread_pool().submit_for(task_func, BSP_NUM_DECODE_TASKS)) {
+        // The pool has been shutdown, decode on the calling thread.
+        for (size_t task = 0; task < BSP_NUM_DECODE_TASKS; task++) {
+            task_func(task);
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "bsp.h"
+#include "bsp_entities.h"
+#include "wad3.h"
+
+
+// Lumps of a parsed BSP which need CPU work after BSPParser::parse(). Each one is decoded and validated by an
+// independent task.
+enum BSPDecodeTask {
+    BSP_DECODE_ENTITIES = 0,
+    BSP_DECODE_TEXTURES,
+    BSP_DECODE_LIGHTING,
+    BSP_DECODE_VISIBILITY,
+    BSP_DECODE_FACES,
+    BSP_NUM_DECODE_TASKS,
+};
+
+// Texture referenced by the texinfos, in the order of the textures lump.
+struct BSPTexture {
+    WAD3TextureName name;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // Index in BSPDecodedLumps::embedded, -1 for textures stored in WADs.
+    int32_t embedded = -1;
+};
+
+// Lightmap of a face: width x height luxels of 16x16 texels for each style, stored one after another as RGB8.
+struct BSPFaceLightmap {
+    // Texture coordinates of the first luxel divided by 16.
+    int32_t mins[2] = {};
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // Number of styles with a lightmap, 0 if the face has none.
+    int num_styles = 0;
+    // Byte offset in the lighting lump.
+    uint32_t offset = 0;
+};
+
+struct BSPFaceBounds {
+    float mins[3] = {};
+    float maxs[3] = {};
+};
+
+// Lumps decoded by decode_bsp_lumps(). Each vector is per element of the corresponding BSPParser view.
+struct BSPDecodedLumps {
+    // False if any task failed.
+    bool valid = false;
+    // Result and duration of each task.
+    bool task_valid[BSP_NUM_DECODE_TASKS] = {};
+    double task_ms[BSP_NUM_DECODE_TASKS] = {};
+    // Time from the start of decoding until the last task completed, close to the slowest task with enough workers.
+    double total_ms = 0;
+
+    // Number of entities in the entities text.
+    size_t num_entities = 0;
+    // Entities with views of the entities text, which point into the file contents of the BSP.
+    BSPEntities entities;
+    std::vector<BSPTexture> textures;
+    // RGBA8 mip levels of the textures embedded in the map.
+    WAD3Parser embedded;
+    std::vector<BSPFaceLightmap> lightmaps;
+    // Number of leaves in the PVS of each leaf, all vis leaves for the leaves without PVS and 0 for the solid leaf 0.
+    std::vector<uint32_t> visible_leaves;
+    std::vector<BSPFaceBounds> face_bounds;
+};
+
+// Return the task name, for logs.
+const char* bsp_decode_task_name(BSPDecodeTask task);
+
+// Decode and validate the lumps of bsp with one task per lump on thread_pool(), wait for all the tasks and return
+// out.valid. Can be called from ThreadPool tasks. Embedded miptexs are decoded as WAD3Parser::decode() does for WADs.
+bool decode_bsp_lumps(const BSPParser& bsp, BSPDecodedLumps& out, const WAD3ParseOptions& texture_options = {});
+
+// Same as decode_bsp_lumps(), but return immediately. done is called once with the result, on the thread which
+// completes the last task. bsp and its file contents must stay alive until then.
+void decode_bsp_lumps_async(const BSPParser& bsp, std::function<void(BSPDecodedLumps&&)> done,
+                            const WAD3ParseOptions& texture_options = {});
@@ -0,0 +1,222 @@
+#include "bsp_entities.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "common/slog.h"
+#include "common/thread.h"
+
+
+namespace {
+
+// Longest number parse_entity_floats() accepts.
+const size_t MAX_NUMBER_CHARS = 63;
+
+enum TokenizeError {
+    TOKENIZE_OK = 0,
+    TOKENIZE_UNTERMINATED_STRING,
+    TOKENIZE_UNEXPECTED_CHAR,
+    TOKENIZE_UNTERMINATED_ENTITY,
+};
+
+// Entities and pairs of a range of the text, first_pair is relative to the range.
+struct TokenizedRange {
+    std::vector<BSPEntity> entities;
+    std::vector<BSPEntityPair> pairs;
+    TokenizeError error = TOKENIZE_OK;
+    size_t error_pos = 0;
+};
+
+// Tokenize text[begin..end), which must start outside of the entities, and append to out. Strings end at the next
+// quote, there are no escapes. Return the error and set out.error_pos if the range is malformed or ends inside an
+// entity or a string.
+TokenizeError tokenize(std::string_view text, size_t begin, size_t end, TokenizedRange& out) {
+    const char* chars = text.data();
+    bool in_entity = false;
+    bool has_key = false;
+    std::string_view key;
+    size_t pos = begin;
+    while (pos < end) {
+        char c = chars[pos];
+        if (uint8_t(c) <= ' ') {
+            pos++;
+        } else if (c == '"' && in_entity) {
+            const char* close = static_cast<const char*>(memchr(chars + pos + 1, '"', end - pos - 1));
+            if (close == nullptr) {
+                out.error_pos = pos;
+                return TOKENIZE_UNTERMINATED_STRING;
+            }
+            std::string_view token(chars + pos + 1, size_t(close - chars) - pos - 1);
+            if (has_key) {
+                out.pairs.push_back({key, token});
+                out.entities.back().num_pairs++;
+            } else {
+                key = token;
+            }
+            has_key = !has_key;
+            pos = size_t(close - chars) + 1;
+        } else if (c == '{' && !in_entity) {
+            in_entity = true;
+            out.entities.push_back({uint32_t(out.pairs.size()), 0});
+            pos++;
+        } else if (c == '}' && in_entity && !has_key) {
+            in_entity = false;
+            pos++;
+        } else {
+            out.error_pos = pos;
+            return TOKENIZE_UNEXPECTED_CHAR;
+        }
+    }
+    if (in_entity) {
+        out.error_pos = end;
+        return TOKENIZE_UNTERMINATED_ENTITY;
+    }
+    return TOKENIZE_OK;
+}
+
+}  // namespace
+
+bool BSPEntities::parse(std::string_view new_text, const char* name, bool parallel) {
+    text = new_text;
+    entities.clear();
+    pairs.clear();
+    classnames.clear();
+    classname_order.clear();
+
+    // Split after the first closing brace past each multiple of the range size. If all the ranges tokenize, the first
+    // one ends outside of the entities, so the second one starts there, and so on: the split was right.
+    size_t num_tasks = parallel ? (text.size() + CHARS_PER_TASK - 1) / CHARS_PER_TASK : 1;
+    bool tokenized = false;
+    if (num_tasks > 1) {
+        std::vector<size_t> splits(num_tasks + 1, text.size());
+        splits[0] = 0;
+        for (size_t i = 1; i < num_tasks; i++) {
+            size_t close = text.find('}', std::max(i * CHARS_PER_TASK, splits[i - 1]));
+            splits[i] = close == std::string_view::npos ? text.size() : close + 1;
+        }
+        std::vector<TokenizedRange> ranges(num_tasks);
+        thread_pool().run_for(
+            [&](size_t i) { ranges[i].error = tokenize(text, splits[i], splits[i + 1], ranges[i]); }, num_tasks);
+        tokenized = std::all_of(ranges.begin(), ranges.end(),
+                                [](const TokenizedRange& range) { return range.error == TOKENIZE_OK; });
+        if (tokenized) {
+            for (const TokenizedRange& range : ranges) {
+                uint32_t first_pair = uint32_t(pairs.size());
+                for (const BSPEntity& entity : range.entities) {
+                    entities.push_back({first_pair + entity.first_pair, entity.num_pairs});
+                }
+                pairs.insert(pairs.end(), range.pairs.begin(), range.pairs.end());
+            }
+        }
+    }
+    if (!tokenized) {
+        TokenizedRange range;
+        switch (tokenize(text, 0, text.size(), range)) {
+        case TOKENIZE_OK:
+            break;
+        case TOKENIZE_UNTERMINATED_STRING:
+            SLOG_ERROR("%s: Unterminated string at offset %zu of entities", name, range.error_pos);
+            return false;
+        case TOKENIZE_UNEXPECTED_CHAR:
+            SLOG_ERROR("%s: Unexpected '%c' at offset %zu of entities", name, text[range.error_pos], range.error_pos);
+            return false;
+        case TOKENIZE_UNTERMINATED_ENTITY:
+            SLOG_ERROR("%s: Unterminated entity at the end of entities", name);
+            return false;
+        }
+        entities = std::move(range.entities);
+        pairs = std::move(range.pairs);
+    }
+
+    classnames.resize(entities.size());
+    classname_order.resize(entities.size());
+    for (size_t i = 0; i < entities.size(); i++) {
+        classnames[i] = value(i, "classname");
+        classname_order[i] = uint32_t(i);
+    }
+    std::stable_sort(classname_order.begin(), classname_order.end(),
+                     [&](uint32_t a, uint32_t b) { return classnames[a] < classnames[b]; });
+    return true;
+}
+
+Span<const BSPEntityPair> BSPEntities::entity_pairs(size_t entity) const {
+    const BSPEntity& e = entities[entity];
+    return Span<const BSPEntityPair>(pairs.data() + e.first_pair, e.num_pairs);
+}
+
+bool BSPEntities::find_value(size_t entity, std::string_view key, std::string_view& value) const {
+    Span<const BSPEntityPair> list = entity_pairs(entity);
+    for (size_t i = list.size(); i > 0; i--) {
+        if (list[i - 1].key == key) {
+            value = list[i - 1].value;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string_view BSPEntities::value(size_t entity, std::string_view key) const {
+    std::string_view result;
+    find_value(entity, key, result);
+    return result;
+}
+
+bool BSPEntities::origin(size_t entity, float out[3]) const {
+    std::string_view origin_value;
+    return find_value(entity, "origin", origin_value) && parse_entity_floats(origin_value, out, 3);
+}
+
+bool BSPEntities::angles(size_t entity, float out[3]) const {
+    std::string_view angles_value;
+    if (find_value(entity, "angles", angles_value)) {
+        return parse_entity_floats(angles_value, out, 3);
+    }
+    float yaw = 0.0f;
+    if (!find_value(entity, "angle", angles_value) || !parse_entity_floats(angles_value, &yaw, 1)) {
+        return false;
+    }
+    out[0] = yaw == -1.0f ? -90.0f : (yaw == -2.0f ? 90.0f : 0.0f);
+    out[1] = yaw == -1.0f || yaw == -2.0f ? 0.0f : yaw;
+    out[2] = 0.0f;
+    return true;
+}
+
+Span<const uint32_t> BSPEntities::find_classname(std::string_view classname) const {
+    auto first = std::lower_bound(classname_order.begin(), classname_order.end(), classname,
+                                  [&](uint32_t entity, std::string_view name) { return classnames[entity] < name; });
+    auto last = std::upper_bound(first, classname_order.end(), classname,
+                                 [&](std::string_view name, uint32_t entity) { return name < classnames[entity]; });
+    return Span<const uint32_t>(classname_order.data() + (first - classname_order.begin()), size_t(last - first));
+}
+
+bool parse_entity_floats(std::string_view text, float* out, int count) {
+    size_t pos = 0;
+    for (int i = 0; i < count; i++) {
+        while (pos < text.size() && uint8_t(text[pos]) <= ' ') {
+            pos++;
+        }
+        size_t start = pos;
+        while (pos < text.size() && uint8_t(text[pos]) > ' ') {
+            pos++;
+        }
+        // strtof() needs a NUL-terminated copy.
+        size_t size = pos - start;
+        if (size == 0 || size > MAX_NUMBER_CHARS) {
+            return false;
+        }
+        char number[MAX_NUMBER_CHARS + 1];
+        memcpy(number, text.data() + start, size);
+        number[size] = '\0';
+        char* number_end = nullptr;
+        out[i] = strtof(number, &number_end);
+        if (number_end != number + size || !std::isfinite(out[i])) {
+            return false;
+        }
+    }
+    while (pos < text.size() && uint8_t(text[pos]) <= ' ') {
+        pos++;
+    }
+    return pos == text.size();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "common/span.h"
+
+
+// Key and value of an entity, without the quotes. Both point into the entities text.
+struct BSPEntityPair {
+    std::string_view key;
+    std::string_view value;
+};
+
+// Entity of the entities text: BSPEntities::pairs[first_pair..first_pair + num_pairs) in the order of the text.
+struct BSPEntity {
+    uint32_t first_pair = 0;
+    uint32_t num_pairs = 0;
+};
+
+// Entities text of a BSP split into { "key" "value" ... } blocks without copying it: the keys and the values are views
+// of the text, which must outlive this object. Large texts are split at the closing braces into ranges tokenized in
+// parallel, the split is checked and the text is tokenized again in one go if a brace was inside a string.
+class BSPEntities {
+public:
+    // Characters of text per task of parse(), smaller texts are tokenized on the calling thread.
+    static constexpr size_t CHARS_PER_TASK = 64 * 1024;
+
+    // Tokenize the text and index the classnames, with the ranges split across thread_pool() if parallel. Return false
+    // and log an error with the name if the text is not a sequence of blocks of key and value pairs.
+    bool parse(std::string_view text, const char* name, bool parallel = false);
+
+    size_t size() const {
+        return entities.size();
+    }
+
+    // Return the pairs of the entity.
+    Span<const BSPEntityPair> entity_pairs(size_t entity) const;
+    // Set value to the value of the key of the entity and return true, or return false if it has no such key. Keys are
+    // case-sensitive and the last pair wins, as in the engine.
+    bool find_value(size_t entity, std::string_view key, std::string_view& value) const;
+    // Return the value of the key of the entity, empty if it has none.
+    std::string_view value(size_t entity, std::string_view key) const;
+    // Return the classname of the entity, empty if it has none.
+    std::string_view classname(size_t entity) const {
+        return classnames[entity];
+    }
+    // Parse the "origin" of the entity. Return false if it has none or it is not 3 numbers.
+    bool origin(size_t entity, float out[3]) const;
+    // Parse the "angles" of the entity as pitch, yaw and roll in degrees, or its "angle" as the yaw, with -1 for up
+    // and -2 for down. Return false if it has neither or they are not numbers.
+    bool angles(size_t entity, float out[3]) const;
+    // Return the indices of the entities with the classname in ascending order.
+    Span<const uint32_t> find_classname(std::string_view classname) const;
+
+    std::string_view text;
+    std::vector<BSPEntity> entities;
+    std::vector<BSPEntityPair> pairs;
+    // Per entity.
+    std::vector<std::string_view> classnames;
+    // Indices of the entities sorted by classname, then by index.
+    std::vector<uint32_t> classname_order;
+};
+
+// Parse count numbers separated by whitespace into out. Return false if the text is anything else or a number is not
+// finite.
+bool parse_entity_floats(std::string_view text, float* out, int count);
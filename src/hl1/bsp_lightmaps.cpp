@@ -0,0 +1,168 @@
+#include "bsp_lightmaps.h"
+
+#include <atomic>
+#include <cstring>
+
+#include "common/atlas.h"
+#include "common/image.h"
+#include "common/slog.h"
+#include "common/thread.h"
+
+
+namespace {
+
+// Faces per task of the parallel copy.
+const size_t FACES_PER_TASK = 256;
+
+}  // namespace
+
+bool BSPLightmapAtlas::build(const BSPParser& bsp, const std::vector<BSPFaceLightmap>& lightmaps,
+                             const BSPLightmapAtlasOptions& options) {
+    pages.clear();
+    rects.clear();
+    uv_offsets.clear();
+    uvs.clear();
+    efficiency = 0.0;
+    if (lightmaps.size() != bsp.faces.size()) {
+        SLOG_ERROR("%s: Got %zu lightmaps for %zu faces", bsp.name.c_str(), lightmaps.size(), bsp.faces.size());
+        return false;
+    }
+
+    // One padded block per face with lightmap and the white luxel last.
+    std::vector<AtlasSize> sizes;
+    std::vector<uint32_t> face_blocks(lightmaps.size(), UINT32_MAX);
+    for (size_t face_idx = 0; face_idx < lightmaps.size(); face_idx++) {
+        const BSPFaceLightmap& lightmap = lightmaps[face_idx];
+        if (lightmap.num_styles == 0) {
+            continue;
+        }
+        size_t size = size_t(lightmap.width) * lightmap.height * 3 * size_t(lightmap.num_styles);
+        if (lightmap.offset > bsp.lighting.size() || bsp.lighting.size() - lightmap.offset < size) {
+            SLOG_ERROR("%s: Lightmap of face %zu out of bounds", bsp.name.c_str(), face_idx);
+            return false;
+        }
+        face_blocks[face_idx] = uint32_t(sizes.size());
+        sizes.push_back({lightmap.width + PADDING * 2,
+                         (lightmap.height + PADDING * 2) * uint32_t(lightmap.num_styles)});
+    }
+    uint32_t white_block = uint32_t(sizes.size());
+    sizes.push_back({1 + PADDING * 2, 1 + PADDING * 2});
+
+    AtlasPackOptions pack_options;
+    pack_options.page_width = options.page_size;
+    pack_options.page_height = options.page_size;
+    pack_options.parallel = options.parallel;
+    AtlasLayout layout;
+    if (!pack_atlas(sizes, pack_options, layout)) {
+        SLOG_ERROR("%s: Could not pack %zu lightmaps into %ux%u pages", bsp.name.c_str(), sizes.size(),
+                   options.page_size, options.page_size);
+        return false;
+    }
+    pages.resize(layout.pages.size());
+    uint64_t luxel_area = 0;
+    uint64_t page_area = 0;
+    for (size_t i = 0; i < layout.pages.size(); i++) {
+        pages[i].width = layout.pages[i].width;
+        pages[i].height = layout.pages[i].height;
+        pages[i].pixels.assign(size_t(pages[i].width) * pages[i].height * 4, 0);
+        page_area += uint64_t(pages[i].width) * pages[i].height;
+    }
+
+    const AtlasRect& white_rect = layout.rects[white_block];
+    uint8_t white[4] = {255, 255, 255, 255};
+    copy_rgba8_padded(white, 1, 1, pages[white_rect.page].pixels.data(), pages[white_rect.page].width,
+                      white_rect.x + PADDING, white_rect.y + PADDING, PADDING);
+
+    rects.resize(lightmaps.size());
+    for (size_t face_idx = 0; face_idx < lightmaps.size(); face_idx++) {
+        const BSPFaceLightmap& lightmap = lightmaps[face_idx];
+        BSPLightmapRect& rect = rects[face_idx];
+        if (face_blocks[face_idx] == UINT32_MAX) {
+            rect = {white_rect.page, white_rect.x + PADDING, white_rect.y + PADDING, 1, 1, 0, 0};
+            continue;
+        }
+        const AtlasRect& block = layout.rects[face_blocks[face_idx]];
+        rect = {block.page,      block.x + PADDING,  block.y + PADDING,  lightmap.width,
+                lightmap.height, lightmap.height + PADDING * 2, lightmap.num_styles};
+        luxel_area += uint64_t(lightmap.width) * lightmap.height * uint64_t(lightmap.num_styles);
+    }
+    efficiency = page_area > 0 ? double(luxel_area) / double(page_area) : 0.0;
+
+    // The blocks do not overlap, so the faces can be copied in any order.
+    thread_pool().run_for_chunked(
+        [&](size_t begin, size_t end) {
+            std::vector<uint8_t> rgba;
+            for (size_t face_idx = begin; face_idx < end; face_idx++) {
+                const BSPFaceLightmap& lightmap = lightmaps[face_idx];
+                const BSPLightmapRect& rect = rects[face_idx];
+                BSPLightmapPage& page = pages[rect.page];
+                size_t num_luxels = size_t(lightmap.width) * lightmap.height;
+                rgba.resize(num_luxels * 4);
+                for (int style = 0; style < lightmap.num_styles; style++) {
+                    const uint8_t* src = bsp.lighting.data() + lightmap.offset + num_luxels * 3 * size_t(style);
+                    for (size_t i = 0; i < num_luxels; i++) {
+                        memcpy(&rgba[i * 4], src + i * 3, 3);
+                        rgba[i * 4 + 3] = 255;
+                    }
+                    copy_rgba8_padded(rgba.data(), lightmap.width, lightmap.height, page.pixels.data(), page.width,
+                                      rect.x, rect.y + rect.style_stride * uint32_t(style), PADDING);
+                }
+            }
+        },
+        lightmaps.size(), FACES_PER_TASK, options.parallel);
+
+    // The UVs of a face start at the sum of the vertex counts of the faces before it.
+    uv_offsets.resize(bsp.faces.size());
+    uint32_t num_vertices = 0;
+    for (size_t face_idx = 0; face_idx < bsp.faces.size(); face_idx++) {
+        uv_offsets[face_idx] = num_vertices;
+        num_vertices += bsp.faces[face_idx].num_edges;
+    }
+    uvs.resize(size_t(num_vertices) * 2);
+    std::atomic<bool> uvs_valid{true};
+    thread_pool().run_for_chunked(
+        [&](size_t begin, size_t end) {
+            for (size_t face_idx = begin; face_idx < end; face_idx++) {
+                const BSPFace& face = bsp.faces[face_idx];
+                const BSPLightmapRect& rect = rects[face_idx];
+                const BSPLightmapPage& page = pages[rect.page];
+                float* face_uvs = uvs.data() + size_t(uv_offsets[face_idx]) * 2;
+                if (rect.num_styles == 0) {
+                    // Center of the white luxel.
+                    for (uint32_t i = 0; i < face.num_edges; i++) {
+                        face_uvs[i * 2] = (float(rect.x) + 0.5f) / float(page.width);
+                        face_uvs[i * 2 + 1] = (float(rect.y) + 0.5f) / float(page.height);
+                    }
+                    continue;
+                }
+                if (face.texinfo >= bsp.texinfos.size()) {
+                    uvs_valid = false;
+                    return;
+                }
+                // Luxel k is centered at the texture coordinate (mins + k) * 16, as in the engine.
+                const BSPTexinfo& texinfo = bsp.texinfos[face.texinfo];
+                const BSPFaceLightmap& lightmap = lightmaps[face_idx];
+                for (uint32_t i = 0; i < face.num_edges; i++) {
+                    const float* point = bsp.face_vertex(face, i);
+                    if (point == nullptr) {
+                        uvs_valid = false;
+                        return;
+                    }
+                    float s =
+                        point[0] * texinfo.s[0] + point[1] * texinfo.s[1] + point[2] * texinfo.s[2] + texinfo.s[3];
+                    float t =
+                        point[0] * texinfo.t[0] + point[1] * texinfo.t[1] + point[2] * texinfo.t[2] + texinfo.t[3];
+                    float u = (s + float(BSP_LUXEL_SIZE / 2)) / float(BSP_LUXEL_SIZE) - float(lightmap.mins[0]);
+                    float v = (t + float(BSP_LUXEL_SIZE / 2)) / float(BSP_LUXEL_SIZE) - float(lightmap.mins[1]);
+                    face_uvs[i * 2] = (float(rect.x) + u) / float(page.width);
+                    face_uvs[i * 2 + 1] = (float(rect.y) + v) / float(page.height);
+                }
+            }
+        },
+        bsp.faces.size(), FACES_PER_TASK, options.parallel);
+    if (!uvs_valid) {
+        SLOG_ERROR("%s: Texinfo or vertex of a face out of bounds", bsp.name.c_str());
+        return false;
+    }
+    return true;
+}
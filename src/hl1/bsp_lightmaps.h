@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "bsp.h"
+#include "bsp_decode.h"
+
+
+// Options for BSPLightmapAtlas::build().
+struct BSPLightmapAtlasOptions {
+    // Maximum page size.
+    uint32_t page_size = 2048;
+    // Pack, copy and compute UVs in parallel on thread_pool(). The result is the same as in the sequential case.
+    bool parallel = false;
+};
+
+// RGBA8 page of BSPLightmapAtlas.
+struct BSPLightmapPage {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+// Placement of the lightmap of a face in BSPLightmapAtlas.
+struct BSPLightmapRect {
+    uint32_t page = 0;
+    // Luxels of style 0.
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // Style k starts k * style_stride rows below style 0.
+    uint32_t style_stride = 0;
+    // Number of styles, 0 for the faces without lightmap.
+    int num_styles = 0;
+};
+
+// Lightmaps of all faces of a BSP packed into a few RGBA8 pages. The styles of a face are stacked vertically, each
+// one surrounded by PADDING luxels of replicated edges. Faces without lightmap (sky, water) point at a shared white
+// luxel, so that all faces can be drawn the same way.
+struct BSPLightmapAtlas {
+    static constexpr uint32_t PADDING = 1;
+
+    // Pack the face lightmaps computed by decode_bsp_lumps() and compute the lightmap UVs of the face vertices.
+    // Return false if the lightmaps are inconsistent with bsp or a lightmap does not fit into a page.
+    bool build(const BSPParser& bsp, const std::vector<BSPFaceLightmap>& lightmaps,
+               const BSPLightmapAtlasOptions& options = {});
+
+    std::vector<BSPLightmapPage> pages;
+    // Placement of each face.
+    std::vector<BSPLightmapRect> rects;
+    // Lightmap UVs of style 0 of the face vertices, (u, v) of vertex i of the face at uvs[2 * (uv_offsets[face_idx] +
+    // i)]. Style k of the face is k * style_stride / page height lower.
+    std::vector<uint32_t> uv_offsets;
+    std::vector<float> uvs;
+    // Luxel area / page area.
+    double efficiency = 0.0;
+};
@@ -0,0 +1,153 @@
+#include "bsp_mesh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <tuple>
+
+#include "common/slog.h"
+#include "common/thread.h"
+
+
+namespace {
+
+// Faces per task of the parallel triangulation.
+const size_t FACES_PER_TASK = 256;
+// Texture size for the texture coordinates of the textures missing from the textures lump.
+const uint32_t MISSING_TEXTURE_SIZE = 16;
+
+// Faces are sorted by model, texture and lightmap page, the face index keeps the order deterministic.
+struct SortedFace {
+    uint32_t model;
+    uint32_t texture;
+    uint32_t lightmap_page;
+    uint32_t face;
+
+    bool same_batch(const SortedFace& other) const {
+        return model == other.model && texture == other.texture && lightmap_page == other.lightmap_page;
+    }
+    bool operator<(const SortedFace& other) const {
+        return std::tie(model, texture, lightmap_page, face) <
+               std::tie(other.model, other.texture, other.lightmap_page, other.face);
+    }
+};
+
+}  // namespace
+
+bool BSPMesh::build(const BSPParser& bsp, const BSPDecodedLumps& lumps, const BSPLightmapAtlas& lightmaps,
+                    const BSPMeshOptions& options) {
+    vertices.clear();
+    indices.clear();
+    batches.clear();
+    models.clear();
+    faces.clear();
+    if (lightmaps.rects.size() != bsp.faces.size() || lightmaps.uv_offsets.size() != bsp.faces.size()) {
+        SLOG_ERROR("%s: Lightmap atlas is for %zu faces, the map has %zu", bsp.name.c_str(), lightmaps.rects.size(),
+                   bsp.faces.size());
+        return false;
+    }
+
+    // Check the references which the triangulation does not check, and sort the faces.
+    std::vector<SortedFace> sorted;
+    for (size_t model_idx = 0; model_idx < bsp.models.size(); model_idx++) {
+        const BSPModel& model = bsp.models[model_idx];
+        if (model.first_face < 0 || model.num_faces < 0 || size_t(model.first_face) > bsp.faces.size() ||
+            size_t(model.num_faces) > bsp.faces.size() - size_t(model.first_face)) {
+            SLOG_ERROR("%s: Faces of model %zu out of bounds", bsp.name.c_str(), model_idx);
+            return false;
+        }
+        for (size_t face_idx = size_t(model.first_face); face_idx < size_t(model.first_face + model.num_faces);
+             face_idx++) {
+            const BSPFace& face = bsp.faces[face_idx];
+            if (face.num_edges < 3 || face.texinfo >= bsp.texinfos.size() ||
+                bsp.texinfos[face.texinfo].miptex >= lumps.textures.size() ||
+                size_t(lightmaps.uv_offsets[face_idx]) + face.num_edges > lightmaps.uvs.size() / 2) {
+                SLOG_ERROR("%s: Invalid face %zu", bsp.name.c_str(), face_idx);
+                return false;
+            }
+            sorted.push_back({uint32_t(model_idx), bsp.texinfos[face.texinfo].miptex,
+                              lightmaps.rects[face_idx].page, uint32_t(face_idx)});
+        }
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    // Assign the vertex and index ranges in the sorted order, and merge the runs of faces into batches.
+    faces.resize(bsp.faces.size());
+    models.resize(bsp.models.size());
+    std::vector<uint32_t> first_vertices(sorted.size());
+    size_t num_vertices = 0;
+    size_t num_indices = 0;
+    for (size_t i = 0; i < sorted.size(); i++) {
+        const SortedFace& sorted_face = sorted[i];
+        uint32_t num_edges = bsp.faces[sorted_face.face].num_edges;
+        if (i == 0 || !sorted_face.same_batch(sorted[i - 1])) {
+            if (models[sorted_face.model].num_batches == 0) {
+                models[sorted_face.model].first_batch = uint32_t(batches.size());
+            }
+            models[sorted_face.model].num_batches++;
+            batches.push_back({sorted_face.texture, sorted_face.lightmap_page, uint32_t(num_indices), 0});
+        }
+        BSPMeshFace& mesh_face = faces[sorted_face.face];
+        mesh_face.first_index = uint32_t(num_indices);
+        mesh_face.num_indices = (num_edges - 2) * 3;
+        mesh_face.batch = uint32_t(batches.size() - 1);
+        batches.back().num_indices += mesh_face.num_indices;
+        first_vertices[i] = uint32_t(num_vertices);
+        num_vertices += num_edges;
+        num_indices += mesh_face.num_indices;
+    }
+    vertices.resize(num_vertices);
+    indices.resize(num_indices);
+
+    // Each face writes its own ranges, so the faces can be triangulated in any order.
+    std::atomic<bool> vertices_valid{true};
+    thread_pool().run_for_chunked(
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                uint32_t face_idx = sorted[i].face;
+                const BSPFace& face = bsp.faces[face_idx];
+                const BSPTexinfo& texinfo = bsp.texinfos[face.texinfo];
+                const BSPTexture& texture = lumps.textures[texinfo.miptex];
+                float width = float(texture.width != 0 ? texture.width : MISSING_TEXTURE_SIZE);
+                float height = float(texture.height != 0 ? texture.height : MISSING_TEXTURE_SIZE);
+                const float* lightmap_uvs = &lightmaps.uvs[size_t(lightmaps.uv_offsets[face_idx]) * 2];
+
+                uint32_t first_vertex = first_vertices[i];
+                for (uint32_t edge = 0; edge < face.num_edges; edge++) {
+                    const float* point = bsp.face_vertex(face, edge);
+                    if (point == nullptr) {
+                        vertices_valid = false;
+                        return;
+                    }
+                    BSPMeshVertex& vertex = vertices[first_vertex + edge];
+                    for (int axis = 0; axis < 3; axis++) {
+                        vertex.position[axis] = point[axis];
+                    }
+                    float s =
+                        point[0] * texinfo.s[0] + point[1] * texinfo.s[1] + point[2] * texinfo.s[2] + texinfo.s[3];
+                    float t =
+                        point[0] * texinfo.t[0] + point[1] * texinfo.t[1] + point[2] * texinfo.t[2] + texinfo.t[3];
+                    vertex.uv[0] = s / width;
+                    vertex.uv[1] = t / height;
+                    vertex.lightmap_uv[0] = lightmap_uvs[edge * 2];
+                    vertex.lightmap_uv[1] = lightmap_uvs[edge * 2 + 1];
+                }
+
+                uint32_t* face_indices = &indices[faces[face_idx].first_index];
+                for (uint32_t edge = 1; edge + 1 < face.num_edges; edge++) {
+                    face_indices[0] = first_vertex;
+                    face_indices[1] = first_vertex + edge;
+                    face_indices[2] = first_vertex + edge + 1;
+                    face_indices += 3;
+                }
+            }
+        },
+        sorted.size(), FACES_PER_TASK, options.parallel);
+    if (!vertices_valid) {
+        SLOG_ERROR("%s: Face vertex out of bounds", bsp.name.c_str());
+        return false;
+    }
+
+    SLOG_INFO("%s: %zu faces, %zu vertices, %zu triangles in %zu batches", bsp.name.c_str(), sorted.size(),
+              vertices.size(), indices.size() / 3, batches.size());
+    return true;
+}
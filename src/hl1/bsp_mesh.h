@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "bsp.h"
+#include "bsp_decode.h"
+#include "bsp_lightmaps.h"
+
+
+// Interleaved vertex of BSPMesh.
+struct BSPMeshVertex {
+    float position[3];
+    // Texture coordinates normalized by the texture size, repeating outside of 0..1.
+    float uv[2];
+    // Coordinates of lightmap style 0 in the page of BSPLightmapAtlas.
+    float lightmap_uv[2];
+};
+static_assert(sizeof(BSPMeshVertex) == 28);
+
+// Range of BSPMesh::indices drawn with one texture and one lightmap page.
+struct BSPMeshBatch {
+    // Index in BSPDecodedLumps::textures.
+    uint32_t texture = 0;
+    uint32_t lightmap_page = 0;
+    uint32_t first_index = 0;
+    uint32_t num_indices = 0;
+};
+
+// Batches of one model of the BSP. Brush entities move, so their faces are never merged with the world.
+struct BSPMeshModel {
+    uint32_t first_batch = 0;
+    uint32_t num_batches = 0;
+};
+
+// Indices of one face in BSPMesh.
+struct BSPMeshFace {
+    uint32_t first_index = 0;
+    // 0 for the faces not covered by any model.
+    uint32_t num_indices = 0;
+    uint32_t batch = 0;
+};
+
+// Options for BSPMesh::build().
+struct BSPMeshOptions {
+    // Triangulate the faces in parallel on thread_pool(). The result is the same as in the sequential case.
+    bool parallel = false;
+};
+
+// Triangles of all faces of a BSP in a single vertex and index buffer. The faces of each model are sorted by texture
+// and lightmap page, so that a model is drawn with one draw call per batch instead of one per face.
+struct BSPMesh {
+    // Triangulate the faces as fans, keeping their winding (clockwise seen from the front, as in Quake), and merge
+    // them into batches. Return false if a face references something out of bounds.
+    bool build(const BSPParser& bsp, const BSPDecodedLumps& lumps, const BSPLightmapAtlas& lightmaps,
+               const BSPMeshOptions& options = {});
+
+    std::vector<BSPMeshVertex> vertices;
+    std::vector<uint32_t> indices;
+    // Batches ordered by model, then by texture and lightmap page.
+    std::vector<BSPMeshBatch> batches;
+    // Per BSPParser::models.
+    std::vector<BSPMeshModel> models;
+    // Per BSPParser::faces.
+    std::vector<BSPMeshFace> faces;
+};
@@ -0,0 +1,103 @@
+#include "bsp_occlusion.h"
+
+#include <cmath>
+#include <string_view>
+
+#include "common/slog.h"
+
+
+bool BSPOcclusion::init(const BSPParser& bsp, const BSPDecodedLumps& lumps, float min_area) {
+    face_occluders.assign(bsp.faces.size(), UINT32_MAX);
+    first_vertices.assign(1, 0);
+    vertices.clear();
+    interior_edges.clear();
+    if (!bsp.valid) {
+        return false;
+    }
+
+    // First occluder using each edge and the index of its vertex starting the edge.
+    struct EdgeOwner {
+        uint32_t face = UINT32_MAX;
+        uint32_t vertex = 0;
+    };
+    std::vector<EdgeOwner> edge_owners(bsp.edges.size());
+    const BSPModel& world = bsp.models[0];
+    if (world.first_face < 0 || world.num_faces < 0 ||
+        size_t(world.first_face) + size_t(world.num_faces) > bsp.faces.size()) {
+        SLOG_ERROR("%s: Faces of the world out of bounds", bsp.name.c_str());
+        return false;
+    }
+    for (size_t face_idx = size_t(world.first_face); face_idx < size_t(world.first_face + world.num_faces);
+         face_idx++) {
+        const BSPFace& face = bsp.faces[face_idx];
+        if (face.texinfo >= bsp.texinfos.size() || bsp.texinfos[face.texinfo].miptex >= lumps.textures.size()) {
+            SLOG_ERROR("%s: Texinfo or texture of face %zu out of bounds", bsp.name.c_str(), face_idx);
+            return false;
+        }
+        const BSPTexinfo& texinfo = bsp.texinfos[face.texinfo];
+        std::string_view name = lumps.textures[texinfo.miptex].name;
+        if ((texinfo.flags & BSP_TEX_SPECIAL) != 0 || (!name.empty() && (name[0] == '{' || name[0] == '!'))) {
+            continue;
+        }
+
+        size_t first_vertex = vertices.size();
+        for (uint32_t i = 0; i < face.num_edges; i++) {
+            const float* point = bsp.face_vertex(face, i);
+            if (point == nullptr) {
+                SLOG_ERROR("%s: Edge %u of face %zu out of bounds", bsp.name.c_str(), i, face_idx);
+                return false;
+            }
+            vertices.insert(vertices.end(), point, point + 3);
+        }
+        // Twice the area is the length of the sum of the cross products of the fan triangles.
+        float cross_sum[3] = {};
+        const float* v0 = &vertices[first_vertex];
+        for (size_t i = first_vertex + 6; i < vertices.size(); i += 3) {
+            const float* v1 = &vertices[i - 3];
+            const float* v2 = &vertices[i];
+            float e1[3] = {v1[0] - v0[0], v1[1] - v0[1], v1[2] - v0[2]};
+            float e2[3] = {v2[0] - v0[0], v2[1] - v0[1], v2[2] - v0[2]};
+            cross_sum[0] += e1[1] * e2[2] - e1[2] * e2[1];
+            cross_sum[1] += e1[2] * e2[0] - e1[0] * e2[2];
+            cross_sum[2] += e1[0] * e2[1] - e1[1] * e2[0];
+        }
+        float area = 0.5f * std::sqrt(cross_sum[0] * cross_sum[0] + cross_sum[1] * cross_sum[1] +
+                                      cross_sum[2] * cross_sum[2]);
+        if (!(area >= min_area)) {
+            vertices.resize(first_vertex);
+            continue;
+        }
+        face_occluders[face_idx] = uint32_t(first_vertices.size() - 1);
+        first_vertices.push_back(uint32_t(vertices.size() / 3));
+
+        // The edges shared by two occluders in the same plane are interior.
+        interior_edges.resize(vertices.size() / 3, 0);
+        for (uint32_t i = 0; i < face.num_edges; i++) {
+            int32_t surfedge = bsp.surfedges[size_t(face.first_edge) + i];
+            size_t edge_idx = surfedge >= 0 ? size_t(surfedge) : size_t(-int64_t(surfedge));
+            uint32_t vertex_idx = uint32_t(first_vertex / 3) + i;
+            EdgeOwner& owner = edge_owners[edge_idx];
+            if (owner.face == UINT32_MAX) {
+                owner = {uint32_t(face_idx), vertex_idx};
+            } else if (bsp.faces[owner.face].plane == face.plane && bsp.faces[owner.face].side == face.side) {
+                interior_edges[owner.vertex] = 1;
+                interior_edges[vertex_idx] = 1;
+            }
+        }
+    }
+    return true;
+}
+
+void BSPOcclusion::render(const OcclusionView& view, const BSPVisibleSet& visible, OcclusionBuffer& buffer,
+                          bool parallel) const {
+    buffer.begin(view);
+    for (uint32_t face_idx : visible.face_list) {
+        uint32_t occluder = face_idx < face_occluders.size() ? face_occluders[face_idx] : UINT32_MAX;
+        if (occluder != UINT32_MAX) {
+            uint32_t first_vertex = first_vertices[occluder];
+            buffer.add_occluder(&vertices[size_t(first_vertex) * 3], first_vertices[occluder + 1] - first_vertex,
+                                &interior_edges[first_vertex]);
+        }
+    }
+    buffer.render(parallel);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "bsp.h"
+#include "bsp_decode.h"
+#include "bsp_vis.h"
+#include "common/occlusion.h"
+
+
+// Large opaque world faces of a BSP used as occluders. A frame renders the occluders among the faces left by the PVS
+// and the frustum into an OcclusionBuffer, then BSPVisibility::find_unoccluded_faces() drops the leaves and the ranges
+// behind them before the draw calls.
+class BSPOcclusion {
+public:
+    static constexpr float DEFAULT_MIN_AREA = 4096.0f;
+
+    // Select the world faces with an area of at least min_area square units and an opaque texture as occluders, so
+    // not the special ones (sky, liquids, triggers) nor the alpha-tested ones ({ names) and the liquids (! names).
+    // Return false if a face references something out of bounds.
+    bool init(const BSPParser& bsp, const BSPDecodedLumps& lumps, float min_area = DEFAULT_MIN_AREA);
+
+    // Start a frame of buffer with the view and render the occluders among visible.face_list, with the tiles split
+    // across thread_pool() if parallel.
+    void render(const OcclusionView& view, const BSPVisibleSet& visible, OcclusionBuffer& buffer,
+                bool parallel = false) const;
+
+    // Per BSPParser::faces, the index of its occluder or UINT32_MAX.
+    std::vector<uint32_t> face_occluders;
+    // Vertices of occluder i, 3 floats each: vertices[first_vertices[i] * 3..first_vertices[i + 1] * 3).
+    std::vector<uint32_t> first_vertices;
+    std::vector<float> vertices;
+    // Per vertex, non-zero if the edge to the next vertex is shared with another occluder in the same plane.
+    std::vector<uint8_t> interior_edges;
+};
@@ -0,0 +1,168 @@
+#include "bsp_trace.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "common/slog.h"
+#include "common/thread.h"
+
+
+namespace {
+
+// Moves per task of the parallel traces.
+const size_t MOVES_PER_TASK = 256;
+
+}  // namespace
+
+bool BSPHulls::build(const BSPParser& bsp) {
+    nodes.clear();
+    normals.clear();
+    if (!bsp.valid) {
+        return false;
+    }
+    BSPNodeFlattener flattener(bsp);
+    for (int hull = 0; hull < BSP_NUM_HULLS; hull++) {
+        // Hull 0 is made from the nodes and the leaves, as the engine does.
+        auto leaf_contents = [&](int32_t child, int32_t& contents) {
+            if (hull != 0) {
+                contents = child;
+                return true;
+            }
+            size_t leaf_idx = size_t(-(child + 1));
+            if (leaf_idx >= bsp.leaves.size() || bsp.leaves[leaf_idx].contents >= 0) {
+                return false;
+            }
+            contents = bsp.leaves[leaf_idx].contents;
+            return true;
+        };
+
+        int32_t root = bsp.models[0].head_nodes[hull];
+        if (root >= 0) {
+            roots[hull] = int32_t(flattener.nodes.size());
+            if (!flattener.flatten(root, hull != 0, leaf_contents)) {
+                SLOG_ERROR("%s: Invalid tree of hull %d", bsp.name.c_str(), hull);
+                return false;
+            }
+        } else if (!leaf_contents(root, roots[hull])) {
+            SLOG_ERROR("%s: Root of hull %d out of bounds", bsp.name.c_str(), hull);
+            return false;
+        }
+    }
+    nodes = std::move(flattener.nodes);
+    normals = std::move(flattener.normals);
+    return true;
+}
+
+const float* BSPHulls::node_normal(const BSPTreeNode& node, float axial[3]) const {
+    if (node.type < 3) {
+        axial[0] = 0.0f;
+        axial[1] = 0.0f;
+        axial[2] = 0.0f;
+        axial[node.type] = 1.0f;
+        return axial;
+    }
+    return &normals[size_t(node.type - 3) * 3];
+}
+
+int32_t BSPHulls::contents(int32_t node_idx, const float point[3]) const {
+    while (node_idx >= 0) {
+        const BSPTreeNode& node = nodes[size_t(node_idx)];
+        node_idx = node.children[bsp_node_distance(node, normals.data(), point) < 0.0f ? 1 : 0];
+    }
+    return node_idx;
+}
+
+int32_t BSPHulls::point_contents(int hull, const float point[3]) const {
+    return contents(roots[hull], point);
+}
+
+bool BSPHulls::check(int hull, int32_t node_idx, float p1f, float p2f, const float p1[3], const float p2[3],
+                     BSPTrace& trace) const {
+    // Return false once the impact is found. The sides of a node with both ends on one side are walked in the loop.
+    while (node_idx >= 0) {
+        const BSPTreeNode& node = nodes[size_t(node_idx)];
+        float t1 = bsp_node_distance(node, normals.data(), p1);
+        float t2 = bsp_node_distance(node, normals.data(), p2);
+        if (t1 >= 0.0f && t2 >= 0.0f) {
+            node_idx = node.children[0];
+            continue;
+        }
+        if (t1 < 0.0f && t2 < 0.0f) {
+            node_idx = node.children[1];
+            continue;
+        }
+
+        // Put the crossing point DIST_EPSILON on the near side, in double precision like the engine.
+        float frac = float((t1 < 0.0f ? t1 + DIST_EPSILON : t1 - DIST_EPSILON) / (t1 - t2));
+        frac = std::min(std::max(frac, 0.0f), 1.0f);
+        float midf = p1f + (p2f - p1f) * frac;
+        float mid[3];
+        for (int i = 0; i < 3; i++) {
+            mid[i] = p1[i] + frac * (p2[i] - p1[i]);
+        }
+        int side = t1 < 0.0f ? 1 : 0;
+        if (!check(hull, node.children[side], p1f, midf, p1, mid, trace)) {
+            return false;
+        }
+        if (contents(node.children[side ^ 1], mid) != BSP_CONTENTS_SOLID) {
+            return check(hull, node.children[side ^ 1], midf, p2f, mid, p2, trace);
+        }
+        if (trace.all_solid) {
+            return false;
+        }
+
+        // The other side is solid, this is the impact.
+        float axial[3];
+        const float* normal = node_normal(node, axial);
+        for (int i = 0; i < 3; i++) {
+            trace.plane.normal[i] = side == 0 ? normal[i] : 0.0f - normal[i];
+        }
+        trace.plane.dist = side == 0 ? node.dist : -node.dist;
+        // Back up when the epsilon put the point into another solid, e.g. in a corner.
+        while (contents(roots[hull], mid) == BSP_CONTENTS_SOLID) {
+            frac = float(frac - 0.1);
+            if (frac < 0.0f) {
+                break;
+            }
+            midf = p1f + (p2f - p1f) * frac;
+            for (int i = 0; i < 3; i++) {
+                mid[i] = p1[i] + frac * (p2[i] - p1[i]);
+            }
+        }
+        trace.fraction = midf;
+        std::copy(mid, mid + 3, trace.end_position);
+        return false;
+    }
+
+    if (node_idx != BSP_CONTENTS_SOLID) {
+        trace.all_solid = false;
+        if (node_idx == BSP_CONTENTS_EMPTY) {
+            trace.in_open = true;
+        } else {
+            trace.in_water = true;
+        }
+    } else {
+        trace.start_solid = true;
+    }
+    return true;
+}
+
+BSPTrace BSPHulls::trace(int hull, const BSPRay& move) const {
+    BSPTrace result;
+    std::copy(move.end, move.end + 3, result.end_position);
+    check(hull, roots[hull], 0.0f, 1.0f, move.start, move.end, result);
+    if (result.all_solid) {
+        result.start_solid = true;
+    }
+    return result;
+}
+
+void BSPHulls::trace_moves(int hull, const BSPRay* moves, size_t num_moves, BSPTrace* traces, bool parallel) const {
+    thread_pool().run_for_chunked(
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                traces[i] = trace(hull, moves[i]);
+            }
+        },
+        num_moves, MOVES_PER_TASK, parallel);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bsp.h"
+#include "bsp_tree.h"
+
+
+// Hulls of BSPModel::head_nodes: hull 0 is the node tree for points, hulls 1-3 are the clipnode trees expanded by the
+// boxes of a standing player (32x32x72), a large monster (64x64x64) and a crouching player (32x32x36).
+const int BSP_NUM_HULLS = 4;
+
+// Plane a trace stopped at, facing the start of the move.
+struct BSPTracePlane {
+    float normal[3] = {};
+    float dist = 0.0f;
+};
+
+// Result of BSPHulls::trace(), with the fields and the semantics of the engine traces.
+struct BSPTrace {
+    // True if the move never left solid space.
+    bool all_solid = true;
+    // True if the move started in solid space.
+    bool start_solid = false;
+    // True if the move went through empty space or through water, slime or lava.
+    bool in_open = false;
+    bool in_water = false;
+    // Fraction of the move before the impact, 1 if nothing was hit. The impact is DIST_EPSILON in front of the plane.
+    float fraction = 1.0f;
+    float end_position[3] = {};
+    BSPTracePlane plane;
+};
+
+// Copy of the hull trees of the world for box traces, flattened by BSPNodeFlattener. The leaf children are contents,
+// hull 0 has the contents of the leaves in place of the leaf indices.
+class BSPHulls {
+public:
+    static constexpr double DIST_EPSILON = 0.03125;
+    static constexpr size_t MAX_DEPTH = BSPNodeFlattener::MAX_DEPTH;
+
+    // Flatten the hulls of model 0. Return false if a tree references something out of bounds, a node is reached twice
+    // or a tree is deeper than MAX_DEPTH.
+    bool build(const BSPParser& bsp);
+
+    // Return the contents of the hull at the point.
+    int32_t point_contents(int hull, const float point[3]) const;
+    // Move the origin of the box of the hull from move.start to move.end and return where it stops. The epsilons, the
+    // order of the float operations and the backing up out of solid space are those of the engine.
+    BSPTrace trace(int hull, const BSPRay& move) const;
+    // Trace num_moves moves into traces, on thread_pool() if parallel.
+    void trace_moves(int hull, const BSPRay* moves, size_t num_moves, BSPTrace* traces, bool parallel = false) const;
+
+    std::vector<BSPTreeNode> nodes;
+    // Normals of the non-axial planes, 3 floats each.
+    std::vector<float> normals;
+    // Root node of each hull, or its contents if the hull has no nodes.
+    int32_t roots[BSP_NUM_HULLS] = {};
+
+private:
+    const float* node_normal(const BSPTreeNode& node, float axial[3]) const;
+    int32_t contents(int32_t node_idx, const float point[3]) const;
+    bool check(int hull, int32_t node_idx, float p1f, float p2f, const float p1[3], const float p2[3],
+               BSPTrace& trace) const;
+};
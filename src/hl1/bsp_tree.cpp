@@ -0,0 +1,472 @@
+#include "bsp_tree.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+#include "common/common.h"
+#include "common/simd.h"
+#include "common/slog.h"
+#include "common/thread.h"
+
+
+namespace {
+
+// Rays per task of the parallel casts, a multiple of the packet size.
+const size_t RAYS_PER_TASK = 256;
+const size_t PACKET_SIZE = 4;
+// Distance a hit point can be outside of the edges of a face and still hit it.
+const float FACE_EPSILON = 0.01f;
+
+struct StackEntry {
+    int32_t node;
+    int32_t entry_node;
+    float tmin;
+    float tmax;
+};
+
+struct PacketStackEntry {
+    int32_t node;
+    int32_t entry_nodes[PACKET_SIZE];
+    float tmin[PACKET_SIZE];
+    float tmax[PACKET_SIZE];
+};
+
+// Return the parameter where the ray leaves the near side of a plane, FLT_MAX if it stays on it.
+FORCE_INLINE float crossing(float start_dist, float dot, int near) {
+    return (near == 0 ? dot < 0.0f : dot > 0.0f) ? -start_dist / dot : FLT_MAX;
+}
+
+void set_hit(const float start[3], const float direction[3], float fraction, BSPRayHit& hit) {
+    hit.fraction = fraction;
+    for (int i = 0; i < 3; i++) {
+        hit.position[i] = start[i] + direction[i] * fraction;
+    }
+}
+
+// Split the lanes of a packet by a plane as cast_ray() splits a single ray: clip tmax to the part in front of the plane
+// and set far_tmin to the start of the part behind it, 2 for the lanes without one. Return the lanes with a part in
+// front in bits 0-3 and the lanes with a part behind in bits 4-7.
+uint32_t split_packet(float start_dist, int near, const float dots[PACKET_SIZE], const float tmin[PACKET_SIZE],
+                      float tmax[PACKET_SIZE], float far_tmin[PACKET_SIZE]) {
+#if defined(SIMD_USE_SSE2)
+    __m128 dot = _mm_loadu_ps(dots);
+    __m128 crosses = near == 0 ? _mm_cmplt_ps(dot, _mm_setzero_ps()) : _mm_cmpgt_ps(dot, _mm_setzero_ps());
+    __m128 t = _mm_div_ps(_mm_set1_ps(-start_dist), dot);
+    t = _mm_or_ps(_mm_and_ps(crosses, t), _mm_andnot_ps(crosses, _mm_set1_ps(FLT_MAX)));
+    __m128 lo = _mm_loadu_ps(tmin);
+    __m128 hi = _mm_loadu_ps(tmax);
+    __m128 active = _mm_cmple_ps(lo, hi);
+    __m128 near_mask = _mm_and_ps(active, _mm_cmpge_ps(t, lo));
+    __m128 far_mask = _mm_and_ps(active, _mm_cmplt_ps(t, hi));
+    __m128 far_lo = _mm_or_ps(_mm_and_ps(far_mask, _mm_max_ps(t, lo)), _mm_andnot_ps(far_mask, _mm_set1_ps(2.0f)));
+    _mm_storeu_ps(far_tmin, far_lo);
+    _mm_storeu_ps(tmax, _mm_min_ps(hi, t));
+    return movemask_u32(near_mask) | movemask_u32(far_mask) << 4;
+#elif defined(SIMD_USE_NEON)
+    float32x4_t dot = vld1q_f32(dots);
+    uint32x4_t crosses = near == 0 ? vcltq_f32(dot, vdupq_n_f32(0.0f)) : vcgtq_f32(dot, vdupq_n_f32(0.0f));
+    float32x4_t t = vbslq_f32(crosses, vdivq_f32(vdupq_n_f32(-start_dist), dot), vdupq_n_f32(FLT_MAX));
+    float32x4_t lo = vld1q_f32(tmin);
+    float32x4_t hi = vld1q_f32(tmax);
+    uint32x4_t active = vcleq_f32(lo, hi);
+    uint32x4_t near_mask = vandq_u32(active, vcgeq_f32(t, lo));
+    uint32x4_t far_mask = vandq_u32(active, vcltq_f32(t, hi));
+    vst1q_f32(far_tmin, vbslq_f32(far_mask, vmaxq_f32(t, lo), vdupq_n_f32(2.0f)));
+    vst1q_f32(tmax, vminq_f32(hi, t));
+    return movemask_u32(near_mask) | movemask_u32(far_mask) << 4;
+#else
+    uint32_t lanes = 0;
+    for (size_t lane = 0; lane < PACKET_SIZE; lane++) {
+        float t = crossing(start_dist, dots[lane], near);
+        bool active = tmin[lane] <= tmax[lane];
+        bool front = active && t >= tmin[lane];
+        bool back = active && t < tmax[lane];
+        far_tmin[lane] = back ? std::max(t, tmin[lane]) : 2.0f;
+        tmax[lane] = std::min(tmax[lane], t);
+        lanes |= (front ? 1u : 0u) << lane | (back ? 1u : 0u) << (lane + 4);
+    }
+    return lanes;
+#endif
+}
+
+}  // namespace
+
+BSPNodeFlattener::BSPNodeFlattener(const BSPParser& parser)
+    : bsp(parser), plane_normals(parser.planes.size(), UINT32_MAX) {}
+
+bool BSPNodeFlattener::flatten(int32_t root, bool clipnodes, const LeafRule& leaf_rule) {
+    struct PendingNode {
+        int32_t node;
+        // Index of the parent in nodes, -1 for the root.
+        int32_t parent;
+        int side;
+        size_t tree_depth;
+    };
+    std::vector<PendingNode> pending = {{root, -1, 0, 1}};
+    size_t num_source_nodes = clipnodes ? bsp.clipnodes.size() : bsp.nodes.size();
+    std::vector<uint8_t> visited(num_source_nodes, 0);
+    while (!pending.empty()) {
+        PendingNode p = pending.back();
+        pending.pop_back();
+        if (p.node < 0 || size_t(p.node) >= num_source_nodes || visited[size_t(p.node)] || p.tree_depth > MAX_DEPTH) {
+            SLOG_ERROR("%s: Node %d out of bounds, reached twice or deeper than %zu", bsp.name.c_str(), p.node,
+                       MAX_DEPTH);
+            return false;
+        }
+        visited[size_t(p.node)] = 1;
+        depth = std::max(depth, p.tree_depth);
+        uint32_t plane_idx = 0;
+        const int16_t* children = nullptr;
+        if (clipnodes) {
+            plane_idx = uint32_t(bsp.clipnodes[size_t(p.node)].plane);
+            children = bsp.clipnodes[size_t(p.node)].children;
+        } else {
+            plane_idx = bsp.nodes[size_t(p.node)].plane;
+            children = bsp.nodes[size_t(p.node)].children;
+        }
+        if (plane_idx >= bsp.planes.size()) {
+            SLOG_ERROR("%s: Plane of node %d out of bounds", bsp.name.c_str(), p.node);
+            return false;
+        }
+
+        int32_t tree_idx = int32_t(nodes.size());
+        if (p.parent >= 0) {
+            nodes[size_t(p.parent)].children[p.side] = tree_idx;
+        }
+        const BSPPlane& plane = bsp.planes[plane_idx];
+        BSPTreeNode tree_node = {};
+        tree_node.dist = plane.dist;
+        // Axial planes of the compilers have the positive unit normal, keep the full normal for anything else.
+        bool axial = uint32_t(plane.type) <= uint32_t(BSP_PLANE_Z) && plane.normal[plane.type] == 1.0f;
+        if (axial) {
+            tree_node.type = uint32_t(plane.type);
+        } else {
+            if (plane_normals[plane_idx] == UINT32_MAX) {
+                plane_normals[plane_idx] = uint32_t(normals.size() / 3);
+                normals.insert(normals.end(), plane.normal, plane.normal + 3);
+            }
+            tree_node.type = 3 + plane_normals[plane_idx];
+        }
+        for (int side = 0; side < 2; side++) {
+            if (children[side] < 0 && !leaf_rule(children[side], tree_node.children[side])) {
+                SLOG_ERROR("%s: Leaf of node %d out of bounds or invalid", bsp.name.c_str(), p.node);
+                return false;
+            }
+        }
+        nodes.push_back(tree_node);
+        source_nodes.push_back(p.node);
+
+        // The back child is popped last, so the front child follows its parent.
+        for (int side = 1; side >= 0; side--) {
+            if (children[side] >= 0) {
+                pending.push_back({children[side], tree_idx, side, p.tree_depth + 1});
+            }
+        }
+    }
+    return true;
+}
+
+bool BSPTree::build(const BSPParser& bsp) {
+    nodes.clear();
+    normals.clear();
+    node_first_faces.clear();
+    faces.clear();
+    edge_planes.clear();
+    depth = 0;
+    if (!bsp.valid || bsp.nodes.empty() || bsp.leaves.empty()) {
+        SLOG_ERROR("%s: No nodes or leaves", bsp.name.c_str());
+        return false;
+    }
+    leaf_solid.resize(bsp.leaves.size());
+    for (size_t leaf_idx = 0; leaf_idx < bsp.leaves.size(); leaf_idx++) {
+        int32_t contents = bsp.leaves[leaf_idx].contents;
+        leaf_solid[leaf_idx] = contents == BSP_CONTENTS_SOLID || contents == BSP_CONTENTS_SKY ? 1 : 0;
+    }
+
+    BSPNodeFlattener flattener(bsp);
+    bool flattened = flattener.flatten(bsp.models[0].head_nodes[0], false, [&](int32_t child, int32_t& out) {
+        size_t leaf_idx = size_t(-(child + 1));
+        out = ~int32_t(leaf_idx);
+        return leaf_idx < bsp.leaves.size();
+    });
+    if (!flattened) {
+        return false;
+    }
+    nodes = std::move(flattener.nodes);
+    normals = std::move(flattener.normals);
+    depth = flattener.depth;
+
+    for (int32_t node_idx : flattener.source_nodes) {
+        const BSPNode& node = bsp.nodes[size_t(node_idx)];
+        if (size_t(node.first_face) + node.num_faces > bsp.faces.size()) {
+            SLOG_ERROR("%s: Faces of node %d out of bounds", bsp.name.c_str(), node_idx);
+            return false;
+        }
+        node_first_faces.push_back(uint32_t(faces.size()));
+        for (uint32_t face_idx = node.first_face; face_idx < uint32_t(node.first_face) + node.num_faces; face_idx++) {
+            const BSPFace& face = bsp.faces[face_idx];
+            if (face.plane >= bsp.planes.size()) {
+                SLOG_ERROR("%s: Plane of face %u out of bounds", bsp.name.c_str(), face_idx);
+                return false;
+            }
+            const BSPPlane& face_plane = bsp.planes[face.plane];
+            float sign = face.side != 0 ? -1.0f : 1.0f;
+            float normal[3] = {face_plane.normal[0] * sign, face_plane.normal[1] * sign, face_plane.normal[2] * sign};
+            float center[3] = {};
+            for (uint32_t i = 0; i < face.num_edges; i++) {
+                const float* point = bsp.face_vertex(face, i);
+                if (point == nullptr) {
+                    SLOG_ERROR("%s: Vertex of face %u out of bounds", bsp.name.c_str(), face_idx);
+                    return false;
+                }
+                for (int j = 0; j < 3; j++) {
+                    center[j] += point[j] / float(face.num_edges);
+                }
+            }
+            if (face.num_edges < 3) {
+                continue;
+            }
+
+            // The edge planes are perpendicular to the face and point inwards whatever the winding.
+            BSPTreeFace tree_face = {face_idx, face.side != 0 ? 1u : 0u, uint32_t(edge_planes.size() / 4), 0};
+            for (uint32_t i = 0; i < face.num_edges; i++) {
+                const float* a = bsp.face_vertex(face, i);
+                const float* b = bsp.face_vertex(face, (i + 1) % face.num_edges);
+                float edge[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+                float edge_normal[3] = {normal[1] * edge[2] - normal[2] * edge[1],
+                                        normal[2] * edge[0] - normal[0] * edge[2],
+                                        normal[0] * edge[1] - normal[1] * edge[0]};
+                float length = std::sqrt(edge_normal[0] * edge_normal[0] + edge_normal[1] * edge_normal[1] +
+                                         edge_normal[2] * edge_normal[2]);
+                if (length < 1e-6f) {
+                    continue;
+                }
+                float edge_dist = 0.0f;
+                float center_dist = 0.0f;
+                for (int j = 0; j < 3; j++) {
+                    edge_normal[j] /= length;
+                    edge_dist += edge_normal[j] * a[j];
+                    center_dist += edge_normal[j] * center[j];
+                }
+                float inward = center_dist >= edge_dist ? 1.0f : -1.0f;
+                for (int j = 0; j < 3; j++) {
+                    edge_planes.push_back(edge_normal[j] * inward);
+                }
+                edge_planes.push_back(edge_dist * inward);
+                tree_face.num_edge_planes++;
+            }
+            faces.push_back(tree_face);
+        }
+    }
+    node_first_faces.push_back(uint32_t(faces.size()));
+    return true;
+}
+
+float BSPTree::node_dot(const BSPTreeNode& node, const float direction[3]) const {
+    if (node.type < 3) {
+        return direction[node.type];
+    }
+    const float* normal = &normals[size_t(node.type - 3) * 3];
+    return direction[0] * normal[0] + direction[1] * normal[1] + direction[2] * normal[2];
+}
+
+int32_t BSPTree::find_face(int32_t node_idx, const float point[3], float dot) const {
+    // The ray enters the front of the faces with side 0 when it goes against the plane normal.
+    uint32_t facing_side = dot < 0.0f ? 0 : 1;
+    for (uint32_t i = node_first_faces[size_t(node_idx)]; i < node_first_faces[size_t(node_idx) + 1]; i++) {
+        const BSPTreeFace& face = faces[i];
+        if (face.side != facing_side) {
+            continue;
+        }
+        const float* plane = &edge_planes[size_t(face.first_edge_plane) * 4];
+        bool inside = true;
+        for (uint32_t edge = 0; edge < face.num_edge_planes && inside; edge++, plane += 4) {
+            inside = point[0] * plane[0] + point[1] * plane[1] + point[2] * plane[2] - plane[3] >= -FACE_EPSILON;
+        }
+        if (inside) {
+            return int32_t(face.face);
+        }
+    }
+    return -1;
+}
+
+int32_t BSPTree::find_leaf(const float point[3]) const {
+    int32_t node_idx = 0;
+    while (node_idx >= 0) {
+        const BSPTreeNode& node = nodes[size_t(node_idx)];
+        node_idx = node.children[bsp_node_distance(node, normals.data(), point) < 0.0f ? 1 : 0];
+    }
+    return ~node_idx;
+}
+
+BSPRayHit BSPTree::cast_ray(const BSPRay& ray) const {
+    BSPRayHit hit;
+    const float* start = ray.start;
+    float direction[3] = {ray.end[0] - start[0], ray.end[1] - start[1], ray.end[2] - start[2]};
+
+    // Walk the nodes front to back, the far side of a crossed plane waits on the stack with the part of the ray behind
+    // the plane. The node of the last crossed plane holds the face where the ray enters a solid leaf.
+    StackEntry stack[MAX_DEPTH];
+    size_t stack_size = 0;
+    int32_t node_idx = 0;
+    int32_t entry_node = -1;
+    float tmin = 0.0f;
+    float tmax = 1.0f;
+    while (true) {
+        while (node_idx >= 0) {
+            const BSPTreeNode& node = nodes[size_t(node_idx)];
+            float start_dist = bsp_node_distance(node, normals.data(), start);
+            int near = start_dist < 0.0f ? 1 : 0;
+            float t = crossing(start_dist, node_dot(node, direction), near);
+            if (t >= tmax) {
+                node_idx = node.children[near];
+            } else if (t < tmin) {
+                node_idx = node.children[near ^ 1];
+            } else {
+                stack[stack_size++] = {node.children[near ^ 1], node_idx, t, tmax};
+                node_idx = node.children[near];
+                tmax = t;
+            }
+        }
+        if (leaf_solid[size_t(~node_idx)]) {
+            set_hit(start, direction, tmin, hit);
+            if (entry_node < 0) {
+                hit.start_solid = true;
+            } else {
+                hit.face = find_face(entry_node, hit.position, node_dot(nodes[size_t(entry_node)], direction));
+            }
+            return hit;
+        }
+        if (stack_size == 0) {
+            set_hit(start, direction, 1.0f, hit);
+            return hit;
+        }
+        const StackEntry& entry = stack[--stack_size];
+        node_idx = entry.node;
+        entry_node = entry.entry_node;
+        tmin = entry.tmin;
+        tmax = entry.tmax;
+    }
+}
+
+void BSPTree::cast_packet(const BSPRay* rays, BSPRayHit* hits) const {
+    // The rays share the start, so they agree on the near side of every plane and only differ in where they cross it.
+    // A lane is idle in a subtree when its interval is empty (tmin > tmax).
+    const float* start = rays[0].start;
+    float directions[3][PACKET_SIZE];
+    for (size_t lane = 0; lane < PACKET_SIZE; lane++) {
+        for (int i = 0; i < 3; i++) {
+            directions[i][lane] = rays[lane].end[i] - start[i];
+        }
+        hits[lane] = BSPRayHit();
+    }
+    uint32_t done_lanes = 0;
+    PacketStackEntry stack[MAX_DEPTH];
+    size_t stack_size = 0;
+    int32_t node_idx = 0;
+    int32_t entry_nodes[PACKET_SIZE] = {-1, -1, -1, -1};
+    float tmin[PACKET_SIZE] = {0.0f, 0.0f, 0.0f, 0.0f};
+    float tmax[PACKET_SIZE] = {1.0f, 1.0f, 1.0f, 1.0f};
+    while (true) {
+        while (node_idx >= 0) {
+            const BSPTreeNode& node = nodes[size_t(node_idx)];
+            float start_dist = bsp_node_distance(node, normals.data(), start);
+            int near = start_dist < 0.0f ? 1 : 0;
+            float dots[PACKET_SIZE];
+            if (node.type < 3) {
+                memcpy(dots, directions[node.type], sizeof(dots));
+            } else {
+                const float* normal = &normals[size_t(node.type - 3) * 3];
+                for (size_t lane = 0; lane < PACKET_SIZE; lane++) {
+                    dots[lane] = directions[0][lane] * normal[0] + directions[1][lane] * normal[1] +
+                                 directions[2][lane] * normal[2];
+                }
+            }
+
+            // The top of the stack holds the far side until it is known to be needed.
+            PacketStackEntry& far = stack[stack_size];
+            memcpy(far.tmax, tmax, sizeof(tmax));
+            uint32_t lanes = split_packet(start_dist, near, dots, tmin, tmax, far.tmin);
+            uint32_t near_lanes = lanes & 0xF;
+            uint32_t far_lanes = lanes >> 4;
+            if (far_lanes != 0) {
+                far.node = node.children[near ^ 1];
+                for (size_t lane = 0; lane < PACKET_SIZE; lane++) {
+                    bool crosses = (near_lanes & far_lanes & (1u << lane)) != 0;
+                    far.entry_nodes[lane] = crosses ? node_idx : entry_nodes[lane];
+                }
+                if (near_lanes == 0) {
+                    node_idx = far.node;
+                    memcpy(entry_nodes, far.entry_nodes, sizeof(entry_nodes));
+                    memcpy(tmin, far.tmin, sizeof(tmin));
+                    memcpy(tmax, far.tmax, sizeof(tmax));
+                    continue;
+                }
+                stack_size++;
+            }
+            node_idx = node.children[near];
+        }
+        if (leaf_solid[size_t(~node_idx)]) {
+            for (size_t lane = 0; lane < PACKET_SIZE; lane++) {
+                if ((done_lanes & (1u << lane)) != 0 || tmin[lane] > tmax[lane]) {
+                    continue;
+                }
+                done_lanes |= 1u << lane;
+                float direction[3] = {directions[0][lane], directions[1][lane], directions[2][lane]};
+                set_hit(start, direction, tmin[lane], hits[lane]);
+                if (entry_nodes[lane] < 0) {
+                    hits[lane].start_solid = true;
+                } else {
+                    const BSPTreeNode& entry = nodes[size_t(entry_nodes[lane])];
+                    hits[lane].face = find_face(entry_nodes[lane], hits[lane].position, node_dot(entry, direction));
+                }
+            }
+        }
+
+        // Pop the next subtree where a lane without a hit is still active.
+        bool found = false;
+        while (!found && stack_size > 0 && done_lanes != 0xF) {
+            const PacketStackEntry& entry = stack[--stack_size];
+            node_idx = entry.node;
+            for (size_t lane = 0; lane < PACKET_SIZE; lane++) {
+                entry_nodes[lane] = entry.entry_nodes[lane];
+                tmin[lane] = (done_lanes & (1u << lane)) != 0 ? 2.0f : entry.tmin[lane];
+                tmax[lane] = entry.tmax[lane];
+                found = found || tmin[lane] <= tmax[lane];
+            }
+        }
+        if (!found) {
+            break;
+        }
+    }
+    for (size_t lane = 0; lane < PACKET_SIZE; lane++) {
+        if ((done_lanes & (1u << lane)) == 0) {
+            float direction[3] = {directions[0][lane], directions[1][lane], directions[2][lane]};
+            set_hit(start, direction, 1.0f, hits[lane]);
+        }
+    }
+}
+
+void BSPTree::cast_rays(const BSPRay* rays, size_t num_rays, BSPRayHit* hits, bool parallel) const {
+    thread_pool().run_for_chunked(
+        [&](size_t begin, size_t end) {
+            size_t i = begin;
+            while (i < end) {
+                bool packet = i + PACKET_SIZE <= end;
+                for (size_t lane = 1; lane < PACKET_SIZE && packet; lane++) {
+                    packet = memcmp(rays[i].start, rays[i + lane].start, sizeof(rays[i].start)) == 0;
+                }
+                if (packet) {
+                    cast_packet(rays + i, hits + i);
+                    i += PACKET_SIZE;
+                } else {
+                    hits[i] = cast_ray(rays[i]);
+                    i++;
+                }
+            }
+        },
+        num_rays, RAYS_PER_TASK, parallel);
+}
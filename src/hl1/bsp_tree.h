@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "bsp.h"
+#include "common/common.h"
+
+
+// Segment from start to end, for the ray casts of BSPTree and the traces of BSPHulls.
+struct BSPRay {
+    float start[3];
+    float end[3];
+};
+
+// First solid surface along a BSPRay.
+struct BSPRayHit {
+    // Fraction of the segment before the hit, 1 if nothing was hit.
+    float fraction = 1.0f;
+    float position[3] = {};
+    // Index in BSPParser::faces of the face hit, -1 if nothing was hit, the ray started in solid space or the hit point
+    // is on no face facing the ray (e.g. a gap between the faces of a broken map).
+    int32_t face = -1;
+    bool start_solid = false;
+};
+
+// Node of the flattened trees of BSPTree and BSPHulls, four fit in a cache line.
+struct BSPTreeNode {
+    float dist;
+    // 0-2 for the axial planes BSP_PLANE_X-Z, otherwise 3 + the index of the normal in the normals of the tree.
+    uint32_t type;
+    // Node index if >= 0, otherwise the child the tree made from the leaf, see BSPNodeFlattener::LeafRule.
+    int32_t children[2];
+};
+static_assert(sizeof(BSPTreeNode) == 16);
+
+// Return the signed distance of the point to the plane of the node, with the normals of its tree.
+FORCE_INLINE float bsp_node_distance(const BSPTreeNode& node, const float* normals, const float point[3]) {
+    if (node.type < 3) {
+        return point[node.type] - node.dist;
+    }
+    const float* normal = normals + size_t(node.type - 3) * 3;
+    return point[0] * normal[0] + point[1] * normal[1] + point[2] * normal[2] - node.dist;
+}
+
+// Flattens node trees of a BSP into nodes. Each tree is stored depth-first with the front child right after its
+// parent, so the walks mostly stay in cache lines they already loaded. The planes are folded into the nodes: the axial
+// ones need a single coordinate, only the others load a normal, which the trees share.
+class BSPNodeFlattener {
+public:
+    static constexpr size_t MAX_DEPTH = 256;
+
+    // Set out to the child of a BSPTreeNode for the child < 0 of a source node, return false if it is invalid.
+    using LeafRule = std::function<bool(int32_t child, int32_t& out)>;
+
+    explicit BSPNodeFlattener(const BSPParser& bsp);
+
+    // Append the tree of BSPParser::nodes, or of BSPParser::clipnodes if clipnodes, from the node root. Return false if
+    // the tree references something out of bounds, a node is reached twice or the tree is deeper than MAX_DEPTH.
+    bool flatten(int32_t root, bool clipnodes, const LeafRule& leaf_rule);
+
+    std::vector<BSPTreeNode> nodes;
+    // Normals of the non-axial planes, 3 floats each.
+    std::vector<float> normals;
+    // Index in the source nodes of each node.
+    std::vector<int32_t> source_nodes;
+    // Depth of the deepest tree.
+    size_t depth = 0;
+
+private:
+    const BSPParser& bsp;
+    // Index of the normal of each plane in normals, UINT32_MAX until a node uses it.
+    std::vector<uint32_t> plane_normals;
+};
+
+// Face of a BSPTreeNode, with the planes of its edges to test if a point on the node plane is inside.
+struct BSPTreeFace {
+    uint32_t face;
+    // Non-zero if the face normal is the opposite of the plane normal.
+    uint32_t side;
+    uint32_t first_edge_plane;
+    uint32_t num_edge_planes;
+};
+
+// Copy of the world node tree laid out for the spatial queries by BSPNodeFlattener, the leaves are the children ~leaf.
+// Solid and sky leaves are solid.
+class BSPTree {
+public:
+    static constexpr size_t MAX_DEPTH = BSPNodeFlattener::MAX_DEPTH;
+
+    // Flatten the node tree of model 0. Return false if the tree references something out of bounds, a node is
+    // reached twice or the tree is deeper than MAX_DEPTH.
+    bool build(const BSPParser& bsp);
+
+    // Return the leaf containing the point.
+    int32_t find_leaf(const float point[3]) const;
+    // Return the first solid surface along the ray.
+    BSPRayHit cast_ray(const BSPRay& ray) const;
+    // Cast num_rays rays into hits. Groups of 4 consecutive rays with the same start, e.g. from a camera, are walked
+    // down the tree together as a packet. If parallel, split the rays across thread_pool().
+    void cast_rays(const BSPRay* rays, size_t num_rays, BSPRayHit* hits, bool parallel = false) const;
+
+    std::vector<BSPTreeNode> nodes;
+    // Normals of the non-axial planes, 3 floats each.
+    std::vector<float> normals;
+    // Per BSPParser::leaves.
+    std::vector<uint8_t> leaf_solid;
+    // Faces of node i: faces[node_first_faces[i]..node_first_faces[i + 1]).
+    std::vector<uint32_t> node_first_faces;
+    std::vector<BSPTreeFace> faces;
+    // Inward normal and distance of each edge of the faces, 4 floats each.
+    std::vector<float> edge_planes;
+    size_t depth = 0;
+
+private:
+    float node_dot(const BSPTreeNode& node, const float direction[3]) const;
+    int32_t find_face(int32_t node_idx, const float point[3], float dot) const;
+    void cast_packet(const BSPRay* rays, BSPRayHit* hits) const;
+};
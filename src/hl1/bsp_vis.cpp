@@ -0,0 +1,296 @@
+#include "bsp_vis.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#include "common/bitset.h"
+#include "common/slog.h"
+#include "common/thread.h"
+
+
+namespace {
+
+// Leaves per task of the parallel decompression.
+const size_t LEAVES_PER_TASK = 64;
+
+}  // namespace
+
+bool BSPVisibility::init(const BSPParser& parser, const BSPMesh& mesh, bool decompress_all) {
+    bsp = &parser;
+    if (!parser.valid || mesh.faces.size() != parser.faces.size()) {
+        SLOG_ERROR("%s: Mesh is for %zu faces, the map has %zu", parser.name.c_str(), mesh.faces.size(),
+                   parser.faces.size());
+        return false;
+    }
+
+    // The camera leaf is found by the flattened tree, which checks the nodes.
+    if (!tree.build(parser)) {
+        return false;
+    }
+
+    int32_t vis_leaves = parser.models[0].vis_leaves;
+    if (vis_leaves < 0 || size_t(vis_leaves) >= parser.leaves.size()) {
+        SLOG_ERROR("%s: Invalid number of vis leaves %d for %zu leaves", parser.name.c_str(), vis_leaves,
+                   parser.leaves.size());
+        return false;
+    }
+    num_vis_leaves = size_t(vis_leaves);
+    pvs_words = bitset_num_words(num_vis_leaves);
+    pvs_rows.assign((num_vis_leaves + 1) * pvs_words, 0);
+    pvs_decompressed.assign(num_vis_leaves + 1, 0);
+
+    // Slots are the faces in the order of their indices in the mesh, so that the visible faces come out sorted by
+    // batch and the neighbors in a batch can be merged into one range.
+    std::vector<uint32_t> sorted_faces(parser.faces.size());
+    std::iota(sorted_faces.begin(), sorted_faces.end(), 0);
+    std::stable_sort(sorted_faces.begin(), sorted_faces.end(), [&](uint32_t a, uint32_t b) {
+        return mesh.faces[a].first_index < mesh.faces[b].first_index;
+    });
+    face_slots.assign(parser.faces.size(), UINT32_MAX);
+    slot_faces.clear();
+    slot_mesh_faces.clear();
+    slot_bounds.clear();
+    for (uint32_t face_idx : sorted_faces) {
+        const BSPMeshFace& mesh_face = mesh.faces[face_idx];
+        if (mesh_face.num_indices == 0) {
+            continue;
+        }
+        if (size_t(mesh_face.first_index) + mesh_face.num_indices > mesh.indices.size()) {
+            SLOG_ERROR("%s: Indices of face %u out of bounds", parser.name.c_str(), face_idx);
+            return false;
+        }
+        BSPFaceBounds bounds;
+        for (int axis = 0; axis < 3; axis++) {
+            bounds.mins[axis] = INFINITY;
+            bounds.maxs[axis] = -INFINITY;
+        }
+        for (uint32_t i = mesh_face.first_index; i < mesh_face.first_index + mesh_face.num_indices; i++) {
+            uint32_t vertex_idx = mesh.indices[i];
+            if (vertex_idx >= mesh.vertices.size()) {
+                SLOG_ERROR("%s: Vertex of face %u out of bounds", parser.name.c_str(), face_idx);
+                return false;
+            }
+            const float* position = mesh.vertices[vertex_idx].position;
+            for (int axis = 0; axis < 3; axis++) {
+                bounds.mins[axis] = std::min(bounds.mins[axis], position[axis]);
+                bounds.maxs[axis] = std::max(bounds.maxs[axis], position[axis]);
+            }
+        }
+        face_slots[face_idx] = uint32_t(slot_faces.size());
+        slot_faces.push_back(face_idx);
+        slot_mesh_faces.push_back(mesh_face);
+        slot_bounds.push_back(bounds);
+    }
+    batches = mesh.batches;
+
+    leaf_first_slots.assign(parser.leaves.size() + 1, 0);
+    leaf_slots.clear();
+    for (size_t leaf_idx = 0; leaf_idx < parser.leaves.size(); leaf_idx++) {
+        const BSPLeaf& leaf = parser.leaves[leaf_idx];
+        leaf_first_slots[leaf_idx] = uint32_t(leaf_slots.size());
+        if (size_t(leaf.first_mark_surface) + leaf.num_mark_surfaces > parser.marksurfaces.size()) {
+            SLOG_ERROR("%s: Mark surfaces of leaf %zu out of bounds", parser.name.c_str(), leaf_idx);
+            return false;
+        }
+        for (size_t i = leaf.first_mark_surface; i < size_t(leaf.first_mark_surface) + leaf.num_mark_surfaces; i++) {
+            uint16_t face_idx = parser.marksurfaces[i];
+            if (face_idx >= parser.faces.size()) {
+                SLOG_ERROR("%s: Mark surface %zu out of bounds", parser.name.c_str(), i);
+                return false;
+            }
+            if (face_slots[face_idx] != UINT32_MAX) {
+                leaf_slots.push_back(face_slots[face_idx]);
+            }
+        }
+    }
+    leaf_first_slots[parser.leaves.size()] = uint32_t(leaf_slots.size());
+
+    leaf_bounds.resize(num_vis_leaves);
+    for (size_t i = 0; i < num_vis_leaves; i++) {
+        const BSPLeaf& leaf = parser.leaves[i + 1];
+        float mins[3] = {float(leaf.mins[0]), float(leaf.mins[1]), float(leaf.mins[2])};
+        float maxs[3] = {float(leaf.maxs[0]), float(leaf.maxs[1]), float(leaf.maxs[2])};
+        leaf_bounds.set(i, mins, maxs);
+    }
+    model_bounds.resize(parser.models.size() - 1);
+    for (size_t i = 0; i + 1 < parser.models.size(); i++) {
+        model_bounds.set(i, parser.models[i + 1].mins, parser.models[i + 1].maxs);
+    }
+
+    if (decompress_all) {
+        thread_pool().run_for_chunked(
+            [&](size_t begin, size_t end) {
+                for (size_t leaf = begin; leaf < end; leaf++) {
+                    decompress_pvs(int32_t(leaf));
+                }
+            },
+            num_vis_leaves + 1, LEAVES_PER_TASK);
+    }
+    return true;
+}
+
+void BSPVisibility::decompress_pvs(int32_t leaf) {
+    uint64_t* row = pvs_rows.data() + size_t(leaf) * pvs_words;
+    pvs_decompressed[size_t(leaf)] = 1;
+    int32_t vis_offset = leaf > 0 ? bsp->leaves[size_t(leaf)].vis_offset : -1;
+    if (vis_offset < 0 || bsp->visdata.empty()) {
+        memset(row, 0xFF, pvs_words * sizeof(uint64_t));
+    } else {
+        // Bytes map to the bits of the words directly on little-endian CPUs. A zero byte is followed by the number of
+        // zero bytes it stands for. Truncated rows leave the rest invisible.
+        uint8_t* row_bytes = reinterpret_cast<uint8_t*>(row);
+        size_t num_row_bytes = (num_vis_leaves + 7) / 8;
+        size_t pos = size_t(vis_offset);
+        size_t row_byte = 0;
+        while (row_byte < num_row_bytes && pos < bsp->visdata.size()) {
+            uint8_t bits = bsp->visdata[pos++];
+            if (bits != 0) {
+                row_bytes[row_byte++] = bits;
+            } else if (pos < bsp->visdata.size()) {
+                row_byte += bsp->visdata[pos++];
+            } else {
+                break;
+            }
+        }
+    }
+    // Keep the bits past the last leaf zero.
+    if (num_vis_leaves % 64 != 0) {
+        row[pvs_words - 1] &= (uint64_t(1) << (num_vis_leaves % 64)) - 1;
+    }
+}
+
+int32_t BSPVisibility::find_leaf(const float point[3]) const {
+    return tree.find_leaf(point);
+}
+
+const uint64_t* BSPVisibility::leaf_pvs(int32_t leaf) {
+    // Leaves past the vis leaves have no PVS and share the row of leaf 0.
+    if (leaf < 0 || size_t(leaf) > num_vis_leaves) {
+        leaf = 0;
+    }
+    if (!pvs_decompressed[size_t(leaf)]) {
+        decompress_pvs(leaf);
+    }
+    return pvs_rows.data() + size_t(leaf) * pvs_words;
+}
+
+size_t BSPVisibility::num_pvs_words() const {
+    return pvs_words;
+}
+
+void BSPVisibility::find_visible_leaves(const float position[3], BSPVisibleSet& out) {
+    out.camera_leaf = find_leaf(position);
+    const uint64_t* pvs = leaf_pvs(out.camera_leaf);
+    out.leaves.assign(pvs, pvs + pvs_words);
+}
+
+void BSPVisibility::find_visible_faces(BSPVisibleSet& out) const {
+    // Scatter the faces of the visible leaves into the face bitset, which dedups the faces shared by several leaves.
+    out.faces.assign(bitset_num_words(slot_faces.size()), 0);
+    bitset_for_each(out.leaves.data(), std::min(out.leaves.size(), pvs_words), [&](size_t bit) {
+        size_t leaf = bit + 1;
+        for (uint32_t i = leaf_first_slots[leaf]; i < leaf_first_slots[leaf + 1]; i++) {
+            bitset_set(out.faces.data(), leaf_slots[i]);
+        }
+    });
+
+    out.face_list.reserve(slot_faces.size());
+    out.ranges.reserve(slot_faces.size());
+    out.face_list.clear();
+    out.ranges.clear();
+    out.num_batches = 0;
+    uint32_t last_batch = UINT32_MAX;
+    bitset_for_each(out.faces.data(), out.faces.size(), [&](size_t slot) {
+        const BSPMeshFace& mesh_face = slot_mesh_faces[slot];
+        out.face_list.push_back(slot_faces[slot]);
+        if (mesh_face.batch == last_batch &&
+            out.ranges.back().first_index + out.ranges.back().num_indices == mesh_face.first_index) {
+            out.ranges.back().num_indices += mesh_face.num_indices;
+            return;
+        }
+        if (mesh_face.batch != last_batch) {
+            out.num_batches++;
+            last_batch = mesh_face.batch;
+        }
+        const BSPMeshBatch& batch = batches[mesh_face.batch];
+        out.ranges.push_back({batch.texture, batch.lightmap_page, mesh_face.first_index, mesh_face.num_indices});
+    });
+}
+
+void BSPVisibility::find_visible_set(const float position[3], BSPVisibleSet& out) {
+    find_visible_leaves(position, out);
+    find_visible_faces(out);
+}
+
+void BSPVisibility::cull_leaves(const Frustum& frustum, BSPVisibleSet& out, bool parallel) const {
+    out.frustum_leaves.resize(leaf_bounds.size());
+    out.frustum_leaves.resize(cull_boxes(frustum, leaf_bounds, out.frustum_leaves.data(), parallel));
+    // Merge the sorted list into the bitset a word at a time.
+    size_t i = 0;
+    for (size_t word_idx = 0; word_idx < std::min(out.leaves.size(), pvs_words); word_idx++) {
+        uint64_t in_frustum = 0;
+        for (; i < out.frustum_leaves.size() && out.frustum_leaves[i] / 64 == word_idx; i++) {
+            in_frustum |= uint64_t(1) << (out.frustum_leaves[i] % 64);
+        }
+        out.leaves[word_idx] &= in_frustum;
+    }
+}
+
+void BSPVisibility::cull_models(const Frustum& frustum, BSPVisibleSet& out, bool parallel) const {
+    out.models.resize(model_bounds.size());
+    out.models.resize(cull_boxes(frustum, model_bounds, out.models.data(), parallel));
+    for (uint32_t& model : out.models) {
+        model++;
+    }
+}
+
+void BSPVisibility::find_unoccluded_faces(const OcclusionBuffer& occlusion, BSPVisibleSet& out) const {
+    // bitset_for_each() has read the word of the bit already, so clearing it is safe.
+    bitset_for_each(out.leaves.data(), std::min(out.leaves.size(), pvs_words), [&](size_t bit) {
+        float mins[3] = {leaf_bounds.mins[0][bit], leaf_bounds.mins[1][bit], leaf_bounds.mins[2][bit]};
+        float maxs[3] = {leaf_bounds.maxs[0][bit], leaf_bounds.maxs[1][bit], leaf_bounds.maxs[2][bit]};
+        if (occlusion.box_occluded(mins, maxs)) {
+            out.leaves[bit / 64] &= ~(uint64_t(1) << (bit % 64));
+        }
+    });
+    find_visible_faces(out);
+
+    // Test the bounds of the faces of each range, keep the faces and the ranges in front in place.
+    size_t num_faces = 0;
+    size_t num_ranges = 0;
+    size_t face_pos = 0;
+    uint32_t last_batch = UINT32_MAX;
+    out.num_batches = 0;
+    for (const BSPMeshBatch& range : out.ranges) {
+        size_t range_first_face = face_pos;
+        BSPFaceBounds bounds = slot_bounds[face_slots[out.face_list[face_pos]]];
+        for (uint32_t num_indices = 0; num_indices < range.num_indices; face_pos++) {
+            uint32_t slot = face_slots[out.face_list[face_pos]];
+            for (int axis = 0; axis < 3; axis++) {
+                bounds.mins[axis] = std::min(bounds.mins[axis], slot_bounds[slot].mins[axis]);
+                bounds.maxs[axis] = std::max(bounds.maxs[axis], slot_bounds[slot].maxs[axis]);
+            }
+            num_indices += slot_mesh_faces[slot].num_indices;
+        }
+        if (occlusion.box_occluded(bounds.mins, bounds.maxs)) {
+            for (size_t i = range_first_face; i < face_pos; i++) {
+                uint32_t slot = face_slots[out.face_list[i]];
+                out.faces[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+            }
+            continue;
+        }
+        uint32_t batch = slot_mesh_faces[face_slots[out.face_list[range_first_face]]].batch;
+        if (batch != last_batch) {
+            out.num_batches++;
+            last_batch = batch;
+        }
+        for (size_t i = range_first_face; i < face_pos; i++) {
+            out.face_list[num_faces++] = out.face_list[i];
+        }
+        out.ranges[num_ranges++] = range;
+    }
+    out.face_list.resize(num_faces);
+    out.ranges.resize(num_ranges);
+}
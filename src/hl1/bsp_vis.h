@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bsp.h"
+#include "bsp_mesh.h"
+#include "bsp_tree.h"
+#include "common/frustum.h"
+#include "common/occlusion.h"
+
+
+// World faces visible from a camera position, filled by BSPVisibility. The buffers keep their capacity between the
+// queries, so that only the first query with a given set allocates.
+struct BSPVisibleSet {
+    // Leaf containing the camera, 0 if the camera is in solid space.
+    int32_t camera_leaf = 0;
+    // Potentially visible leaves: bit i for leaf i + 1, as in the PVS rows.
+    std::vector<uint64_t> leaves;
+    // Visible faces: bit i for face i in the mesh order.
+    std::vector<uint64_t> faces;
+    // Indices of the visible faces in BSPParser::faces, in the mesh order.
+    std::vector<uint32_t> face_list;
+    // Index ranges of the visible faces in the mesh order, adjacent faces of a batch are merged into one range.
+    std::vector<BSPMeshBatch> ranges;
+    // Number of batches with visible faces.
+    size_t num_batches = 0;
+    // Leaves in the frustum as bit indices of leaves in ascending order, filled by BSPVisibility::cull_leaves().
+    std::vector<uint32_t> frustum_leaves;
+    // Brush models in the frustum in ascending order, filled by BSPVisibility::cull_models().
+    std::vector<uint32_t> models;
+};
+
+// Potentially visible sets of a BSP: finds the leaf of the camera, decompresses its PVS into a bitset and collects
+// the visible faces of the mesh. Brush entity faces are not referenced by the leaves and are not included. Not
+// thread-safe, the PVS rows are decompressed and cached on first use.
+class BSPVisibility {
+public:
+    // Build the BSPTree of the map and index the leaf faces and the mesh order of the faces. If decompress_all,
+    // decompress the PVS of all leaves in parallel on thread_pool() instead of on first use. Return false if the tree
+    // or the leaves reference something out of bounds. bsp must outlive this object.
+    bool init(const BSPParser& bsp, const BSPMesh& mesh, bool decompress_all = false);
+
+    // Return the leaf containing the point, 0 for solid space.
+    int32_t find_leaf(const float point[3]) const;
+    // Return the PVS of the leaf, num_pvs_words() words with bit i for leaf i + 1. Leaves without PVS and the solid
+    // leaf 0 see everything.
+    const uint64_t* leaf_pvs(int32_t leaf);
+    size_t num_pvs_words() const;
+
+    // Set out.camera_leaf and out.leaves for the camera position.
+    void find_visible_leaves(const float position[3], BSPVisibleSet& out);
+    // Fill the faces and the ranges of out from out.leaves, which can be culled further before, e.g. with bitset_and().
+    void find_visible_faces(BSPVisibleSet& out) const;
+    // find_visible_leaves() and find_visible_faces().
+    void find_visible_set(const float position[3], BSPVisibleSet& out);
+
+    // Clear the bits of out.leaves outside of the frustum, between find_visible_leaves() and find_visible_faces().
+    // The bounds of all the leaves are tested, split across thread_pool() if parallel.
+    void cull_leaves(const Frustum& frustum, BSPVisibleSet& out, bool parallel = false) const;
+    // Set out.models to the brush models, excluding the world model 0, with bounds in the frustum. The bounds are
+    // those of the BSP, without the origins of the entities.
+    void cull_models(const Frustum& frustum, BSPVisibleSet& out, bool parallel = false) const;
+    // find_visible_faces() without the leaves of out.leaves behind the occluders of the buffer, then without the
+    // ranges whose faces are behind them. The occluders are usually the faces of a previous find_visible_faces().
+    void find_unoccluded_faces(const OcclusionBuffer& occlusion, BSPVisibleSet& out) const;
+
+private:
+    const BSPParser* bsp = nullptr;
+    BSPTree tree;
+    size_t num_vis_leaves = 0;
+    size_t pvs_words = 0;
+    // PVS rows of leaves 0..num_vis_leaves, pvs_words each, valid if pvs_decompressed is set.
+    std::vector<uint64_t> pvs_rows;
+    std::vector<uint8_t> pvs_decompressed;
+    // Mesh order slots of the faces of each leaf: leaf_slots[leaf_first_slots[leaf]..leaf_first_slots[leaf + 1]).
+    std::vector<uint32_t> leaf_first_slots;
+    std::vector<uint32_t> leaf_slots;
+    // Face index, mesh face and bounds of each slot.
+    std::vector<uint32_t> slot_faces;
+    std::vector<BSPMeshFace> slot_mesh_faces;
+    std::vector<BSPFaceBounds> slot_bounds;
+    // Slot of each face, UINT32_MAX for the faces without indices.
+    std::vector<uint32_t> face_slots;
+    // Batches of the mesh, for the texture and the lightmap page of the ranges.
+    std::vector<BSPMeshBatch> batches;
+    // Bounds of leaf i + 1 and of model i + 1 at i.
+    FrustumBoxes leaf_bounds;
+    FrustumBoxes model_bounds;
+
+    void decompress_pvs(int32_t leaf);
+};
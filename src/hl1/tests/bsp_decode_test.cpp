@@ -0,0 +1,228 @@
+#include "hl1/bsp_decode.h"
+
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "bsp_test_map.h"
+#include "common/sync.h"
+#include "hl1_test.h"
+
+
+TEST_SUITE_BEGIN("bsp_decode");
+
+namespace {
+
+// Return a mutable pointer to the element of a view into the file contents.
+template <typename T>
+T* mutable_element(FileContents& file, const T& element) {
+    size_t offset = size_t(reinterpret_cast<const uint8_t*>(&element) - file.contents.data());
+    return reinterpret_cast<T*>(file.contents.data() + offset);
+}
+
+// Check that all tasks but the failed one succeeded.
+void check_failed_task(const BSPDecodedLumps& lumps, BSPDecodeTask failed_task) {
+    CHECK_FALSE(lumps.valid);
+    for (int task = 0; task < BSP_NUM_DECODE_TASKS; task++) {
+        CHECK(lumps.task_valid[task] == (task != failed_task));
+    }
+}
+
+}  // namespace
+
+TEST_CASE("decode_bsp_lumps") {
+    TestBSPOptions options;
+    options.num_styles = 2;
+    TestBSP map = make_test_bsp(options);
+    BSPParser bsp;
+    REQUIRE(bsp.parse(map.file));
+
+    BSPDecodedLumps lumps;
+    REQUIRE(decode_bsp_lumps(bsp, lumps));
+    CHECK(lumps.valid);
+    for (int task = 0; task < BSP_NUM_DECODE_TASKS; task++) {
+        CHECK(lumps.task_valid[task]);
+        CHECK(lumps.task_ms[task] >= 0.0);
+        CHECK(lumps.task_ms[task] <= lumps.total_ms);
+    }
+    CHECK(lumps.num_entities == size_t(options.num_entities) + 1);
+    CHECK(lumps.entities.size() == lumps.num_entities);
+    CHECK(lumps.entities.classname(0) == "worldspawn");
+
+    SUBCASE("textures") {
+        REQUIRE(lumps.textures.size() == size_t(options.num_textures));
+        REQUIRE(lumps.embedded.miptexs.size() == 2);
+        for (int texture_idx = 0; texture_idx < options.num_textures; texture_idx++) {
+            const BSPTexture& texture = lumps.textures[size_t(texture_idx)];
+            TestTexture test_texture;
+            test_texture.name = "maptex" + std::to_string(texture_idx);
+            test_texture.width = 16u << (texture_idx % 3);
+            test_texture.seed = uint32_t(texture_idx);
+            CHECK(texture.name == test_texture.name);
+            CHECK(texture.width == test_texture.width);
+            CHECK(texture.height == test_texture.height);
+            if (texture_idx % 2 != 0) {
+                CHECK(texture.embedded == -1);
+                continue;
+            }
+            REQUIRE(texture.embedded == texture_idx / 2);
+            const WAD3Miptex& miptex = lumps.embedded.miptexs[size_t(texture.embedded)];
+            CHECK(miptex.name == test_texture.name);
+            for (int mip_level = 0; mip_level < WAD3Miptex::NUM_LEVELS; mip_level++) {
+                const uint8_t* pixels = miptex.mipmaps[mip_level].data.data();
+                for (uint32_t y = 0; y < (miptex.height >> mip_level); y++) {
+                    for (uint32_t x = 0; x < (miptex.width >> mip_level); x++) {
+                        uint8_t rgb[3];
+                        test_palette_color(test_texture_index(test_texture, mip_level, x, y), rgb);
+                        const uint8_t* pixel = pixels + (size_t(y) * (miptex.width >> mip_level) + x) * 4;
+                        REQUIRE(memcmp(pixel, rgb, 3) == 0);
+                        REQUIRE(pixel[3] == 255);
+                    }
+                }
+            }
+        }
+    }
+
+    SUBCASE("lighting") {
+        // The test map stores the lightmaps of the faces back to back.
+        REQUIRE(lumps.lightmaps.size() == bsp.faces.size());
+        size_t expected_offset = 0;
+        for (size_t face_idx = 0; face_idx < bsp.faces.size(); face_idx++) {
+            const BSPFaceLightmap& lightmap = lumps.lightmaps[face_idx];
+            CHECK(lightmap.offset == expected_offset);
+            CHECK(lightmap.num_styles == options.num_styles);
+            // 64 units are 4 luxels, one more when the texture offset is not a multiple of 16.
+            CHECK(lightmap.width >= 5);
+            CHECK(lightmap.width <= 6);
+            CHECK(lightmap.height == 5);
+            expected_offset += size_t(lightmap.width) * lightmap.height * 3 * size_t(lightmap.num_styles);
+        }
+        CHECK(expected_offset == bsp.lighting.size());
+    }
+
+    SUBCASE("visibility") {
+        REQUIRE(lumps.visible_leaves.size() == bsp.leaves.size());
+        CHECK(lumps.visible_leaves[0] == 0);
+        for (size_t leaf_idx = 1; leaf_idx < bsp.leaves.size(); leaf_idx++) {
+            uint32_t expected = 0;
+            for (size_t other_idx = 1; other_idx < bsp.leaves.size(); other_idx++) {
+                expected += map.leaf_sees(int32_t(leaf_idx), int32_t(other_idx)) ? 1 : 0;
+            }
+            CHECK(lumps.visible_leaves[leaf_idx] == expected);
+        }
+    }
+
+    SUBCASE("faces") {
+        REQUIRE(lumps.face_bounds.size() == bsp.faces.size());
+        for (size_t face_idx = 0; face_idx < bsp.faces.size(); face_idx++) {
+            const BSPFaceBounds& bounds = lumps.face_bounds[face_idx];
+            int axis = bsp.planes[bsp.faces[face_idx].plane].type;
+            for (int i = 0; i < 3; i++) {
+                float size = bounds.maxs[i] - bounds.mins[i];
+                CHECK(size == (i == axis ? 0.0f : float(TestBSPOptions::CELL_SIZE)));
+            }
+        }
+    }
+}
+
+TEST_CASE("decode_bsp_lumps_async") {
+    TestBSP map = make_test_bsp();
+    BSPParser bsp;
+    REQUIRE(bsp.parse(map.file));
+    BSPDecodedLumps expected;
+    REQUIRE(decode_bsp_lumps(bsp, expected));
+
+    // done is called once, after all the tasks.
+    for (int i = 0; i < 20; i++) {
+        TaskLatch latch(1);
+        BSPDecodedLumps lumps;
+        int num_calls = 0;
+        decode_bsp_lumps_async(bsp, [&](BSPDecodedLumps&& result) {
+            num_calls++;
+            lumps = std::move(result);
+            latch.count_down();
+        });
+        latch.wait();
+        CHECK(num_calls == 1);
+        CHECK(lumps.valid);
+        CHECK(lumps.num_entities == expected.num_entities);
+        CHECK(lumps.embedded.miptexs.size() == expected.embedded.miptexs.size());
+        CHECK(lumps.lightmaps.size() == expected.lightmaps.size());
+        CHECK(lumps.visible_leaves == expected.visible_leaves);
+        CHECK(lumps.face_bounds.size() == expected.face_bounds.size());
+    }
+
+    SUBCASE("invalid parser") {
+        BSPParser invalid;
+        bool called = false;
+        decode_bsp_lumps_async(invalid, [&](BSPDecodedLumps&& result) {
+            called = true;
+            CHECK_FALSE(result.valid);
+        });
+        CHECK(called);
+    }
+}
+
+TEST_CASE("decode_bsp_lumps invalid lumps") {
+    TestBSP map = make_test_bsp();
+    FileContents& file = map.file;
+    BSPParser bsp;
+    REQUIRE(bsp.parse(file));
+    BSPDecodedLumps lumps;
+
+    SUBCASE("unbalanced entity") {
+        size_t close = bsp.entities.rfind('}');
+        *mutable_element(file, bsp.entities[close]) = ' ';
+        CHECK_FALSE(decode_bsp_lumps(bsp, lumps));
+        check_failed_task(lumps, BSP_DECODE_ENTITIES);
+    }
+
+    SUBCASE("unterminated entity string") {
+        size_t quote = bsp.entities.rfind('"');
+        *mutable_element(file, bsp.entities[quote]) = ' ';
+        CHECK_FALSE(decode_bsp_lumps(bsp, lumps));
+        check_failed_task(lumps, BSP_DECODE_ENTITIES);
+    }
+
+    SUBCASE("texture out of bounds") {
+        uint8_t* offset = mutable_element(file, bsp.textures[4]);
+        int32_t bad_offset = int32_t(bsp.textures.size());
+        memcpy(offset, &bad_offset, 4);
+        CHECK_FALSE(decode_bsp_lumps(bsp, lumps));
+        check_failed_task(lumps, BSP_DECODE_TEXTURES);
+    }
+
+    SUBCASE("lightmap out of bounds") {
+        mutable_element(file, bsp.faces[bsp.faces.size() - 1])->light_offset = int32_t(bsp.lighting.size()) - 3;
+        CHECK_FALSE(decode_bsp_lumps(bsp, lumps));
+        check_failed_task(lumps, BSP_DECODE_LIGHTING);
+    }
+
+    SUBCASE("PVS out of bounds") {
+        mutable_element(file, bsp.leaves[1])->vis_offset = int32_t(bsp.visdata.size());
+        CHECK_FALSE(decode_bsp_lumps(bsp, lumps));
+        check_failed_task(lumps, BSP_DECODE_VISIBILITY);
+    }
+
+    SUBCASE("degenerate face") {
+        // Without lightmap, so that only the face check fails.
+        BSPFace* face = mutable_element(file, bsp.faces[0]);
+        face->num_edges = 2;
+        face->light_offset = -1;
+        CHECK_FALSE(decode_bsp_lumps(bsp, lumps));
+        check_failed_task(lumps, BSP_DECODE_FACES);
+    }
+
+    SUBCASE("edge out of bounds") {
+        *mutable_element(file, bsp.surfedges[0]) = -int32_t(bsp.edges.size());
+        CHECK_FALSE(decode_bsp_lumps(bsp, lumps));
+        CHECK_FALSE(lumps.task_valid[BSP_DECODE_LIGHTING]);
+        CHECK_FALSE(lumps.task_valid[BSP_DECODE_FACES]);
+        CHECK(lumps.task_valid[BSP_DECODE_TEXTURES]);
+    }
+}
+
+TEST_SUITE_END();
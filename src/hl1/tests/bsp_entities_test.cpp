@@ -0,0 +1,216 @@
+#include "hl1/bsp_entities.h"
+
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bsp_test_map.h"
+
+
+TEST_SUITE_BEGIN("bsp_entities");
+
+namespace {
+
+// Check that a and b tokenized the same text into the same views.
+void check_same_entities(const BSPEntities& a, const BSPEntities& b) {
+    REQUIRE(a.entities.size() == b.entities.size());
+    REQUIRE(a.pairs.size() == b.pairs.size());
+    for (size_t i = 0; i < a.entities.size(); i++) {
+        CHECK(a.entities[i].first_pair == b.entities[i].first_pair);
+        CHECK(a.entities[i].num_pairs == b.entities[i].num_pairs);
+    }
+    for (size_t i = 0; i < a.pairs.size(); i++) {
+        CHECK(a.pairs[i].key.data() == b.pairs[i].key.data());
+        CHECK(a.pairs[i].key.size() == b.pairs[i].key.size());
+        CHECK(a.pairs[i].value.data() == b.pairs[i].value.data());
+        CHECK(a.pairs[i].value.size() == b.pairs[i].value.size());
+    }
+    CHECK(a.classname_order == b.classname_order);
+}
+
+// Entities text of worldspawn and num_entities point entities, with braces in the message of every strange_every-th.
+std::string make_entities_text(int num_entities, int strange_every) {
+    std::string text = "{\n\"classname\" \"worldspawn\"\n}\n";
+    for (int i = 0; i < num_entities; i++) {
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer), "{\n\"origin\" \"%d %d %d\"\n\"classname\" \"%s\"\n\"message\" \"%s\"\n}\n",
+                 i, -i, i * 2, i % 3 == 0 ? "light" : "info_target", i % strange_every == 0 ? "a }\n{ b" : "text");
+        text += buffer;
+    }
+    return text;
+}
+
+}  // namespace
+
+TEST_CASE("BSPEntities test map") {
+    TestBSPOptions options;
+    TestBSP map = make_test_bsp(options);
+    BSPParser bsp;
+    REQUIRE(bsp.parse(map.file));
+    BSPEntities entities;
+    REQUIRE(entities.parse(bsp.entities, "test.bsp"));
+    REQUIRE(entities.size() == size_t(options.num_entities) + 1);
+
+    CHECK(entities.classname(0) == "worldspawn");
+    CHECK(entities.value(0, "wad") == "\\\\half-life\\\\valve\\\\halflife.wad");
+    CHECK(entities.entity_pairs(0).size() == 2);
+    for (const BSPEntityPair& pair : entities.pairs) {
+        // The keys and the values are views of the text.
+        CHECK(pair.key.data() >= bsp.entities.data());
+        CHECK(pair.value.data() + pair.value.size() <= bsp.entities.data() + bsp.entities.size());
+    }
+
+    const int size_x = options.size[0];
+    const int size_y = options.size[1];
+    const float cell = float(TestBSPOptions::CELL_SIZE);
+    size_t num_vis_leaves = map.leaf_cells.size() - 1;
+    for (int i = 0; i < options.num_entities; i++) {
+        CAPTURE(i);
+        size_t entity = size_t(i) + 1;
+        int c = map.leaf_cells[1 + size_t(i) % num_vis_leaves];
+        float origin[3];
+        REQUIRE(entities.origin(entity, origin));
+        CHECK(origin[0] == (float(c % size_x) + 0.5f) * cell);
+        CHECK(origin[1] == (float((c / size_x) % size_y) + 0.5f) * cell);
+        CHECK(origin[2] == (float(c / (size_x * size_y)) + 0.5f) * cell);
+        float angles[3];
+        REQUIRE(entities.angles(entity, angles));
+        CHECK(angles[0] == 0.0f);
+        CHECK(angles[1] == float(i * 45 % 360));
+        CHECK(angles[2] == 0.0f);
+        CHECK(entities.classname(entity) == (i % 2 == 0 ? "info_player_start" : "light"));
+    }
+    Span<const uint32_t> starts = entities.find_classname("info_player_start");
+    CHECK(std::vector<uint32_t>(starts.begin(), starts.end()) == std::vector<uint32_t>{1, 3, 5, 7});
+    Span<const uint32_t> lights = entities.find_classname("light");
+    CHECK(std::vector<uint32_t>(lights.begin(), lights.end()) == std::vector<uint32_t>{2, 4, 6, 8});
+    CHECK(entities.find_classname("worldspawn").size() == 1);
+    CHECK(entities.find_classname("light_spot").empty());
+    CHECK(entities.find_classname("").empty());
+}
+
+TEST_CASE("BSPEntities lookups") {
+    std::string_view text = "{\"classname\" \"func_door\" \"angle\" \"-1\" \"origin\" \"1 2\" \"speed\" \"10\"\n"
+                            "\"speed\" \"20\"}\n"
+                            "{\"angle\" \"-2\" \"origin\" \" 1.5\t-2 3e2 \" \"target\" \"{ \"\"\" \"\"}\n"
+                            "{\"angle\" \"90\" \"angles\" \"10 20 x\" \"origin\" \"1 2 3 4\"}\n"
+                            "{\"angle\" \"270\" \"origin\" \"1e40 0 0\"}\n"
+                            "{}";
+    BSPEntities entities;
+    REQUIRE(entities.parse(text, "lookups"));
+    REQUIRE(entities.size() == 5);
+
+    // The last pair wins, keys are case-sensitive.
+    CHECK(entities.value(0, "speed") == "20");
+    CHECK(entities.value(0, "Speed").empty());
+    std::string_view value = "unchanged";
+    CHECK_FALSE(entities.find_value(0, "target", value));
+    CHECK(value == "unchanged");
+    CHECK(entities.find_value(1, "target", value));
+    CHECK(value == "{ ");
+    CHECK(entities.find_value(1, "", value));
+    CHECK(value.empty());
+    CHECK(entities.classname(0) == "func_door");
+    CHECK(entities.classname(1).empty());
+    CHECK(entities.entity_pairs(4).empty());
+
+    float v[3] = {};
+    CHECK_FALSE(entities.origin(0, v));
+    REQUIRE(entities.origin(1, v));
+    CHECK(v[0] == 1.5f);
+    CHECK(v[1] == -2.0f);
+    CHECK(v[2] == 300.0f);
+    CHECK_FALSE(entities.origin(2, v));
+    CHECK_FALSE(entities.origin(3, v));
+    CHECK_FALSE(entities.origin(4, v));
+
+    // "angle" is the yaw, with -1 and -2 for up and down. "angles" takes precedence.
+    REQUIRE(entities.angles(0, v));
+    CHECK(v[0] == -90.0f);
+    CHECK(v[1] == 0.0f);
+    REQUIRE(entities.angles(1, v));
+    CHECK(v[0] == 90.0f);
+    CHECK_FALSE(entities.angles(2, v));
+    REQUIRE(entities.angles(3, v));
+    CHECK(v[0] == 0.0f);
+    CHECK(v[1] == 270.0f);
+    CHECK(v[2] == 0.0f);
+    CHECK_FALSE(entities.angles(4, v));
+
+    CHECK(parse_entity_floats("\n-0.5 \n", v, 1));
+    CHECK(v[0] == -0.5f);
+    CHECK_FALSE(parse_entity_floats("", v, 1));
+    CHECK_FALSE(parse_entity_floats("1,2", v, 1));
+    CHECK_FALSE(parse_entity_floats("nan", v, 1));
+    CHECK_FALSE(parse_entity_floats(std::string(100, '1'), v, 1));
+}
+
+TEST_CASE("BSPEntities malformed") {
+    const char* invalid_texts[] = {
+        "{",
+        "}",
+        "{ \"key\" }",
+        "{ \"key\" \"value\" \"key\" }",
+        "{ \"key\" \"value",
+        "{ { } }",
+        "\"key\" \"value\"",
+        "{ key value }",
+        "{ \"key\" \"value\" } x",
+        "{ \"key\" \"value\" } }",
+    };
+    for (const char* text : invalid_texts) {
+        CAPTURE(text);
+        for (bool parallel : {false, true}) {
+            BSPEntities entities;
+            CHECK_FALSE(entities.parse(text, "malformed", parallel));
+            CHECK(entities.size() == 0);
+        }
+    }
+
+    const char* valid_texts[] = {"", " \n\t", "{}", "{ \"key\" \"value\" }{\"k\"\"v\"}", "{\"}\" \"{\"}"};
+    const size_t valid_sizes[] = {0, 0, 1, 2, 1};
+    for (size_t i = 0; i < std::size(valid_texts); i++) {
+        CAPTURE(valid_texts[i]);
+        BSPEntities entities;
+        CHECK(entities.parse(valid_texts[i], "valid"));
+        CHECK(entities.size() == valid_sizes[i]);
+    }
+}
+
+TEST_CASE("BSPEntities parallel") {
+    // Large enough for many tasks, with closing braces in the strings every now and then to move the splits into
+    // strings, or everywhere.
+    for (int strange_every : {1, 97, 1000000}) {
+        CAPTURE(strange_every);
+        std::string text = make_entities_text(20000, strange_every);
+        REQUIRE(text.size() > BSPEntities::CHARS_PER_TASK * 8);
+        BSPEntities sequential;
+        REQUIRE(sequential.parse(text, "sequential"));
+        BSPEntities parallel;
+        REQUIRE(parallel.parse(text, "parallel", true));
+        CHECK(parallel.size() == 20001);
+        check_same_entities(sequential, parallel);
+        CHECK(parallel.find_classname("light").size() == 6667);
+        float origin[3];
+        REQUIRE(parallel.origin(20000, origin));
+        CHECK(origin[0] == 19999.0f);
+        CHECK(origin[1] == -19999.0f);
+        CHECK(parallel.value(1, "message") == "a }\n{ b");
+    }
+
+    // Errors at the end of the text are found by the last task.
+    std::string text = make_entities_text(20000, 97);
+    for (const char* tail : {"{", "{\"key\"", "{\"key\" \"value", "x"}) {
+        CAPTURE(tail);
+        BSPEntities entities;
+        CHECK_FALSE(entities.parse(text + tail, "parallel", true));
+        CHECK(entities.size() == 0);
+    }
+}
+
+TEST_SUITE_END();
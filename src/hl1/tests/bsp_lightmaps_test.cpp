@@ -0,0 +1,211 @@
+#include "hl1/bsp_lightmaps.h"
+
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "bsp_test_map.h"
+
+
+TEST_SUITE_BEGIN("bsp_lightmaps");
+
+namespace {
+
+const uint8_t* page_pixel(const BSPLightmapPage& page, uint32_t x, uint32_t y) {
+    REQUIRE(x < page.width);
+    REQUIRE(y < page.height);
+    return &page.pixels[(size_t(y) * page.width + x) * 4];
+}
+
+// Check the luxels and the replicated edges of each style of the face.
+void check_face_luxels(const BSPLightmapAtlas& atlas, const BSPParser& bsp, const BSPFaceLightmap& lightmap,
+                       size_t face_idx) {
+    const BSPLightmapRect& rect = atlas.rects[face_idx];
+    REQUIRE(rect.page < atlas.pages.size());
+    const BSPLightmapPage& page = atlas.pages[rect.page];
+    CHECK(rect.width == lightmap.width);
+    CHECK(rect.height == lightmap.height);
+    CHECK(rect.num_styles == lightmap.num_styles);
+    uint32_t padding = BSPLightmapAtlas::PADDING;
+    for (int style = 0; style < lightmap.num_styles; style++) {
+        const uint8_t* src = bsp.lighting.data() + lightmap.offset +
+                             size_t(lightmap.width) * lightmap.height * 3 * size_t(style);
+        uint32_t style_y = rect.y + rect.style_stride * uint32_t(style);
+        for (uint32_t y = 0; y < lightmap.height + padding * 2; y++) {
+            for (uint32_t x = 0; x < lightmap.width + padding * 2; x++) {
+                // Padding luxels replicate the nearest edge luxel.
+                uint32_t src_x = std::min(std::max(x, padding), lightmap.width + padding - 1) - padding;
+                uint32_t src_y = std::min(std::max(y, padding), lightmap.height + padding - 1) - padding;
+                const uint8_t* expected = src + (size_t(src_y) * lightmap.width + src_x) * 3;
+                const uint8_t* pixel = page_pixel(page, rect.x - padding + x, style_y - padding + y);
+                REQUIRE(memcmp(pixel, expected, 3) == 0);
+                REQUIRE(pixel[3] == 255);
+            }
+        }
+    }
+}
+
+// Check that the padded blocks of the faces do not overlap.
+void check_no_overlaps(const BSPLightmapAtlas& atlas) {
+    std::vector<std::vector<uint8_t>> used(atlas.pages.size());
+    for (size_t page = 0; page < atlas.pages.size(); page++) {
+        used[page].assign(size_t(atlas.pages[page].width) * atlas.pages[page].height, 0);
+    }
+    uint32_t padding = BSPLightmapAtlas::PADDING;
+    for (const BSPLightmapRect& rect : atlas.rects) {
+        if (rect.num_styles == 0) {
+            continue;
+        }
+        uint32_t block_height = rect.style_stride * uint32_t(rect.num_styles);
+        for (uint32_t y = rect.y - padding; y < rect.y - padding + block_height; y++) {
+            for (uint32_t x = rect.x - padding; x < rect.x + rect.width + padding; x++) {
+                uint8_t& cell = used[rect.page][size_t(y) * atlas.pages[rect.page].width + x];
+                REQUIRE(cell == 0);
+                cell = 1;
+            }
+        }
+    }
+}
+
+}  // namespace
+
+TEST_CASE("BSPLightmapAtlas build") {
+    for (int num_styles = 1; num_styles <= 4; num_styles++) {
+        CAPTURE(num_styles);
+        TestBSPOptions options;
+        options.num_styles = num_styles;
+        StagedTestBSP test(options, TestBSPStage::DECODED);
+        const BSPParser& bsp = test.bsp;
+
+        BSPLightmapAtlas atlas;
+        REQUIRE(atlas.build(bsp, test.lumps.lightmaps));
+        CHECK(atlas.pages.size() == 1);
+        CHECK(atlas.efficiency > 0.4);
+        CHECK(atlas.efficiency <= 1.0);
+        REQUIRE(atlas.rects.size() == bsp.faces.size());
+        check_no_overlaps(atlas);
+
+        for (size_t face_idx = 0; face_idx < bsp.faces.size(); face_idx++) {
+            const BSPFace& face = bsp.faces[face_idx];
+            const BSPLightmapRect& rect = atlas.rects[face_idx];
+            check_face_luxels(atlas, bsp, test.lumps.lightmaps[face_idx], face_idx);
+
+            // The UVs stay within the luxel centers of the face.
+            const BSPLightmapPage& page = atlas.pages[rect.page];
+            REQUIRE(atlas.uv_offsets[face_idx] + face.num_edges <= atlas.uvs.size() / 2);
+            for (uint32_t i = 0; i < face.num_edges; i++) {
+                const float* uv = &atlas.uvs[(size_t(atlas.uv_offsets[face_idx]) + i) * 2];
+                float x = uv[0] * float(page.width) - float(rect.x);
+                float y = uv[1] * float(page.height) - float(rect.y);
+                CHECK(x >= 0.5f - 1e-3f);
+                CHECK(x <= float(rect.width) - 0.5f + 1e-3f);
+                CHECK(y >= 0.5f - 1e-3f);
+                CHECK(y <= float(rect.height) - 0.5f + 1e-3f);
+            }
+        }
+    }
+}
+
+TEST_CASE("BSPLightmapAtlas UVs") {
+    StagedTestBSP test(TestBSPOptions{}, TestBSPStage::DECODED);
+    const BSPParser& bsp = test.bsp;
+    BSPLightmapAtlas atlas;
+    REQUIRE(atlas.build(bsp, test.lumps.lightmaps));
+
+    // A 64 unit face spans 4 luxels between its corners.
+    for (size_t face_idx = 0; face_idx < bsp.faces.size(); face_idx++) {
+        const BSPFace& face = bsp.faces[face_idx];
+        const BSPLightmapPage& page = atlas.pages[atlas.rects[face_idx].page];
+        float min_uv[2] = {INFINITY, INFINITY};
+        float max_uv[2] = {-INFINITY, -INFINITY};
+        for (uint32_t i = 0; i < face.num_edges; i++) {
+            const float* uv = &atlas.uvs[(size_t(atlas.uv_offsets[face_idx]) + i) * 2];
+            for (int axis = 0; axis < 2; axis++) {
+                min_uv[axis] = std::min(min_uv[axis], uv[axis]);
+                max_uv[axis] = std::max(max_uv[axis], uv[axis]);
+            }
+        }
+        CHECK((max_uv[0] - min_uv[0]) * float(page.width) == doctest::Approx(4.0f));
+        CHECK((max_uv[1] - min_uv[1]) * float(page.height) == doctest::Approx(4.0f));
+    }
+}
+
+TEST_CASE("BSPLightmapAtlas faces without lightmap") {
+    StagedTestBSP test(TestBSPOptions{}, TestBSPStage::DECODED);
+    std::vector<BSPFaceLightmap> lightmaps = test.lumps.lightmaps;
+    lightmaps[0].num_styles = 0;
+    lightmaps[3].num_styles = 0;
+
+    BSPLightmapAtlas atlas;
+    REQUIRE(atlas.build(test.bsp, lightmaps));
+    const BSPLightmapRect& rect = atlas.rects[0];
+    CHECK(rect.num_styles == 0);
+    CHECK(atlas.rects[3].x == rect.x);
+    CHECK(atlas.rects[3].y == rect.y);
+    const BSPLightmapPage& page = atlas.pages[rect.page];
+    for (uint32_t y = rect.y - 1; y <= rect.y + 1; y++) {
+        for (uint32_t x = rect.x - 1; x <= rect.x + 1; x++) {
+            const uint8_t* pixel = page_pixel(page, x, y);
+            CHECK(pixel[0] == 255);
+            CHECK(pixel[1] == 255);
+            CHECK(pixel[2] == 255);
+        }
+    }
+    for (uint32_t i = 0; i < test.bsp.faces[0].num_edges; i++) {
+        const float* uv = &atlas.uvs[(size_t(atlas.uv_offsets[0]) + i) * 2];
+        CHECK(uv[0] * float(page.width) == doctest::Approx(float(rect.x) + 0.5f));
+        CHECK(uv[1] * float(page.height) == doctest::Approx(float(rect.y) + 0.5f));
+    }
+}
+
+TEST_CASE("BSPLightmapAtlas pages") {
+    TestBSPOptions options;
+    options.num_styles = 4;
+    StagedTestBSP test(options, TestBSPStage::DECODED);
+
+    // Small pages need several of them, the same packing comes out in parallel.
+    BSPLightmapAtlasOptions atlas_options;
+    atlas_options.page_size = 64;
+    BSPLightmapAtlas atlas;
+    REQUIRE(atlas.build(test.bsp, test.lumps.lightmaps, atlas_options));
+    CHECK(atlas.pages.size() > 1);
+    check_no_overlaps(atlas);
+    for (size_t face_idx = 0; face_idx < test.bsp.faces.size(); face_idx++) {
+        check_face_luxels(atlas, test.bsp, test.lumps.lightmaps[face_idx], face_idx);
+    }
+
+    atlas_options.parallel = true;
+    BSPLightmapAtlas parallel_atlas;
+    REQUIRE(parallel_atlas.build(test.bsp, test.lumps.lightmaps, atlas_options));
+    REQUIRE(parallel_atlas.pages.size() == atlas.pages.size());
+    for (size_t page = 0; page < atlas.pages.size(); page++) {
+        CHECK(parallel_atlas.pages[page].pixels == atlas.pages[page].pixels);
+    }
+    CHECK(parallel_atlas.uvs == atlas.uvs);
+
+    // 4 styles of 6 luxels and the padding do not fit into 16 rows.
+    atlas_options.page_size = 16;
+    CHECK_FALSE(atlas.build(test.bsp, test.lumps.lightmaps, atlas_options));
+}
+
+TEST_CASE("BSPLightmapAtlas invalid lightmaps") {
+    StagedTestBSP test(TestBSPOptions{}, TestBSPStage::DECODED);
+    std::vector<BSPFaceLightmap> lightmaps = test.lumps.lightmaps;
+    BSPLightmapAtlas atlas;
+
+    SUBCASE("face count") {
+        lightmaps.pop_back();
+        CHECK_FALSE(atlas.build(test.bsp, lightmaps));
+    }
+
+    SUBCASE("out of bounds") {
+        lightmaps.back().offset = uint32_t(test.bsp.lighting.size());
+        CHECK_FALSE(atlas.build(test.bsp, lightmaps));
+    }
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,145 @@
+#include "hl1/bsp_mesh.h"
+
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "bsp_test_map.h"
+
+
+TEST_SUITE_BEGIN("bsp_mesh");
+
+TEST_CASE("BSPMesh build") {
+    TestBSPOptions options;
+    options.num_textures = 5;
+    StagedTestBSP test(options, TestBSPStage::LIGHTMAPS);
+    const BSPParser& bsp = test.bsp;
+    BSPMesh mesh;
+    REQUIRE(mesh.build(bsp, test.lumps, test.lightmaps));
+
+    // Quads become two triangles, the faces use at most one batch per texture.
+    CHECK(mesh.vertices.size() == bsp.faces.size() * 4);
+    CHECK(mesh.indices.size() == bsp.faces.size() * 6);
+    CHECK(mesh.batches.size() == size_t(options.num_textures));
+    REQUIRE(mesh.models.size() == 1);
+    CHECK(mesh.models[0].first_batch == 0);
+    CHECK(mesh.models[0].num_batches == mesh.batches.size());
+
+    // Batches are contiguous and sorted by texture.
+    uint32_t next_index = 0;
+    for (size_t batch_idx = 0; batch_idx < mesh.batches.size(); batch_idx++) {
+        const BSPMeshBatch& batch = mesh.batches[batch_idx];
+        CHECK(batch.first_index == next_index);
+        CHECK(batch.lightmap_page == 0);
+        if (batch_idx > 0) {
+            CHECK(batch.texture > mesh.batches[batch_idx - 1].texture);
+        }
+        next_index += batch.num_indices;
+    }
+    CHECK(next_index == mesh.indices.size());
+
+    REQUIRE(mesh.faces.size() == bsp.faces.size());
+    for (size_t face_idx = 0; face_idx < bsp.faces.size(); face_idx++) {
+        const BSPFace& face = bsp.faces[face_idx];
+        const BSPMeshFace& mesh_face = mesh.faces[face_idx];
+        const BSPTexinfo& texinfo = bsp.texinfos[face.texinfo];
+        const BSPMeshBatch& batch = mesh.batches[mesh_face.batch];
+        CHECK(batch.texture == texinfo.miptex);
+        CHECK(mesh_face.num_indices == 6);
+        CHECK(mesh_face.first_index >= batch.first_index);
+        CHECK(mesh_face.first_index + mesh_face.num_indices <= batch.first_index + batch.num_indices);
+
+        // The fan starts at the first vertex of the face and keeps its order.
+        const uint32_t* face_indices = &mesh.indices[mesh_face.first_index];
+        for (uint32_t i = 0; i < face.num_edges; i++) {
+            uint32_t vertex_idx = i == 0 ? face_indices[0] : i == 1 ? face_indices[1] : face_indices[(i - 1) * 3 - 1];
+            const BSPMeshVertex& vertex = mesh.vertices[vertex_idx];
+            const float* point = bsp.face_vertex(face, i);
+            CHECK(memcmp(vertex.position, point, sizeof(vertex.position)) == 0);
+            const BSPTexture& texture = test.lumps.textures[texinfo.miptex];
+            float s = point[0] * texinfo.s[0] + point[1] * texinfo.s[1] + point[2] * texinfo.s[2] + texinfo.s[3];
+            CHECK(vertex.uv[0] * float(texture.width) == doctest::Approx(s));
+            const float* lightmap_uv = &test.lightmaps.uvs[(size_t(test.lightmaps.uv_offsets[face_idx]) + i) * 2];
+            CHECK(vertex.lightmap_uv[0] == lightmap_uv[0]);
+            CHECK(vertex.lightmap_uv[1] == lightmap_uv[1]);
+        }
+
+        // Clockwise seen from the front: the cross product points away from the viewer.
+        const BSPPlane& plane = bsp.planes[face.plane];
+        for (uint32_t triangle = 0; triangle < 2; triangle++) {
+            const float* a = mesh.vertices[face_indices[triangle * 3]].position;
+            const float* b = mesh.vertices[face_indices[triangle * 3 + 1]].position;
+            const float* c = mesh.vertices[face_indices[triangle * 3 + 2]].position;
+            float ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+            float ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+            float cross[3] = {ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2],
+                              ab[0] * ac[1] - ab[1] * ac[0]};
+            float dot = cross[0] * plane.normal[0] + cross[1] * plane.normal[1] + cross[2] * plane.normal[2];
+            float front_dot = face.side != 0 ? -dot : dot;
+            CHECK(front_dot == doctest::Approx(-float(TestBSPOptions::CELL_SIZE * TestBSPOptions::CELL_SIZE)));
+        }
+    }
+}
+
+TEST_CASE("BSPMesh lightmap pages") {
+    // Several lightmap pages split the batches of a texture.
+    TestBSPOptions options;
+    options.num_styles = 4;
+    StagedTestBSP test(options, TestBSPStage::LIGHTMAPS);
+    BSPLightmapAtlasOptions atlas_options;
+    atlas_options.page_size = 64;
+    REQUIRE(test.lightmaps.build(test.bsp, test.lumps.lightmaps, atlas_options));
+    REQUIRE(test.lightmaps.pages.size() > 1);
+
+    BSPMesh mesh;
+    REQUIRE(mesh.build(test.bsp, test.lumps, test.lightmaps));
+    CHECK(mesh.batches.size() > size_t(options.num_textures));
+    for (size_t face_idx = 0; face_idx < test.bsp.faces.size(); face_idx++) {
+        CHECK(mesh.batches[mesh.faces[face_idx].batch].lightmap_page == test.lightmaps.rects[face_idx].page);
+    }
+
+    // The parallel build is the same.
+    BSPMeshOptions mesh_options;
+    mesh_options.parallel = true;
+    BSPMesh parallel_mesh;
+    REQUIRE(parallel_mesh.build(test.bsp, test.lumps, test.lightmaps, mesh_options));
+    REQUIRE(parallel_mesh.vertices.size() == mesh.vertices.size());
+    CHECK(memcmp(parallel_mesh.vertices.data(), mesh.vertices.data(),
+                 mesh.vertices.size() * sizeof(BSPMeshVertex)) == 0);
+    CHECK(parallel_mesh.indices == mesh.indices);
+    REQUIRE(parallel_mesh.batches.size() == mesh.batches.size());
+    for (size_t i = 0; i < mesh.batches.size(); i++) {
+        CHECK(parallel_mesh.batches[i].first_index == mesh.batches[i].first_index);
+        CHECK(parallel_mesh.batches[i].num_indices == mesh.batches[i].num_indices);
+    }
+}
+
+TEST_CASE("BSPMesh invalid faces") {
+    StagedTestBSP test(TestBSPOptions{}, TestBSPStage::LIGHTMAPS);
+    FileContents& file = test.map.file;
+    BSPMesh mesh;
+
+    SUBCASE("lightmaps of another map") {
+        test.lightmaps.rects.pop_back();
+        CHECK_FALSE(mesh.build(test.bsp, test.lumps, test.lightmaps));
+    }
+
+    SUBCASE("texture out of bounds") {
+        size_t offset = size_t(reinterpret_cast<const uint8_t*>(&test.bsp.texinfos[0].miptex) - file.contents.data());
+        uint32_t miptex = uint32_t(test.lumps.textures.size());
+        memcpy(&file.contents[offset], &miptex, 4);
+        CHECK_FALSE(mesh.build(test.bsp, test.lumps, test.lightmaps));
+    }
+
+    SUBCASE("model faces out of bounds") {
+        size_t offset =
+            size_t(reinterpret_cast<const uint8_t*>(&test.bsp.models[0].num_faces) - file.contents.data());
+        int32_t num_faces = int32_t(test.bsp.faces.size()) + 1;
+        memcpy(&file.contents[offset], &num_faces, 4);
+        CHECK_FALSE(mesh.build(test.bsp, test.lumps, test.lightmaps));
+    }
+}
+
+TEST_SUITE_END();
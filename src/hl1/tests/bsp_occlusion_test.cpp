@@ -0,0 +1,161 @@
+#include "hl1/bsp_occlusion.h"
+
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "bsp_test_map.h"
+#include "common/bitset.h"
+#include "common/frustum.h"
+#include "hl1/bsp_tree.h"
+
+
+TEST_SUITE_BEGIN("bsp_occlusion");
+
+namespace {
+
+// Return true if the segment from the camera to the point crosses no solid space.
+bool point_visible(const BSPTree& tree, const float camera[3], const float point[3]) {
+    BSPRay ray = {{camera[0], camera[1], camera[2]}, {point[0], point[1], point[2]}};
+    return tree.cast_ray(ray).fraction == 1.0f;
+}
+
+}  // namespace
+
+TEST_CASE("BSPOcclusion occluders") {
+    StagedTestBSP test(TestBSPOptions{}, TestBSPStage::DECODED);
+    BSPOcclusion occlusion;
+    // The faces are 64x64 squares.
+    REQUIRE(occlusion.init(test.bsp, test.lumps, 4096.0f));
+    CHECK(occlusion.first_vertices.size() == test.bsp.faces.size() + 1);
+    CHECK(occlusion.vertices.size() == test.bsp.faces.size() * 4 * 3);
+    CHECK(occlusion.interior_edges.size() == test.bsp.faces.size() * 4);
+    size_t num_interior = size_t(std::count(occlusion.interior_edges.begin(), occlusion.interior_edges.end(), 1));
+    CHECK(num_interior > 0);
+    CHECK(num_interior < occlusion.interior_edges.size());
+    for (size_t face_idx = 0; face_idx < test.bsp.faces.size(); face_idx++) {
+        CHECK(occlusion.face_occluders[face_idx] == face_idx);
+    }
+
+    REQUIRE(occlusion.init(test.bsp, test.lumps, 4097.0f));
+    CHECK(occlusion.first_vertices.size() == 1);
+    CHECK(occlusion.vertices.empty());
+    CHECK(occlusion.face_occluders[0] == UINT32_MAX);
+}
+
+TEST_CASE("BSPOcclusion culling is conservative") {
+    TestBSPOptions options;
+    options.size[0] = 16;
+    options.size[1] = 14;
+    options.size[2] = 3;
+    options.solid_percent = 35;
+    options.vis_radius = 16;
+    StagedTestBSP test(options);
+    BSPVisibility vis;
+    REQUIRE(vis.init(test.bsp, test.mesh));
+    BSPOcclusion occlusion;
+    REQUIRE(occlusion.init(test.bsp, test.lumps));
+    BSPTree tree;
+    REQUIRE(tree.build(test.bsp));
+    OcclusionBuffer buffer;
+    buffer.init(128, 96);
+
+    const float cell = float(TestBSPOptions::CELL_SIZE);
+    BSPVisibleSet visible;
+    size_t num_culled_leaves = 0;
+    size_t num_culled_faces = 0;
+    for (size_t leaf = 1; leaf < test.map.leaf_cells.size(); leaf += 5) {
+        int c = test.map.leaf_cells[leaf];
+        float camera[3] = {(float(c % options.size[0]) + 0.3f) * cell,
+                           (float(c / options.size[0] % options.size[1]) + 0.6f) * cell,
+                           (float(c / (options.size[0] * options.size[1])) + 0.5f) * cell};
+        for (int direction = 0; direction < 4; direction++) {
+            CAPTURE(leaf);
+            CAPTURE(direction);
+            float yaw = float(direction) * 1.5707963f + 0.3f;
+            OcclusionView view;
+            std::copy(camera, camera + 3, view.position);
+            view.forward[0] = std::cos(yaw);
+            view.forward[1] = std::sin(yaw);
+            view.forward[2] = 0.0f;
+            view.right[0] = std::sin(yaw);
+            view.right[1] = -std::cos(yaw);
+            view.right[2] = 0.0f;
+            view.tan_half_fov_y = 0.75f;
+            Frustum frustum;
+            frustum.set_perspective(view.position, view.forward, view.right, view.up, view.tan_half_fov_x,
+                                    view.tan_half_fov_y, view.near_dist, 1e5f);
+
+            vis.find_visible_leaves(camera, visible);
+            vis.cull_leaves(frustum, visible);
+            vis.find_visible_faces(visible);
+            std::vector<uint64_t> leaves_before = visible.leaves;
+            std::vector<uint32_t> faces_before = visible.face_list;
+            occlusion.render(view, visible, buffer, direction % 2 == 0);
+            vis.find_unoccluded_faces(buffer, visible);
+
+            // No point of the culled leaves in the view can be seen from the camera.
+            for (size_t bit = 0; bit + 1 < test.map.leaf_cells.size(); bit++) {
+                if (!bitset_test(leaves_before.data(), bit) || bitset_test(visible.leaves.data(), bit)) {
+                    CHECK(bitset_test(leaves_before.data(), bit) == bitset_test(visible.leaves.data(), bit));
+                    continue;
+                }
+                num_culled_leaves++;
+                int other = test.map.leaf_cells[bit + 1];
+                int p[3] = {other % options.size[0], other / options.size[0] % options.size[1],
+                            other / (options.size[0] * options.size[1])};
+                for (int i = 0; i < 27; i++) {
+                    float point[3];
+                    int steps[3] = {i % 3, i / 3 % 3, i / 9};
+                    for (int axis = 0; axis < 3; axis++) {
+                        point[axis] = (float(p[axis]) + 0.1f + 0.4f * float(steps[axis])) * cell;
+                    }
+                    if (frustum.test_box(point, point)) {
+                        CAPTURE(bit);
+                        CHECK_FALSE(point_visible(tree, camera, point));
+                    }
+                }
+            }
+
+            // No point of the culled faces in the view can be seen either.
+            std::vector<uint32_t> faces_after = visible.face_list;
+            std::sort(faces_before.begin(), faces_before.end());
+            std::sort(faces_after.begin(), faces_after.end());
+            CHECK(std::includes(faces_before.begin(), faces_before.end(), faces_after.begin(), faces_after.end()));
+            CHECK(bitset_count(visible.faces.data(), visible.faces.size()) == faces_after.size());
+            for (uint32_t face_idx : faces_before) {
+                if (std::binary_search(faces_after.begin(), faces_after.end(), face_idx)) {
+                    continue;
+                }
+                num_culled_faces++;
+                const BSPFace& face = test.bsp.faces[face_idx];
+                const BSPPlane& plane = test.bsp.planes[face.plane];
+                float center[3] = {};
+                for (uint32_t i = 0; i < face.num_edges; i++) {
+                    for (int axis = 0; axis < 3; axis++) {
+                        center[axis] += test.bsp.face_vertex(face, i)[axis] / float(face.num_edges);
+                    }
+                }
+                for (uint32_t i = 0; i <= face.num_edges; i++) {
+                    const float* corner = i < face.num_edges ? test.bsp.face_vertex(face, i) : center;
+                    float point[3];
+                    for (int axis = 0; axis < 3; axis++) {
+                        float normal = face.side == 0 ? plane.normal[axis] : -plane.normal[axis];
+                        point[axis] = center[axis] + 0.9f * (corner[axis] - center[axis]) + normal;
+                    }
+                    if (frustum.test_box(point, point)) {
+                        CAPTURE(face_idx);
+                        CHECK_FALSE(point_visible(tree, camera, point));
+                    }
+                }
+            }
+        }
+    }
+    CHECK(num_culled_leaves > 0);
+    CHECK(num_culled_faces > 0);
+}
+
+TEST_SUITE_END();
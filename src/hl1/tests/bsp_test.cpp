@@ -0,0 +1,183 @@
+#include "hl1/bsp.h"
+
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "bsp_test_map.h"
+
+
+TEST_SUITE_BEGIN("bsp");
+
+namespace {
+
+// Return true if the span points into the file contents.
+template <typename T>
+bool points_into(Span<const T> span, const FileContents& file) {
+    const uint8_t* begin = reinterpret_cast<const uint8_t*>(span.data());
+    return begin >= file.contents.data() && begin + span.size_bytes() <= file.contents.data() + file.contents.size();
+}
+
+void set_lump(FileContents& file, BSPLump lump, int32_t offset, int32_t length) {
+    int32_t entry[2] = {offset, length};
+    memcpy(&file.contents[4 + size_t(lump) * 8], entry, 8);
+}
+
+void get_lump(const FileContents& file, BSPLump lump, int32_t& offset, int32_t& length) {
+    int32_t entry[2];
+    memcpy(entry, &file.contents[4 + size_t(lump) * 8], 8);
+    offset = entry[0];
+    length = entry[1];
+}
+
+}  // namespace
+
+TEST_CASE("BSPParser parse") {
+    TestBSP map = make_test_bsp();
+    BSPParser bsp;
+    REQUIRE(bsp.parse(map.file));
+    CHECK(bsp.valid);
+    CHECK(bsp.name == "test.bsp");
+
+    // All views point into the file.
+    CHECK(points_into(bsp.planes, map.file));
+    CHECK(points_into(bsp.textures, map.file));
+    CHECK(points_into(bsp.vertices, map.file));
+    CHECK(points_into(bsp.visdata, map.file));
+    CHECK(points_into(bsp.nodes, map.file));
+    CHECK(points_into(bsp.texinfos, map.file));
+    CHECK(points_into(bsp.faces, map.file));
+    CHECK(points_into(bsp.lighting, map.file));
+    CHECK(points_into(bsp.clipnodes, map.file));
+    CHECK(points_into(bsp.leaves, map.file));
+    CHECK(points_into(bsp.marksurfaces, map.file));
+    CHECK(points_into(bsp.edges, map.file));
+    CHECK(points_into(bsp.surfedges, map.file));
+    CHECK(points_into(bsp.models, map.file));
+
+    CHECK(bsp.entities.substr(0, 1) == "{");
+    CHECK(bsp.entities.back() == '\n');
+    CHECK(bsp.entities.find("worldspawn") != std::string_view::npos);
+
+    REQUIRE(bsp.leaves.size() == map.leaf_cells.size());
+    CHECK(bsp.leaves[0].contents == BSP_CONTENTS_SOLID);
+    size_t num_faces = 0;
+    for (size_t leaf_idx = 1; leaf_idx < bsp.leaves.size(); leaf_idx++) {
+        const BSPLeaf& leaf = bsp.leaves[leaf_idx];
+        CHECK(leaf.contents == BSP_CONTENTS_EMPTY);
+        CHECK(leaf.num_mark_surfaces == map.cell_faces[size_t(map.leaf_cells[leaf_idx])].size());
+        num_faces += leaf.num_mark_surfaces;
+    }
+    CHECK(bsp.faces.size() == num_faces);
+    CHECK(bsp.marksurfaces.size() == num_faces);
+    CHECK(bsp.surfedges.size() == num_faces * 4);
+    CHECK(bsp.clipnodes.size() == bsp.nodes.size());
+    REQUIRE(bsp.models.size() == 1);
+    CHECK(bsp.models[0].num_faces == int32_t(num_faces));
+    CHECK(bsp.models[0].vis_leaves == int32_t(bsp.leaves.size() - 1));
+    for (const BSPPlane& plane : bsp.planes) {
+        CHECK(plane.type >= BSP_PLANE_X);
+        CHECK(plane.type <= BSP_PLANE_Z);
+        CHECK(plane.normal[plane.type] == 1.0f);
+    }
+    for (const BSPFace& face : bsp.faces) {
+        CHECK(face.first_edge + face.num_edges <= bsp.surfedges.size());
+        CHECK(face.plane < bsp.planes.size());
+        CHECK(face.texinfo < bsp.texinfos.size());
+    }
+
+    // Parsing again replaces the views.
+    TestBSPOptions options;
+    options.size[2] = 4;
+    TestBSP other_map = make_test_bsp(options);
+    REQUIRE(bsp.parse(other_map.file));
+    CHECK(points_into(bsp.faces, other_map.file));
+    CHECK(bsp.leaves.size() == other_map.leaf_cells.size());
+}
+
+TEST_CASE("BSPParser face_vertex") {
+    TestBSP map = make_test_bsp();
+    BSPParser bsp;
+    REQUIRE(bsp.parse(map.file));
+
+    // Consecutive vertices of a face share an edge.
+    for (const BSPFace& face : bsp.faces) {
+        for (uint32_t i = 0; i < face.num_edges; i++) {
+            const float* a = bsp.face_vertex(face, i);
+            const float* b = bsp.face_vertex(face, (i + 1) % face.num_edges);
+            REQUIRE(a != nullptr);
+            REQUIRE(b != nullptr);
+            int num_different = 0;
+            for (int axis = 0; axis < 3; axis++) {
+                num_different += a[axis] != b[axis] ? 1 : 0;
+            }
+            CHECK(num_different == 1);
+        }
+    }
+
+    BSPFace face = bsp.faces[0];
+    face.first_edge = uint32_t(bsp.surfedges.size()) - 1;
+    CHECK(bsp.face_vertex(face, 0) != nullptr);
+    CHECK(bsp.face_vertex(face, 1) == nullptr);
+    face.first_edge = 0;
+    int32_t* surfedge = reinterpret_cast<int32_t*>(map.file.contents.data() +
+                                                    (reinterpret_cast<const uint8_t*>(bsp.surfedges.data()) -
+                                                     map.file.contents.data()));
+    *surfedge = int32_t(bsp.edges.size());
+    CHECK(bsp.face_vertex(face, 0) == nullptr);
+}
+
+TEST_CASE("BSPParser invalid files") {
+    TestBSP map = make_test_bsp();
+    FileContents& file = map.file;
+    BSPParser bsp;
+    int32_t offset = 0;
+    int32_t length = 0;
+
+    SUBCASE("truncated header") {
+        file.contents.resize(40);
+        CHECK_FALSE(bsp.parse(file));
+    }
+
+    SUBCASE("wrong version") {
+        int32_t version = 29;
+        memcpy(file.contents.data(), &version, 4);
+        CHECK_FALSE(bsp.parse(file));
+    }
+
+    SUBCASE("lump out of bounds") {
+        get_lump(file, BSP_LUMP_FACES, offset, length);
+        set_lump(file, BSP_LUMP_FACES, offset, int32_t(file.contents.size()) - offset + 20);
+        CHECK_FALSE(bsp.parse(file));
+    }
+
+    SUBCASE("negative lump offset") {
+        get_lump(file, BSP_LUMP_PLANES, offset, length);
+        set_lump(file, BSP_LUMP_PLANES, -20, length);
+        CHECK_FALSE(bsp.parse(file));
+    }
+
+    SUBCASE("partial element") {
+        get_lump(file, BSP_LUMP_NODES, offset, length);
+        set_lump(file, BSP_LUMP_NODES, offset, length - 1);
+        CHECK_FALSE(bsp.parse(file));
+    }
+
+    SUBCASE("misaligned lump") {
+        get_lump(file, BSP_LUMP_VERTICES, offset, length);
+        set_lump(file, BSP_LUMP_VERTICES, offset + 2, length - 12);
+        CHECK_FALSE(bsp.parse(file));
+    }
+
+    SUBCASE("no world model") {
+        get_lump(file, BSP_LUMP_MODELS, offset, length);
+        set_lump(file, BSP_LUMP_MODELS, offset, 0);
+        CHECK_FALSE(bsp.parse(file));
+    }
+
+    CHECK_FALSE(bsp.valid);
+}
+
+TEST_SUITE_END();
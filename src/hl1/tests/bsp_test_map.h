@@ -0,0 +1,499 @@
+#pragma once
+
+#include <doctest/doctest.h>
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/io.h"
+#include "hl1/bsp.h"
+#include "hl1/bsp_decode.h"
+#include "hl1/bsp_lightmaps.h"
+#include "hl1/bsp_mesh.h"
+#include "hl1_test.h"
+
+
+// Description of a grid map for make_test_bsp(): size[0] x size[1] x size[2] cubic cells of CELL_SIZE units, each
+// solid or empty. The border cells are always solid, so the map is sealed.
+struct TestBSPOptions {
+    static constexpr int CELL_SIZE = 64;
+
+    int size[3] = {8, 8, 3};
+    // Interior cells are solid with probability solid_percent, chosen from the seed.
+    uint32_t seed = 1;
+    int solid_percent = 20;
+    // Faces use num_textures textures, the even ones are embedded in the map, the odd ones are stored in WADs.
+    int num_textures = 3;
+    // Number of light styles of each face, 1-4.
+    int num_styles = 1;
+    // Each leaf sees the leaves within vis_radius cells (along each axis).
+    int vis_radius = 2;
+    // Number of point entities besides worldspawn.
+    int num_entities = 8;
+    // Number of brush models besides the world, each a 32 units cube in an empty cell, without faces or nodes.
+    int num_brush_models = 0;
+};
+
+// Grid map built by make_test_bsp(), with the layout the tests check against.
+struct TestBSP {
+    TestBSPOptions options;
+    // Per cell, x varies fastest.
+    std::vector<uint8_t> solid;
+    // Leaf of each cell, 0 (the shared solid leaf) for the solid cells.
+    std::vector<int32_t> cell_leaves;
+    // Cell of each leaf, -1 for leaf 0.
+    std::vector<int32_t> leaf_cells;
+    // Faces between each empty cell and its solid neighbors.
+    std::vector<std::vector<uint32_t>> cell_faces;
+    FileContents file;
+
+    int cell_index(int x, int y, int z) const {
+        return (z * options.size[1] + y) * options.size[0] + x;
+    }
+    // Return true for solid cells and for cells outside of the map.
+    bool is_solid(int x, int y, int z) const {
+        if (x < 0 || y < 0 || z < 0 || x >= options.size[0] || y >= options.size[1] || z >= options.size[2]) {
+            return true;
+        }
+        return solid[cell_index(x, y, z)] != 0;
+    }
+    // Return true if leaf a sees leaf b according to TestBSPOptions::vis_radius.
+    bool leaf_sees(int32_t a, int32_t b) const {
+        int ca = leaf_cells[a];
+        int cb = leaf_cells[b];
+        for (int axis = 0; axis < 3; axis++) {
+            int stride = axis == 0 ? 1 : axis == 1 ? options.size[0] : options.size[0] * options.size[1];
+            int pa = (ca / stride) % options.size[axis];
+            int pb = (cb / stride) % options.size[axis];
+            if (pa - pb > options.vis_radius || pb - pa > options.vis_radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Build an in-memory BSP v30 file of a grid map. The nodes split the grid in halves along the longest axis down to
+// single cells, every empty cell is a leaf. Faces separate the empty cells from the solid ones and face the empty
+// cells. The clipnodes of hulls 1-3 mirror the nodes without expansion.
+inline TestBSP make_test_bsp(const TestBSPOptions& options = {}) {
+    TestBSP map;
+    map.options = options;
+    const int size_x = options.size[0];
+    const int size_y = options.size[1];
+    const int size_z = options.size[2];
+    const int num_cells = size_x * size_y * size_z;
+    const float cell = float(TestBSPOptions::CELL_SIZE);
+
+    uint32_t rng = options.seed * 2654435761u + 12345u;
+    auto next_random = [&rng]() {
+        rng = rng * 1664525u + 1013904223u;
+        return rng >> 8;
+    };
+    map.solid.resize(size_t(num_cells));
+    for (int z = 0; z < size_z; z++) {
+        for (int y = 0; y < size_y; y++) {
+            for (int x = 0; x < size_x; x++) {
+                bool border = x == 0 || y == 0 || z == 0 || x == size_x - 1 || y == size_y - 1 || z == size_z - 1;
+                bool solid = border || int(next_random() % 100) < options.solid_percent;
+                map.solid[size_t(map.cell_index(x, y, z))] = solid ? 1 : 0;
+            }
+        }
+    }
+
+    std::vector<BSPLeaf> leaves(1);
+    leaves[0].contents = BSP_CONTENTS_SOLID;
+    leaves[0].vis_offset = -1;
+    map.cell_leaves.assign(size_t(num_cells), 0);
+    map.leaf_cells.assign(1, -1);
+    for (int c = 0; c < num_cells; c++) {
+        if (map.solid[size_t(c)] == 0) {
+            map.cell_leaves[size_t(c)] = int32_t(leaves.size());
+            map.leaf_cells.push_back(c);
+            leaves.emplace_back();
+        }
+    }
+    map.cell_faces.resize(size_t(num_cells));
+
+    std::vector<BSPPlane> planes;
+    std::map<std::pair<int, int>, uint32_t> plane_indices;
+    std::vector<BSPVertex> vertices;
+    std::map<std::array<int, 3>, uint16_t> vertex_indices;
+    std::vector<BSPEdge> edges(1);
+    std::map<std::pair<uint16_t, uint16_t>, int32_t> edge_indices;
+    std::vector<int32_t> surfedges;
+    std::vector<BSPFace> faces;
+    std::vector<BSPNode> nodes;
+    std::vector<BSPClipnode> clipnodes;
+    std::vector<uint8_t> lighting;
+
+    // Texinfos per axis and texture: s and t run along the two other axes.
+    std::vector<BSPTexinfo> texinfos;
+    for (int axis = 0; axis < 3; axis++) {
+        for (int texture = 0; texture < options.num_textures; texture++) {
+            BSPTexinfo texinfo = {};
+            texinfo.s[(axis + 1) % 3] = 1.0f;
+            texinfo.t[(axis + 2) % 3] = -1.0f;
+            texinfo.s[3] = float(texture * 8);
+            texinfo.miptex = uint32_t(texture);
+            texinfos.push_back(texinfo);
+        }
+    }
+
+    auto add_vertex = [&](const int p[3]) {
+        std::array<int, 3> key = {p[0], p[1], p[2]};
+        auto it = vertex_indices.find(key);
+        if (it != vertex_indices.end()) {
+            return it->second;
+        }
+        BSPVertex vertex = {{float(p[0]) * cell, float(p[1]) * cell, float(p[2]) * cell}};
+        vertices.push_back(vertex);
+        uint16_t idx = uint16_t(vertices.size() - 1);
+        vertex_indices.emplace(key, idx);
+        return idx;
+    };
+    auto add_surfedge = [&](uint16_t v0, uint16_t v1) {
+        auto it = edge_indices.find({v1, v0});
+        if (it != edge_indices.end()) {
+            surfedges.push_back(-it->second);
+            return;
+        }
+        BSPEdge edge = {{v0, v1}};
+        edges.push_back(edge);
+        edge_indices.emplace(std::make_pair(v0, v1), int32_t(edges.size() - 1));
+        surfedges.push_back(int32_t(edges.size() - 1));
+    };
+
+    // Add the face of the cell (u, v) on the two other axes on the plane axis = coord, facing the empty cell.
+    auto add_face = [&](uint32_t plane, int axis, int coord, int u, int v, int empty_cell, bool facing_positive) {
+        int axis_u = (axis + 1) % 3;
+        int axis_v = (axis + 2) % 3;
+        int corners[4][2] = {{0, 0}, {0, 1}, {1, 1}, {1, 0}};
+        if (!facing_positive) {
+            std::swap(corners[1], corners[3]);
+        }
+        BSPFace face = {};
+        face.plane = uint16_t(plane);
+        face.side = facing_positive ? 0 : 1;
+        face.first_edge = uint32_t(surfedges.size());
+        face.num_edges = 4;
+        uint16_t corner_vertices[4];
+        for (int i = 0; i < 4; i++) {
+            int p[3];
+            p[axis] = coord;
+            p[axis_u] = u + corners[i][0];
+            p[axis_v] = v + corners[i][1];
+            corner_vertices[i] = add_vertex(p);
+        }
+        for (int i = 0; i < 4; i++) {
+            add_surfedge(corner_vertices[i], corner_vertices[(i + 1) % 4]);
+        }
+        int texture = int((uint32_t(empty_cell) * 7u + uint32_t(axis)) % uint32_t(options.num_textures));
+        face.texinfo = uint16_t(axis * options.num_textures + texture);
+
+        // Lightmap extents as the engine computes them: 16 texels per luxel.
+        const BSPTexinfo& texinfo = texinfos[face.texinfo];
+        float min_st[2] = {1e9f, 1e9f};
+        float max_st[2] = {-1e9f, -1e9f};
+        for (uint16_t vertex_idx : corner_vertices) {
+            const float* point = vertices[vertex_idx].point;
+            for (int i = 0; i < 2; i++) {
+                const float* vec = i == 0 ? texinfo.s : texinfo.t;
+                float st = point[0] * vec[0] + point[1] * vec[1] + point[2] * vec[2] + vec[3];
+                min_st[i] = st < min_st[i] ? st : min_st[i];
+                max_st[i] = st > max_st[i] ? st : max_st[i];
+            }
+        }
+        int luxels = 1;
+        for (int i = 0; i < 2; i++) {
+            luxels *= int(std::ceil(max_st[i] / 16.0f) - std::floor(min_st[i] / 16.0f)) + 1;
+        }
+        for (int style = 0; style < 4; style++) {
+            face.styles[style] = style < options.num_styles ? uint8_t(style * 10) : 255;
+        }
+        face.light_offset = int32_t(lighting.size());
+        for (int style = 0; style < options.num_styles; style++) {
+            for (int i = 0; i < luxels * 3; i++) {
+                lighting.push_back(uint8_t(faces.size() * 5 + size_t(style) * 40 + size_t(i)));
+            }
+        }
+        map.cell_faces[size_t(empty_cell)].push_back(uint32_t(faces.size()));
+        faces.push_back(face);
+    };
+
+    // Build the node of the cells [lo, hi) and return its child index: node index or -(leaf + 1).
+    auto build_node = [&](auto&& self, const int lo[3], const int hi[3]) -> int16_t {
+        if (hi[0] - lo[0] == 1 && hi[1] - lo[1] == 1 && hi[2] - lo[2] == 1) {
+            return int16_t(-(map.cell_leaves[size_t(map.cell_index(lo[0], lo[1], lo[2]))] + 1));
+        }
+        bool all_solid = true;
+        for (int z = lo[2]; z < hi[2] && all_solid; z++) {
+            for (int y = lo[1]; y < hi[1] && all_solid; y++) {
+                for (int x = lo[0]; x < hi[0] && all_solid; x++) {
+                    all_solid = map.is_solid(x, y, z);
+                }
+            }
+        }
+        if (all_solid) {
+            return -1;
+        }
+
+        int axis = 0;
+        for (int i = 1; i < 3; i++) {
+            if (hi[i] - lo[i] > hi[axis] - lo[axis]) {
+                axis = i;
+            }
+        }
+        int mid = lo[axis] + (hi[axis] - lo[axis]) / 2;
+        auto plane_it = plane_indices.find({axis, mid});
+        if (plane_it == plane_indices.end()) {
+            BSPPlane plane = {};
+            plane.normal[axis] = 1.0f;
+            plane.dist = float(mid) * cell;
+            plane.type = axis;
+            planes.push_back(plane);
+            plane_it = plane_indices.emplace(std::make_pair(axis, mid), uint32_t(planes.size() - 1)).first;
+        }
+
+        size_t node_idx = nodes.size();
+        nodes.emplace_back();
+        clipnodes.emplace_back();
+        BSPNode node = {};
+        node.plane = plane_it->second;
+        for (int i = 0; i < 3; i++) {
+            node.mins[i] = int16_t(lo[i] * TestBSPOptions::CELL_SIZE);
+            node.maxs[i] = int16_t(hi[i] * TestBSPOptions::CELL_SIZE);
+        }
+        node.first_face = uint16_t(faces.size());
+        int axis_u = (axis + 1) % 3;
+        int axis_v = (axis + 2) % 3;
+        for (int u = lo[axis_u]; u < hi[axis_u]; u++) {
+            for (int v = lo[axis_v]; v < hi[axis_v]; v++) {
+                int back[3];
+                back[axis] = mid - 1;
+                back[axis_u] = u;
+                back[axis_v] = v;
+                int front[3] = {back[0], back[1], back[2]};
+                front[axis] = mid;
+                bool back_solid = map.is_solid(back[0], back[1], back[2]);
+                bool front_solid = map.is_solid(front[0], front[1], front[2]);
+                if (back_solid && !front_solid) {
+                    add_face(node.plane, axis, mid, u, v, map.cell_index(front[0], front[1], front[2]), true);
+                } else if (!back_solid && front_solid) {
+                    add_face(node.plane, axis, mid, u, v, map.cell_index(back[0], back[1], back[2]), false);
+                }
+            }
+        }
+        node.num_faces = uint16_t(faces.size() - node.first_face);
+
+        int front_lo[3] = {lo[0], lo[1], lo[2]};
+        int back_hi[3] = {hi[0], hi[1], hi[2]};
+        front_lo[axis] = mid;
+        back_hi[axis] = mid;
+        node.children[0] = self(self, front_lo, hi);
+        node.children[1] = self(self, lo, back_hi);
+        nodes[node_idx] = node;
+
+        BSPClipnode clipnode = {};
+        clipnode.plane = int32_t(node.plane);
+        for (int i = 0; i < 2; i++) {
+            int16_t child = node.children[i];
+            clipnode.children[i] = child >= 0 ? child : child == -1 ? BSP_CONTENTS_SOLID : BSP_CONTENTS_EMPTY;
+        }
+        clipnodes[node_idx] = clipnode;
+        return int16_t(node_idx);
+    };
+    int lo[3] = {0, 0, 0};
+    int hi[3] = {size_x, size_y, size_z};
+    build_node(build_node, lo, hi);
+
+    std::vector<uint16_t> marksurfaces;
+    for (size_t leaf_idx = 1; leaf_idx < leaves.size(); leaf_idx++) {
+        int c = map.leaf_cells[leaf_idx];
+        int p[3] = {c % size_x, (c / size_x) % size_y, c / (size_x * size_y)};
+        BSPLeaf& leaf = leaves[leaf_idx];
+        leaf.contents = BSP_CONTENTS_EMPTY;
+        for (int i = 0; i < 3; i++) {
+            leaf.mins[i] = int16_t(p[i] * TestBSPOptions::CELL_SIZE);
+            leaf.maxs[i] = int16_t((p[i] + 1) * TestBSPOptions::CELL_SIZE);
+        }
+        leaf.first_mark_surface = uint16_t(marksurfaces.size());
+        for (uint32_t face_idx : map.cell_faces[size_t(c)]) {
+            marksurfaces.push_back(uint16_t(face_idx));
+        }
+        leaf.num_mark_surfaces = uint16_t(marksurfaces.size() - leaf.first_mark_surface);
+    }
+
+    // PVS rows cover the leaves 1..N, runs of zero bytes are stored as a zero followed by the run length.
+    std::vector<uint8_t> visdata;
+    size_t num_vis_leaves = leaves.size() - 1;
+    size_t row_bytes = (num_vis_leaves + 7) / 8;
+    for (size_t leaf_idx = 1; leaf_idx < leaves.size(); leaf_idx++) {
+        std::vector<uint8_t> row(row_bytes);
+        for (size_t other = 1; other < leaves.size(); other++) {
+            if (map.leaf_sees(int32_t(leaf_idx), int32_t(other))) {
+                row[(other - 1) / 8] |= uint8_t(1 << ((other - 1) % 8));
+            }
+        }
+        leaves[leaf_idx].vis_offset = int32_t(visdata.size());
+        for (size_t i = 0; i < row.size(); i++) {
+            if (row[i] != 0) {
+                visdata.push_back(row[i]);
+                continue;
+            }
+            size_t run = 0;
+            while (i < row.size() && row[i] == 0 && run < 255) {
+                run++;
+                i++;
+            }
+            i--;
+            visdata.push_back(0);
+            visdata.push_back(uint8_t(run));
+        }
+    }
+
+    BSPModel world = {};
+    for (int i = 0; i < 3; i++) {
+        world.mins[i] = 0.0f;
+        world.maxs[i] = float(options.size[i]) * cell;
+    }
+    world.vis_leaves = int32_t(num_vis_leaves);
+    world.num_faces = int32_t(faces.size());
+
+    // Textures lump: count, offsets, then the miptexs. WAD textures have no pixel data.
+    std::vector<uint8_t> textures_lump;
+    auto append_u32 = [](std::vector<uint8_t>& out, uint32_t value) {
+        uint8_t bytes[4];
+        memcpy(bytes, &value, 4);
+        out.insert(out.end(), bytes, bytes + 4);
+    };
+    append_u32(textures_lump, uint32_t(options.num_textures));
+    textures_lump.resize(textures_lump.size() + size_t(options.num_textures) * 4);
+    for (int texture = 0; texture < options.num_textures; texture++) {
+        uint32_t offset = uint32_t(textures_lump.size());
+        memcpy(&textures_lump[4 + size_t(texture) * 4], &offset, 4);
+        TestTexture test_texture;
+        test_texture.name = "maptex" + std::to_string(texture);
+        test_texture.width = 16u << (texture % 3);
+        test_texture.height = 16;
+        test_texture.seed = uint32_t(texture);
+        char name[16] = {};
+        memcpy(name, test_texture.name.data(), test_texture.name.size());
+        textures_lump.insert(textures_lump.end(), name, name + 16);
+        append_u32(textures_lump, test_texture.width);
+        append_u32(textures_lump, test_texture.height);
+        size_t mip_offsets_pos = textures_lump.size();
+        textures_lump.resize(textures_lump.size() + 16);
+        if (texture % 2 != 0) {
+            continue;
+        }
+        for (int mip_level = 0; mip_level < 4; mip_level++) {
+            uint32_t mip_offset = uint32_t(textures_lump.size()) - offset;
+            memcpy(&textures_lump[mip_offsets_pos + size_t(mip_level) * 4], &mip_offset, 4);
+            for (uint32_t y = 0; y < (test_texture.height >> mip_level); y++) {
+                for (uint32_t x = 0; x < (test_texture.width >> mip_level); x++) {
+                    textures_lump.push_back(test_texture_index(test_texture, mip_level, x, y));
+                }
+            }
+        }
+        textures_lump.push_back(0);  // colors_used = 256
+        textures_lump.push_back(1);
+        for (int i = 0; i < 256; i++) {
+            uint8_t rgb[3];
+            test_palette_color(uint8_t(i), rgb);
+            textures_lump.insert(textures_lump.end(), rgb, rgb + 3);
+        }
+        textures_lump.resize((textures_lump.size() + 3) & ~size_t(3));
+    }
+
+    std::string entities = "{\n\"classname\" \"worldspawn\"\n\"wad\" \"\\\\half-life\\\\valve\\\\halflife.wad\"\n}\n";
+    for (int i = 0; i < options.num_entities && num_vis_leaves > 0; i++) {
+        int c = map.leaf_cells[1 + size_t(i) % num_vis_leaves];
+        float origin[3] = {(float(c % size_x) + 0.5f) * cell, (float((c / size_x) % size_y) + 0.5f) * cell,
+                           (float(c / (size_x * size_y)) + 0.5f) * cell};
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer), "{\n\"origin\" \"%g %g %g\"\n\"angles\" \"0 %d 0\"\n\"classname\" \"%s\"\n}\n",
+                 origin[0], origin[1], origin[2], i * 45 % 360, i % 2 == 0 ? "info_player_start" : "light");
+        entities += buffer;
+    }
+
+    // Header, then the lumps in order, each aligned to 4 bytes.
+    std::vector<uint8_t>& out = map.file.contents;
+    map.file.name = "test.bsp";
+    out.resize(4 + BSP_NUM_LUMPS * 8);
+    int32_t version = BSPParser::VERSION;
+    memcpy(out.data(), &version, 4);
+    auto add_lump = [&out](BSPLump lump, const void* data, size_t size) {
+        out.resize((out.size() + 3) & ~size_t(3));
+        int32_t entry[2] = {int32_t(out.size()), int32_t(size)};
+        memcpy(&out[4 + size_t(lump) * 8], entry, 8);
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        out.insert(out.end(), bytes, bytes + size);
+    };
+    add_lump(BSP_LUMP_ENTITIES, entities.c_str(), entities.size() + 1);
+    add_lump(BSP_LUMP_PLANES, planes.data(), planes.size() * sizeof(BSPPlane));
+    add_lump(BSP_LUMP_TEXTURES, textures_lump.data(), textures_lump.size());
+    add_lump(BSP_LUMP_VERTICES, vertices.data(), vertices.size() * sizeof(BSPVertex));
+    add_lump(BSP_LUMP_VISIBILITY, visdata.data(), visdata.size());
+    add_lump(BSP_LUMP_NODES, nodes.data(), nodes.size() * sizeof(BSPNode));
+    add_lump(BSP_LUMP_TEXINFO, texinfos.data(), texinfos.size() * sizeof(BSPTexinfo));
+    add_lump(BSP_LUMP_FACES, faces.data(), faces.size() * sizeof(BSPFace));
+    add_lump(BSP_LUMP_LIGHTING, lighting.data(), lighting.size());
+    add_lump(BSP_LUMP_CLIPNODES, clipnodes.data(), clipnodes.size() * sizeof(BSPClipnode));
+    add_lump(BSP_LUMP_LEAVES, leaves.data(), leaves.size() * sizeof(BSPLeaf));
+    add_lump(BSP_LUMP_MARKSURFACES, marksurfaces.data(), marksurfaces.size() * sizeof(uint16_t));
+    add_lump(BSP_LUMP_EDGES, edges.data(), edges.size() * sizeof(BSPEdge));
+    add_lump(BSP_LUMP_SURFEDGES, surfedges.data(), surfedges.size() * sizeof(int32_t));
+    std::vector<BSPModel> models = {world};
+    for (int i = 0; i < options.num_brush_models && num_vis_leaves > 0; i++) {
+        int c = map.leaf_cells[1 + size_t(i) % num_vis_leaves];
+        BSPModel model = {};
+        int p[3] = {c % size_x, (c / size_x) % size_y, c / (size_x * size_y)};
+        for (int axis = 0; axis < 3; axis++) {
+            model.mins[axis] = (float(p[axis]) + 0.5f) * cell - 16.0f;
+            model.maxs[axis] = (float(p[axis]) + 0.5f) * cell + 16.0f;
+            model.origin[axis] = (float(p[axis]) + 0.5f) * cell;
+        }
+        models.push_back(model);
+    }
+    add_lump(BSP_LUMP_MODELS, models.data(), models.size() * sizeof(BSPModel));
+    return map;
+}
+
+// Stages of the loading pipeline run by StagedTestBSP, in order.
+enum class TestBSPStage {
+    // Parse the file and decode the lumps.
+    DECODED,
+    // Also build the lightmap atlas.
+    LIGHTMAPS,
+    // Also build the mesh.
+    MESH,
+};
+
+// Test map loaded up to a stage of the pipeline, each stage is required to succeed.
+struct StagedTestBSP {
+    TestBSP map;
+    BSPParser bsp;
+    BSPDecodedLumps lumps;
+    BSPLightmapAtlas lightmaps;
+    BSPMesh mesh;
+
+    explicit StagedTestBSP(const TestBSPOptions& options, TestBSPStage last_stage = TestBSPStage::MESH)
+        : map(make_test_bsp(options)) {
+        REQUIRE(bsp.parse(map.file));
+        REQUIRE(decode_bsp_lumps(bsp, lumps));
+        if (last_stage >= TestBSPStage::LIGHTMAPS) {
+            REQUIRE(lightmaps.build(bsp, lumps.lightmaps));
+        }
+        if (last_stage >= TestBSPStage::MESH) {
+            REQUIRE(mesh.build(bsp, lumps, lightmaps));
+        }
+    }
+};
@@ -0,0 +1,294 @@
+#include "hl1/bsp_trace.h"
+
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "bsp_test_map.h"
+
+
+TEST_SUITE_BEGIN("bsp_trace");
+
+namespace {
+
+// Transcription of the recursive hull check of the engine, on the on-disk nodes and clipnodes.
+struct NaiveHull {
+    const BSPParser& bsp;
+    int hull;
+
+    const BSPPlane& plane(int32_t num) const {
+        return bsp.planes[hull == 0 ? bsp.nodes[size_t(num)].plane : uint32_t(bsp.clipnodes[size_t(num)].plane)];
+    }
+    int32_t child(int32_t num, int side) const {
+        if (hull != 0) {
+            return bsp.clipnodes[size_t(num)].children[side];
+        }
+        int32_t c = bsp.nodes[size_t(num)].children[side];
+        return c >= 0 ? c : bsp.leaves[size_t(-(c + 1))].contents;
+    }
+    float distance(int32_t num, const float p[3]) const {
+        const BSPPlane& pl = plane(num);
+        if (pl.type < 3) {
+            return p[pl.type] - pl.dist;
+        }
+        return pl.normal[0] * p[0] + pl.normal[1] * p[1] + pl.normal[2] * p[2] - pl.dist;
+    }
+    int32_t point_contents(int32_t num, const float p[3]) const {
+        while (num >= 0) {
+            num = child(num, distance(num, p) < 0 ? 1 : 0);
+        }
+        return num;
+    }
+
+    bool recursive_check(int32_t num, float p1f, float p2f, const float p1[3], const float p2[3],
+                         BSPTrace& trace) const {
+        const double DIST_EPSILON = 0.03125;
+        if (num < 0) {
+            if (num != BSP_CONTENTS_SOLID) {
+                trace.all_solid = false;
+                if (num == BSP_CONTENTS_EMPTY) {
+                    trace.in_open = true;
+                } else {
+                    trace.in_water = true;
+                }
+            } else {
+                trace.start_solid = true;
+            }
+            return true;
+        }
+        float t1 = distance(num, p1);
+        float t2 = distance(num, p2);
+        if (t1 >= 0 && t2 >= 0) {
+            return recursive_check(child(num, 0), p1f, p2f, p1, p2, trace);
+        }
+        if (t1 < 0 && t2 < 0) {
+            return recursive_check(child(num, 1), p1f, p2f, p1, p2, trace);
+        }
+        float frac;
+        if (t1 < 0) {
+            frac = float((t1 + DIST_EPSILON) / (t1 - t2));
+        } else {
+            frac = float((t1 - DIST_EPSILON) / (t1 - t2));
+        }
+        if (frac < 0) {
+            frac = 0;
+        }
+        if (frac > 1) {
+            frac = 1;
+        }
+        float midf = p1f + (p2f - p1f) * frac;
+        float mid[3];
+        for (int i = 0; i < 3; i++) {
+            mid[i] = p1[i] + frac * (p2[i] - p1[i]);
+        }
+        int side = t1 < 0;
+        if (!recursive_check(child(num, side), p1f, midf, p1, mid, trace)) {
+            return false;
+        }
+        if (point_contents(child(num, side ^ 1), mid) != BSP_CONTENTS_SOLID) {
+            return recursive_check(child(num, side ^ 1), midf, p2f, mid, p2, trace);
+        }
+        if (trace.all_solid) {
+            return false;
+        }
+        const BSPPlane& pl = plane(num);
+        for (int i = 0; i < 3; i++) {
+            trace.plane.normal[i] = side == 0 ? pl.normal[i] : 0.0f - pl.normal[i];
+        }
+        trace.plane.dist = side == 0 ? pl.dist : -pl.dist;
+        while (point_contents(bsp.models[0].head_nodes[hull], mid) == BSP_CONTENTS_SOLID) {
+            frac -= 0.1;
+            if (frac < 0) {
+                trace.fraction = midf;
+                memcpy(trace.end_position, mid, sizeof(mid));
+                return false;
+            }
+            midf = p1f + (p2f - p1f) * frac;
+            for (int i = 0; i < 3; i++) {
+                mid[i] = p1[i] + frac * (p2[i] - p1[i]);
+            }
+        }
+        trace.fraction = midf;
+        memcpy(trace.end_position, mid, sizeof(mid));
+        return false;
+    }
+
+    BSPTrace trace(const BSPRay& move) const {
+        BSPTrace result;
+        memcpy(result.end_position, move.end, sizeof(move.end));
+        recursive_check(bsp.models[0].head_nodes[hull], 0, 1, move.start, move.end, result);
+        if (result.all_solid) {
+            result.start_solid = true;
+        }
+        return result;
+    }
+};
+
+std::vector<BSPRay> random_moves(const TestBSPOptions& options, size_t num_moves, uint32_t seed) {
+    uint32_t rng = seed * 2654435761u + 1u;
+    auto random_coord = [&](int axis) {
+        rng = rng * 1664525u + 1013904223u;
+        float size = float(options.size[axis] * TestBSPOptions::CELL_SIZE);
+        return float(rng >> 8) / float(1 << 24) * size;
+    };
+    std::vector<BSPRay> moves(num_moves);
+    for (BSPRay& move : moves) {
+        for (int axis = 0; axis < 3; axis++) {
+            move.start[axis] = random_coord(axis);
+        }
+        // Short moves as well as moves across the map.
+        bool short_move = (rng >> 4) % 2 == 0;
+        for (int axis = 0; axis < 3; axis++) {
+            float end = random_coord(axis);
+            move.end[axis] = short_move ? move.start[axis] + (end - move.start[axis]) / 16.0f : end;
+        }
+    }
+    return moves;
+}
+
+void check_same_trace(const BSPTrace& a, const BSPTrace& b) {
+    CHECK(a.all_solid == b.all_solid);
+    CHECK(a.start_solid == b.start_solid);
+    CHECK(a.in_open == b.in_open);
+    CHECK(a.in_water == b.in_water);
+    CHECK(a.fraction == b.fraction);
+    CHECK(memcmp(a.end_position, b.end_position, sizeof(a.end_position)) == 0);
+    CHECK(memcmp(a.plane.normal, b.plane.normal, sizeof(a.plane.normal)) == 0);
+    CHECK(a.plane.dist == b.plane.dist);
+}
+
+}  // namespace
+
+TEST_CASE("BSPHulls trace") {
+    TestBSPOptions options;
+    options.size[0] = 12;
+    options.size[1] = 10;
+    options.size[2] = 5;
+    options.solid_percent = 30;
+    TestBSP map = make_test_bsp(options);
+    BSPParser bsp;
+    REQUIRE(bsp.parse(map.file));
+    BSPHulls hulls;
+    REQUIRE(hulls.build(bsp));
+    CHECK(hulls.nodes.size() == bsp.nodes.size() + 3 * bsp.clipnodes.size());
+    CHECK(hulls.normals.empty());
+
+    // The results are the same as the engine's, bit for bit.
+    std::vector<BSPRay> moves = random_moves(options, 2000, 1);
+    for (int hull = 0; hull < BSP_NUM_HULLS; hull++) {
+        CAPTURE(hull);
+        NaiveHull naive = {bsp, hull};
+        size_t num_impacts = 0;
+        for (const BSPRay& move : moves) {
+            BSPTrace trace = hulls.trace(hull, move);
+            check_same_trace(trace, naive.trace(move));
+            CHECK(hulls.point_contents(hull, move.start) == naive.point_contents(bsp.models[0].head_nodes[hull],
+                                                                                  move.start));
+            num_impacts += trace.fraction < 1.0f && !trace.start_solid ? 1 : 0;
+        }
+        CHECK(num_impacts > 100);
+    }
+}
+
+TEST_CASE("BSPHulls trace semantics") {
+    TestBSP map = make_test_bsp();
+    BSPParser bsp;
+    REQUIRE(bsp.parse(map.file));
+    BSPHulls hulls;
+    REQUIRE(hulls.build(bsp));
+    REQUIRE(map.cell_leaves[size_t(map.cell_index(1, 1, 1))] != 0);
+
+    // The move stops DIST_EPSILON in front of the wall, the plane faces the start.
+    BSPTrace trace = hulls.trace(1, {{96.0f, 96.0f, 96.0f}, {-32.0f, 96.0f, 96.0f}});
+    CHECK_FALSE(trace.start_solid);
+    CHECK_FALSE(trace.all_solid);
+    CHECK(trace.in_open);
+    CHECK(trace.fraction == doctest::Approx((32.0 - BSPHulls::DIST_EPSILON) / 128.0));
+    CHECK(trace.end_position[0] == doctest::Approx(64.0 + BSPHulls::DIST_EPSILON));
+    CHECK(trace.end_position[1] == 96.0f);
+    CHECK(trace.plane.normal[0] == 1.0f);
+    CHECK(trace.plane.dist == 64.0f);
+
+    // A move from inside the wall out of it starts solid but is not all solid.
+    trace = hulls.trace(1, {{32.0f, 96.0f, 96.0f}, {96.0f, 96.0f, 96.0f}});
+    CHECK(trace.start_solid);
+    CHECK_FALSE(trace.all_solid);
+    CHECK(trace.fraction == 1.0f);
+
+    // A move within the wall is all solid.
+    trace = hulls.trace(1, {{16.0f, 96.0f, 96.0f}, {32.0f, 96.0f, 96.0f}});
+    CHECK(trace.start_solid);
+    CHECK(trace.all_solid);
+
+    // A move without impact ends at its end.
+    trace = hulls.trace(1, {{96.0f, 96.0f, 96.0f}, {100.0f, 90.0f, 80.0f}});
+    CHECK(trace.fraction == 1.0f);
+    CHECK(trace.end_position[2] == 80.0f);
+    CHECK(hulls.point_contents(1, trace.end_position) == BSP_CONTENTS_EMPTY);
+}
+
+TEST_CASE("BSPHulls non-axial planes and batches") {
+    TestBSPOptions options;
+    options.size[0] = 10;
+    TestBSP map = make_test_bsp(options);
+    BSPParser bsp;
+    REQUIRE(bsp.parse(map.file));
+    BSPHulls axial_hulls;
+    REQUIRE(axial_hulls.build(bsp));
+    for (const BSPPlane& plane : bsp.planes) {
+        int32_t type = 3;
+        size_t offset = size_t(reinterpret_cast<const uint8_t*>(&plane.type) - map.file.contents.data());
+        memcpy(&map.file.contents[offset], &type, 4);
+    }
+    BSPHulls hulls;
+    REQUIRE(hulls.build(bsp));
+    CHECK(hulls.normals.size() == bsp.planes.size() * 3);
+
+    std::vector<BSPRay> moves = random_moves(options, 1000, 2);
+    for (bool parallel : {false, true}) {
+        std::vector<BSPTrace> traces(moves.size());
+        hulls.trace_moves(2, moves.data(), moves.size(), traces.data(), parallel);
+        for (size_t i = 0; i < moves.size(); i++) {
+            check_same_trace(traces[i], axial_hulls.trace(2, moves[i]));
+        }
+    }
+}
+
+TEST_CASE("BSPHulls malformed hulls") {
+    TestBSP map = make_test_bsp();
+    BSPParser bsp;
+    REQUIRE(bsp.parse(map.file));
+    BSPHulls hulls;
+    auto write = [&](const void* p, const void* value, size_t size) {
+        size_t offset = size_t(reinterpret_cast<const uint8_t*>(p) - map.file.contents.data());
+        memcpy(&map.file.contents[offset], value, size);
+    };
+
+    SUBCASE("clipnode plane out of bounds") {
+        int32_t plane = int32_t(bsp.planes.size());
+        write(&bsp.clipnodes[0].plane, &plane, 4);
+        CHECK_FALSE(hulls.build(bsp));
+    }
+
+    SUBCASE("clipnode cycle") {
+        int16_t child = 0;
+        write(&bsp.clipnodes[1].children[0], &child, 2);
+        CHECK_FALSE(hulls.build(bsp));
+    }
+
+    SUBCASE("leaf out of bounds") {
+        int16_t child = int16_t(-int32_t(bsp.leaves.size()) - 1);
+        write(&bsp.nodes[0].children[0], &child, 2);
+        CHECK_FALSE(hulls.build(bsp));
+    }
+
+    SUBCASE("root out of bounds") {
+        int32_t root = int32_t(bsp.clipnodes.size());
+        write(&bsp.models[0].head_nodes[3], &root, 4);
+        CHECK_FALSE(hulls.build(bsp));
+    }
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,294 @@
+#include "hl1/bsp_tree.h"
+
+#include <doctest/doctest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "bsp_test_map.h"
+
+
+TEST_SUITE_BEGIN("bsp_tree");
+
+namespace {
+
+float plane_distance(const BSPPlane& plane, const float point[3]) {
+    return point[0] * plane.normal[0] + point[1] * plane.normal[1] + point[2] * plane.normal[2] - plane.dist;
+}
+
+bool naive_leaf_solid(const BSPParser& bsp, int32_t leaf) {
+    int32_t contents = bsp.leaves[size_t(leaf)].contents;
+    return contents == BSP_CONTENTS_SOLID || contents == BSP_CONTENTS_SKY;
+}
+
+int32_t naive_find_leaf(const BSPParser& bsp, int32_t node_idx, const float point[3]) {
+    while (node_idx >= 0) {
+        const BSPNode& node = bsp.nodes[size_t(node_idx)];
+        node_idx = node.children[plane_distance(bsp.planes[node.plane], point) < 0.0f ? 1 : 0];
+    }
+    return -(node_idx + 1);
+}
+
+struct NaiveHit {
+    float fraction = 1.0f;
+    float position[3] = {};
+    bool start_solid = false;
+};
+
+// Recursive segment check as in the engine. Return false when the segment hits solid space.
+bool naive_cast(const BSPParser& bsp, int32_t node_idx, float f1, float f2, const float p1[3], const float p2[3],
+                NaiveHit& hit) {
+    if (node_idx < 0) {
+        return !naive_leaf_solid(bsp, -(node_idx + 1));
+    }
+    const BSPNode& node = bsp.nodes[size_t(node_idx)];
+    const BSPPlane& plane = bsp.planes[node.plane];
+    float d1 = plane_distance(plane, p1);
+    float d2 = plane_distance(plane, p2);
+    if (d1 >= 0.0f && d2 >= 0.0f) {
+        return naive_cast(bsp, node.children[0], f1, f2, p1, p2, hit);
+    }
+    if (d1 < 0.0f && d2 < 0.0f) {
+        return naive_cast(bsp, node.children[1], f1, f2, p1, p2, hit);
+    }
+    int side = d1 < 0.0f ? 1 : 0;
+    float frac = d1 / (d1 - d2);
+    float mid_f = f1 + (f2 - f1) * frac;
+    float mid[3];
+    for (int i = 0; i < 3; i++) {
+        mid[i] = p1[i] + (p2[i] - p1[i]) * frac;
+    }
+    if (!naive_cast(bsp, node.children[side], f1, mid_f, p1, mid, hit)) {
+        return false;
+    }
+    if (naive_leaf_solid(bsp, naive_find_leaf(bsp, node.children[side ^ 1], mid))) {
+        hit.fraction = mid_f;
+        memcpy(hit.position, mid, sizeof(mid));
+        return false;
+    }
+    return naive_cast(bsp, node.children[side ^ 1], mid_f, f2, mid, p2, hit);
+}
+
+NaiveHit naive_cast_ray(const BSPParser& bsp, const BSPRay& ray) {
+    NaiveHit hit;
+    int32_t head = bsp.models[0].head_nodes[0];
+    if (naive_leaf_solid(bsp, naive_find_leaf(bsp, head, ray.start))) {
+        hit.start_solid = true;
+        hit.fraction = 0.0f;
+        return hit;
+    }
+    naive_cast(bsp, head, 0.0f, 1.0f, ray.start, ray.end, hit);
+    return hit;
+}
+
+// Return true if the point is on the face within tolerance and the face faces the direction.
+bool face_contains(const BSPParser& bsp, uint32_t face_idx, const float point[3], const float direction[3]) {
+    const BSPFace& face = bsp.faces[face_idx];
+    const BSPPlane& plane = bsp.planes[face.plane];
+    float sign = face.side != 0 ? -1.0f : 1.0f;
+    float dot = direction[0] * plane.normal[0] + direction[1] * plane.normal[1] + direction[2] * plane.normal[2];
+    if (std::fabs(plane_distance(plane, point)) > 0.05f || dot * sign >= 0.0f) {
+        return false;
+    }
+    float min_cross = 0.0f;
+    float max_cross = 0.0f;
+    for (uint32_t i = 0; i < face.num_edges; i++) {
+        const float* a = bsp.face_vertex(face, i);
+        const float* b = bsp.face_vertex(face, (i + 1) % face.num_edges);
+        float ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+        float ap[3] = {point[0] - a[0], point[1] - a[1], point[2] - a[2]};
+        float cross[3] = {ab[1] * ap[2] - ab[2] * ap[1], ab[2] * ap[0] - ab[0] * ap[2], ab[0] * ap[1] - ab[1] * ap[0]};
+        float c = (cross[0] * plane.normal[0] + cross[1] * plane.normal[1] + cross[2] * plane.normal[2]) /
+                  std::sqrt(ab[0] * ab[0] + ab[1] * ab[1] + ab[2] * ab[2]);
+        min_cross = std::fmin(min_cross, c);
+        max_cross = std::fmax(max_cross, c);
+    }
+    return min_cross >= -0.05f || max_cross <= 0.05f;
+}
+
+std::vector<BSPRay> random_rays(const TestBSPOptions& options, size_t num_rays, size_t rays_per_start, uint32_t seed) {
+    uint32_t rng = seed * 2654435761u + 1u;
+    auto random_coord = [&](int axis) {
+        rng = rng * 1664525u + 1013904223u;
+        float size = float(options.size[axis] * TestBSPOptions::CELL_SIZE);
+        return float(rng >> 8) / float(1 << 24) * (size + 64.0f) - 32.0f;
+    };
+    std::vector<BSPRay> rays(num_rays);
+    for (size_t i = 0; i < num_rays; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            rays[i].start[axis] = i % rays_per_start == 0 ? random_coord(axis) : rays[i - 1].start[axis];
+            rays[i].end[axis] = random_coord(axis);
+        }
+    }
+    return rays;
+}
+
+void check_same_hit(const BSPRayHit& a, const BSPRayHit& b) {
+    CHECK(a.fraction == b.fraction);
+    CHECK(memcmp(a.position, b.position, sizeof(a.position)) == 0);
+    CHECK(a.face == b.face);
+    CHECK(a.start_solid == b.start_solid);
+}
+
+}  // namespace
+
+TEST_CASE("BSPTree layout") {
+    TestBSP map = make_test_bsp();
+    BSPParser bsp;
+    REQUIRE(bsp.parse(map.file));
+    BSPTree tree;
+    REQUIRE(tree.build(bsp));
+    CHECK(tree.nodes.size() == bsp.nodes.size());
+    CHECK(tree.normals.empty());
+    CHECK(tree.faces.size() == bsp.faces.size());
+    CHECK(tree.node_first_faces.size() == tree.nodes.size() + 1);
+    CHECK(tree.depth > 0);
+    CHECK(tree.depth <= BSPTree::MAX_DEPTH);
+    // The front child follows its parent.
+    for (size_t i = 0; i < tree.nodes.size(); i++) {
+        if (tree.nodes[i].children[0] >= 0) {
+            CHECK(size_t(tree.nodes[i].children[0]) == i + 1);
+        }
+    }
+}
+
+TEST_CASE("BSPTree find_leaf") {
+    TestBSPOptions options;
+    options.size[0] = 12;
+    options.size[1] = 10;
+    options.size[2] = 5;
+    TestBSP map = make_test_bsp(options);
+    BSPParser bsp;
+    REQUIRE(bsp.parse(map.file));
+    BSPTree tree;
+    REQUIRE(tree.build(bsp));
+    for (const BSPRay& ray : random_rays(options, 2000, 1, 7)) {
+        CHECK(tree.find_leaf(ray.start) == naive_find_leaf(bsp, bsp.models[0].head_nodes[0], ray.start));
+    }
+    for (size_t cell = 0; cell < map.cell_leaves.size(); cell++) {
+        int c = int(cell);
+        float center[3] = {(float(c % options.size[0]) + 0.5f) * 64.0f,
+                           (float((c / options.size[0]) % options.size[1]) + 0.5f) * 64.0f,
+                           (float(c / (options.size[0] * options.size[1])) + 0.5f) * 64.0f};
+        CHECK(tree.find_leaf(center) == map.cell_leaves[cell]);
+    }
+}
+
+TEST_CASE("BSPTree cast_ray") {
+    TestBSPOptions options;
+    options.size[0] = 12;
+    options.size[1] = 10;
+    options.size[2] = 5;
+    options.solid_percent = 30;
+    TestBSP map = make_test_bsp(options);
+    BSPParser bsp;
+    REQUIRE(bsp.parse(map.file));
+    BSPTree tree;
+    REQUIRE(tree.build(bsp));
+
+    size_t num_hits = 0;
+    for (const BSPRay& ray : random_rays(options, 3000, 1, 3)) {
+        BSPRayHit hit = tree.cast_ray(ray);
+        NaiveHit naive = naive_cast_ray(bsp, ray);
+        CHECK(hit.start_solid == naive.start_solid);
+        CHECK(std::fabs(hit.fraction - naive.fraction) < 1e-4f);
+        if (hit.start_solid || hit.fraction == 1.0f) {
+            CHECK(hit.face == -1);
+            continue;
+        }
+        num_hits++;
+        float direction[3] = {ray.end[0] - ray.start[0], ray.end[1] - ray.start[1], ray.end[2] - ray.start[2]};
+        REQUIRE(hit.face >= 0);
+        CHECK(face_contains(bsp, uint32_t(hit.face), hit.position, direction));
+    }
+    CHECK(num_hits > 300);
+
+    // A ray along a cell center hits the wall facing it.
+    int32_t leaf = map.cell_leaves[size_t(map.cell_index(1, 1, 1))];
+    if (leaf != 0) {
+        BSPRay ray = {{96.0f, 96.0f, 96.0f}, {-1000.0f, 96.0f, 96.0f}};
+        BSPRayHit hit = tree.cast_ray(ray);
+        CHECK(hit.position[0] == doctest::Approx(64.0f));
+        CHECK(hit.face >= 0);
+    }
+}
+
+TEST_CASE("BSPTree non-axial planes") {
+    // Planes without an axial type use the normals and give the same results.
+    TestBSPOptions options;
+    options.size[0] = 10;
+    TestBSP map = make_test_bsp(options);
+    BSPParser bsp;
+    REQUIRE(bsp.parse(map.file));
+    BSPTree axial_tree;
+    REQUIRE(axial_tree.build(bsp));
+    for (const BSPPlane& plane : bsp.planes) {
+        int32_t type = 3;
+        size_t offset = size_t(reinterpret_cast<const uint8_t*>(&plane.type) - map.file.contents.data());
+        memcpy(&map.file.contents[offset], &type, 4);
+    }
+    BSPTree tree;
+    REQUIRE(tree.build(bsp));
+    CHECK(tree.normals.size() == bsp.planes.size() * 3);
+    for (const BSPRay& ray : random_rays(options, 1000, 1, 11)) {
+        CHECK(tree.find_leaf(ray.start) == axial_tree.find_leaf(ray.start));
+        check_same_hit(tree.cast_ray(ray), axial_tree.cast_ray(ray));
+    }
+}
+
+TEST_CASE("BSPTree cast_rays") {
+    TestBSPOptions options;
+    options.size[0] = 16;
+    options.size[1] = 12;
+    options.size[2] = 4;
+    TestBSP map = make_test_bsp(options);
+    BSPParser bsp;
+    REQUIRE(bsp.parse(map.file));
+    BSPTree tree;
+    REQUIRE(tree.build(bsp));
+
+    // Packets of rays with the same start, a few single rays and a partial packet at the end give the same hits as
+    // the single casts.
+    for (size_t rays_per_start : {1, 3, 4, 16}) {
+        CAPTURE(rays_per_start);
+        std::vector<BSPRay> rays = random_rays(options, 1001, rays_per_start, 5);
+        for (bool parallel : {false, true}) {
+            std::vector<BSPRayHit> hits(rays.size());
+            tree.cast_rays(rays.data(), rays.size(), hits.data(), parallel);
+            for (size_t i = 0; i < rays.size(); i++) {
+                check_same_hit(hits[i], tree.cast_ray(rays[i]));
+            }
+        }
+    }
+}
+
+TEST_CASE("BSPTree malformed trees") {
+    TestBSP map = make_test_bsp();
+    BSPParser bsp;
+    REQUIRE(bsp.parse(map.file));
+    BSPTree tree;
+    auto write_child = [&](size_t node_idx, int side, int16_t child) {
+        const int16_t* p = &bsp.nodes[node_idx].children[side];
+        size_t offset = size_t(reinterpret_cast<const uint8_t*>(p) - map.file.contents.data());
+        memcpy(&map.file.contents[offset], &child, 2);
+    };
+
+    SUBCASE("node out of bounds") {
+        write_child(0, 0, int16_t(bsp.nodes.size()));
+        CHECK_FALSE(tree.build(bsp));
+    }
+
+    SUBCASE("leaf out of bounds") {
+        write_child(0, 0, int16_t(-int32_t(bsp.leaves.size()) - 1));
+        CHECK_FALSE(tree.build(bsp));
+    }
+
+    SUBCASE("cycle") {
+        write_child(1, 0, 0);
+        CHECK_FALSE(tree.build(bsp));
+    }
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,272 @@
+#include "hl1/bsp_vis.h"
+
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <vector>
+
+#include "bsp_test_map.h"
+#include "common/bitset.h"
+
+
+TEST_SUITE_BEGIN("bsp_vis");
+
+namespace {
+
+// Test map loaded up to the mesh, with the centers of its grid cells.
+struct VisTestBSP : StagedTestBSP {
+    explicit VisTestBSP(const TestBSPOptions& options) : StagedTestBSP(options) {}
+
+    void cell_center(int cell, float out[3]) const {
+        const int* size = map.options.size;
+        int p[3] = {cell % size[0], (cell / size[0]) % size[1], cell / (size[0] * size[1])};
+        for (int i = 0; i < 3; i++) {
+            out[i] = (float(p[i]) + 0.5f) * float(TestBSPOptions::CELL_SIZE);
+        }
+    }
+};
+
+// Check the visible set of a leaf against the grid layout of the test map.
+void check_visible_set(const VisTestBSP& test, int32_t leaf, const BSPVisibleSet& visible) {
+    std::set<uint32_t> expected_faces;
+    for (size_t other = 1; other < test.map.leaf_cells.size(); other++) {
+        if (leaf == 0 || test.map.leaf_sees(leaf, int32_t(other))) {
+            const std::vector<uint32_t>& faces = test.map.cell_faces[size_t(test.map.leaf_cells[other])];
+            expected_faces.insert(faces.begin(), faces.end());
+        }
+    }
+    std::set<uint32_t> faces(visible.face_list.begin(), visible.face_list.end());
+    CHECK(faces.size() == visible.face_list.size());
+    CHECK(faces == expected_faces);
+    CHECK(bitset_count(visible.faces.data(), visible.faces.size()) == visible.face_list.size());
+
+    // The ranges follow the mesh order, stay within their batch and cover the indices of the visible faces.
+    size_t num_indices = 0;
+    std::set<uint32_t> batches;
+    for (size_t i = 0; i < visible.ranges.size(); i++) {
+        const BSPMeshBatch& range = visible.ranges[i];
+        if (i > 0) {
+            CHECK(range.first_index >= visible.ranges[i - 1].first_index + visible.ranges[i - 1].num_indices);
+        }
+        auto batch_it = std::find_if(test.mesh.batches.begin(), test.mesh.batches.end(), [&](const BSPMeshBatch& b) {
+            return range.first_index >= b.first_index && range.first_index < b.first_index + b.num_indices;
+        });
+        REQUIRE(batch_it != test.mesh.batches.end());
+        CHECK(range.first_index + range.num_indices <= batch_it->first_index + batch_it->num_indices);
+        CHECK(range.texture == batch_it->texture);
+        CHECK(range.lightmap_page == batch_it->lightmap_page);
+        batches.insert(uint32_t(batch_it - test.mesh.batches.begin()));
+        num_indices += range.num_indices;
+    }
+    CHECK(num_indices == visible.face_list.size() * 6);
+    CHECK(visible.num_batches == batches.size());
+}
+
+}  // namespace
+
+TEST_CASE("BSPVisibility find_leaf") {
+    VisTestBSP test(TestBSPOptions{});
+    BSPVisibility vis;
+    REQUIRE(vis.init(test.bsp, test.mesh));
+    for (size_t cell = 0; cell < test.map.cell_leaves.size(); cell++) {
+        float center[3];
+        test.cell_center(int(cell), center);
+        CHECK(vis.find_leaf(center) == test.map.cell_leaves[cell]);
+    }
+    float outside[3] = {-100.0f, 10.0f, 10.0f};
+    CHECK(vis.find_leaf(outside) == 0);
+}
+
+TEST_CASE("BSPVisibility PVS") {
+    TestBSPOptions options;
+    options.size[0] = 24;
+    options.size[1] = 12;
+    options.size[2] = 4;
+    options.vis_radius = 3;
+    VisTestBSP test(options);
+    size_t num_leaves = test.map.leaf_cells.size();
+
+    // Lazy and eager decompression give the same rows, bit i is leaf i + 1 and the bits past the last leaf are zero.
+    BSPVisibility lazy;
+    BSPVisibility eager;
+    REQUIRE(lazy.init(test.bsp, test.mesh));
+    REQUIRE(eager.init(test.bsp, test.mesh, true));
+    REQUIRE(lazy.num_pvs_words() == bitset_num_words(num_leaves - 1));
+    for (int32_t leaf = 1; leaf < int32_t(num_leaves); leaf++) {
+        const uint64_t* pvs = lazy.leaf_pvs(leaf);
+        for (size_t other = 1; other < num_leaves; other++) {
+            CHECK(bitset_test(pvs, other - 1) == test.map.leaf_sees(leaf, int32_t(other)));
+        }
+        CHECK(bitset_count(pvs, lazy.num_pvs_words()) <= num_leaves - 1);
+        CHECK(memcmp(pvs, eager.leaf_pvs(leaf), lazy.num_pvs_words() * sizeof(uint64_t)) == 0);
+    }
+    // The solid leaf sees everything.
+    CHECK(bitset_count(lazy.leaf_pvs(0), lazy.num_pvs_words()) == num_leaves - 1);
+}
+
+TEST_CASE("BSPVisibility visible set") {
+    TestBSPOptions options;
+    options.size[0] = 16;
+    options.size[1] = 16;
+    options.size[2] = 4;
+    options.num_textures = 5;
+    options.vis_radius = 1;
+    VisTestBSP test(options);
+    BSPVisibility vis;
+    REQUIRE(vis.init(test.bsp, test.mesh));
+
+    BSPVisibleSet visible;
+    const uint32_t* face_list_data = nullptr;
+    const BSPMeshBatch* ranges_data = nullptr;
+    for (size_t cell = 0; cell < test.map.cell_leaves.size(); cell++) {
+        float center[3];
+        test.cell_center(int(cell), center);
+        vis.find_visible_set(center, visible);
+        CAPTURE(cell);
+        CHECK(visible.camera_leaf == test.map.cell_leaves[cell]);
+        check_visible_set(test, visible.camera_leaf, visible);
+
+        // The buffers are sized for all faces by the first query and are not reallocated.
+        if (face_list_data == nullptr) {
+            face_list_data = visible.face_list.data();
+            ranges_data = visible.ranges.data();
+        }
+        CHECK(visible.face_list.data() == face_list_data);
+        CHECK(visible.ranges.data() == ranges_data);
+    }
+
+    // Culling the leaves further leaves only their faces.
+    float center[3];
+    test.cell_center(test.map.leaf_cells[1], center);
+    vis.find_visible_leaves(center, visible);
+    std::vector<uint64_t> mask(visible.leaves.size(), 0);
+    bitset_set(mask.data(), 0);
+    bitset_and(visible.leaves.data(), mask.data(), mask.size());
+    vis.find_visible_faces(visible);
+    std::vector<uint32_t> faces = visible.face_list;
+    std::sort(faces.begin(), faces.end());
+    CHECK(faces == test.map.cell_faces[size_t(test.map.leaf_cells[1])]);
+}
+
+TEST_CASE("BSPVisibility frustum culling") {
+    TestBSPOptions options;
+    options.size[0] = 16;
+    options.size[1] = 12;
+    options.size[2] = 4;
+    options.vis_radius = 6;
+    options.num_brush_models = 20;
+    VisTestBSP test(options);
+    BSPVisibility vis;
+    REQUIRE(vis.init(test.bsp, test.mesh));
+
+    auto leaf_in_frustum = [&](const Frustum& frustum, size_t leaf_idx) {
+        const BSPLeaf& leaf = test.bsp.leaves[leaf_idx];
+        float mins[3] = {float(leaf.mins[0]), float(leaf.mins[1]), float(leaf.mins[2])};
+        float maxs[3] = {float(leaf.maxs[0]), float(leaf.maxs[1]), float(leaf.maxs[2])};
+        return frustum.test_box(mins, maxs);
+    };
+    const float forward[3] = {1.0f, 0.0f, 0.0f};
+    const float right[3] = {0.0f, -1.0f, 0.0f};
+    const float up[3] = {0.0f, 0.0f, 1.0f};
+    BSPVisibleSet visible;
+    size_t num_culled = 0;
+    for (size_t leaf = 1; leaf < test.map.leaf_cells.size(); leaf++) {
+        CAPTURE(leaf);
+        float center[3];
+        test.cell_center(test.map.leaf_cells[leaf], center);
+        Frustum frustum;
+        frustum.set_perspective(center, forward, right, up, 1.0f, 0.75f, 4.0f, 4096.0f);
+        vis.find_visible_leaves(center, visible);
+        std::vector<uint64_t> pvs = visible.leaves;
+        vis.cull_leaves(frustum, visible, leaf % 2 == 0);
+
+        // The leaves are those of the PVS passing the box test, the list has all the leaves passing it.
+        std::vector<uint32_t> expected_list;
+        for (size_t bit = 0; bit + 1 < test.bsp.leaves.size(); bit++) {
+            bool in_frustum = leaf_in_frustum(frustum, bit + 1);
+            if (in_frustum) {
+                expected_list.push_back(uint32_t(bit));
+            }
+            CHECK(bitset_test(visible.leaves.data(), bit) == (in_frustum && bitset_test(pvs.data(), bit)));
+        }
+        CHECK(visible.frustum_leaves == expected_list);
+        CHECK(bitset_test(visible.leaves.data(), leaf - 1));
+        num_culled += bitset_count(pvs.data(), pvs.size()) - bitset_count(visible.leaves.data(), visible.leaves.size());
+
+        vis.find_visible_faces(visible);
+        for (uint32_t face : visible.face_list) {
+            bool in_visible_leaf = false;
+            bitset_for_each(visible.leaves.data(), visible.leaves.size(), [&](size_t bit) {
+                const std::vector<uint32_t>& faces = test.map.cell_faces[size_t(test.map.leaf_cells[bit + 1])];
+                in_visible_leaf = in_visible_leaf || std::binary_search(faces.begin(), faces.end(), face);
+            });
+            CHECK(in_visible_leaf);
+        }
+
+        vis.cull_models(frustum, visible, leaf % 3 == 0);
+        std::vector<uint32_t> expected_models;
+        for (size_t model = 1; model < test.bsp.models.size(); model++) {
+            if (frustum.test_box(test.bsp.models[model].mins, test.bsp.models[model].maxs)) {
+                expected_models.push_back(uint32_t(model));
+            }
+        }
+        CHECK(visible.models == expected_models);
+    }
+    CHECK(num_culled > 0);
+    CHECK(test.bsp.models.size() == 21);
+}
+
+TEST_CASE("BSPVisibility malformed maps") {
+    VisTestBSP test(TestBSPOptions{});
+    FileContents& file = test.map.file;
+    BSPVisibility vis;
+    auto file_offset = [&](const void* p) {
+        return size_t(reinterpret_cast<const uint8_t*>(p) - file.contents.data());
+    };
+
+    SUBCASE("leaves without PVS see everything") {
+        for (const BSPLeaf& leaf : test.bsp.leaves) {
+            int32_t vis_offset = -1;
+            memcpy(&file.contents[file_offset(&leaf.vis_offset)], &vis_offset, 4);
+        }
+        REQUIRE(vis.init(test.bsp, test.mesh));
+        BSPVisibleSet visible;
+        float center[3];
+        test.cell_center(test.map.leaf_cells[1], center);
+        vis.find_visible_set(center, visible);
+        CHECK(visible.face_list.size() == test.bsp.faces.size());
+        check_visible_set(test, 0, visible);
+    }
+
+    SUBCASE("truncated PVS") {
+        // Rows running past the end of the lump leave the rest of the leaves invisible.
+        const BSPLeaf& last_leaf = test.bsp.leaves[test.bsp.leaves.size() - 1];
+        int32_t vis_offset = int32_t(test.bsp.visdata.size()) - 1;
+        memcpy(&file.contents[file_offset(&last_leaf.vis_offset)], &vis_offset, 4);
+        REQUIRE(vis.init(test.bsp, test.mesh));
+        const uint64_t* pvs = vis.leaf_pvs(int32_t(test.bsp.leaves.size() - 1));
+        CHECK(bitset_count(pvs, vis.num_pvs_words()) <= 8);
+    }
+
+    SUBCASE("node child out of bounds") {
+        int16_t child = int16_t(test.bsp.nodes.size());
+        memcpy(&file.contents[file_offset(&test.bsp.nodes[0].children[0])], &child, 2);
+        CHECK_FALSE(vis.init(test.bsp, test.mesh));
+    }
+
+    SUBCASE("mark surface out of bounds") {
+        uint16_t face_idx = uint16_t(test.bsp.faces.size());
+        memcpy(&file.contents[file_offset(&test.bsp.marksurfaces[0])], &face_idx, 2);
+        CHECK_FALSE(vis.init(test.bsp, test.mesh));
+    }
+
+    SUBCASE("mesh of another map") {
+        test.mesh.faces.pop_back();
+        CHECK_FALSE(vis.init(test.bsp, test.mesh));
+    }
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "common/io.h"
+
+
+// Description of a texture for make_test_wad().
+struct TestTexture {
+    std::string name;
+    uint32_t width = 16;
+    uint32_t height = 16;
+    // Pixel indices are generated from the seed, see test_texture_index().
+    uint32_t seed = 0;
+};
+
+// Return the palette index for the pixel (x, y) of the mip level in the test texture.
+inline uint8_t test_texture_index(const TestTexture& texture, int mip_level, uint32_t x, uint32_t y) {
+    return uint8_t(x * 7 + y * 13 + uint32_t(mip_level) * 31 + texture.seed);
+}
+
+// Return the palette color for the given index in the test textures.
+inline void test_palette_color(uint8_t index, uint8_t rgb[3]) {
+    rgb[0] = index;
+    rgb[1] = uint8_t(255 - index);
+    rgb[2] = uint8_t(index * 3);
+}
+
+// Build an in-memory WAD3 file containing the given textures with all four mip levels.
+inline FileContents make_test_wad(const std::vector<TestTexture>& textures) {
+    FileContents file;
+    file.name = "test.wad";
+    std::vector<uint8_t>& out = file.contents;
+
+    auto append_u32 = [&out](uint32_t v) {
+        uint8_t bytes[4];
+        memcpy(bytes, &v, 4);
+        out.insert(out.end(), bytes, bytes + 4);
+    };
+    auto write_u32_at = [&out](size_t offset, uint32_t v) { memcpy(&out[offset], &v, 4); };
+
+    out.insert(out.end(), {'W', 'A', 'D', '3'});
+    append_u32(uint32_t(textures.size()));
+    append_u32(0);  // Directory offset, patched below.
+
+    std::vector<uint32_t> entry_offsets;
+    std::vector<uint32_t> entry_sizes;
+    for (const TestTexture& texture : textures) {
+        uint32_t entry_offset = uint32_t(out.size());
+        entry_offsets.push_back(entry_offset);
+
+        char name[16] = {};
+        memcpy(name, texture.name.data(), std::min(texture.name.size(), sizeof(name)));
+        out.insert(out.end(), name, name + 16);
+        append_u32(texture.width);
+        append_u32(texture.height);
+        size_t mip_offsets_pos = out.size();
+        for (int i = 0; i < 4; i++) {
+            append_u32(0);
+        }
+
+        for (int mip_level = 0; mip_level < 4; mip_level++) {
+            write_u32_at(mip_offsets_pos + size_t(mip_level) * 4, uint32_t(out.size()) - entry_offset);
+            uint32_t width = texture.width >> mip_level;
+            uint32_t height = texture.height >> mip_level;
+            for (uint32_t y = 0; y < height; y++) {
+                for (uint32_t x = 0; x < width; x++) {
+                    out.push_back(test_texture_index(texture, mip_level, x, y));
+                }
+            }
+        }
+
+        out.push_back(0);  // colors_used = 256
+        out.push_back(1);
+        for (int i = 0; i < 256; i++) {
+            uint8_t rgb[3];
+            test_palette_color(uint8_t(i), rgb);
+            out.insert(out.end(), rgb, rgb + 3);
+        }
+        out.push_back(0);  // Padding.
+        out.push_back(0);
+        entry_sizes.push_back(uint32_t(out.size()) - entry_offset);
+    }
+
+    write_u32_at(8, uint32_t(out.size()));
+    for (size_t i = 0; i < textures.size(); i++) {
+        append_u32(entry_offsets[i]);
+        append_u32(entry_sizes[i]);
+        append_u32(entry_sizes[i]);
+        out.push_back(0x43);  // Miptex type.
+        out.push_back(0);     // Not compressed.
+        out.push_back(0);     // Padding.
+        out.push_back(0);
+        char name[16] = {};
+        memcpy(name, textures[i].name.data(), std::min(textures[i].name.size(), sizeof(name)));
+        out.insert(out.end(), name, name + 16);
+    }
+
+    return file;
+}
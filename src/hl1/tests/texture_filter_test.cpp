@@ -0,0 +1,77 @@
+#include "hl1/texture_filter.h"
+
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+TEST_SUITE_BEGIN("texture_filter");
+
+namespace {
+
+std::vector<uint32_t> naive_filter(const std::vector<WAD3TextureName>& lower_names, std::string_view lower_pattern) {
+    std::vector<uint32_t> matches;
+    for (size_t i = 0; i < lower_names.size(); i++) {
+        if (lower_names[i].view().find(lower_pattern) != std::string_view::npos) {
+            matches.push_back(uint32_t(i));
+        }
+    }
+    return matches;
+}
+
+}  // namespace
+
+TEST_CASE("texture_name_contains") {
+    WAD3TextureName name = "{fence_01";
+    CHECK(texture_name_contains(name, ""));
+    CHECK(texture_name_contains(name, "{"));
+    CHECK(texture_name_contains(name, "1"));
+    CHECK(texture_name_contains(name, "fe"));
+    CHECK(texture_name_contains(name, "nce_0"));
+    CHECK(texture_name_contains(name, "{fence_01"));
+    CHECK_FALSE(texture_name_contains(name, "{fence_012"));
+    CHECK_FALSE(texture_name_contains(name, "fence_02"));
+    CHECK_FALSE(texture_name_contains(name, "x"));
+    CHECK_FALSE(texture_name_contains(name, "seventeen_chars_a"));
+
+    // Matches at the last positions of full-length names.
+    WAD3TextureName full = "sixteen_chars_ab";
+    CHECK(texture_name_contains(full, "b"));
+    CHECK(texture_name_contains(full, "ab"));
+    CHECK(texture_name_contains(full, "sixteen_chars_ab"));
+    CHECK_FALSE(texture_name_contains(full, "abc"));
+
+    // The first and last chars match at several positions before the full match.
+    WAD3TextureName repeated = "aabaabaaab";
+    CHECK(texture_name_contains(repeated, "aaab"));
+    CHECK_FALSE(texture_name_contains(repeated, "aaaab"));
+    CHECK_FALSE(texture_name_contains(WAD3TextureName(), "a"));
+}
+
+TEST_CASE("filter_texture_names") {
+    std::vector<WAD3TextureName> names;
+    for (uint32_t i = 0; i < 50000; i++) {
+        std::string name = (i % 4 == 0 ? "+0~Wall_" : "floor") + std::to_string(i * 7);
+        names.push_back(WAD3TextureName(name).to_lower());
+    }
+
+    for (std::string_view pattern : {"", "W", "wall", "+0~", "_1", "77", "floor1234567", "floor0", "missing"}) {
+        CAPTURE(pattern);
+        std::vector<uint32_t> expected = naive_filter(names, WAD3TextureName(pattern).to_lower().view());
+        std::vector<uint32_t> sequential;
+        filter_texture_names(names, pattern, sequential);
+        CHECK(sequential == expected);
+        std::vector<uint32_t> parallel;
+        filter_texture_names(names, pattern, parallel, true);
+        CHECK(parallel == expected);
+    }
+
+    std::vector<uint32_t> matches = {1, 2, 3};
+    filter_texture_names(names, "seventeen_chars_a", matches);
+    CHECK(matches.empty());
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,137 @@
+#include "hl1/texture_index.h"
+
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "common/thread.h"
+
+
+TEST_SUITE_BEGIN("texture_index");
+
+namespace {
+
+std::string to_lower(std::string_view name) {
+    std::string lower(name);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return char(tolower(c)); });
+    return lower;
+}
+
+}  // namespace
+
+TEST_CASE("TextureNameIndex") {
+    TextureNameIndex index;
+    TextureRef ref;
+
+    SUBCASE("empty index") {
+        CHECK_FALSE(index.find("wall", ref));
+        index.build({});
+        CHECK(index.size() == 0);
+        CHECK_FALSE(index.find("wall", ref));
+    }
+
+    SUBCASE("case-insensitive lookup") {
+        index.build({{"WALL01", "{Fence", "sixteen_chars_ab", "!water"}});
+        CHECK(index.size() == 4);
+        REQUIRE(index.find("wall01", ref));
+        CHECK(ref.wad == 0);
+        CHECK(ref.texture == 0);
+        REQUIRE(index.find("{FENCE", ref));
+        CHECK(ref.texture == 1);
+        REQUIRE(index.find("SIXTEEN_chars_AB", ref));
+        CHECK(ref.texture == 2);
+        REQUIRE(index.find("!Water", ref));
+        CHECK(ref.texture == 3);
+
+        CHECK_FALSE(index.find("wall0", ref));
+        CHECK_FALSE(index.find("wall011", ref));
+        CHECK_FALSE(index.find("", ref));
+        CHECK_FALSE(index.find("seventeen_chars_a", ref));
+        // Only ASCII letters are folded.
+        CHECK_FALSE(index.find("{fence\xc0", ref));
+    }
+
+    SUBCASE("search path precedence") {
+        index.build({{"a", "b", "B"}, {"c", "A"}, {"C", "d"}});
+        CHECK(index.size() == 4);
+        REQUIRE(index.find("a", ref));
+        CHECK(ref.wad == 0);
+        CHECK(ref.texture == 0);
+        REQUIRE(index.find("b", ref));
+        CHECK(ref.wad == 0);
+        CHECK(ref.texture == 1);
+        REQUIRE(index.find("c", ref));
+        CHECK(ref.wad == 1);
+        CHECK(ref.texture == 0);
+        REQUIRE(index.find("D", ref));
+        CHECK(ref.wad == 2);
+        CHECK(ref.texture == 1);
+    }
+
+    SUBCASE("invalid names are skipped") {
+        index.build({{"", std::string_view("\0a", 2), "seventeen_chars_a", "ok"}});
+        CHECK(index.size() == 1);
+        REQUIRE(index.find("OK", ref));
+        CHECK(ref.texture == 3);
+    }
+
+    SUBCASE("rebuild") {
+        index.build({{"a"}});
+        index.build({{"b"}});
+        CHECK(index.size() == 1);
+        CHECK_FALSE(index.find("a", ref));
+        CHECK(index.find("b", ref));
+    }
+}
+
+TEST_CASE("TextureNameIndex matches std::unordered_map") {
+    std::vector<std::vector<std::string>> wads(5);
+    for (size_t i = 0; i < 20000; i++) {
+        // Overlapping names across WADs, with varying case.
+        std::string name = (i % 3 == 0 ? "TEX_" : "tex_") + std::to_string((i * 7919) % 12000);
+        wads[i % wads.size()].push_back(name);
+    }
+    std::vector<std::vector<std::string_view>> wad_names;
+    std::unordered_map<std::string, TextureRef> expected;
+    for (size_t wad_idx = 0; wad_idx < wads.size(); wad_idx++) {
+        wad_names.emplace_back(wads[wad_idx].begin(), wads[wad_idx].end());
+        for (size_t texture_idx = 0; texture_idx < wads[wad_idx].size(); texture_idx++) {
+            TextureRef ref = {uint32_t(wad_idx), uint32_t(texture_idx)};
+            expected.emplace(to_lower(wads[wad_idx][texture_idx]), ref);
+        }
+    }
+    TextureNameIndex index;
+    index.build(wad_names);
+    CHECK(index.size() == expected.size());
+
+    for (size_t i = 0; i < 13000; i++) {
+        std::string name = "Tex_" + std::to_string(i);
+        auto it = expected.find(to_lower(name));
+        TextureRef ref;
+        REQUIRE(index.find(name, ref) == (it != expected.end()));
+        if (it != expected.end()) {
+            CHECK(ref.wad == it->second.wad);
+            CHECK(ref.texture == it->second.texture);
+        }
+    }
+
+    // Concurrent lookups do not need any synchronization.
+    std::atomic<size_t> found{0};
+    thread_pool().run_for(
+        [&](size_t i) {
+            TextureRef ref;
+            if (index.find("TEX_" + std::to_string(i), ref)) {
+                found++;
+            }
+        },
+        13000);
+    CHECK(found == expected.size());
+}
+
+TEST_SUITE_END();
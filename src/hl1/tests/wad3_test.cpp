@@ -0,0 +1,331 @@
+#include "hl1/wad3.h"
+
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/image.h"
+#include "hl1_test.h"
+
+
+TEST_SUITE_BEGIN("wad3");
+
+namespace {
+
+// Check that all mip levels of the miptex match the source test texture.
+bool miptex_matches(const WAD3Miptex& miptex, const TestTexture& texture) {
+    if (miptex.name != texture.name || miptex.width != texture.width || miptex.height != texture.height) {
+        return false;
+    }
+    for (int mip_level = 0; mip_level < WAD3Miptex::NUM_LEVELS; mip_level++) {
+        uint32_t width = texture.width >> mip_level;
+        uint32_t height = texture.height >> mip_level;
+        Span<uint8_t> data = miptex.mipmaps[mip_level].data;
+        if (data.size() != size_t(width) * height * 4) {
+            return false;
+        }
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                uint8_t rgb[3];
+                test_palette_color(test_texture_index(texture, mip_level, x, y), rgb);
+                const uint8_t* pixel = &data[(y * width + x) * 4];
+                if (pixel[0] != rgb[0] || pixel[1] != rgb[1] || pixel[2] != rgb[2] || pixel[3] != 255) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+std::vector<TestTexture> make_test_textures(size_t count) {
+    std::vector<TestTexture> textures;
+    for (size_t i = 0; i < count; i++) {
+        TestTexture texture;
+        texture.name = "tex" + std::to_string(i);
+        texture.width = uint32_t(16 * (1 + i % 4));
+        texture.height = uint32_t(16 * (1 + i % 3));
+        texture.seed = uint32_t(i);
+        textures.push_back(texture);
+    }
+    return textures;
+}
+
+}  // namespace
+
+TEST_CASE("WAD3View parse") {
+    std::vector<TestTexture> textures = make_test_textures(5);
+    textures[4].name = "sixteen_chars_ab";
+    FileContents file = make_test_wad(textures);
+    const uint8_t* contents_begin = file.contents.data();
+    const uint8_t* contents_end = contents_begin + file.contents.size();
+
+    SUBCASE("indexes all textures without copying") {
+        WAD3View view;
+        CHECK(view.parse(file));
+        CHECK(view.valid);
+        CHECK(view.name == "test.wad");
+        REQUIRE(view.entries.size() == textures.size());
+        for (size_t i = 0; i < textures.size(); i++) {
+            const WAD3ViewEntry& entry = view.entries[i];
+            CHECK(entry.name == textures[i].name);
+            CHECK(entry.width == textures[i].width);
+            CHECK(entry.height == textures[i].height);
+            const uint8_t* name_ptr = reinterpret_cast<const uint8_t*>(entry.name.data());
+            CHECK((name_ptr >= contents_begin && name_ptr + entry.name.size() <= contents_end));
+            CHECK((entry.palette >= contents_begin && entry.palette + 768 <= contents_end));
+            for (int mip_level = 0; mip_level < WAD3Miptex::NUM_LEVELS; mip_level++) {
+                const uint8_t* indices = entry.mip_indices[mip_level];
+                CHECK((indices >= contents_begin && indices < contents_end));
+                CHECK(indices[1] == test_texture_index(textures[i], mip_level, 1, 0));
+            }
+        }
+    }
+
+    SUBCASE("decode_level matches the parser") {
+        WAD3View view;
+        REQUIRE(view.parse(file));
+        WAD3Parser wad;
+        REQUIRE(wad.parse(file));
+        REQUIRE(wad.miptexs.size() == view.entries.size());
+        for (size_t i = 0; i < view.entries.size(); i++) {
+            uint32_t rgba_palette[256];
+            view.entries[i].decode_palette(rgba_palette);
+            for (int mip_level = 0; mip_level < WAD3Miptex::NUM_LEVELS; mip_level++) {
+                Span<uint8_t> expected = wad.miptexs[i].mipmaps[mip_level].data;
+                std::vector<uint8_t> decoded(expected.size());
+                view.entries[i].decode_level(mip_level, rgba_palette, decoded.data());
+                CHECK(memcmp(decoded.data(), expected.data(), expected.size()) == 0);
+            }
+        }
+    }
+
+    SUBCASE("content hash ignores the name") {
+        std::vector<TestTexture> with_copies = textures;
+        with_copies.push_back({"copy_of_0", textures[0].width, textures[0].height, textures[0].seed});
+        with_copies.push_back({"other_seed", textures[0].width, textures[0].height, textures[0].seed + 100});
+        FileContents copies_file = make_test_wad(with_copies);
+        WAD3View view;
+        REQUIRE(view.parse(copies_file));
+        REQUIRE(view.entries.size() == with_copies.size());
+        CHECK(view.entries[textures.size()].hash == view.entries[0].hash);
+        CHECK(view.entries[textures.size() + 1].hash != view.entries[0].hash);
+        for (size_t i = 1; i < textures.size(); i++) {
+            CHECK(view.entries[i].hash != view.entries[0].hash);
+        }
+
+        WAD3Parser wad;
+        REQUIRE(wad.parse(copies_file));
+        for (size_t i = 0; i < view.entries.size(); i++) {
+            CHECK(wad.miptexs[i].hash == view.entries[i].hash);
+        }
+    }
+
+    SUBCASE("garbage directory size") {
+        uint32_t num_dirs = 0x10000000;
+        memcpy(&file.contents[4], &num_dirs, 4);
+        WAD3View view;
+        CHECK_FALSE(view.parse(file));
+        CHECK_FALSE(view.valid);
+    }
+}
+
+TEST_CASE("WAD3Parser parse") {
+    SUBCASE("decodes all textures") {
+        std::vector<TestTexture> textures = make_test_textures(5);
+        FileContents file = make_test_wad(textures);
+
+        WAD3Parser wad;
+        CHECK(wad.parse(file));
+        CHECK(wad.valid);
+        CHECK(wad.name == "test.wad");
+        REQUIRE(wad.miptexs.size() == textures.size());
+        for (size_t i = 0; i < textures.size(); i++) {
+            CHECK(miptex_matches(wad.miptexs[i], textures[i]));
+        }
+    }
+
+    SUBCASE("invalid magic") {
+        FileContents file = make_test_wad(make_test_textures(1));
+        file.contents[3] = '2';
+
+        WAD3Parser wad;
+        CHECK_FALSE(wad.parse(file));
+        CHECK_FALSE(wad.valid);
+    }
+
+    SUBCASE("truncated directory") {
+        FileContents file = make_test_wad(make_test_textures(3));
+        file.contents.pop_back();
+
+        WAD3Parser wad;
+        CHECK_FALSE(wad.parse(file));
+    }
+
+    SUBCASE("invalid textures are skipped") {
+        std::vector<TestTexture> textures = make_test_textures(3);
+        textures[1].width = 17;
+        FileContents file = make_test_wad(textures);
+
+        WAD3Parser wad;
+        CHECK(wad.parse(file));
+        REQUIRE(wad.miptexs.size() == 2);
+        CHECK(miptex_matches(wad.miptexs[0], textures[0]));
+        CHECK(miptex_matches(wad.miptexs[1], textures[2]));
+    }
+}
+
+TEST_CASE("WAD3Parser arena storage") {
+    std::vector<TestTexture> textures = make_test_textures(20);
+    FileContents file = make_test_wad(textures);
+
+    WAD3Parser wad;
+    REQUIRE(wad.parse(file));
+    REQUIRE(wad.miptexs.size() == textures.size());
+
+    SUBCASE("mip levels are adjacent and aligned") {
+        for (const WAD3Miptex& miptex : wad.miptexs) {
+            CHECK(uintptr_t(miptex.mipmaps[0].data.data()) % Arena::DEFAULT_ALIGNMENT == 0);
+            for (int mip_level = 1; mip_level < WAD3Miptex::NUM_LEVELS; mip_level++) {
+                const Span<uint8_t>& prev = miptex.mipmaps[mip_level - 1].data;
+                CHECK(miptex.mipmaps[mip_level].data.data() == prev.data() + ((prev.size() + 15) & ~size_t(15)));
+                CHECK(uintptr_t(miptex.mipmaps[mip_level].data.data()) % 16 == 0);
+            }
+        }
+    }
+
+    SUBCASE("all textures are in a single block") {
+        CHECK(wad.arena.bytes_used() <= wad.arena.bytes_reserved());
+        const uint8_t* first = wad.miptexs.front().mipmaps[0].data.data();
+        const Span<uint8_t>& last = wad.miptexs.back().mipmaps[WAD3Miptex::NUM_LEVELS - 1].data;
+        CHECK(size_t(last.data() + last.size() - first) <= wad.arena.bytes_reserved());
+    }
+
+    SUBCASE("moving the parser keeps the texture data") {
+        const uint8_t* data_ptr = wad.miptexs[3].mipmaps[0].data.data();
+        WAD3Parser moved = std::move(wad);
+        CHECK(moved.miptexs[3].mipmaps[0].data.data() == data_ptr);
+        CHECK(miptex_matches(moved.miptexs[3], textures[3]));
+    }
+}
+
+TEST_CASE("WAD3Parser full mip chain") {
+    std::vector<TestTexture> textures = make_test_textures(12);
+    textures[0].width = 64;
+    textures[0].height = 16;
+    FileContents file = make_test_wad(textures);
+
+    SUBCASE("stored levels only by default") {
+        WAD3Parser wad;
+        REQUIRE(wad.parse(file));
+        for (const WAD3Miptex& miptex : wad.miptexs) {
+            CHECK(miptex.num_levels == WAD3Miptex::NUM_LEVELS);
+        }
+    }
+
+    SUBCASE("generated levels go down to 1x1") {
+        WAD3ParseOptions options;
+        options.full_mip_chain = true;
+        options.parallel = true;
+        WAD3Parser wad;
+        REQUIRE(wad.parse(file, options));
+        REQUIRE(wad.miptexs.size() == textures.size());
+
+        // 64x16 -> 32x8 -> 16x4 -> 8x2 (stored) -> 4x1 -> 2x1 -> 1x1
+        const WAD3Miptex& wide = wad.miptexs[0];
+        CHECK(wide.num_levels == 7);
+        CHECK(wide.mipmaps[4].data.size() == 4 * 1 * 4);
+        CHECK(wide.mipmaps[5].data.size() == 2 * 1 * 4);
+        CHECK(wide.mipmaps[6].data.size() == 1 * 1 * 4);
+
+        for (size_t i = 0; i < textures.size(); i++) {
+            const WAD3Miptex& miptex = wad.miptexs[i];
+            CHECK(miptex_matches(miptex, textures[i]));
+            CHECK(miptex.num_levels == mip_chain_length(miptex.width, miptex.height));
+            const WAD3MiptexLevel& last = miptex.mipmaps[miptex.num_levels - 1];
+            REQUIRE(last.data.size() == 4);
+            CHECK(last.data[3] == 255);
+
+            // Each generated level is the box-filtered previous level.
+            for (int mip_level = WAD3Miptex::NUM_LEVELS; mip_level < miptex.num_levels; mip_level++) {
+                std::vector<uint8_t> expected(miptex.mipmaps[mip_level].data.size());
+                downsample_rgba8(miptex.mipmaps[mip_level - 1].data.data(), mip_level_dim(miptex.width, mip_level - 1),
+                                 mip_level_dim(miptex.height, mip_level - 1), expected.data(), false);
+                CHECK(memcmp(expected.data(), miptex.mipmaps[mip_level].data.data(), expected.size()) == 0);
+            }
+        }
+    }
+
+    SUBCASE("generated levels stop at max_levels") {
+        WAD3ParseOptions options;
+        options.full_mip_chain = true;
+        options.max_levels = 5;
+        WAD3Parser wad;
+        REQUIRE(wad.parse(file, options));
+        for (size_t i = 0; i < textures.size(); i++) {
+            const WAD3Miptex& miptex = wad.miptexs[i];
+            CHECK(miptex_matches(miptex, textures[i]));
+            CHECK(miptex.num_levels == std::min(mip_chain_length(miptex.width, miptex.height), 5));
+        }
+        // The stored levels are decoded whatever the maximum.
+        options.max_levels = 1;
+        REQUIRE(wad.parse(file, options));
+        CHECK(wad.miptexs[0].num_levels == WAD3Miptex::NUM_LEVELS);
+    }
+
+    SUBCASE("gamma-correct generation is brighter for high contrast") {
+        WAD3ParseOptions options;
+        options.full_mip_chain = true;
+        WAD3Parser linear;
+        REQUIRE(linear.parse(file, options));
+        options.gamma_correct_mips = true;
+        WAD3Parser gamma;
+        REQUIRE(gamma.parse(file, options));
+
+        // Stored levels do not change, generated levels are at least as bright in linear light.
+        const WAD3Miptex& linear_miptex = linear.miptexs[1];
+        const WAD3Miptex& gamma_miptex = gamma.miptexs[1];
+        CHECK(memcmp(linear_miptex.mipmaps[3].data.data(), gamma_miptex.mipmaps[3].data.data(),
+                     linear_miptex.mipmaps[3].data.size()) == 0);
+        const WAD3MiptexLevel& linear_last = linear_miptex.mipmaps[linear_miptex.num_levels - 1];
+        const WAD3MiptexLevel& gamma_last = gamma_miptex.mipmaps[gamma_miptex.num_levels - 1];
+        CHECK(gamma_last.data[0] + gamma_last.data[1] + gamma_last.data[2] >=
+              linear_last.data[0] + linear_last.data[1] + linear_last.data[2]);
+    }
+}
+
+TEST_CASE("WAD3Parser parallel parse") {
+    SUBCASE("same result as sequential parse") {
+        std::vector<TestTexture> textures = make_test_textures(500);
+        textures[100].width = 17;
+        textures[333].height = 0;
+        FileContents file = make_test_wad(textures);
+
+        WAD3Parser sequential;
+        CHECK(sequential.parse(file));
+
+        WAD3ParseOptions options;
+        options.parallel = true;
+        WAD3Parser parallel;
+        CHECK(parallel.parse(file, options));
+
+        REQUIRE(parallel.miptexs.size() == textures.size() - 2);
+        REQUIRE(parallel.miptexs.size() == sequential.miptexs.size());
+        for (size_t i = 0; i < parallel.miptexs.size(); i++) {
+            CHECK(parallel.miptexs[i].name == sequential.miptexs[i].name);
+            for (int mip_level = 0; mip_level < WAD3Miptex::NUM_LEVELS; mip_level++) {
+                Span<uint8_t> parallel_data = parallel.miptexs[i].mipmaps[mip_level].data;
+                Span<uint8_t> sequential_data = sequential.miptexs[i].mipmaps[mip_level].data;
+                REQUIRE(parallel_data.size() == sequential_data.size());
+                CHECK(memcmp(parallel_data.data(), sequential_data.data(), parallel_data.size()) == 0);
+            }
+        }
+    }
+}
+
+TEST_SUITE_END();
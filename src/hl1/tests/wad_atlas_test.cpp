@@ -0,0 +1,227 @@
+#include "hl1/wad_atlas.h"
+
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "common/image.h"
+#include "common/texture_compression.h"
+#include "hl1/wad3.h"
+#include "hl1_test.h"
+
+
+TEST_SUITE_BEGIN("wad_atlas");
+
+namespace {
+
+// Return true if all the levels of the miptex are copied into the atlas at the expected positions.
+bool atlas_contains_miptex(const WAD3Atlas& atlas, size_t idx, const WAD3Miptex& miptex) {
+    const AtlasRect& rect = atlas.rects[idx];
+    const WAD3AtlasPage& page = atlas.pages[rect.page];
+    for (int mip_level = 0; mip_level < page.num_texture_levels; mip_level++) {
+        uint32_t width = mip_level_dim(miptex.width, mip_level);
+        uint32_t height = mip_level_dim(miptex.height, mip_level);
+        uint32_t page_width = mip_level_dim(page.width, mip_level);
+        for (uint32_t y = 0; y < height; y++) {
+            const uint8_t* src = miptex.mipmaps[mip_level].data.data() + size_t(y) * width * 4;
+            const uint8_t* dst = page.levels[mip_level].data() +
+                                 ((size_t((rect.y >> mip_level) + y) * page_width) + (rect.x >> mip_level)) * 4;
+            if (memcmp(src, dst, size_t(width) * 4) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Fill all levels of the miptex with rows alternating between color0 and color1, the pixels point into storage.
+void make_striped_miptex(uint32_t width, uint32_t height, const uint8_t color0[3], const uint8_t color1[3],
+                         std::vector<uint8_t>& storage, WAD3Miptex& miptex) {
+    miptex.width = width;
+    miptex.height = height;
+    miptex.num_levels = WAD3Atlas::MAX_PAGE_LEVELS;
+    size_t total_size = 0;
+    for (int mip_level = 0; mip_level < miptex.num_levels; mip_level++) {
+        total_size += size_t(mip_level_dim(width, mip_level)) * mip_level_dim(height, mip_level) * 4;
+    }
+    storage.resize(total_size);
+    uint8_t* dst = storage.data();
+    for (int mip_level = 0; mip_level < miptex.num_levels; mip_level++) {
+        uint32_t level_width = mip_level_dim(width, mip_level);
+        uint32_t level_height = mip_level_dim(height, mip_level);
+        size_t level_size = size_t(level_width) * level_height * 4;
+        miptex.mipmaps[mip_level].data = Span<uint8_t>(dst, level_size);
+        for (uint32_t y = 0; y < level_height; y++) {
+            const uint8_t* color = y % 2 == 0 ? color0 : color1;
+            for (uint32_t x = 0; x < level_width; x++) {
+                memcpy(dst, color, 3);
+                dst[3] = 255;
+                dst += 4;
+            }
+        }
+    }
+}
+
+}  // namespace
+
+TEST_CASE("WAD3Atlas build") {
+    std::vector<TestTexture> textures;
+    for (uint32_t i = 0; i < 40; i++) {
+        textures.push_back({"tex" + std::to_string(i), 16u << (i % 4), 16u << ((i / 4) % 3), i});
+    }
+    FileContents file = make_test_wad(textures);
+    WAD3ParseOptions parse_options;
+    parse_options.full_mip_chain = true;
+    WAD3Parser wad;
+    REQUIRE(wad.parse(file, parse_options));
+
+    SUBCASE("all mip levels are copied") {
+        WAD3Atlas atlas;
+        REQUIRE(atlas.build(wad.miptexs));
+        REQUIRE(atlas.rects.size() == wad.miptexs.size());
+        REQUIRE(!atlas.pages.empty());
+        CHECK(atlas.pages[0].num_texture_levels == WAD3Atlas::MAX_PAGE_LEVELS);
+        CHECK(atlas.efficiency > 0.0);
+        CHECK(atlas.efficiency <= 1.0);
+        for (size_t i = 0; i < wad.miptexs.size(); i++) {
+            CHECK(atlas_contains_miptex(atlas, i, wad.miptexs[i]));
+        }
+    }
+
+    SUBCASE("uv rect covers the texture") {
+        WAD3Atlas atlas;
+        REQUIRE(atlas.build(wad.miptexs));
+        float uv0[2];
+        float uv1[2];
+        atlas.get_uv(5, uv0, uv1);
+        const WAD3AtlasPage& page = atlas.pages[atlas.rects[5].page];
+        CHECK((uv1[0] - uv0[0]) * float(page.width) == doctest::Approx(wad.miptexs[5].width));
+        CHECK((uv1[1] - uv0[1]) * float(page.height) == doctest::Approx(wad.miptexs[5].height));
+    }
+
+    SUBCASE("small pages split textures") {
+        WAD3AtlasOptions options;
+        options.page_size = 256;
+        options.parallel = true;
+        WAD3Atlas atlas;
+        REQUIRE(atlas.build(wad.miptexs, options));
+        CHECK(atlas.pages.size() > 1);
+        for (size_t i = 0; i < wad.miptexs.size(); i++) {
+            CHECK(atlas_contains_miptex(atlas, i, wad.miptexs[i]));
+        }
+    }
+
+    SUBCASE("stored levels only") {
+        WAD3Parser stored_wad;
+        REQUIRE(stored_wad.parse(file));
+        WAD3Atlas atlas;
+        REQUIRE(atlas.build(stored_wad.miptexs));
+        CHECK(atlas.pages[0].num_texture_levels == WAD3Miptex::NUM_LEVELS);
+    }
+
+    SUBCASE("mip tail is downsampled from the page") {
+        WAD3AtlasOptions options;
+        options.gamma_correct_mips = true;
+        WAD3Atlas atlas;
+        REQUIRE(atlas.build(wad.miptexs, options));
+        for (const WAD3AtlasPage& page : atlas.pages) {
+            REQUIRE(page.num_levels == mip_chain_length(page.width, page.height));
+            REQUIRE(page.num_texture_levels < page.num_levels);
+            CHECK(page.levels[page.num_levels - 1].size() == 4);
+            for (int mip_level = page.num_texture_levels; mip_level < page.num_levels; mip_level++) {
+                uint32_t width = mip_level_dim(page.width, mip_level - 1);
+                uint32_t height = mip_level_dim(page.height, mip_level - 1);
+                std::vector<uint8_t> expected(page.levels[mip_level].size());
+                downsample_rgba8(page.levels[mip_level - 1].data(), width, height, expected.data(), true);
+                CHECK(memcmp(expected.data(), page.levels[mip_level].data(), expected.size()) == 0);
+            }
+        }
+    }
+
+    SUBCASE("compressed pages") {
+        WAD3Atlas rgba_atlas;
+        REQUIRE(rgba_atlas.build(wad.miptexs));
+        for (TextureFormat format : {TextureFormat::BC1, TextureFormat::ETC2_RGB8}) {
+            WAD3AtlasOptions options;
+            options.format = format;
+            WAD3Atlas atlas;
+            REQUIRE(atlas.build(wad.miptexs, options));
+            REQUIRE(atlas.pages.size() == rgba_atlas.pages.size());
+            for (size_t i = 0; i < atlas.pages.size(); i++) {
+                const WAD3AtlasPage& page = atlas.pages[i];
+                const WAD3AtlasPage& rgba_page = rgba_atlas.pages[i];
+                CHECK(page.format == format);
+                REQUIRE(page.num_texture_levels == WAD3Atlas::MAX_COMPRESSED_PAGE_LEVELS);
+                REQUIRE(page.num_texture_levels < rgba_page.num_texture_levels);
+                REQUIRE(page.num_levels == rgba_page.num_levels);
+                for (int mip_level = 0; mip_level < page.num_texture_levels; mip_level++) {
+                    uint32_t width = mip_level_dim(page.width, mip_level);
+                    uint32_t height = mip_level_dim(page.height, mip_level);
+                    REQUIRE(page.levels[mip_level].size() == texture_image_size(format, width, height));
+                    std::vector<uint8_t> expected(page.levels[mip_level].size());
+                    compress_rgba8(format, rgba_page.levels[mip_level].data(), width, height, expected.data());
+                    CHECK(memcmp(expected.data(), page.levels[mip_level].data(), expected.size()) == 0);
+                }
+            }
+        }
+    }
+
+    SUBCASE("texture larger than page") {
+        WAD3AtlasOptions options;
+        options.page_size = 64;
+        WAD3Atlas atlas;
+        CHECK_FALSE(atlas.build(wad.miptexs, options));
+    }
+}
+
+TEST_CASE("WAD3Atlas compressed pages do not bleed between textures") {
+    // Red and blue textures with stripes of different brightness, so that a block covering both could not encode
+    // all of its colors exactly. The first texture ends at the start of a 4x4 block at level 4, which also holds the
+    // first column of the second texture.
+    const uint8_t red0[3] = {255, 0, 0};
+    const uint8_t red1[3] = {96, 0, 0};
+    const uint8_t blue0[3] = {0, 0, 255};
+    const uint8_t blue1[3] = {0, 0, 96};
+    std::vector<uint8_t> red_storage;
+    std::vector<uint8_t> blue_storage;
+    std::vector<WAD3Miptex> miptexs(2);
+    make_striped_miptex(64, 64, red0, red1, red_storage, miptexs[0]);
+    make_striped_miptex(64, 64, blue0, blue1, blue_storage, miptexs[1]);
+
+    for (TextureFormat format : {TextureFormat::BC1, TextureFormat::ETC2_RGB8}) {
+        CAPTURE(int(format));
+        WAD3AtlasOptions options;
+        options.format = format;
+        WAD3Atlas atlas;
+        REQUIRE(atlas.build(miptexs, options));
+        REQUIRE(atlas.pages.size() == 1);
+        const WAD3AtlasPage& page = atlas.pages[0];
+        int mip_level = page.num_texture_levels - 1;
+        uint32_t width = mip_level_dim(page.width, mip_level);
+        uint32_t height = mip_level_dim(page.height, mip_level);
+        std::vector<uint8_t> decoded(size_t(width) * height * 4);
+        decompress_rgba8(format, page.levels[mip_level].data(), width, height, decoded.data());
+
+        for (size_t i = 0; i < miptexs.size(); i++) {
+            const AtlasRect& rect = atlas.rects[i];
+            // The channel of the other texture. The codecs may add the same amount to all channels (e.g. ETC2
+            // luminance modifiers), so it is compared with green, which is zero in both textures.
+            int other_channel = i == 0 ? 2 : 0;
+            uint32_t x0 = rect.x >> mip_level;
+            uint32_t y0 = rect.y >> mip_level;
+            for (uint32_t y = y0; y < y0 + mip_level_dim(rect.height, mip_level); y++) {
+                for (uint32_t x = x0; x < x0 + mip_level_dim(rect.width, mip_level); x++) {
+                    CAPTURE(x);
+                    CAPTURE(y);
+                    const uint8_t* texel = &decoded[(size_t(y) * width + x) * 4];
+                    CHECK(texel[other_channel] <= texel[1]);
+                }
+            }
+        }
+    }
+}
+
+TEST_SUITE_END();
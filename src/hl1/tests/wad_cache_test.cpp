@@ -0,0 +1,399 @@
+#include "hl1/wad_cache.h"
+
+#include <doctest/doctest.h>
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "common/io.h"
+#include "common/tests/common_test.h"
+#include "hl1_test.h"
+
+
+TEST_SUITE_BEGIN("wad_cache");
+
+namespace {
+
+bool textures_equal(const WAD3Textures& a, const WAD3Textures& b) {
+    if (a.name != b.name || a.textures.size() != b.textures.size() || a.atlas.rects.size() != b.atlas.rects.size() ||
+        a.atlas.pages.size() != b.atlas.pages.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.textures.size(); i++) {
+        const WAD3TextureInfo& ta = a.textures[i];
+        const WAD3TextureInfo& tb = b.textures[i];
+        if (ta.name != tb.name || ta.hash != tb.hash || ta.width != tb.width || ta.height != tb.height ||
+            ta.rect != tb.rect) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < a.atlas.rects.size(); i++) {
+        const AtlasRect& ra = a.atlas.rects[i];
+        const AtlasRect& rb = b.atlas.rects[i];
+        if (ra.page != rb.page || ra.x != rb.x || ra.y != rb.y || ra.width != rb.width || ra.height != rb.height) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < a.atlas.pages.size(); i++) {
+        const WAD3AtlasPage& pa = a.atlas.pages[i];
+        const WAD3AtlasPage& pb = b.atlas.pages[i];
+        if (pa.width != pb.width || pa.height != pb.height || pa.num_levels != pb.num_levels ||
+            pa.num_texture_levels != pb.num_texture_levels ||
+            pa.format != pb.format) {
+            return false;
+        }
+        for (int mip_level = 0; mip_level < pa.num_levels; mip_level++) {
+            if (pa.levels[mip_level].size() != pb.levels[mip_level].size() ||
+                memcmp(pa.levels[mip_level].data(), pb.levels[mip_level].data(), pa.levels[mip_level].size()) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Load the cache or rebuild and save it, like the loading code does. Return true if the cache was used.
+bool load_or_build(const FileContents& file, const std::string& cache_path, TextureFormat format,
+                   WAD3Textures& textures, const WAD3SharedTextures& shared = {}) {
+    WAD3CacheKey key;
+    REQUIRE(key.init(file.name.c_str(), format));
+    if (textures.load_cache(cache_path.c_str(), key) && textures.shared_hash == wad3_shared_hash(shared)) {
+        return true;
+    }
+    WAD3ParseOptions parse_options;
+    parse_options.full_mip_chain = true;
+    parse_options.max_levels = WAD3Atlas::MAX_PAGE_LEVELS;
+    WAD3AtlasOptions atlas_options;
+    atlas_options.format = format;
+    REQUIRE(textures.build(file, parse_options, atlas_options, shared));
+    REQUIRE(key.init(file, format));
+    REQUIRE(textures.save_cache(cache_path.c_str(), key));
+    return false;
+}
+
+void modify_file(const std::string& path, size_t offset, uint8_t xor_value) {
+    FileContents contents;
+    REQUIRE(file_read_contents(path.c_str(), contents));
+    REQUIRE(offset < contents.contents.size());
+    contents.contents[offset] ^= xor_value;
+    REQUIRE(file_write_contents(path.c_str(), contents.contents.data(), contents.contents.size()));
+}
+
+}  // namespace
+
+TEST_CASE("WAD3Textures cache") {
+    std::string dir = make_temp_directory();
+    REQUIRE(!dir.empty());
+    std::string wad_path = path_join(dir.c_str(), "test.wad");
+    std::string cache_path = wad3_cache_path(wad_path.c_str());
+
+    std::vector<TestTexture> test_textures;
+    for (uint32_t i = 0; i < 20; i++) {
+        test_textures.push_back({"texture_" + std::to_string(i), 16u << (i % 3), 16u << ((i / 3) % 3), i});
+    }
+    test_textures.push_back({"sixteen_chars_ab", 32, 16, 99});
+    // Copy of texture_1 under another name.
+    test_textures.push_back({"copy_of_1", 32, 16, 1});
+    FileContents wad_data = make_test_wad(test_textures);
+    REQUIRE(file_write_contents(wad_path.c_str(), wad_data.contents.data(), wad_data.contents.size()));
+    FileContents wad_file;
+    REQUIRE(file_read_contents(wad_path.c_str(), wad_file));
+
+    for (TextureFormat format : {TextureFormat::RGBA8, TextureFormat::BC1}) {
+        CAPTURE(int(format));
+        remove(cache_path.c_str());
+
+        WAD3Textures built;
+        CHECK_FALSE(load_or_build(wad_file, cache_path, format, built));
+        CHECK(built.name == "test.wad");
+        CHECK(built.textures[test_textures.size() - 2].name == "sixteen_chars_ab");
+
+        // Warm start.
+        WAD3Textures cached;
+        CHECK(load_or_build(wad_file, cache_path, format, cached));
+        CHECK(textures_equal(built, cached));
+        for (const WAD3AtlasPage& page : cached.atlas.pages) {
+            for (int mip_level = 0; mip_level < page.num_levels; mip_level++) {
+                CHECK(reinterpret_cast<uintptr_t>(page.levels[mip_level].data()) % 64 == 0);
+            }
+        }
+        CHECK(cached.atlas.efficiency == doctest::Approx(built.atlas.efficiency));
+    }
+
+    SUBCASE("copies are packed once") {
+        WAD3Textures textures;
+        CHECK(load_or_build(wad_file, cache_path, TextureFormat::BC1, textures));
+        const WAD3TextureInfo& original = textures.textures[1];
+        const WAD3TextureInfo& copy = textures.textures.back();
+        CHECK(copy.name == "copy_of_1");
+        CHECK(copy.hash == original.hash);
+        CHECK(copy.rect == original.rect);
+        CHECK(textures.atlas.rects.size() == textures.textures.size() - 1);
+    }
+
+    SUBCASE("shared textures are not packed") {
+        // An earlier WAD stores texture_0 and texture_1.
+        WAD3View view;
+        REQUIRE(view.parse(wad_file));
+        WAD3ContentKeys content_keys;
+        bool stored = true;
+        content_keys.add(view.entries[0], stored);
+        CHECK_FALSE(stored);
+        content_keys.add(view.entries[1], stored);
+        WAD3SharedTextures shared;
+        content_keys.add_wad(view.entries, shared);
+        CHECK(shared.stored_keys.size() == 2);
+
+        WAD3Textures textures;
+        CHECK_FALSE(load_or_build(wad_file, cache_path, TextureFormat::BC1, textures, shared));
+        CHECK(textures.textures[0].rect == -1);
+        CHECK(textures.textures[1].rect == -1);
+        CHECK(textures.textures.back().rect == -1);
+        CHECK(textures.textures[2].rect >= 0);
+        CHECK(textures.atlas.rects.size() == textures.textures.size() - 3);
+
+        WAD3Textures cached;
+        CHECK(load_or_build(wad_file, cache_path, TextureFormat::BC1, cached, shared));
+        CHECK(textures_equal(textures, cached));
+        // Different shared textures change the layout.
+        CHECK_FALSE(load_or_build(wad_file, cache_path, TextureFormat::BC1, cached));
+    }
+
+    SUBCASE("keys are taken from the cache") {
+        WAD3View view;
+        REQUIRE(view.parse(wad_file));
+        WAD3ContentKeys content_keys;
+        WAD3SharedTextures shared;
+        content_keys.add_wad(view.entries, shared);
+
+        WAD3Textures textures;
+        CHECK_FALSE(load_or_build(wad_file, cache_path, TextureFormat::BC1, textures, shared));
+        CHECK(load_or_build(wad_file, cache_path, TextureFormat::BC1, textures, shared));
+        WAD3ContentKeys cached_keys;
+        WAD3SharedTextures cached;
+        CHECK(cached_keys.add_cached_wad(textures.textures, textures.shared_hash, cached));
+        CHECK(cached.keys == shared.keys);
+        CHECK(cached.stored_keys == shared.stored_keys);
+        // A later WAD with the same textures finds them stored by the cached one.
+        WAD3SharedTextures later;
+        cached_keys.add_wad(view.entries, later);
+        CHECK(later.keys == shared.keys);
+        CHECK(later.stored_keys.size() == test_textures.size() - 1);
+    }
+
+    SUBCASE("cached keys of different textures are not merged") {
+        // Caches built against different WADs can store the same key for different textures.
+        auto texture_info = [](uint64_t key, uint64_t content_hash, uint32_t width) {
+            WAD3TextureInfo texture;
+            texture.hash = key;
+            texture.content_hash = content_hash;
+            texture.width = width;
+            texture.height = 16;
+            return texture;
+        };
+        auto own_hash = [](uint64_t key) {
+            WAD3SharedTextures own;
+            own.keys = {key};
+            return wad3_shared_hash(own);
+        };
+        WAD3ContentKeys content_keys;
+        WAD3SharedTextures shared;
+        REQUIRE(content_keys.add_cached_wad({texture_info(5, 5, 16)}, own_hash(5), shared));
+        CHECK(shared.stored_keys.empty());
+        // Different content or size under the same key is rejected, and nothing is added.
+        CHECK_FALSE(content_keys.add_cached_wad({texture_info(5, 7, 16)}, own_hash(5), shared));
+        CHECK_FALSE(content_keys.add_cached_wad({texture_info(5, 5, 32)}, own_hash(5), shared));
+        CHECK(content_keys.entries.size() == 1);
+        // The same texture is found stored by the first WAD.
+        WAD3SharedTextures stored;
+        stored.keys = {5};
+        stored.stored_keys = {5};
+        CHECK(content_keys.add_cached_wad({texture_info(5, 5, 16)}, wad3_shared_hash(stored), shared));
+        CHECK(shared.stored_keys == std::vector<uint64_t>{5});
+        // A key which matches but was built without the first WAD is rejected by the hash.
+        CHECK_FALSE(content_keys.add_cached_wad({texture_info(5, 5, 16)}, own_hash(5), shared));
+    }
+
+    SUBCASE("hash collisions are not merged") {
+        // Pretend that texture_2 and texture_3 have the hash of texture_1 and its copy.
+        WAD3View view;
+        REQUIRE(view.parse(wad_file));
+        uint64_t hash = view.entries[1].hash;
+        view.entries[2].hash = hash;
+        view.entries[3].hash = hash;
+        WAD3ContentKeys content_keys;
+        WAD3SharedTextures shared;
+        content_keys.add_wad(view.entries, shared);
+        REQUIRE(shared.keys.size() == test_textures.size());
+        CHECK(shared.keys[1] == hash);
+        CHECK(shared.keys.back() == hash);
+        CHECK(shared.keys[2] != hash);
+        CHECK(shared.keys[3] != hash);
+        CHECK(shared.keys[2] != shared.keys[3]);
+        CHECK(shared.stored_keys.empty());
+
+        // The same keys are assigned again, and a later WAD stores none of the textures.
+        WAD3SharedTextures later;
+        content_keys.add_wad(view.entries, later);
+        CHECK(later.keys == shared.keys);
+        CHECK(later.stored_keys.size() == test_textures.size() - 1);
+
+        WAD3Textures textures;
+        CHECK_FALSE(load_or_build(wad_file, cache_path, TextureFormat::BC1, textures, shared));
+        CHECK(textures.textures[2].hash == shared.keys[2]);
+        CHECK(textures.textures[2].rect != textures.textures[1].rect);
+        CHECK(textures.textures[3].rect != textures.textures[1].rect);
+        CHECK(textures.textures.back().rect == textures.textures[1].rect);
+        CHECK(textures.atlas.rects.size() == textures.textures.size() - 1);
+
+        // Keys of another file are rejected.
+        WAD3SharedTextures wrong;
+        wrong.keys = {hash};
+        WAD3Textures rejected;
+        CHECK_FALSE(rejected.build(wad_file, WAD3ParseOptions(), WAD3AtlasOptions(), wrong));
+    }
+
+    SUBCASE("different texture format") {
+        WAD3Textures textures;
+        CHECK(load_or_build(wad_file, cache_path, TextureFormat::BC1, textures));
+        CHECK_FALSE(load_or_build(wad_file, cache_path, TextureFormat::ETC2_RGB8, textures));
+        CHECK(load_or_build(wad_file, cache_path, TextureFormat::ETC2_RGB8, textures));
+    }
+
+    SUBCASE("deleted cache is rebuilt") {
+        remove(cache_path.c_str());
+        WAD3Textures textures;
+        CHECK_FALSE(load_or_build(wad_file, cache_path, TextureFormat::BC1, textures));
+        CHECK(load_or_build(wad_file, cache_path, TextureFormat::BC1, textures));
+    }
+
+    SUBCASE("corrupt cache is rebuilt") {
+        // The header, the source path and the texture list.
+        for (size_t offset : {size_t(0), size_t(20), size_t(100), size_t(200)}) {
+            CAPTURE(offset);
+            modify_file(cache_path, offset, 0x40);
+            WAD3Textures textures;
+            CHECK_FALSE(load_or_build(wad_file, cache_path, TextureFormat::BC1, textures));
+            WAD3Textures rebuilt;
+            CHECK(load_or_build(wad_file, cache_path, TextureFormat::BC1, rebuilt));
+            CHECK(textures_equal(textures, rebuilt));
+        }
+    }
+
+    SUBCASE("corrupt level is found when it is used") {
+        size_t offset = 0;
+        uint32_t last_page = 0;
+        {
+            WAD3Textures textures;
+            REQUIRE(load_or_build(wad_file, cache_path, TextureFormat::BC1, textures));
+            last_page = uint32_t(textures.atlas.pages.size() - 1);
+            const WAD3AtlasPage& page = textures.atlas.pages[last_page];
+            REQUIRE(page.num_levels > 1);
+            offset = size_t(page.levels[1].data() - textures.cache_file.contents().data());
+        }
+        modify_file(cache_path, offset, 0x40);
+        WAD3Textures textures;
+        CHECK(load_or_build(wad_file, cache_path, TextureFormat::BC1, textures));
+        CHECK(textures.verify_level(last_page, 0));
+        CHECK_FALSE(textures.verify_level(last_page, 1));
+        // The cache file is removed, so that the next start rebuilds it.
+        WAD3Textures rebuilt;
+        CHECK_FALSE(load_or_build(wad_file, cache_path, TextureFormat::BC1, rebuilt));
+        CHECK(load_or_build(wad_file, cache_path, TextureFormat::BC1, rebuilt));
+        for (uint32_t page = 0; page < uint32_t(rebuilt.atlas.pages.size()); page++) {
+            for (int mip_level = 0; mip_level < rebuilt.atlas.pages[page].num_levels; mip_level++) {
+                CHECK(rebuilt.verify_level(page, mip_level));
+            }
+        }
+    }
+
+    SUBCASE("truncated cache is rebuilt") {
+        FileContents contents;
+        REQUIRE(file_read_contents(cache_path.c_str(), contents));
+        for (size_t size : {size_t(0), size_t(10), contents.contents.size() - 1}) {
+            REQUIRE(file_write_contents(cache_path.c_str(), contents.contents.data(), size));
+            WAD3Textures textures;
+            CHECK_FALSE(load_or_build(wad_file, cache_path, TextureFormat::BC1, textures));
+        }
+    }
+
+    SUBCASE("modified source is rebuilt") {
+        // Same size, but different content and modification time. The times are set explicitly, so that the test does
+        // not depend on the timestamp resolution of the filesystem.
+        FileStat cache_stat;
+        REQUIRE(file_stat(cache_path.c_str(), cache_stat));
+        const int64_t old_mtime_ns = cache_stat.mtime_ns - 10000000000;
+        modify_file(wad_path, wad_file.contents.size() - 1, 1);
+        REQUIRE(file_set_mtime(wad_path.c_str(), old_mtime_ns));
+        FileContents modified;
+        REQUIRE(file_read_contents(wad_path.c_str(), modified));
+        WAD3Textures textures;
+        CHECK_FALSE(load_or_build(modified, cache_path, TextureFormat::BC1, textures));
+        CHECK(load_or_build(modified, cache_path, TextureFormat::BC1, textures));
+
+        // A different modification time falls back to the contents, e.g. for copied files. A match stores the new
+        // time in the cache file, so the contents are not compared again.
+        WAD3CacheKey key;
+        REQUIRE(key.init(modified, TextureFormat::BC1));
+        key.source_mtime_ns++;
+        CHECK(textures.load_cache(cache_path.c_str(), key));
+        key.source_hash++;
+        CHECK(textures.load_cache(cache_path.c_str(), key));
+        key.source_mtime_ns++;
+        CHECK_FALSE(textures.load_cache(cache_path.c_str(), key));
+        // The file is hashed if the key has no hash.
+        REQUIRE(key.init(wad_path.c_str(), TextureFormat::BC1));
+        CHECK(key.source_hash == 0);
+        key.source_mtime_ns = old_mtime_ns + 10;
+        FileContents source;
+        CHECK(textures.load_cache(cache_path.c_str(), key, &source));
+        CHECK(source.contents.empty());
+        // The contents read for the comparison are handed back if they differ.
+        modify_file(wad_path, wad_file.contents.size() - 1, 1);
+        key.source_mtime_ns++;
+        CHECK_FALSE(textures.load_cache(cache_path.c_str(), key, &source));
+        CHECK(source.contents == wad_file.contents);
+        key.source_size++;
+        CHECK_FALSE(textures.load_cache(cache_path.c_str(), key));
+        key.source_size--;
+        key.source_path = "other.wad";
+        CHECK_FALSE(textures.load_cache(cache_path.c_str(), key));
+    }
+
+    SUBCASE("source as new as the cache is compared") {
+        // A source rewritten in the same timestamp tick as its cache keeps its size and modification time.
+        FileStat source_stat;
+        REQUIRE(file_stat(wad_path.c_str(), source_stat));
+        const int64_t mtime_ns = source_stat.mtime_ns - 10000000000;
+        REQUIRE(file_set_mtime(wad_path.c_str(), mtime_ns));
+        WAD3Textures textures;
+        CHECK(load_or_build(wad_file, cache_path, TextureFormat::BC1, textures));
+
+        // The contents match, and the header is written again, so that the cache becomes newer than the source.
+        REQUIRE(file_set_mtime(cache_path.c_str(), mtime_ns));
+        CHECK(load_or_build(wad_file, cache_path, TextureFormat::BC1, textures));
+        FileStat cache_stat;
+        REQUIRE(file_stat(cache_path.c_str(), cache_stat));
+        CHECK(cache_stat.mtime_ns > mtime_ns);
+
+        // Same size and modification time, but different contents.
+        REQUIRE(file_set_mtime(cache_path.c_str(), mtime_ns));
+        modify_file(wad_path, wad_file.contents.size() - 1, 1);
+        REQUIRE(file_set_mtime(wad_path.c_str(), mtime_ns));
+        FileContents modified;
+        REQUIRE(file_read_contents(wad_path.c_str(), modified));
+        CHECK_FALSE(load_or_build(modified, cache_path, TextureFormat::BC1, textures));
+        CHECK(load_or_build(modified, cache_path, TextureFormat::BC1, textures));
+    }
+
+    remove(cache_path.c_str());
+    remove(wad_path.c_str());
+    rmdir(dir.c_str());
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,140 @@
+#include "hl1/wad_thumbnails.h"
+
+#include <doctest/doctest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "common/image.h"
+#include "common/texture_compression.h"
+#include "hl1_test.h"
+
+
+TEST_SUITE_BEGIN("wad_thumbnails");
+
+namespace {
+
+// Return the RGBA8 pixels of the mip level of the texture as stored in its atlas page.
+std::vector<uint8_t> atlas_level_pixels(const WAD3Textures& textures, const WAD3TextureInfo& texture, int level) {
+    const AtlasRect& rect = textures.atlas.rects[texture.rect];
+    const WAD3AtlasPage& page = textures.atlas.pages[rect.page];
+    uint32_t page_width = mip_level_dim(page.width, level);
+    uint32_t page_height = mip_level_dim(page.height, level);
+    std::vector<uint8_t> page_pixels(size_t(page_width) * page_height * 4);
+    if (texture_format_is_compressed(page.format)) {
+        decompress_rgba8(page.format, page.levels[level].data(), page_width, page_height, page_pixels.data());
+    } else {
+        memcpy(page_pixels.data(), page.levels[level].data(), page_pixels.size());
+    }
+    uint32_t width = mip_level_dim(texture.width, level);
+    uint32_t height = mip_level_dim(texture.height, level);
+    std::vector<uint8_t> pixels(size_t(width) * height * 4);
+    for (uint32_t y = 0; y < height; y++) {
+        memcpy(&pixels[size_t(y) * width * 4],
+               &page_pixels[((size_t(rect.y >> level) + y) * page_width + (rect.x >> level)) * 4], size_t(width) * 4);
+    }
+    return pixels;
+}
+
+// Return the pixels of the thumbnail and check that the padding replicates its edges.
+std::vector<uint8_t> thumbnail_pixels(const WAD3Thumbnails& thumbnails, const WAD3Thumbnail& thumbnail) {
+    const WAD3ThumbnailPage& page = thumbnails.pages[thumbnail.page];
+    uint32_t x = uint32_t(std::lround(thumbnail.uv0[0] * float(page.width)));
+    uint32_t y = uint32_t(std::lround(thumbnail.uv0[1] * float(page.height)));
+    CHECK(uint32_t(std::lround(thumbnail.uv1[0] * float(page.width))) - x == thumbnail.width);
+    CHECK(uint32_t(std::lround(thumbnail.uv1[1] * float(page.height))) - y == thumbnail.height);
+    std::vector<uint8_t> pixels(size_t(thumbnail.width) * thumbnail.height * 4);
+    for (uint32_t row = 0; row < thumbnail.height; row++) {
+        const uint8_t* src = &page.pixels[((size_t(y) + row) * page.width + x) * 4];
+        memcpy(&pixels[size_t(row) * thumbnail.width * 4], src, size_t(thumbnail.width) * 4);
+        CHECK(memcmp(src - 4, src, 4) == 0);
+    }
+    return pixels;
+}
+
+void check_thumbnails(TextureFormat format) {
+    std::vector<TestTexture> test_textures;
+    for (uint32_t i = 0; i < 30; i++) {
+        test_textures.push_back({"tex" + std::to_string(i), 16u << (i % 6), 16u << ((i / 6) % 5), i});
+    }
+    FileContents file = make_test_wad(test_textures);
+    WAD3AtlasOptions atlas_options;
+    atlas_options.format = format;
+    atlas_options.page_size = 1024;
+    WAD3Textures textures;
+    REQUIRE(textures.build(file, {}, atlas_options));
+
+    WAD3Thumbnails thumbnails;
+    thumbnails.add(textures);
+    // Textures already added by another WAD are skipped.
+    thumbnails.add(textures);
+    REQUIRE(thumbnails.thumbnails.size() == test_textures.size());
+    REQUIRE(thumbnails.build());
+    CHECK(thumbnails.pages.size() == 1);
+    CHECK(thumbnails.staging.empty());
+
+    for (const WAD3TextureInfo& texture : textures.textures) {
+        CAPTURE(texture.width);
+        CAPTURE(texture.height);
+        const WAD3Thumbnail* thumbnail = thumbnails.find(texture.hash);
+        REQUIRE(thumbnail != nullptr);
+        // The smallest of the 4 stored levels which covers THUMBNAIL_SIZE.
+        int level = 0;
+        while (level < 3 && std::max(texture.width, texture.height) >> (level + 1) >= WAD3Thumbnails::THUMBNAIL_SIZE) {
+            level++;
+        }
+        CHECK(thumbnail->width == texture.width >> level);
+        CHECK(thumbnail->height == texture.height >> level);
+        CHECK(thumbnail_pixels(thumbnails, *thumbnail) == atlas_level_pixels(textures, texture, level));
+    }
+    CHECK(thumbnails.find(0) == nullptr);
+}
+
+}  // namespace
+
+TEST_CASE("WAD3Thumbnails are downsampled to fit into max_pages") {
+    std::vector<TestTexture> test_textures;
+    for (uint32_t i = 0; i < 64; i++) {
+        test_textures.push_back({"tex" + std::to_string(i), 64, 32, i});
+    }
+    FileContents file = make_test_wad(test_textures);
+    WAD3Textures textures;
+    REQUIRE(textures.build(file, {}, {}));
+
+    // 64 thumbnails of 32x16 (34x18 padded) do not fit into one 128x128 page, 16x8 ones do.
+    WAD3Thumbnails thumbnails;
+    thumbnails.add(textures);
+    REQUIRE(thumbnails.thumbnails.size() == test_textures.size());
+    std::vector<uint8_t> first_pixels(thumbnails.staging.begin(), thumbnails.staging.begin() + 32 * 16 * 4);
+    REQUIRE(thumbnails.build(128, 1));
+    REQUIRE(thumbnails.pages.size() == 1);
+    for (const WAD3Thumbnail& thumbnail : thumbnails.thumbnails) {
+        CHECK(thumbnail.width == 16);
+        CHECK(thumbnail.height == 8);
+    }
+    std::vector<uint8_t> expected(16 * 8 * 4);
+    downsample_rgba8(first_pixels.data(), 32, 16, expected.data(), true);
+    CHECK(thumbnail_pixels(thumbnails, thumbnails.thumbnails[0]) == expected);
+
+    // Even 1x1 thumbnails do not fit.
+    WAD3Thumbnails too_many;
+    too_many.add(textures);
+    CHECK_FALSE(too_many.build(16, 1));
+}
+
+TEST_CASE("WAD3Thumbnails RGBA8") {
+    check_thumbnails(TextureFormat::RGBA8);
+}
+
+TEST_CASE("WAD3Thumbnails BC1") {
+    check_thumbnails(TextureFormat::BC1);
+}
+
+TEST_CASE("WAD3Thumbnails ETC2") {
+    check_thumbnails(TextureFormat::ETC2_RGB8);
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,115 @@
+#include "texture_filter.h"
+
+#include <cstring>
+
+#include "common/bits.h"
+#include "common/simd.h"
+#include "common/thread.h"
+
+
+namespace {
+
+// Names per task of the parallel scan, and the number of names below which the scan stays on the calling thread.
+const size_t FILTER_CHUNK_SIZE = 4096;
+const size_t MIN_PARALLEL_NAMES = 4 * FILTER_CHUNK_SIZE;
+
+// The names are scanned as one 16-byte chunk.
+static_assert(sizeof(WAD3TextureName) == 16);
+
+// NEON has no movemask, its masks have 4 bits per position.
+#if defined(SIMD_USE_NEON)
+const int MASK_BITS_PER_POSITION = 4;
+#else
+const int MASK_BITS_PER_POSITION = 1;
+#endif
+
+// Return a mask with MASK_BITS_PER_POSITION bits per position of the name at which both the first and the last chars of
+// the pattern match. name points to the 16 bytes of the name. The matches of the last char are shifted down by
+// pattern_size - 1 positions instead of being loaded from there, so that no bytes past the name are read.
+uint64_t candidate_positions(const uint8_t* name, const uint8_t* pattern, size_t pattern_size) {
+#if defined(SIMD_USE_SSE2)
+    __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(name));
+    uint64_t first = uint64_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(char(pattern[0])))));
+    uint64_t last = uint64_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(char(pattern[pattern_size - 1])))));
+    return first & (last >> (pattern_size - 1));
+#elif defined(SIMD_USE_NEON)
+    uint8x16_t v = vld1q_u8(name);
+    // Narrow each 0x00 / 0xFF byte into 4 bits.
+    uint8x8_t first = vshrn_n_u16(vreinterpretq_u16_u8(vceqq_u8(v, vdupq_n_u8(pattern[0]))), 4);
+    uint8x8_t last = vshrn_n_u16(vreinterpretq_u16_u8(vceqq_u8(v, vdupq_n_u8(pattern[pattern_size - 1]))), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(first), 0) &
+           (vget_lane_u64(vreinterpret_u64_u8(last), 0) >> ((pattern_size - 1) * MASK_BITS_PER_POSITION));
+#else
+    uint64_t mask = 0;
+    for (size_t i = 0; i + pattern_size <= 16; i++) {
+        if (name[i] == pattern[0] && name[i + pattern_size - 1] == pattern[pattern_size - 1]) {
+            mask |= uint64_t(1) << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+void filter_range(const std::vector<WAD3TextureName>& lower_names, const WAD3TextureName& pattern, size_t begin,
+                  size_t end, std::vector<uint32_t>& matches) {
+    std::string_view pattern_view = pattern.view();
+    for (size_t i = begin; i < end; i++) {
+        if (texture_name_contains(lower_names[i], pattern_view)) {
+            matches.push_back(uint32_t(i));
+        }
+    }
+}
+
+}  // namespace
+
+bool texture_name_contains(const WAD3TextureName& name, std::string_view pattern) {
+    size_t pattern_size = pattern.size();
+    if (pattern_size == 0) {
+        return true;
+    }
+    if (pattern_size > WAD3TextureName::CAPACITY) {
+        return false;
+    }
+    // The name is zero-padded to whole chunks and the pattern has no zero bytes, so the candidates never run past the
+    // end of the name and the positions above CAPACITY - pattern_size can be masked off.
+    const uint8_t* name_bytes = reinterpret_cast<const uint8_t*>(&name);
+    const uint8_t* pattern_bytes = reinterpret_cast<const uint8_t*>(pattern.data());
+    size_t num_positions = WAD3TextureName::CAPACITY - pattern_size + 1;
+    uint64_t mask = candidate_positions(name_bytes, pattern_bytes, pattern_size);
+    if (num_positions * MASK_BITS_PER_POSITION < 64) {
+        mask &= (uint64_t(1) << (num_positions * MASK_BITS_PER_POSITION)) - 1;
+    }
+    while (mask != 0) {
+        size_t position = size_t(count_trailing_zeros(mask)) / MASK_BITS_PER_POSITION;
+        if (pattern_size <= 2 || memcmp(name_bytes + position + 1, pattern_bytes + 1, pattern_size - 2) == 0) {
+            return true;
+        }
+        mask &= ~((uint64_t(1) << ((position + 1) * MASK_BITS_PER_POSITION)) - 1);
+    }
+    return false;
+}
+
+void filter_texture_names(const std::vector<WAD3TextureName>& lower_names, std::string_view pattern,
+                          std::vector<uint32_t>& matches, bool parallel) {
+    matches.clear();
+    if (pattern.size() > WAD3TextureName::CAPACITY) {
+        return;
+    }
+    WAD3TextureName lower_pattern = WAD3TextureName(pattern).to_lower();
+
+    if (!parallel || lower_names.size() < MIN_PARALLEL_NAMES) {
+        filter_range(lower_names, lower_pattern, 0, lower_names.size(), matches);
+        return;
+    }
+
+    size_t num_chunks = (lower_names.size() + FILTER_CHUNK_SIZE - 1) / FILTER_CHUNK_SIZE;
+    std::vector<std::vector<uint32_t>> chunk_matches(num_chunks);
+    thread_pool().run_for_chunked(
+        [&](size_t begin, size_t end) {
+            filter_range(lower_names, lower_pattern, begin, end, chunk_matches[begin / FILTER_CHUNK_SIZE]);
+        },
+        lower_names.size(), FILTER_CHUNK_SIZE);
+    for (const std::vector<uint32_t>& chunk : chunk_matches) {
+        matches.insert(matches.end(), chunk.begin(), chunk.end());
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "wad3.h"
+
+
+// Return true if name contains pattern. Both must be lowercase, see WAD3TextureName::to_lower().
+bool texture_name_contains(const WAD3TextureName& name, std::string_view pattern);
+
+// Set matches to the indices of lower_names (lowercase texture names) which contain pattern, ignoring ASCII case. An
+// empty pattern matches all names. If parallel is true, large sets are scanned in chunks on thread_pool(), the order
+// of matches is the same as in the sequential case.
+void filter_texture_names(const std::vector<WAD3TextureName>& lower_names, std::string_view pattern,
+                          std::vector<uint32_t>& matches, bool parallel = false);
@@ -0,0 +1,64 @@
+#include "texture_index.h"
+
+#include "common/common.h"
+
+
+namespace {
+
+// Return false if the name is empty or too long to be a key.
+FORCE_INLINE bool is_valid_name(std::string_view name) {
+    return !name.empty() && name[0] != '\0' && name.size() <= TextureNameIndex::MAX_NAME_LENGTH;
+}
+
+}  // namespace
+
+void TextureNameIndex::build(const std::vector<std::vector<std::string_view>>& wads) {
+    size_t total = 0;
+    for (const std::vector<std::string_view>& names : wads) {
+        total += names.size();
+    }
+    size_t capacity = 16;
+    while (capacity < total * 2) {
+        capacity *= 2;
+    }
+    keys.assign(capacity, Key{});
+    refs.assign(capacity, TextureRef{});
+    mask = capacity - 1;
+    num_names = 0;
+
+    for (size_t wad_idx = 0; wad_idx < wads.size(); wad_idx++) {
+        const std::vector<std::string_view>& names = wads[wad_idx];
+        for (size_t texture_idx = 0; texture_idx < names.size(); texture_idx++) {
+            if (!is_valid_name(names[texture_idx])) {
+                continue;
+            }
+            Key key = Key(names[texture_idx]).to_lower();
+            size_t slot = key.hash() & mask;
+            while (!keys[slot].empty() && keys[slot] != key) {
+                slot = (slot + 1) & mask;
+            }
+            // Names which are already in the index come from an earlier WAD or entry, which takes precedence.
+            if (keys[slot].empty()) {
+                keys[slot] = key;
+                refs[slot] = {uint32_t(wad_idx), uint32_t(texture_idx)};
+                num_names++;
+            }
+        }
+    }
+}
+
+bool TextureNameIndex::find(std::string_view name, TextureRef& ref) const {
+    if (num_names == 0 || !is_valid_name(name)) {
+        return false;
+    }
+    Key key = Key(name).to_lower();
+    size_t slot = key.hash() & mask;
+    while (!keys[slot].empty()) {
+        if (keys[slot] == key) {
+            ref = refs[slot];
+            return true;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return false;
+}
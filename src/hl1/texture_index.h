@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "common/inline_string.h"
+
+// Location of a texture found by TextureNameIndex.
+struct TextureRef {
+    // Index of the WAD in the search path.
+    uint32_t wad = 0;
+    // Index of the texture in the WAD.
+    uint32_t texture = 0;
+};
+
+// Case-insensitive index of texture names across the WADs of a search path, the way BSP faces refer to textures.
+// Names are stored lowercase in InlineString keys of an open-addressing table, which are compared a chunk at a time.
+// Once build() has returned, the index is immutable: find() does not lock or write anything and can be called from any
+// number of threads.
+class TextureNameIndex {
+public:
+    // Maximum length of texture names, the size of the name field in WAD files.
+    static constexpr size_t MAX_NAME_LENGTH = 16;
+
+    // Build the index from the texture names of each WAD in search-path order. When several textures have the same
+    // name, the one in the earliest WAD wins, and within one WAD the earliest entry wins, the same as the engine
+    // searching the WADs listed in worldspawn from left to right. Empty names and names longer than MAX_NAME_LENGTH
+    // are skipped.
+    void build(const std::vector<std::vector<std::string_view>>& wads);
+
+    // Find the texture with the name, ignoring ASCII case. Return false if there is none.
+    bool find(std::string_view name, TextureRef& ref) const;
+
+    // Number of unique names in the index.
+    size_t size() const {
+        return num_names;
+    }
+
+    // Lowercase name.
+    using Key = InlineString<MAX_NAME_LENGTH>;
+
+private:
+    // Slots with empty keys are empty, the capacity is a power of two at least twice the number of names.
+    std::vector<Key> keys;
+    std::vector<TextureRef> refs;
+    size_t mask = 0;
+    size_t num_names = 0;
+};
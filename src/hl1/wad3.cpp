@@ -1,10 +1,16 @@
 #include "wad3.h"
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <vector>
 
+#include "common/hash.h"
+#include "common/image.h"
 #include "common/io.h"
 #include "common/slog.h"
+#include "common/thread.h"
 
 
 // See https://twhl.info/wiki/page/Specification:_WAD3 for details
@@ -40,130 +46,257 @@ struct WAD3RawMiptexTrailer {
     uint8_t palette[256 * 3];
 };
 
-bool parse_miptex(const FileContents& file, const WAD3DirEntry& entry, WAD3Miptex& miptex) {
-    if (entry.entry_size < sizeof(WAD3RawMiptexHeader)) {
-        SLOG_ERROR("%s: Entry size for %s must be at least %zu, is %d", file.name.c_str(), entry.texture_name,
-                   sizeof(WAD3RawMiptexHeader), int(entry.entry_size));
+// Return the number of decoded mip levels for the texture.
+int decoded_num_levels(uint32_t width, uint32_t height, const WAD3ParseOptions& options) {
+    if (!options.full_mip_chain) {
+        return WAD3Miptex::NUM_LEVELS;
+    }
+    int max_levels = std::clamp(options.max_levels, WAD3Miptex::NUM_LEVELS, WAD3Miptex::MAX_LEVELS);
+    return std::min(mip_chain_length(width, height), max_levels);
+}
+
+// Return the size of the decoded RGBA mip level, padded to 16 bytes so that every level is aligned.
+size_t decoded_level_size(uint32_t width, uint32_t height, int mip_level) {
+    size_t size = size_t(mip_level_dim(width, mip_level)) * mip_level_dim(height, mip_level) * 4;
+    return (size + 15) & ~size_t(15);
+}
+
+// Return the size of the decoded RGBA data for all mip levels.
+size_t decoded_miptex_size(uint32_t width, uint32_t height, int num_levels) {
+    size_t result = 0;
+    for (int mip_level = 0; mip_level < num_levels; mip_level++) {
+        result += decoded_level_size(width, height, mip_level);
+    }
+    return result;
+}
+
+bool parse_header(const FileContents& file, WAD3Header& header) {
+    if (!file.read_at(0, header)) {
+        SLOG_ERROR("%s: Insufficient data length for header", file.name.c_str());
+        return false;
+    }
+    if (memcmp(header.magic, "WAD3", 4) != 0) {
+        SLOG_ERROR("%s: Invalid magic number (expected 'WAD3')", file.name.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool process_directory(const FileContents& file, const WAD3Header& header, std::vector<WAD3ViewEntry>& entries) {
+    // Read the whole directory at once instead of reading entries one by one. Check the size before allocating, the
+    // number of entries may be garbage.
+    std::vector<WAD3DirEntry> dir_entries;
+    if (header.num_dirs <= file.contents.size() / sizeof(WAD3DirEntry)) {
+        dir_entries.resize(header.num_dirs);
+    }
+    if (dir_entries.size() != header.num_dirs ||
+        !file.read_array_at(header.dir_offset, dir_entries.size(), dir_entries.data())) {
+        SLOG_ERROR("%s: Insufficient data length for directory", file.name.c_str());
         return false;
     }
 
+    const char* contents_ptr = reinterpret_cast<const char*>(file.contents.data());
+    for (size_t i = 0; i < dir_entries.size(); i++) {
+        const WAD3DirEntry& dir_entry = dir_entries[i];
+        if (dir_entry.file_type != MIPTEX_FILE_TYPE) {
+            continue;
+        }
+        if (dir_entry.compressed) {
+            SLOG_ERROR("%s: Got compressed entry %.16s, skipping", file.name.c_str(), dir_entry.texture_name);
+            continue;
+        }
+
+        if (dir_entry.entry_size < sizeof(WAD3RawMiptexHeader)) {
+            SLOG_ERROR("%s: Entry size for %.16s must be at least %zu, is %d", file.name.c_str(),
+                       dir_entry.texture_name, sizeof(WAD3RawMiptexHeader), int(dir_entry.entry_size));
+            continue;
+        }
+
+        WAD3ViewEntry entry;
+        // Point the name into the directory entry in the file rather than into the local copy.
+        const char* name_ptr = contents_ptr + header.dir_offset + i * sizeof(WAD3DirEntry) +
+                               offsetof(WAD3DirEntry, texture_name);
+        entry.name = std::string_view(name_ptr, strnlen(name_ptr, sizeof(dir_entry.texture_name)));
+        if (!entry.parse(Span<const uint8_t>(file.contents.data(), file.contents.size()), dir_entry.entry_offset,
+                         file.name.c_str())) {
+            continue;
+        }
+        entries.push_back(entry);
+    }
+
+    return true;
+}
+
+}  // namespace
+
+bool WAD3ViewEntry::parse(Span<const uint8_t> data, size_t offset, const char* file_name) {
     WAD3RawMiptexHeader header = {};
-    if (!file.read_at(entry.entry_offset, header)) {
-        SLOG_ERROR("%s: Entry %s out of bounds", file.name.c_str(), entry.texture_name);
+    if (offset > data.size() || data.size() - offset < sizeof(header)) {
+        SLOG_ERROR("%s: Entry %.*s out of bounds", file_name, int(name.size()), name.data());
         return false;
     }
+    memcpy(&header, data.data() + offset, sizeof(header));
     if (header.width == 0 || header.height == 0 || (header.width % 16) != 0 || (header.height % 16) != 0) {
-        SLOG_ERROR("%s: Invalid texture dimensions %ux%u for %s", file.name.c_str(), header.width, header.height,
-                   entry.texture_name);
+        SLOG_ERROR("%s: Invalid texture dimensions %ux%u for %.*s", file_name, header.width, header.height,
+                   int(name.size()), name.data());
         return false;
     }
 
-    size_t trailer_offset = entry.entry_offset + header.mip_offsets[3] + header.width * header.height / 64;
-    WAD3RawMiptexTrailer trailer = {};
-    if (!file.read_at(trailer_offset, trailer)) {
-        SLOG_ERROR("%s: Entry %s out of bounds", file.name.c_str(), entry.texture_name);
+    size_t trailer_offset = offset + header.mip_offsets[3] + header.width * header.height / 64;
+    int16_t colors_used = 0;
+    if (trailer_offset + sizeof(WAD3RawMiptexTrailer) > data.size()) {
+        SLOG_ERROR("%s: Entry %.*s out of bounds", file_name, int(name.size()), name.data());
         return false;
     }
+    memcpy(&colors_used, data.data() + trailer_offset, sizeof(colors_used));
 
-    if (trailer.colors_used != 256) {
-        SLOG_ERROR("%s: Invalid number of colors (%d) in palette for %s", file.name.c_str(), trailer.colors_used,
-                   entry.texture_name);
+    if (colors_used != 256) {
+        SLOG_ERROR("%s: Invalid number of colors (%d) in palette for %.*s", file_name, colors_used,
+                   int(name.size()), name.data());
         return false;
     }
 
-    miptex.name = std::string(header.texture_name, strnlen(header.texture_name, 16));
-    miptex.width = header.width;
-    miptex.height = header.height;
-
-    uint32_t width = header.width;
-    uint32_t height = header.height;
     for (int mip_level = 0; mip_level < WAD3Miptex::NUM_LEVELS; mip_level++) {
-        uint32_t mip_offset = header.mip_offsets[mip_level];
-        uint32_t mip_size = width * height;
-        uint32_t absolute_offset = entry.entry_offset + mip_offset;
-        if (absolute_offset + mip_size > file.contents.size()) {
-            SLOG_ERROR("%s: Mipmap %d for %s out of bounds", file.name.c_str(), mip_level, entry.texture_name);
+        size_t mip_size = size_t(header.width >> mip_level) * (header.height >> mip_level);
+        size_t absolute_offset = offset + header.mip_offsets[mip_level];
+        if (absolute_offset + mip_size > data.size()) {
+            SLOG_ERROR("%s: Mipmap %d for %.*s out of bounds", file_name, mip_level, int(name.size()), name.data());
             return false;
         }
+        mip_indices[mip_level] = data.data() + absolute_offset;
+    }
 
-        miptex.mipmaps[mip_level].data.resize(mip_size * 4);
-        uint8_t* data_ptr = miptex.mipmaps[mip_level].data.data();
-        const uint8_t* contents_ptr = file.contents.data();
-        for (size_t i = 0; i < mip_size; i++) {
-            uint8_t color = contents_ptr[absolute_offset + i];
-            uint8_t r = trailer.palette[color * 3];
-            uint8_t g = trailer.palette[color * 3 + 1];
-            uint8_t b = trailer.palette[color * 3 + 2];
-            data_ptr[i * 4] = r;
-            data_ptr[i * 4 + 1] = g;
-            data_ptr[i * 4 + 2] = b;
-            data_ptr[i * 4 + 3] = 255;
-        }
+    width = header.width;
+    height = header.height;
+    palette = data.data() + trailer_offset + offsetof(WAD3RawMiptexTrailer, palette);
 
-        width /= 2;
-        height /= 2;
+    // Everything but the name, so that copies of a texture under different names get the same hash.
+    uint32_t dims[2] = {header.width, header.height};
+    uint64_t content_hash = hash64(dims, sizeof(dims));
+    for (int mip_level = 0; mip_level < WAD3Miptex::NUM_LEVELS; mip_level++) {
+        size_t mip_size = size_t(header.width >> mip_level) * (header.height >> mip_level);
+        content_hash = hash64(mip_indices[mip_level], mip_size, content_hash);
     }
-
+    hash = hash64(palette, 256 * 3, content_hash);
     return true;
 }
 
-bool parse_header(const FileContents& file, WAD3Header& header) {
-    if (!file.read_at(0, header)) {
-        SLOG_ERROR("%s: Insufficient data length for header", file.name.c_str());
-        return false;
+void WAD3ViewEntry::decode_palette(uint32_t* rgba_palette) const {
+    for (int i = 0; i < 256; i++) {
+        uint8_t rgba[4] = {palette[i * 3], palette[i * 3 + 1], palette[i * 3 + 2], 255};
+        memcpy(&rgba_palette[i], rgba, 4);
     }
-    if (memcmp(header.magic, "WAD3", 4) != 0) {
-        SLOG_ERROR("%s: Invalid magic number (expected 'WAD3')", file.name.c_str());
-        return false;
+}
+
+void WAD3ViewEntry::decode_level(int mip_level, const uint32_t* rgba_palette, uint8_t* dst) const {
+    const uint8_t* src = mip_indices[mip_level];
+    size_t mip_size = size_t(width >> mip_level) * (height >> mip_level);
+    for (size_t i = 0; i < mip_size; i++) {
+        memcpy(dst + i * 4, &rgba_palette[src[i]], 4);
     }
-    return true;
 }
 
-bool process_directory(const FileContents& file, const WAD3Header& header, std::vector<WAD3Miptex>& miptexs) {
-    for (size_t i = 0; i < header.num_dirs; i++) {
-        WAD3DirEntry entry = {};
-        if (!file.read_at(header.dir_offset + i * sizeof(WAD3DirEntry), entry)) {
-            SLOG_ERROR("%s: Insufficient data length for directory", file.name.c_str());
+bool WAD3ViewEntry::same_content(const WAD3ViewEntry& other) const {
+    if (width != other.width || height != other.height || memcmp(palette, other.palette, 256 * 3) != 0) {
+        return false;
+    }
+    for (int mip_level = 0; mip_level < WAD3Miptex::NUM_LEVELS; mip_level++) {
+        size_t mip_size = size_t(width >> mip_level) * (height >> mip_level);
+        if (memcmp(mip_indices[mip_level], other.mip_indices[mip_level], mip_size) != 0) {
             return false;
         }
+    }
+    return true;
+}
 
-        if (entry.file_type != MIPTEX_FILE_TYPE) {
-            continue;
-        }
-        if (entry.compressed) {
-            SLOG_ERROR("%s: Got compressed entry %s, skipping", file.name.c_str(), entry.texture_name);
-            continue;
-        }
-
-        WAD3Miptex miptex = {};
-        if (!parse_miptex(file, entry, miptex)) {
-            continue;
-        }
+bool WAD3View::parse(const FileContents& file) {
+    valid = false;
+    name = path_get_filename(file.name.c_str());
+    entries.clear();
 
-        miptexs.push_back(std::move(miptex));
+    WAD3Header header = {};
+    if (!parse_header(file, header)) {
+        return false;
+    }
+    if (!process_directory(file, header, entries)) {
+        return false;
     }
 
+    valid = true;
     return true;
 }
 
-}  // namespace
-
-bool WAD3Parser::parse(const FileContents& file) {
+bool WAD3Parser::parse(const FileContents& file, const WAD3ParseOptions& options) {
     SLOG_INFO("Parsing WAD3 %s", file.name.c_str());
 
     valid = false;
     name = path_get_filename(file.name.c_str());
     miptexs.clear();
+    arena.clear();
 
-
-    WAD3Header header = {};
-    if (!parse_header(file, header)) {
+    WAD3View view;
+    if (!view.parse(file)) {
         return false;
     }
-    if (!process_directory(file, header, miptexs)) {
-        return false;
+    decode(view.entries, options);
+    return true;
+}
+
+void WAD3Parser::decode(const std::vector<WAD3ViewEntry>& entries, const WAD3ParseOptions& options) {
+    miptexs.clear();
+    arena.clear();
+
+    // Indexing is cheap and done by the caller, so that the total decoded size is known and all the textures can be
+    // placed in a single arena block.
+    size_t total_size = 0;
+    for (const WAD3ViewEntry& entry : entries) {
+        int num_levels = decoded_num_levels(entry.width, entry.height, options);
+        total_size += decoded_miptex_size(entry.width, entry.height, num_levels) + Arena::DEFAULT_ALIGNMENT;
+    }
+
+    // All mip levels of a texture are adjacent, each level is padded to 16 bytes.
+    arena.reserve(total_size);
+    miptexs.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        const WAD3ViewEntry& entry = entries[i];
+        WAD3Miptex& miptex = miptexs[i];
+        miptex.name = entry.name;
+        miptex.hash = entry.hash;
+        miptex.width = entry.width;
+        miptex.height = entry.height;
+        miptex.num_levels = decoded_num_levels(entry.width, entry.height, options);
+
+        uint8_t* data = arena.allocate(decoded_miptex_size(entry.width, entry.height, miptex.num_levels));
+        for (int mip_level = 0; mip_level < miptex.num_levels; mip_level++) {
+            size_t level_size = size_t(mip_level_dim(entry.width, mip_level)) *
+                                mip_level_dim(entry.height, mip_level) * 4;
+            miptex.mipmaps[mip_level].data = Span<uint8_t>(data, level_size);
+            data += decoded_level_size(entry.width, entry.height, mip_level);
+        }
+    }
+
+    // Each texture is decoded into its preallocated slot, so the result does not depend on the decoding order.
+    auto decode_entry = [&](size_t i) {
+        WAD3Miptex& miptex = miptexs[i];
+        // Convert palette into RGBA once per texture, so that each pixel is a single 32-bit load and store.
+        uint32_t rgba_palette[256];
+        entries[i].decode_palette(rgba_palette);
+        for (int mip_level = 0; mip_level < WAD3Miptex::NUM_LEVELS; mip_level++) {
+            entries[i].decode_level(mip_level, rgba_palette, miptex.mipmaps[mip_level].data.data());
+        }
+        for (int mip_level = WAD3Miptex::NUM_LEVELS; mip_level < miptex.num_levels; mip_level++) {
+            downsample_rgba8(miptex.mipmaps[mip_level - 1].data.data(), mip_level_dim(miptex.width, mip_level - 1),
+                             mip_level_dim(miptex.height, mip_level - 1), miptex.mipmaps[mip_level].data.data(),
+                             options.gamma_correct_mips);
+        }
+    };
+    if (options.parallel) {
+        thread_pool().run_for(decode_entry, entries.size());
+    } else {
+        for (size_t i = 0; i < entries.size(); i++) {
+            decode_entry(i);
+        }
     }
 
     valid = true;
-    return true;
 }
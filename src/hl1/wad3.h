@@ -2,33 +2,108 @@
 
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "common/arena.h"
+#include "common/inline_string.h"
 #include "common/io.h"
+#include "common/span.h"
 
 
+// Texture name, the 16-byte name field of WAD directory entries.
+using WAD3TextureName = InlineString<16>;
+
 // One mip level of WAD texture.
 struct WAD3MiptexLevel {
-    // RGBA data (alpha is always 255).
-    std::vector<uint8_t> data;
+    // RGBA data (alpha is always 255), points into WAD3Parser::arena.
+    Span<uint8_t> data;
 };
 
 // WAD texture + mipmaps.
 struct WAD3Miptex {
+    // Number of mip levels stored in WAD files.
     static constexpr int NUM_LEVELS = 4;
+    // Maximum number of mip levels, including the generated ones (same as SG_MAX_MIPMAPS).
+    static constexpr int MAX_LEVELS = 16;
 
     // Texture name.
-    std::string name;
+    WAD3TextureName name;
+    // Content hash, see WAD3ViewEntry::hash.
+    uint64_t hash = 0;
+    // Texture dimensions.
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // Number of valid mip levels: NUM_LEVELS, or the generated chain down to 1x1 or to WAD3ParseOptions::max_levels.
+    int num_levels = NUM_LEVELS;
+    WAD3MiptexLevel mipmaps[MAX_LEVELS];
+};
+
+// One texture in WAD3View. All pointers point into the FileContents passed to WAD3View::parse().
+struct WAD3ViewEntry {
+    // Texture name, points into the 16-byte name field of the directory entry.
+    std::string_view name;
     // Texture dimensions.
-    uint32_t width;
-    uint32_t height;
-    WAD3MiptexLevel mipmaps[NUM_LEVELS];
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // Palette indices for each mip level, (width >> level) * (height >> level) bytes per level.
+    const uint8_t* mip_indices[WAD3Miptex::NUM_LEVELS] = {};
+    // 256 RGB palette colors.
+    const uint8_t* palette = nullptr;
+    // Hash of the dimensions, the pixel indices of all mip levels and the palette: byte-identical textures have the
+    // same hash regardless of their names.
+    uint64_t hash = 0;
+
+    // Check that the miptex header at offset of data, all mip levels and the palette are in bounds, and fill the fields
+    // but the name. The name should be set before, it is used in errors along with file_name. Return false if the
+    // miptex is invalid.
+    bool parse(Span<const uint8_t> data, size_t offset, const char* file_name);
+
+    // Convert the palette into 256 RGBA colors (alpha is always 255), one 32-bit value per color.
+    void decode_palette(uint32_t* rgba_palette) const;
+    // Expand palette indices of the mip level into RGBA with the palette from decode_palette(), dst must have room for
+    // 4 bytes per pixel.
+    void decode_level(int mip_level, const uint32_t* rgba_palette, uint8_t* dst) const;
+
+    // Return true if the entries have the same dimensions, pixel indices and palette, i.e. everything the hash covers.
+    bool same_content(const WAD3ViewEntry& other) const;
+};
+
+// Zero-copy index of WAD file from HL1: validates the directory and the miptexs, but does not decode or copy the
+// pixel data. The FileContents must outlive the view.
+struct WAD3View {
+    // Index the file, set valid and other fields. Return false if parsing failed (valid will be false as well).
+    bool parse(const FileContents& file);
+
+    // False if the parse() was not called or returned an error.
+    bool valid = false;
+    // File name.
+    std::string name;
+    // Valid miptex entries in the directory order.
+    std::vector<WAD3ViewEntry> entries;
+};
+
+// Options for WAD3Parser::parse().
+struct WAD3ParseOptions {
+    // Decode directory entries in parallel on thread_pool(). The order of parsed textures is the same as in the
+    // sequential case.
+    bool parallel = false;
+    // Generate mip levels below the stored ones down to 1x1 with a box filter.
+    bool full_mip_chain = false;
+    // Stop the generated chain at max_levels levels, e.g. WAD3Atlas::MAX_PAGE_LEVELS for textures packed into atlas
+    // pages, which downsample the smaller levels from the whole page instead. The stored levels are always decoded.
+    int max_levels = WAD3Miptex::MAX_LEVELS;
+    // Average the colors in linear space when generating mip levels.
+    bool gamma_correct_mips = false;
 };
 
 // Parser for WAD files from HL1.
 struct WAD3Parser {
     // Parse file, set valid and other fields. Return false if parsing failed (valid will be false as well).
-    bool parse(const FileContents& file);
+    bool parse(const FileContents& file, const WAD3ParseOptions& options = {});
+    // Decode the miptexs of the view entries, which may come from WAD3View or from another container such as the
+    // textures lump of a BSP. Set valid, but keep the name.
+    void decode(const std::vector<WAD3ViewEntry>& entries, const WAD3ParseOptions& options = {});
 
     // False if the parse() was not called or returned an error.
     bool valid = false;
@@ -36,4 +111,6 @@ struct WAD3Parser {
     std::string name;
     // Parsed mip textures.
     std::vector<WAD3Miptex> miptexs;
+    // Pixel data of all miptexs: the whole WAD is freed at once and moving the parser does not copy pixels.
+    Arena arena;
 };
@@ -0,0 +1,152 @@
+#include "wad_atlas.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "common/image.h"
+#include "common/slog.h"
+#include "common/thread.h"
+
+
+namespace {
+
+// Writable RGBA8 levels of a page while the textures are copied.
+struct PageLevels {
+    Span<uint8_t> levels[WAD3Miptex::MAX_LEVELS];
+};
+
+// Return the number of levels of the page: the full chain down to 1x1.
+int page_num_levels(uint32_t width, uint32_t height) {
+    return std::min(mip_chain_length(width, height), WAD3Miptex::MAX_LEVELS);
+}
+
+}  // namespace
+
+int WAD3Atlas::max_page_levels(TextureFormat format) {
+    return texture_format_is_compressed(format) ? MAX_COMPRESSED_PAGE_LEVELS : MAX_PAGE_LEVELS;
+}
+
+bool WAD3Atlas::build(const std::vector<WAD3Miptex>& miptexs, const WAD3AtlasOptions& options) {
+    pages.clear();
+    rects.clear();
+    efficiency = 0.0;
+    arena.clear();
+
+    // The textures are copied into the levels all the miptexs have, generated ones included, up to
+    // max_page_levels().
+    std::vector<AtlasSize> sizes(miptexs.size());
+    int num_texture_levels = max_page_levels(options.format);
+    for (size_t i = 0; i < miptexs.size(); i++) {
+        sizes[i] = {miptexs[i].width, miptexs[i].height};
+        num_texture_levels = std::min(num_texture_levels, miptexs[i].num_levels);
+    }
+
+    AtlasPackOptions pack_options;
+    pack_options.page_width = options.page_size;
+    pack_options.page_height = options.page_size;
+    pack_options.padding = PADDING;
+    pack_options.alignment = PADDING;
+    pack_options.parallel = options.parallel;
+    AtlasLayout layout;
+    if (!pack_atlas(sizes, pack_options, layout)) {
+        SLOG_ERROR("Could not pack %zu textures into %ux%u atlas pages", miptexs.size(), options.page_size,
+                   options.page_size);
+        return false;
+    }
+
+    // Compressed pages are composed in a temporary arena.
+    bool compressed = texture_format_is_compressed(options.format);
+    Arena staging_arena;
+    Arena& rgba_arena = compressed ? staging_arena : arena;
+    size_t rgba_size = 0;
+    size_t total_size = 0;
+    for (const AtlasSize& size : layout.pages) {
+        int num_levels = page_num_levels(size.width, size.height);
+        for (int mip_level = 0; mip_level < num_levels; mip_level++) {
+            uint32_t width = mip_level_dim(size.width, mip_level);
+            uint32_t height = mip_level_dim(size.height, mip_level);
+            rgba_size += texture_image_size(TextureFormat::RGBA8, width, height) + Arena::DEFAULT_ALIGNMENT;
+            total_size += texture_image_size(options.format, width, height) + Arena::DEFAULT_ALIGNMENT;
+        }
+    }
+    arena.reserve(total_size);
+    if (compressed) {
+        staging_arena.reserve(rgba_size);
+    }
+    pages.resize(layout.pages.size());
+    std::vector<PageLevels> rgba_levels(layout.pages.size());
+    for (size_t i = 0; i < layout.pages.size(); i++) {
+        WAD3AtlasPage& page = pages[i];
+        page.width = layout.pages[i].width;
+        page.height = layout.pages[i].height;
+        page.num_levels = page_num_levels(page.width, page.height);
+        page.num_texture_levels = std::min(num_texture_levels, page.num_levels);
+        page.format = options.format;
+        for (int mip_level = 0; mip_level < page.num_levels; mip_level++) {
+            size_t level_size = texture_image_size(TextureFormat::RGBA8, mip_level_dim(page.width, mip_level),
+                                                   mip_level_dim(page.height, mip_level));
+            Span<uint8_t>& level = rgba_levels[i].levels[mip_level];
+            level = Span<uint8_t>(rgba_arena.allocate(level_size), level_size);
+            // The gaps between textures are not covered by any padding.
+            if (mip_level < page.num_texture_levels) {
+                memset(level.data(), 0, level_size);
+            }
+        }
+    }
+    rects = std::move(layout.rects);
+    efficiency = layout.efficiency();
+
+    // Padded rectangles do not overlap, so the textures can be copied in parallel.
+    auto copy_texture = [&](size_t i) {
+        const WAD3Miptex& miptex = miptexs[i];
+        const AtlasRect& rect = rects[i];
+        const WAD3AtlasPage& page = pages[rect.page];
+        for (int mip_level = 0; mip_level < page.num_texture_levels; mip_level++) {
+            copy_rgba8_padded(miptex.mipmaps[mip_level].data.data(), mip_level_dim(miptex.width, mip_level),
+                              mip_level_dim(miptex.height, mip_level), rgba_levels[rect.page].levels[mip_level].data(),
+                              mip_level_dim(page.width, mip_level), rect.x >> mip_level, rect.y >> mip_level,
+                              PADDING >> mip_level);
+        }
+    };
+    if (options.parallel) {
+        thread_pool().run_for(copy_texture, miptexs.size());
+    } else {
+        for (size_t i = 0; i < miptexs.size(); i++) {
+            copy_texture(i);
+        }
+    }
+
+    for (size_t i = 0; i < pages.size(); i++) {
+        WAD3AtlasPage& page = pages[i];
+        for (int mip_level = page.num_texture_levels; mip_level < page.num_levels; mip_level++) {
+            downsample_rgba8(rgba_levels[i].levels[mip_level - 1].data(), mip_level_dim(page.width, mip_level - 1),
+                             mip_level_dim(page.height, mip_level - 1), rgba_levels[i].levels[mip_level].data(),
+                             options.gamma_correct_mips);
+        }
+        for (int mip_level = 0; mip_level < page.num_levels; mip_level++) {
+            if (!compressed) {
+                page.levels[mip_level] = rgba_levels[i].levels[mip_level];
+                continue;
+            }
+            uint32_t width = mip_level_dim(page.width, mip_level);
+            uint32_t height = mip_level_dim(page.height, mip_level);
+            size_t level_size = texture_image_size(page.format, width, height);
+            uint8_t* level = arena.allocate(level_size);
+            compress_rgba8(page.format, rgba_levels[i].levels[mip_level].data(), width, height, level,
+                           options.parallel);
+            page.levels[mip_level] = Span<const uint8_t>(level, level_size);
+        }
+    }
+    return true;
+}
+
+void WAD3Atlas::get_uv(size_t idx, float uv0[2], float uv1[2]) const {
+    const AtlasRect& rect = rects[idx];
+    const WAD3AtlasPage& page = pages[rect.page];
+    uv0[0] = float(rect.x) / float(page.width);
+    uv0[1] = float(rect.y) / float(page.height);
+    uv1[0] = float(rect.x + rect.width) / float(page.width);
+    uv1[1] = float(rect.y + rect.height) / float(page.height);
+}
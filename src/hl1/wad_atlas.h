@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "common/arena.h"
+#include "common/atlas.h"
+#include "common/span.h"
+#include "common/texture_compression.h"
+#include "wad3.h"
+
+
+// Options for WAD3Atlas::build().
+struct WAD3AtlasOptions {
+    // Maximum page size.
+    uint32_t page_size = 2048;
+    // Pack, copy and compress textures in parallel on thread_pool().
+    bool parallel = false;
+    // Format of the page levels, compressed pages are composed in RGBA8 and then compressed.
+    TextureFormat format = TextureFormat::RGBA8;
+    // Average the colors in linear space when generating the mip tail of the pages.
+    bool gamma_correct_mips = false;
+};
+
+// One page of WAD3Atlas with mip levels.
+struct WAD3AtlasPage {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // Number of levels in the full chain down to 1x1. Levels below num_texture_levels are the mip tail: they are
+    // downsampled from the whole page, so that the page can be minified further, and do not keep the textures apart.
+    int num_levels = 0;
+    int num_texture_levels = 0;
+    TextureFormat format = TextureFormat::RGBA8;
+    // Data of each mip level in the page format, points into WAD3Atlas::arena (or into a cache file).
+    Span<const uint8_t> levels[WAD3Miptex::MAX_LEVELS];
+};
+
+// Texture atlas for the textures of a WAD file: miptexs are packed into a few large pages, so that they can be drawn
+// from a few GPU images instead of one image per texture.
+struct WAD3Atlas {
+    // Textures are padded by PADDING pixels of replicated edges and placed at multiples of PADDING, so that the mip
+    // level k of a texture is at (x >> k, y >> k) in the mip level k of the page while PADDING >> k is at least 1.
+    // Past that level the textures would no longer start on whole pixels and would blend into their neighbours, so
+    // the textures are copied into at most MAX_PAGE_LEVELS levels even for miptexs with generated chains down to 1x1,
+    // and the loader does not generate the smaller ones (see WAD3ParseOptions::max_levels). The levels below are the
+    // mip tail, downsampled from the whole page. At the last texture level the textures are at least two padding
+    // pixels apart, so each 2x2 box of the first tail level covers a single texture and its replicated edges.
+    //
+    // Compressed pages encode 4x4 blocks, and a block must not cover the texels of two textures, otherwise one pair of
+    // endpoint colors is shared by both and they bleed into each other. The textures are at least 2 * (PADDING >> k)
+    // pixels apart at level k and start on multiples of PADDING >> k, which keeps them in separate blocks while
+    // PADDING >> k is at least 2, so compressed pages have at most MAX_COMPRESSED_PAGE_LEVELS levels.
+    static constexpr int PADDING_LOG2 = 4;
+    static constexpr uint32_t PADDING = 1u << PADDING_LOG2;
+    static constexpr int MAX_PAGE_LEVELS = PADDING_LOG2 + 1;
+    static constexpr int MAX_COMPRESSED_PAGE_LEVELS = PADDING_LOG2;
+
+    // Return the maximum number of levels of the pages in the format.
+    static int max_page_levels(TextureFormat format);
+
+    // Pack miptexs into pages and copy their mip levels. Return false if a texture does not fit into a page.
+    bool build(const std::vector<WAD3Miptex>& miptexs, const WAD3AtlasOptions& options = {});
+
+    // Return texture coordinates of the miptex idx in its page.
+    void get_uv(size_t idx, float uv0[2], float uv1[2]) const;
+
+    // Atlas pages.
+    std::vector<WAD3AtlasPage> pages;
+    // Position of each miptex, in the same order as the miptexs passed to build().
+    std::vector<AtlasRect> rects;
+    // Content area / page area.
+    double efficiency = 0.0;
+    // Pixel data of all pages.
+    Arena arena;
+};
@@ -0,0 +1,566 @@
+#include "wad_cache.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include "common/hash.h"
+#include "common/image.h"
+#include "common/slog.h"
+
+
+namespace {
+
+const uint32_t CACHE_MAGIC = 0x43444157;  // "WADC"
+const uint32_t CACHE_VERSION = 5;
+// Level data is aligned to cache lines, so that it can be uploaded straight from the mapped file.
+const size_t CACHE_ALIGNMENT = 64;
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_size;
+    int64_t source_mtime_ns;
+    uint64_t source_hash;
+    uint64_t shared_hash;
+    uint32_t format;
+    uint32_t source_path_size;
+    uint32_t num_textures;
+    uint32_t num_pages;
+    uint32_t num_rects;
+    uint32_t padding;
+    // Size of the whole file, to detect truncated files, and hash of the header and of the sections before the level
+    // data, to detect corrupt ones. The levels are hashed separately, see CachePage.
+    uint64_t file_size;
+    uint64_t header_hash;
+};
+static_assert(sizeof(CacheHeader) == 80);
+
+struct CacheTexture {
+    char name[16];
+    uint64_t hash;
+    uint64_t content_hash;
+    uint32_t width;
+    uint32_t height;
+    int32_t rect;
+    uint32_t padding;
+};
+static_assert(sizeof(CacheTexture) == 48);
+
+struct CacheRect {
+    uint32_t page;
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+static_assert(sizeof(CacheRect) == 20);
+
+struct CachePage {
+    uint32_t width;
+    uint32_t height;
+    uint32_t num_levels;
+    uint32_t num_texture_levels;
+    // Offsets from the start of the file.
+    uint64_t level_offsets[WAD3Miptex::MAX_LEVELS];
+    // Checked by WAD3Textures::verify_level(), so that loading does not read the levels.
+    uint64_t level_hashes[WAD3Miptex::MAX_LEVELS];
+};
+static_assert(sizeof(CachePage) == 16 + 16 * WAD3Miptex::MAX_LEVELS);
+
+size_t align_up(size_t v) {
+    return (v + CACHE_ALIGNMENT - 1) & ~(CACHE_ALIGNMENT - 1);
+}
+
+// Offsets of the sections: header, source path, textures, pages, rects and then the level data.
+struct CacheLayout {
+    size_t source_path_offset = 0;
+    size_t textures_offset = 0;
+    size_t pages_offset = 0;
+    size_t rects_offset = 0;
+    size_t data_offset = 0;
+
+    CacheLayout(size_t source_path_size, size_t num_textures, size_t num_pages, size_t num_rects) {
+        source_path_offset = sizeof(CacheHeader);
+        textures_offset = align_up(source_path_offset + source_path_size);
+        pages_offset = textures_offset + num_textures * sizeof(CacheTexture);
+        rects_offset = pages_offset + num_pages * sizeof(CachePage);
+        data_offset = align_up(rects_offset + num_rects * sizeof(CacheRect));
+    }
+};
+
+// Return the hash of the header, with header_hash taken as 0, and of the sections up to the level data.
+uint64_t hash_header(CacheHeader header, const uint8_t* data, const CacheLayout& layout) {
+    header.header_hash = 0;
+    uint64_t hash = hash64(&header, sizeof(header));
+    return hash64(data + sizeof(CacheHeader), layout.data_offset - sizeof(CacheHeader), hash);
+}
+
+// Return true if the cache was written for the source file of the key. The contents are not compared if the
+// modification time is the same and older than the cache file (cache_mtime_ns): a file rewritten within the same
+// timestamp tick keeps its time, so a source as new as the cache may have changed after the cache was written.
+// Otherwise the file is hashed unless the key has the hash already. If the file is read and its hash differs, its
+// contents are moved into source.
+bool key_matches(const CacheHeader& header, const char* source_path, const WAD3CacheKey& key, int64_t cache_mtime_ns,
+                 FileContents& source) {
+    if (header.source_size != key.source_size || header.format != uint32_t(key.format) ||
+        header.source_path_size != key.source_path.size() ||
+        memcmp(source_path, key.source_path.data(), key.source_path.size()) != 0) {
+        return false;
+    }
+    if (header.source_mtime_ns == key.source_mtime_ns && key.source_mtime_ns < cache_mtime_ns) {
+        return true;
+    }
+    if (key.source_hash != 0) {
+        return header.source_hash == key.source_hash;
+    }
+    FileContents contents;
+    if (!file_read_contents(key.source_path.c_str(), contents)) {
+        return false;
+    }
+    if (header.source_hash == hash64(contents.contents.data(), contents.contents.size())) {
+        return true;
+    }
+    source = std::move(contents);
+    return false;
+}
+
+// Store the new modification time of the source file in the header of the cache file, so that the next start does not
+// compare the contents again: the write also makes the cache file newer than the source. The mapping is released
+// before the header is updated in place and the file is then mapped again. Return false if it cannot be mapped again
+// or was replaced in between.
+bool update_source_mtime(const char* path, MappedFile& cache_file, CacheHeader& header, const CacheLayout& layout,
+                         int64_t source_mtime_ns) {
+    CacheHeader updated = header;
+    updated.source_mtime_ns = source_mtime_ns;
+    updated.header_hash = hash_header(updated, cache_file.contents().data(), layout);
+    cache_file.close();
+    if (file_write_at(path, 0, &updated, sizeof(updated))) {
+        header = updated;
+    } else {
+        // The cache is still valid, its contents are compared again on the next start.
+        SLOG_ERROR("%s: Could not store the modification time of the source file", path);
+    }
+    if (!cache_file.open(path)) {
+        return false;
+    }
+    Span<const uint8_t> contents = cache_file.contents();
+    if (contents.size() != header.file_size || memcmp(contents.data(), &header, sizeof(header)) != 0) {
+        SLOG_ERROR("%s: Cache file was replaced while loading, rebuilding", path);
+        cache_file.close();
+        return false;
+    }
+    return true;
+}
+
+// Return the hash of a page level, stored in CachePage::level_hashes.
+uint64_t hash_level(Span<const uint8_t> level) {
+    return hash64(level.data(), level.size());
+}
+
+// Entries added from cache files have no pixels, they are compared by their content hash instead.
+bool same_texture(const WAD3ViewEntry& a, const WAD3ViewEntry& b) {
+    if (a.palette == nullptr || b.palette == nullptr) {
+        return a.width == b.width && a.height == b.height && a.hash == b.hash;
+    }
+    return a.same_content(b);
+}
+
+// Fills WAD3SharedTextures with the keys of the textures of a WAD in order.
+struct SharedKeys {
+    WAD3SharedTextures& shared;
+    // Keys which were not added by this WAD are stored by the WADs before.
+    std::unordered_set<uint64_t> new_keys;
+
+    explicit SharedKeys(WAD3SharedTextures& shared) : shared(shared) {
+        shared.keys.clear();
+        shared.stored_keys.clear();
+    }
+
+    // Add the key of the next texture, stored is true if the key was added before.
+    void add(uint64_t key, bool stored) {
+        shared.keys.push_back(key);
+        if (!stored) {
+            new_keys.insert(key);
+        } else if (new_keys.count(key) == 0) {
+            shared.stored_keys.push_back(key);
+        }
+    }
+
+    void finish() {
+        std::sort(shared.stored_keys.begin(), shared.stored_keys.end());
+        shared.stored_keys.erase(std::unique(shared.stored_keys.begin(), shared.stored_keys.end()),
+                                 shared.stored_keys.end());
+    }
+};
+
+}  // namespace
+
+uint64_t WAD3ContentKeys::add(const WAD3ViewEntry& entry, bool& stored) {
+    uint64_t key = entry.hash;
+    while (true) {
+        auto [it, inserted] = entries.emplace(key, entry);
+        if (inserted || same_texture(it->second, entry)) {
+            stored = !inserted;
+            return key;
+        }
+        // A hash collision: the bytes differ, so the texture must not be merged.
+        key = hash64(&key, sizeof(key), key);
+    }
+}
+
+void WAD3ContentKeys::add_wad(const std::vector<WAD3ViewEntry>& wad_entries, WAD3SharedTextures& shared) {
+    SharedKeys shared_keys(shared);
+    for (const WAD3ViewEntry& entry : wad_entries) {
+        bool stored = false;
+        uint64_t key = add(entry, stored);
+        shared_keys.add(key, stored);
+    }
+    shared_keys.finish();
+}
+
+bool WAD3ContentKeys::add_cached_wad(const std::vector<WAD3TextureInfo>& textures, uint64_t shared_hash,
+                                     WAD3SharedTextures& shared) {
+    SharedKeys shared_keys(shared);
+    std::vector<uint64_t> new_keys;
+    bool keys_match = true;
+    for (const WAD3TextureInfo& texture : textures) {
+        WAD3ViewEntry entry;
+        entry.width = texture.width;
+        entry.height = texture.height;
+        entry.hash = texture.content_hash;
+        // Probed again rather than taken from the cache, which may have been built when another texture had the key.
+        bool stored = false;
+        uint64_t key = add(entry, stored);
+        if (!stored) {
+            new_keys.push_back(key);
+        }
+        keys_match = keys_match && key == texture.hash;
+        shared_keys.add(key, stored);
+    }
+    shared_keys.finish();
+    if (keys_match && wad3_shared_hash(shared) == shared_hash) {
+        return true;
+    }
+    for (uint64_t key : new_keys) {
+        entries.erase(key);
+    }
+    return false;
+}
+
+bool WAD3CacheKey::init(const char* path, TextureFormat texture_format) {
+    FileStat stat;
+    if (!file_stat(path, stat)) {
+        return false;
+    }
+    source_path = path;
+    source_size = stat.size;
+    source_mtime_ns = stat.mtime_ns;
+    source_hash = 0;
+    format = texture_format;
+    return true;
+}
+
+bool WAD3CacheKey::init(const FileContents& file, TextureFormat texture_format) {
+    if (!init(file.name.c_str(), texture_format)) {
+        SLOG_ERROR("%s: Could not get file size and modification time", file.name.c_str());
+        return false;
+    }
+    source_hash = hash64(file.contents.data(), file.contents.size());
+    return true;
+}
+
+uint64_t wad3_shared_hash(const WAD3SharedTextures& shared) {
+    uint64_t hash = hash64(shared.keys.data(), shared.keys.size() * sizeof(uint64_t));
+    return hash64(shared.stored_keys.data(), shared.stored_keys.size() * sizeof(uint64_t), hash);
+}
+
+std::string wad3_cache_path(const char* wad_path) {
+    return std::string(wad_path) + ".cache";
+}
+
+bool WAD3Textures::build(const FileContents& file, const WAD3ParseOptions& parse_options,
+                         const WAD3AtlasOptions& atlas_options, const WAD3SharedTextures& shared) {
+    name = path_get_filename(file.name.c_str());
+    textures.clear();
+    shared_hash = wad3_shared_hash(shared);
+    cache_file.close();
+    level_hashes.clear();
+    verified_levels.clear();
+
+    SLOG_INFO("Parsing WAD3 %s", file.name.c_str());
+    WAD3View view;
+    if (!view.parse(file)) {
+        return false;
+    }
+    // The keys are computed here if the caller did not, so that copies within the WAD are still merged.
+    WAD3SharedTextures own_keys;
+    const std::vector<uint64_t>* keys = &shared.keys;
+    if (keys->empty()) {
+        WAD3ContentKeys content_keys;
+        content_keys.add_wad(view.entries, own_keys);
+        keys = &own_keys.keys;
+    }
+    if (keys->size() != view.entries.size()) {
+        SLOG_ERROR("%s: %zu content keys for %zu textures", file.name.c_str(), keys->size(), view.entries.size());
+        return false;
+    }
+    // Only the first copy of each texture is decoded and packed. Equal keys mean equal bytes, see WAD3ContentKeys.
+    std::vector<WAD3ViewEntry> packed_entries;
+    std::unordered_map<uint64_t, int> packed_rects;
+    size_t num_copies = 0;
+    textures.resize(view.entries.size());
+    for (size_t i = 0; i < view.entries.size(); i++) {
+        const WAD3ViewEntry& entry = view.entries[i];
+        WAD3TextureInfo& texture = textures[i];
+        texture.name = entry.name;
+        texture.hash = (*keys)[i];
+        texture.content_hash = entry.hash;
+        texture.width = entry.width;
+        texture.height = entry.height;
+        if (std::binary_search(shared.stored_keys.begin(), shared.stored_keys.end(), texture.hash)) {
+            continue;
+        }
+        auto [it, inserted] = packed_rects.emplace(texture.hash, int(packed_entries.size()));
+        texture.rect = it->second;
+        if (inserted) {
+            packed_entries.push_back(entry);
+        } else {
+            num_copies++;
+        }
+    }
+    if (num_copies > 0) {
+        SLOG_INFO("%s: %zu textures are copies of other textures in the WAD", file.name.c_str(), num_copies);
+    }
+    WAD3Parser wad;
+    wad.decode(packed_entries, parse_options);
+    return atlas.build(wad.miptexs, atlas_options);
+}
+
+bool WAD3Textures::load_cache(const char* path, const WAD3CacheKey& key, FileContents* source) {
+    name = path_get_filename(key.source_path.c_str());
+    textures.clear();
+    atlas.pages.clear();
+    atlas.rects.clear();
+    atlas.efficiency = 0.0;
+    atlas.arena.clear();
+    level_hashes.clear();
+    verified_levels.clear();
+
+    FileStat stat;
+    if (!file_stat(path, stat)) {
+        // First start, nothing to log.
+        return false;
+    }
+    if (!cache_file.open(path)) {
+        return false;
+    }
+    Span<const uint8_t> contents = cache_file.contents();
+
+    CacheHeader header;
+    if (contents.size() < sizeof(CacheHeader)) {
+        SLOG_ERROR("%s: Cache file is truncated", path);
+        cache_file.close();
+        return false;
+    }
+    memcpy(&header, contents.data(), sizeof(header));
+    if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.file_size != contents.size()) {
+        SLOG_INFO("%s: Cache file is from another version or truncated, rebuilding", path);
+        cache_file.close();
+        return false;
+    }
+    // The counts are checked before the layout is computed from them, so that the offsets cannot overflow.
+    if (header.source_path_size > contents.size() || header.num_textures > contents.size() ||
+        header.num_pages > contents.size() || header.num_rects > contents.size()) {
+        SLOG_ERROR("%s: Cache file is corrupt, rebuilding", path);
+        cache_file.close();
+        return false;
+    }
+    CacheLayout layout(header.source_path_size, header.num_textures, header.num_pages, header.num_rects);
+    if (layout.data_offset > contents.size() || hash_header(header, contents.data(), layout) != header.header_hash) {
+        SLOG_ERROR("%s: Cache file is corrupt, rebuilding", path);
+        cache_file.close();
+        return false;
+    }
+    FileContents read_source;
+    if (!key_matches(header, reinterpret_cast<const char*>(contents.data() + layout.source_path_offset), key,
+                     stat.mtime_ns, read_source)) {
+        SLOG_INFO("%s: Source file has changed, rebuilding", path);
+        cache_file.close();
+        if (source != nullptr) {
+            *source = std::move(read_source);
+        }
+        return false;
+    }
+    if (header.source_mtime_ns != key.source_mtime_ns || key.source_mtime_ns >= stat.mtime_ns) {
+        // The file was touched or copied, or written in the same tick as the cache, but its contents are the same.
+        if (!update_source_mtime(path, cache_file, header, layout, key.source_mtime_ns)) {
+            return false;
+        }
+        contents = cache_file.contents();
+    }
+
+    // The hash matches, so the header was written by save_cache() and the remaining checks are for internal
+    // consistency.
+    atlas.pages.resize(header.num_pages);
+    level_hashes.assign(size_t(header.num_pages) * WAD3Miptex::MAX_LEVELS, 0);
+    uint64_t page_area = 0;
+    for (size_t i = 0; i < header.num_pages; i++) {
+        CachePage cache_page;
+        memcpy(&cache_page, contents.data() + layout.pages_offset + i * sizeof(CachePage), sizeof(cache_page));
+        WAD3AtlasPage& page = atlas.pages[i];
+        page.width = cache_page.width;
+        page.height = cache_page.height;
+        page.num_levels = int(cache_page.num_levels);
+        page.num_texture_levels = int(cache_page.num_texture_levels);
+        page.format = key.format;
+        if (cache_page.num_levels < 1 || cache_page.num_levels > uint32_t(WAD3Miptex::MAX_LEVELS) ||
+            cache_page.num_texture_levels < 1 || cache_page.num_texture_levels > cache_page.num_levels) {
+            SLOG_ERROR("%s: Invalid number of levels %u (%u with textures) in page %zu", path, cache_page.num_levels,
+                       cache_page.num_texture_levels, i);
+            cache_file.close();
+            return false;
+        }
+        for (int mip_level = 0; mip_level < page.num_levels; mip_level++) {
+            size_t level_size = texture_image_size(page.format, mip_level_dim(page.width, mip_level),
+                                                   mip_level_dim(page.height, mip_level));
+            uint64_t offset = cache_page.level_offsets[mip_level];
+            if (offset < layout.data_offset || offset % CACHE_ALIGNMENT != 0 || offset > contents.size() ||
+                level_size > contents.size() - offset) {
+                SLOG_ERROR("%s: Level %d of page %zu out of bounds", path, mip_level, i);
+                cache_file.close();
+                return false;
+            }
+            page.levels[mip_level] = contents.subspan(size_t(offset), level_size);
+            level_hashes[i * WAD3Miptex::MAX_LEVELS + size_t(mip_level)] = cache_page.level_hashes[mip_level];
+        }
+        page_area += uint64_t(page.width) * page.height;
+    }
+
+    atlas.rects.resize(header.num_rects);
+    uint64_t content_area = 0;
+    for (size_t i = 0; i < header.num_rects; i++) {
+        CacheRect rect;
+        memcpy(&rect, contents.data() + layout.rects_offset + i * sizeof(CacheRect), sizeof(rect));
+        if (rect.page >= header.num_pages || uint64_t(rect.x) + rect.width > atlas.pages[rect.page].width ||
+            uint64_t(rect.y) + rect.height > atlas.pages[rect.page].height) {
+            SLOG_ERROR("%s: Rect %zu out of page bounds", path, i);
+            cache_file.close();
+            return false;
+        }
+        atlas.rects[i] = {rect.page, rect.x, rect.y, rect.width, rect.height};
+        content_area += uint64_t(rect.width) * rect.height;
+    }
+    atlas.efficiency = page_area > 0 ? double(content_area) / double(page_area) : 0.0;
+
+    textures.resize(header.num_textures);
+    for (size_t i = 0; i < header.num_textures; i++) {
+        CacheTexture cache_texture;
+        memcpy(&cache_texture, contents.data() + layout.textures_offset + i * sizeof(CacheTexture),
+               sizeof(cache_texture));
+        if (cache_texture.rect < -1 || cache_texture.rect >= int32_t(header.num_rects)) {
+            SLOG_ERROR("%s: Invalid rect %d for texture %zu", path, cache_texture.rect, i);
+            cache_file.close();
+            return false;
+        }
+        WAD3TextureInfo& texture = textures[i];
+        texture.name = std::string_view(cache_texture.name, strnlen(cache_texture.name, sizeof(cache_texture.name)));
+        texture.hash = cache_texture.hash;
+        texture.content_hash = cache_texture.content_hash;
+        texture.width = cache_texture.width;
+        texture.height = cache_texture.height;
+        texture.rect = cache_texture.rect;
+    }
+    shared_hash = header.shared_hash;
+    verified_levels.assign(header.num_pages, 0);
+    return true;
+}
+
+bool WAD3Textures::save_cache(const char* path, const WAD3CacheKey& key) const {
+    CacheLayout layout(key.source_path.size(), textures.size(), atlas.pages.size(), atlas.rects.size());
+    size_t file_size = layout.data_offset;
+    for (const WAD3AtlasPage& page : atlas.pages) {
+        for (int mip_level = 0; mip_level < page.num_levels; mip_level++) {
+            file_size = align_up(file_size + page.levels[mip_level].size());
+        }
+    }
+
+    std::vector<uint8_t> data(file_size, 0);
+    memcpy(data.data() + layout.source_path_offset, key.source_path.data(), key.source_path.size());
+    for (size_t i = 0; i < textures.size(); i++) {
+        const WAD3TextureInfo& texture = textures[i];
+        CacheTexture cache_texture = {};
+        std::string_view name_view = texture.name.view();
+        memcpy(cache_texture.name, name_view.data(), std::min(name_view.size(), sizeof(cache_texture.name)));
+        cache_texture.hash = texture.hash;
+        cache_texture.content_hash = texture.content_hash;
+        cache_texture.width = texture.width;
+        cache_texture.height = texture.height;
+        cache_texture.rect = texture.rect;
+        memcpy(data.data() + layout.textures_offset + i * sizeof(CacheTexture), &cache_texture, sizeof(cache_texture));
+    }
+    for (size_t i = 0; i < atlas.rects.size(); i++) {
+        const AtlasRect& rect = atlas.rects[i];
+        CacheRect cache_rect = {rect.page, rect.x, rect.y, rect.width, rect.height};
+        memcpy(data.data() + layout.rects_offset + i * sizeof(CacheRect), &cache_rect, sizeof(cache_rect));
+    }
+    size_t offset = layout.data_offset;
+    for (size_t i = 0; i < atlas.pages.size(); i++) {
+        const WAD3AtlasPage& page = atlas.pages[i];
+        CachePage cache_page = {};
+        cache_page.width = page.width;
+        cache_page.height = page.height;
+        cache_page.num_levels = uint32_t(page.num_levels);
+        cache_page.num_texture_levels = uint32_t(page.num_texture_levels);
+        for (int mip_level = 0; mip_level < page.num_levels; mip_level++) {
+            cache_page.level_offsets[mip_level] = offset;
+            cache_page.level_hashes[mip_level] = hash_level(page.levels[mip_level]);
+            memcpy(data.data() + offset, page.levels[mip_level].data(), page.levels[mip_level].size());
+            offset = align_up(offset + page.levels[mip_level].size());
+        }
+        memcpy(data.data() + layout.pages_offset + i * sizeof(CachePage), &cache_page, sizeof(cache_page));
+    }
+
+    CacheHeader header = {};
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.source_size = key.source_size;
+    header.source_mtime_ns = key.source_mtime_ns;
+    header.source_hash = key.source_hash;
+    header.shared_hash = shared_hash;
+    header.format = uint32_t(key.format);
+    header.source_path_size = uint32_t(key.source_path.size());
+    header.num_textures = uint32_t(textures.size());
+    header.num_pages = uint32_t(atlas.pages.size());
+    header.num_rects = uint32_t(atlas.rects.size());
+    header.file_size = file_size;
+    header.header_hash = hash_header(header, data.data(), layout);
+    memcpy(data.data(), &header, sizeof(header));
+
+    std::string tmp_path = std::string(path) + ".tmp";
+    if (!file_write_contents(tmp_path.c_str(), data.data(), data.size())) {
+        return false;
+    }
+    return file_rename(tmp_path.c_str(), path);
+}
+
+bool WAD3Textures::verify_level(uint32_t page, int mip_level) {
+    if (level_hashes.empty() || (verified_levels[page] & (1u << mip_level)) != 0) {
+        return true;
+    }
+    uint64_t hash = level_hashes[size_t(page) * WAD3Miptex::MAX_LEVELS + size_t(mip_level)];
+    if (hash_level(atlas.pages[page].levels[mip_level]) != hash) {
+        // The next start rebuilds the cache.
+        SLOG_ERROR("%s: Level %d of page %u is corrupt, removing the file", cache_file.name().c_str(), mip_level, page);
+        remove(cache_file.name().c_str());
+        return false;
+    }
+    verified_levels[page] |= 1u << mip_level;
+    return true;
+}
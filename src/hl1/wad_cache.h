@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common/io.h"
+#include "common/texture_compression.h"
+#include "wad3.h"
+#include "wad_atlas.h"
+
+
+// One texture of WAD3Textures.
+struct WAD3TextureInfo {
+    WAD3TextureName name;
+    // Content key, see WAD3ContentKeys: the content hash unless it collides with a different texture.
+    uint64_t hash = 0;
+    // Content hash, see WAD3ViewEntry::hash.
+    uint64_t content_hash = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // Index in atlas.rects, or -1 if the texture is a copy of a texture with the same key which is stored by another
+    // WAD or earlier in this one.
+    int rect = -1;
+};
+
+// Content keys of the textures of a WAD, from WAD3ContentKeys::add_wad().
+struct WAD3SharedTextures {
+    // Key of each entry of WAD3View::entries, or empty to take the keys of a WAD which shares nothing.
+    std::vector<uint64_t> keys;
+    // Sorted keys of the textures stored by other WADs.
+    std::vector<uint64_t> stored_keys;
+};
+
+// Assigns content keys to the textures of a sequence of WADs. The key is the content hash, unless the hash is taken by
+// a texture with different bytes: the key is then hashed again until it is free or the bytes match. Byte-identical
+// textures share a key and different textures never do. The entries must outlive this object.
+struct WAD3ContentKeys {
+    // Return the key of the entry and set stored to true if a texture with the same bytes was added before.
+    uint64_t add(const WAD3ViewEntry& entry, bool& stored);
+    // Add the entries of the next WAD and fill its keys and the keys of its textures stored by the WADs before.
+    void add_wad(const std::vector<WAD3ViewEntry>& wad_entries, WAD3SharedTextures& shared);
+    // Same as add_wad() for a WAD loaded from its cache file: the keys are probed from the content hashes and sizes in
+    // the cache instead of the pixels, so the WAD is not read. The pixels of these textures are not known, later
+    // entries are compared to them by their content hash. Return false and add nothing if the keys differ from the
+    // ones in the cache or do not hash to shared_hash (e.g. the cache was built against other WADs), the WAD must then
+    // be rebuilt and added with add_wad().
+    bool add_cached_wad(const std::vector<WAD3TextureInfo>& textures, uint64_t shared_hash,
+                        WAD3SharedTextures& shared);
+
+    // Key -> first entry with the key, without pixels for the textures added by add_cached_wad().
+    std::unordered_map<uint64_t, WAD3ViewEntry> entries;
+};
+
+// Identifies the source WAD file and the texture format of a cache file. The file is identified by its path, size and
+// modification time, the hash of its contents is only compared when the modification time differs (e.g. the file was
+// copied) or is not older than the cache file, so that warm starts do not read unchanged WADs.
+struct WAD3CacheKey {
+    std::string source_path;
+    uint64_t source_size = 0;
+    int64_t source_mtime_ns = 0;
+    // Hash of the file contents, 0 if not known yet: WAD3Textures::load_cache() then hashes the file if it needs to.
+    uint64_t source_hash = 0;
+    TextureFormat format = TextureFormat::RGBA8;
+
+    // Fill the key from the metadata of the file, without reading it. Return false if the file does not exist.
+    bool init(const char* path, TextureFormat texture_format);
+    // Fill the key from the contents of the file and the metadata of file.name, for WAD3Textures::save_cache(). Return
+    // false if the file does not exist anymore.
+    bool init(const FileContents& file, TextureFormat texture_format);
+};
+
+// Return the hash of the keys, which identifies the layout of the textures built with them.
+uint64_t wad3_shared_hash(const WAD3SharedTextures& shared);
+
+// Return the path of the cache file of the WAD file, the cache is stored next to it.
+std::string wad3_cache_path(const char* wad_path);
+
+// Textures of a WAD file ready for display: the texture list and the atlas pages. They are either built from the WAD
+// file or loaded from its cache file, so that warm starts skip parsing and packing.
+struct WAD3Textures {
+    // Parse the WAD file and pack its textures into an atlas. Byte-identical textures are packed once, and the textures
+    // with keys in shared.stored_keys are not packed at all. Return false if shared.keys are not the keys of the file.
+    bool build(const FileContents& file, const WAD3ParseOptions& parse_options, const WAD3AtlasOptions& atlas_options,
+               const WAD3SharedTextures& shared = {});
+
+    // Map the cache file and point the atlas pages into it. Return false if the file is missing, was written for a
+    // different key or its header is corrupt. Only the header and the texture list are checked here, the page levels
+    // are checked by verify_level() when they are used. The caller compares shared_hash to the keys of the WAD.
+    // If the contents were compared and match, the new time is stored in the cache file. If the source file was read
+    // to compare its contents and they differ, the contents are moved into source (if not null), so that the caller
+    // does not read the file again; otherwise source is left as is.
+    bool load_cache(const char* path, const WAD3CacheKey& key, FileContents* source = nullptr);
+    // Write the cache file. The file is written to a temporary file first and then renamed over the old one, so that
+    // readers never see partial files.
+    bool save_cache(const char* path, const WAD3CacheKey& key) const;
+
+    // Check the mip level of the atlas page against its hash in the cache file, once. Levels of atlases built from the
+    // WAD are not checked. Return false if the level is corrupt.
+    bool verify_level(uint32_t page, int mip_level);
+
+    // WAD file name.
+    std::string name;
+    // All the textures in the WAD, including the copies.
+    std::vector<WAD3TextureInfo> textures;
+    WAD3Atlas atlas;
+    // Hash of the WAD3SharedTextures passed to build(), see wad3_shared_hash().
+    uint64_t shared_hash = 0;
+    // Backing storage of the atlas pages loaded from the cache.
+    MappedFile cache_file;
+    // Hashes of the page levels in the cache file, WAD3Miptex::MAX_LEVELS per page. Empty if the atlas was built.
+    std::vector<uint64_t> level_hashes;
+    // Bit mip_level of each page is set once the level has been verified.
+    std::vector<uint32_t> verified_levels;
+};
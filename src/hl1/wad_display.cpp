@@ -2,47 +2,279 @@
 
 #include <imgui.h>
 #include <sokol_app.h>
+#include <sokol_time.h>
 #include <util/sokol_imgui.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string_view>
+
+#include "common/defer.h"
+#include "common/image.h"
 #include "common/slog.h"
-#include "wad3.h"
+#include "common/thread.h"
+#include "texture_filter.h"
+
+
+namespace {
+
+sg_pixel_format to_sg_pixel_format(TextureFormat format) {
+    switch (format) {
+        case TextureFormat::BC1:
+            return SG_PIXELFORMAT_BC1_RGBA;
+        case TextureFormat::ETC2_RGB8:
+            return SG_PIXELFORMAT_ETC2_RGB8;
+        default:
+            return SG_PIXELFORMAT_RGBA8;
+    }
+}
+
+// Return the size of the mip chain of the texture as it would be stored in an atlas page.
+size_t texture_chain_size(TextureFormat format, uint32_t width, uint32_t height) {
+    size_t size = 0;
+    for (int level = 0; level < WAD3Atlas::max_page_levels(format); level++) {
+        size += texture_image_size(format, mip_level_dim(width, level), mip_level_dim(height, level));
+    }
+    return size;
+}
 
+bool is_format_supported(TextureFormat format) {
+    sg_pixelformat_info info = sg_query_pixelformat(to_sg_pixel_format(format));
+    return info.sample && info.filter;
+}
+
+// Return the sizes of the mip levels of the page.
+void page_level_bytes(const WAD3AtlasPage& page, size_t* level_bytes) {
+    for (int mip_level = 0; mip_level < page.num_levels; mip_level++) {
+        level_bytes[mip_level] = page.levels[mip_level].size();
+    }
+}
+
+}  // namespace
+
+void WAD3Display::init(size_t gpu_budget, size_t upload_budget_per_frame) {
+    texture_format = TextureFormat::RGBA8;
+    for (TextureFormat format : {TextureFormat::BC1, TextureFormat::ETC2_RGB8}) {
+        if (is_format_supported(format)) {
+            texture_format = format;
+            break;
+        }
+    }
+
+    sg_sampler_desc sampler_desc = {};
+    sampler_desc.min_filter = SG_FILTER_LINEAR;
+    sampler_desc.mag_filter = SG_FILTER_LINEAR;
+    sampler_desc.mipmap_filter = SG_FILTER_LINEAR;
+    sampler = sg_make_sampler(sampler_desc);
+    page_residency.set_budget(gpu_budget);
+    page_residency.set_max_resident(MAX_RESIDENT_PAGES);
+    upload_budget = upload_budget_per_frame;
+}
+
+void WAD3Display::add_wad(WAD3Textures&& textures, uint32_t search_order) {
+    const WAD3Atlas& atlas = textures.atlas;
+    uint32_t first_page = uint32_t(pages.size());
+    for (uint32_t page_idx = 0; page_idx < uint32_t(atlas.pages.size()); page_idx++) {
+        const WAD3AtlasPage& page = atlas.pages[page_idx];
+        size_t bytes = 0;
+        for (int mip_level = 0; mip_level < page.num_levels; mip_level++) {
+            bytes += page.levels[mip_level].size();
+        }
+        PageEntry page_entry;
+        page_entry.source = uint32_t(sources.size());
+        page_entry.source_page = page_idx;
+        pages.push_back(page_entry);
+        page_residency.add(bytes);
+        page_bytes += bytes;
+    }
 
-void WAD3Display::add_wad(const WAD3Parser& wad) {
     WADEntry wad_entry;
-    wad_entry.name = wad.name;
-    for (const WAD3Miptex& miptex : wad.miptexs) {
+    wad_entry.name = textures.name;
+    wad_entry.search_order = search_order;
+    wad_entry.textures.reserve(textures.textures.size());
+    PendingWAD pending;
+    pending.wad = uint32_t(wads.size());
+    pending.source = uint32_t(sources.size());
+    pending.first_page = first_page;
+    pending_wads.push_back(pending);
+    num_queued_textures += textures.textures.size();
+    wads.push_back(std::move(wad_entry));
+    sources.push_back(std::move(textures));
+}
+
+bool WAD3Display::add_pending_textures(size_t max_bytes, double max_ms) {
+    uint64_t start = stm_now();
+    size_t bytes = 0;
+    size_t pending_idx = 0;
+    for (; pending_idx < pending_wads.size(); pending_idx++) {
+        PendingWAD& pending = pending_wads[pending_idx];
+        WAD3Textures& textures = sources[pending.source];
+        WADEntry& wad_entry = wads[pending.wad];
+        while (pending.next_texture < textures.textures.size()) {
+            if (bytes >= max_bytes || stm_ms(stm_since(start)) >= max_ms) {
+                break;
+            }
+            const WAD3TextureInfo& texture = textures.textures[pending.next_texture];
+            TextureEntry entry;
+            entry.name = texture.name;
+            entry.hash = texture.hash;
+            entry.width = texture.width;
+            entry.height = texture.height;
+            wad_entry.textures.push_back(std::move(entry));
+
+            num_textures++;
+            if (texture.rect < 0) {
+                num_shared_textures++;
+                shared_bytes += texture_chain_size(texture_format, texture.width, texture.height);
+            } else {
+                const WAD3Atlas& atlas = textures.atlas;
+                TextureLocation location;
+                location.page = pending.first_page + atlas.rects[texture.rect].page;
+                atlas.get_uv(size_t(texture.rect), location.uv0, location.uv1);
+                texture_locations.emplace(texture.hash, location);
+                bytes += thumbnails.add_texture(textures, pending.next_texture);
+            }
+            pending.next_texture++;
+        }
+        if (pending.next_texture < textures.textures.size()) {
+            break;
+        }
+    }
+    pending_wads.erase(pending_wads.begin(), pending_wads.begin() + ptrdiff_t(pending_idx));
+    return pending_wads.empty();
+}
+
+bool WAD3Display::finish_loading(size_t max_bytes, double max_ms) {
+    if (!finishing) {
+        finishing = true;
+        finish_latch.reset(1);
+        thread_pool().submit([this]() {
+            DEFER(finish_latch.count_down());
+            build_indices();
+        });
+        return false;
+    }
+    if (!finish_latch.done()) {
+        return false;
+    }
+
+    uint64_t start = stm_now();
+    size_t bytes = 0;
+    while (thumbnail_pages.size() < thumbnails.pages.size()) {
+        // A page larger than the whole budget gets a frame of its own.
+        if (bytes > 0 && (bytes >= max_bytes || stm_ms(stm_since(start)) >= max_ms)) {
+            break;
+        }
+        const WAD3ThumbnailPage& page = thumbnails.pages[thumbnail_pages.size()];
         sg_image_desc img_desc = {};
-        img_desc.width = int(miptex.width);
-        img_desc.height = int(miptex.height);
+        img_desc.width = int(page.width);
+        img_desc.height = int(page.height);
         img_desc.pixel_format = SG_PIXELFORMAT_RGBA8;
-        img_desc.data.mip_levels[0].ptr = miptex.mipmaps[0].data.data();
-        img_desc.data.mip_levels[0].size = miptex.mipmaps[0].data.size();
-        sg_image image = sg_make_image(img_desc);
-        sg_view_desc view_desc = {};
-        view_desc.texture.image = image;
-        sg_view image_view = sg_make_view(view_desc);
+        img_desc.data.mip_levels[0].ptr = page.pixels.data();
+        img_desc.data.mip_levels[0].size = page.pixels.size();
+        PageEntry page_entry;
+        page_entry.failed = !page_entry.create(img_desc);
+        thumbnail_pages.push_back(page_entry);
+        bytes += page.pixels.size();
+    }
+    if (thumbnail_pages.size() < thumbnails.pages.size()) {
+        return false;
+    }
+    update_filter();
+    loading = false;
+    return true;
+}
 
-        TextureEntry entry;
-        entry.name = miptex.name;
-        entry.image = image;
-        entry.image_view = image_view;
-        entry.width = miptex.width;
-        entry.height = miptex.height;
-        wad_entry.textures.push_back(std::move(entry));
+void WAD3Display::build_indices() {
+    std::stable_sort(wads.begin(), wads.end(),
+                     [](const WADEntry& a, const WADEntry& b) { return a.search_order < b.search_order; });
+    std::vector<std::vector<std::string_view>> wad_names(wads.size());
+    for (size_t i = 0; i < wads.size(); i++) {
+        for (const TextureEntry& texture : wads[i].textures) {
+            wad_names[i].push_back(texture.name);
+        }
     }
-    wads.push_back(std::move(wad_entry));
+    texture_index.build(wad_names);
+
+    lower_names.clear();
+    for (WADEntry& wad : wads) {
+        wad.first_texture = uint32_t(lower_names.size());
+        for (const TextureEntry& texture : wad.textures) {
+            lower_names.push_back(texture.name.to_lower());
+        }
+    }
+
+    // Large sets of thumbnails are downsampled rather than dropped.
+    thumbnails.build(THUMBNAIL_PAGE_SIZE, MAX_THUMBNAIL_PAGES);
+}
+
+void WAD3Display::update_filter() {
+    std::string_view filter = filter_buffer;
+    // Large sets of names are scanned on thread_pool(), the order of the matches stays the same.
+    std::vector<uint32_t> matches;
+    filter_texture_names(lower_names, filter, matches, true);
+    size_t match_idx = 0;
+    grid_items.clear();
+    for (int wad_idx = 0; wad_idx < int(wads.size()); wad_idx++) {
+        WADEntry& wad = wads[wad_idx];
+        wad.matches.clear();
+        uint32_t end = wad.first_texture + uint32_t(wad.textures.size());
+        for (; match_idx < matches.size() && matches[match_idx] < end; match_idx++) {
+            uint32_t texture_idx = matches[match_idx] - wad.first_texture;
+            wad.matches.push_back(texture_idx);
+            auto thumbnail = thumbnails.thumbnail_indices.find(wad.textures[texture_idx].hash);
+            int thumbnail_idx = thumbnail != thumbnails.thumbnail_indices.end() ? int(thumbnail->second) : -1;
+            grid_items.push_back({wad_idx, int(texture_idx), thumbnail_idx});
+        }
+    }
+    has_filter_ref = texture_index.find(filter, filter_ref);
+    tree_rows_dirty = true;
+}
+
+void WAD3Display::update_tree_rows() {
+    tree_rows.clear();
+    for (int wad_idx = 0; wad_idx < int(wads.size()); wad_idx++) {
+        const WADEntry& wad = wads[wad_idx];
+        tree_rows.push_back({wad_idx, -1});
+        if (wad.open) {
+            for (uint32_t texture_idx : wad.matches) {
+                tree_rows.push_back({wad_idx, int(texture_idx)});
+            }
+        }
+    }
+    tree_rows_dirty = false;
 }
 
 void WAD3Display::render() {
+    page_residency.next_frame();
+    frame_upload_bytes = 0;
+    stream_pages();
     ImGui::SetNextWindowSize(ImVec2(800, 600), ImGuiCond_FirstUseEver);
     if (ImGui::Begin("WAD Texture Browser")) {
+        if (loading && finishing) {
+            // The WADs are being sorted on thread_pool().
+            ImGui::Text("Loading: indexing %zu textures...", num_textures);
+            ImGui::ProgressBar(1.0f);
+            ImGui::End();
+            return;
+        }
         if (loading) {
-            ImGui::Text("Loading (%zu complete)...", wads.size());
+            ImGui::Text("Loading: %zu WADs, %zu of %zu textures added...", wads.size(), num_textures,
+                        num_queued_textures);
+            float progress = num_queued_textures > 0 ? float(num_textures) / float(num_queued_textures) : 0.0f;
+            ImGui::ProgressBar(progress);
             ImGui::End();
             return;
         }
 
+        const double mib = 1024 * 1024;
+        ImGui::Text("%zu textures, %zu shared, %.1f MiB of pages, %.1f MiB saved by sharing", num_textures,
+                    num_shared_textures, double(page_bytes) / mib, double(shared_bytes) / mib);
+        ImGui::Text("GPU: %zu of %zu pages, %.1f MiB of %.1f MiB budget, %.1f MiB uploaded",
+                    page_residency.num_resident(), pages.size(), double(page_residency.resident_bytes()) / mib,
+                    double(page_residency.budget()) / mib, double(uploaded_bytes) / mib);
+
         if (ImGui::BeginTable("WAD BrowserTable", 2, ImGuiTableFlags_Resizable | ImGuiTableFlags_BordersInnerV)) {
             ImGui::TableSetupColumn("WAD Tree View", ImGuiTableColumnFlags_WidthFixed, 300.0f);
             ImGui::TableSetupColumn("WAD Image Preview", ImGuiTableColumnFlags_WidthStretch);
@@ -50,64 +282,45 @@ void WAD3Display::render() {
             ImGui::TableNextRow();
             ImGui::TableSetColumnIndex(0);
 
-            char filter_buffer[1000];
-            strncpy(filter_buffer, filter_text.c_str(), sizeof(filter_buffer) - 1);
-            filter_buffer[sizeof(filter_buffer) - 1] = '\0';
+            if (ImGui::RadioButton("Tree", !grid_view)) {
+                grid_view = false;
+            }
+            ImGui::SameLine();
+            if (ImGui::RadioButton("Grid", grid_view)) {
+                grid_view = true;
+            }
             if (ImGui::InputText("Filter", filter_buffer, sizeof(filter_buffer))) {
-                filter_text = filter_buffer;
+                update_filter();
             }
-            if (!filter_text.empty()) {
+            if (filter_buffer[0] != '\0') {
                 ImGui::SameLine();
                 if (ImGui::SmallButton("X")) {
-                    filter_text.clear();
+                    filter_buffer[0] = '\0';
+                    update_filter();
                 }
             }
+            // Show which texture a map referring to the name would use.
+            if (has_filter_ref) {
+                const WADEntry& wad = wads[filter_ref.wad];
+                std::string_view texture_name = wad.textures[filter_ref.texture].name.view();
+                ImGui::TextDisabled("Maps use %.*s from %s", int(texture_name.size()), texture_name.data(),
+                                    wad.name.c_str());
+            }
 
-            ImGui::BeginChild("WADTreeViewWindow", ImVec2(0, 0), ImGuiChildFlags_Borders);
-            for (int wad_idx = 0; wad_idx < int(wads.size()); wad_idx++) {
-                const WADEntry& wad = wads[wad_idx];
-
-                if (ImGui::TreeNodeEx(wad.name.c_str(), ImGuiTreeNodeFlags_SpanFullWidth)) {
-                    for (int texture_idx = 0; texture_idx < int(wad.textures.size()); texture_idx++) {
-                        const TextureEntry& texture = wad.textures[texture_idx];
-                        bool matches = true;
-                        if (!filter_text.empty()) {
-                            matches = texture.name.find(filter_text) != std::string::npos;
-                        }
-
-                        if (matches) {
-                            ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen |
-                                                       ImGuiTreeNodeFlags_SpanFullWidth;
-                            if (selected_wad_index == wad_idx && selected_texture_index == texture_idx) {
-                                flags |= ImGuiTreeNodeFlags_Selected;
-                            }
-
-                            if (ImGui::TreeNodeEx(texture.name.c_str(), flags)) {
-                                if (ImGui::IsItemClicked()) {
-                                    selected_wad_index = wad_idx;
-                                    selected_texture_index = texture_idx;
-                                }
-                            }
-
-                            if (ImGui::IsItemHovered()) {
-                                ImGui::BeginTooltip();
-                                ImGui::Text("Size: %ux%u", texture.width, texture.height);
-                                ImGui::EndTooltip();
-                            }
-                        }
-                    }
-                    ImGui::TreePop();
-                }
+            if (grid_view) {
+                render_grid();
+            } else {
+                render_tree();
             }
-            ImGui::EndChild();
 
             ImGui::TableSetColumnIndex(1);
 
             if (ImGui::BeginChild("WADImagePreviewWindow")) {
                 if (selected_wad_index >= 0 && selected_texture_index >= 0) {
                     const TextureEntry& selected_texture = wads[selected_wad_index].textures[selected_texture_index];
-                    ImGui::Text("Texture: %s, size: %ux%u", selected_texture.name.c_str(), selected_texture.width,
-                                selected_texture.height);
+                    std::string_view texture_name = selected_texture.name.view();
+                    ImGui::Text("Texture: %.*s, size: %ux%u", int(texture_name.size()), texture_name.data(),
+                                selected_texture.width, selected_texture.height);
                     ImGui::Checkbox("Scale", &scale_image);
                     ImGui::Separator();
 
@@ -119,8 +332,23 @@ void WAD3Display::render() {
                         image_size.y *= min_scale;
                     }
 
-                    ImTextureID tex_id = ImTextureID(simgui_imtextureid(selected_texture.image_view));
-                    ImGui::Image(tex_id, image_size);
+                    auto location = texture_locations.find(selected_texture.hash);
+                    if (location != texture_locations.end()) {
+                        const TextureLocation& loc = location->second;
+                        sg_view page_view = use_page(loc.page);
+                        if (page_view.id != SG_INVALID_ID) {
+                            ImTextureID tex_id = ImTextureID(simgui_imtextureid_with_sampler(page_view, sampler));
+                            ImGui::Image(tex_id, image_size, ImVec2(loc.uv0[0], loc.uv0[1]),
+                                         ImVec2(loc.uv1[0], loc.uv1[1]));
+                        } else {
+                            ImGui::Text("The atlas page of the texture could not be uploaded.");
+                        }
+                        if (pages[loc.page].uploaded_level > 0) {
+                            ImGui::TextDisabled("Streaming, mip level %d", pages[loc.page].uploaded_level);
+                        }
+                    } else {
+                        ImGui::Text("The texture is stored by a WAD which failed to load.");
+                    }
                 }
             }
             ImGui::EndChild();
@@ -129,23 +357,259 @@ void WAD3Display::render() {
         }
     }
     ImGui::End();
+    evict_pages();
+}
+
+sg_view WAD3Display::use_page(uint32_t page) {
+    PageEntry& entry = pages[page];
+    if (page_residency.use(page)) {
+        return entry.image_view;
+    }
+    // Something is shown right away: at least the smallest level, more if the frame budget allows.
+    const WAD3AtlasPage& source = sources[entry.source].atlas.pages[entry.source_page];
+    size_t level_bytes[WAD3Miptex::MAX_LEVELS];
+    page_level_bytes(source, level_bytes);
+    size_t budget_left = upload_budget > frame_upload_bytes ? upload_budget - frame_upload_bytes : 0;
+    upload_page_stage(page, next_mip_stage(level_bytes, source.num_levels, source.num_levels, budget_left, true));
+    if (entry.uploaded_level > 0) {
+        streaming_pages.push_back(page);
+    }
+    return entry.image_view;
+}
+
+void WAD3Display::upload_page_stage(uint32_t page, int first_level) {
+    PageEntry& entry = pages[page];
+    entry.destroy();
+    if (entry.failed) {
+        return;
+    }
+    WAD3Textures& textures = sources[entry.source];
+    const WAD3AtlasPage& source = textures.atlas.pages[entry.source_page];
+    for (int mip_level = first_level; mip_level < source.num_levels; mip_level++) {
+        if (!textures.verify_level(entry.source_page, mip_level)) {
+            entry.failed = true;
+            return;
+        }
+    }
+    // The stage is a smaller image with the same layout, so the texture coordinates do not change.
+    sg_image_desc img_desc = {};
+    img_desc.width = int(mip_level_dim(source.width, first_level));
+    img_desc.height = int(mip_level_dim(source.height, first_level));
+    img_desc.pixel_format = to_sg_pixel_format(source.format);
+    img_desc.num_mipmaps = source.num_levels - first_level;
+    size_t stage_bytes = 0;
+    for (int mip_level = first_level; mip_level < source.num_levels; mip_level++) {
+        img_desc.data.mip_levels[mip_level - first_level].ptr = source.levels[mip_level].data();
+        img_desc.data.mip_levels[mip_level - first_level].size = source.levels[mip_level].size();
+        stage_bytes += source.levels[mip_level].size();
+    }
+    if (!entry.create(img_desc)) {
+        entry.failed = true;
+        return;
+    }
+    frame_upload_bytes += stage_bytes;
+    uploaded_bytes += stage_bytes;
+    entry.uploaded_level = first_level;
+}
+
+void WAD3Display::stream_pages() {
+    size_t num_streaming = 0;
+    for (uint32_t page : streaming_pages) {
+        PageEntry& entry = pages[page];
+        // Evicted pages start over from the smallest level when they are used again.
+        if (entry.uploaded_level <= 0) {
+            continue;
+        }
+        const WAD3AtlasPage& source = sources[entry.source].atlas.pages[entry.source_page];
+        size_t level_bytes[WAD3Miptex::MAX_LEVELS];
+        page_level_bytes(source, level_bytes);
+        size_t budget_left = upload_budget > frame_upload_bytes ? upload_budget - frame_upload_bytes : 0;
+        // A stage larger than the whole budget gets a frame of its own.
+        int stage =
+            next_mip_stage(level_bytes, source.num_levels, entry.uploaded_level, budget_left, frame_upload_bytes == 0);
+        if (stage >= 0) {
+            upload_page_stage(page, stage);
+        }
+        if (entry.uploaded_level > 0) {
+            streaming_pages[num_streaming++] = page;
+        }
+    }
+    streaming_pages.resize(num_streaming);
+}
+
+void WAD3Display::evict_pages() {
+    // The evicted pages are not referenced by this frame's draw commands.
+    std::vector<uint32_t> evicted;
+    page_residency.evict(evicted);
+    for (uint32_t page : evicted) {
+        pages[page].destroy();
+    }
+}
+
+void WAD3Display::render_tree() {
+    ImGui::BeginChild("WADTreeViewWindow", ImVec2(0, 0), ImGuiChildFlags_Borders);
+    if (tree_rows_dirty) {
+        update_tree_rows();
+    }
+    // Only the rows in view are emitted, so the cost does not depend on the number of textures.
+    ImGuiListClipper clipper;
+    clipper.Begin(int(tree_rows.size()));
+    while (clipper.Step()) {
+        for (int row_idx = clipper.DisplayStart; row_idx < clipper.DisplayEnd; row_idx++) {
+            const TreeRow& row = tree_rows[row_idx];
+            WADEntry& wad = wads[row.wad];
+            if (row.texture < 0) {
+                ImGui::SetNextItemOpen(wad.open);
+                bool open = ImGui::TreeNodeEx(reinterpret_cast<void*>(intptr_t(row.wad)),
+                                              ImGuiTreeNodeFlags_SpanFullWidth |
+                                                  ImGuiTreeNodeFlags_NoTreePushOnOpen,
+                                              "%s", wad.name.c_str());
+                if (open != wad.open) {
+                    wad.open = open;
+                    tree_rows_dirty = true;
+                }
+                continue;
+            }
+
+            const TextureEntry& texture = wad.textures[row.texture];
+            ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen |
+                                       ImGuiTreeNodeFlags_SpanFullWidth;
+            if (selected_wad_index == row.wad && selected_texture_index == row.texture) {
+                flags |= ImGuiTreeNodeFlags_Selected;
+            }
+
+            ImGui::Indent();
+            // Texture IDs follow the WAD IDs, names are not unique across WADs.
+            void* id = reinterpret_cast<void*>(intptr_t(wads.size() + wad.first_texture + row.texture));
+            if (ImGui::TreeNodeEx(id, flags, "%.*s", int(texture.name.size()), texture.name.view().data())) {
+                if (ImGui::IsItemClicked()) {
+                    selected_wad_index = row.wad;
+                    selected_texture_index = row.texture;
+                }
+            }
+
+            if (ImGui::IsItemHovered()) {
+                ImGui::BeginTooltip();
+                ImGui::Text("Size: %ux%u", texture.width, texture.height);
+                ImGui::EndTooltip();
+            }
+            ImGui::Unindent();
+        }
+    }
+    clipper.End();
+    ImGui::EndChild();
+}
+
+void WAD3Display::render_grid() {
+    ImGui::SliderInt("Size", &thumbnail_cell_size, 32, 128);
+    ImGui::BeginChild("WADGridWindow", ImVec2(0, 0), ImGuiChildFlags_Borders);
+    const ImGuiStyle& style = ImGui::GetStyle();
+    float cell = float(thumbnail_cell_size);
+    ImVec2 step(cell + style.ItemSpacing.x, cell + style.ItemSpacing.y);
+    int num_columns = std::max(1, int((ImGui::GetContentRegionAvail().x + style.ItemSpacing.x) / step.x));
+    int num_rows = (int(grid_items.size()) + num_columns - 1) / num_columns;
+    ImDrawList* draw_list = ImGui::GetWindowDrawList();
+    bool window_hovered = ImGui::IsWindowHovered();
+
+    // The clipper works on rows of num_columns cells, each row a Dummy item for the layout. The cells of the visible
+    // rows are then drawn at positions computed from the start of the first one.
+    ImGuiListClipper clipper;
+    clipper.Begin(num_rows, step.y);
+    while (clipper.Step()) {
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+            ImGui::Dummy(ImVec2(step.x * float(num_columns), cell));
+        }
+        int first_item = clipper.DisplayStart * num_columns;
+        int end_item = std::min(int(grid_items.size()), clipper.DisplayEnd * num_columns);
+        auto cell_min = [&](int item_idx) {
+            int row = item_idx / num_columns - clipper.DisplayStart;
+            int column = item_idx % num_columns;
+            return ImVec2(origin.x + float(column) * step.x, origin.y + float(row) * step.y);
+        };
+
+        // Quads are emitted page by page, so that ImGui merges the thumbnails of each page into one draw command.
+        for (uint32_t page = 0; page < uint32_t(thumbnail_pages.size()); page++) {
+            if (thumbnail_pages[page].failed) {
+                continue;
+            }
+            ImTextureID tex_id =
+                ImTextureID(simgui_imtextureid_with_sampler(thumbnail_pages[page].image_view, sampler));
+            for (int item_idx = first_item; item_idx < end_item; item_idx++) {
+                const GridItem& item = grid_items[item_idx];
+                if (item.thumbnail < 0 || thumbnails.thumbnails[item.thumbnail].page != page) {
+                    continue;
+                }
+                const WAD3Thumbnail& thumbnail = thumbnails.thumbnails[item.thumbnail];
+                const TextureEntry& texture = wads[item.wad].textures[item.texture];
+                // Keep the aspect ratio, centered in the cell.
+                float scale = cell / float(std::max(texture.width, texture.height));
+                ImVec2 size(float(texture.width) * scale, float(texture.height) * scale);
+                ImVec2 p0 = cell_min(item_idx);
+                p0.x += (cell - size.x) * 0.5f;
+                p0.y += (cell - size.y) * 0.5f;
+                draw_list->AddImage(tex_id, p0, ImVec2(p0.x + size.x, p0.y + size.y),
+                                    ImVec2(thumbnail.uv0[0], thumbnail.uv0[1]),
+                                    ImVec2(thumbnail.uv1[0], thumbnail.uv1[1]));
+            }
+        }
+
+        for (int item_idx = first_item; item_idx < end_item; item_idx++) {
+            const GridItem& item = grid_items[item_idx];
+            ImVec2 p0 = cell_min(item_idx);
+            ImVec2 p1(p0.x + cell, p0.y + cell);
+            if (selected_wad_index == item.wad && selected_texture_index == item.texture) {
+                draw_list->AddRect(p0, p1, IM_COL32(255, 200, 0, 255), 0.0f, 0, 2.0f);
+            }
+            if (window_hovered && ImGui::IsMouseHoveringRect(p0, p1)) {
+                const TextureEntry& texture = wads[item.wad].textures[item.texture];
+                ImGui::SetTooltip("%.*s, size: %ux%u", int(texture.name.size()), texture.name.view().data(),
+                                  texture.width, texture.height);
+                if (ImGui::IsMouseClicked(ImGuiMouseButton_Left)) {
+                    selected_wad_index = item.wad;
+                    selected_texture_index = item.texture;
+                }
+            }
+        }
+    }
+    clipper.End();
+    ImGui::EndChild();
 }
 
 void WAD3Display::destroy() {
-    for (WADEntry& entry : wads) {
+    // build_indices() may still be running if the app quits while loading.
+    if (finishing) {
+        finish_latch.wait();
+    }
+    for (PageEntry& entry : pages) {
+        entry.destroy();
+    }
+    for (PageEntry& entry : thumbnail_pages) {
         entry.destroy();
     }
+    sg_destroy_sampler(sampler);
+    sampler = {0};
 }
 
-void WAD3Display::WADEntry::destroy() {
-    for (TextureEntry& entry : textures) {
-        entry.destroy();
+bool WAD3Display::PageEntry::create(const sg_image_desc& img_desc) {
+    image = sg_make_image(img_desc);
+    if (sg_query_image_state(image) == SG_RESOURCESTATE_VALID) {
+        sg_view_desc view_desc = {};
+        view_desc.texture.image = image;
+        image_view = sg_make_view(view_desc);
+        if (sg_query_view_state(image_view) == SG_RESOURCESTATE_VALID) {
+            return true;
+        }
     }
+    SLOG_ERROR("Could not create a %dx%d image", img_desc.width, img_desc.height);
+    destroy();
+    return false;
 }
 
-void WAD3Display::TextureEntry::destroy() {
+void WAD3Display::PageEntry::destroy() {
     sg_destroy_view(image_view);
     image_view = {0};
     sg_destroy_image(image);
     image = {0};
+    uploaded_level = -1;
 }
@@ -4,16 +4,58 @@
 
 #include <cstdint>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "common/inline_string.h"
+#include "common/residency.h"
 #include "common/struct.h"
-#include "wad3.h"
+#include "common/sync.h"
+#include "common/texture_compression.h"
+#include "texture_index.h"
+#include "wad_cache.h"
+#include "wad_thumbnails.h"
 
 
 // Display for WAD files from HL1.
 struct WAD3Display {
-    // Add a new WAD file to display.
-    void add_wad(const WAD3Parser& wad);
+    // Default GPU memory budget for the atlas pages, and default budget for the uploads in one frame.
+    static constexpr size_t DEFAULT_GPU_BUDGET = size_t(256) << 20;
+    static constexpr size_t DEFAULT_UPLOAD_BUDGET = size_t(4) << 20;
+    // Maximum number of resident atlas pages, whatever their size, and of thumbnail pages (each one holds thousands of
+    // thumbnails, and the thumbnails are downsampled if they need more pages, see WAD3Thumbnails::build()).
+    static constexpr size_t MAX_RESIDENT_PAGES = 192;
+    static constexpr size_t MAX_THUMBNAIL_PAGES = 8;
+    static constexpr uint32_t THUMBNAIL_PAGE_SIZE = 2048;
+    // Number of images, and of views, the display needs at most: sg_desc::image_pool_size and view_pool_size must leave
+    // room for them. Only the preview makes a page resident within a frame, so the resident pages go over their
+    // maximum by at most one before they are evicted.
+    static constexpr int NUM_IMAGES = int(MAX_RESIDENT_PAGES + 1 + MAX_THUMBNAIL_PAGES);
+
+    // Initialize WAD3Display and select texture_format. Must be called after sg_setup(). The atlas pages are uploaded
+    // when they are needed, and the least recently used ones are released once they take more than gpu_budget bytes
+    // or there are more than MAX_RESIDENT_PAGES of them. Pages are streamed smallest mip levels first, uploading about
+    // upload_budget bytes per frame.
+    void init(size_t gpu_budget = DEFAULT_GPU_BUDGET, size_t upload_budget = DEFAULT_UPLOAD_BUDGET);
+
+    // Add a new WAD file to display, the textures are drawn from its atlas pages. The pages should be in
+    // texture_format. Textures stored by other WADs are drawn once those WADs are added. search_order is the position
+    // of the WAD in the search path, WADs can be added in any order. The textures are kept, so that evicted pages can
+    // be uploaded again. Only the pages are registered here, the textures are added by add_pending_textures().
+    void add_wad(WAD3Textures&& textures, uint32_t search_order);
+
+    // Add the textures of the added WADs one by one until max_bytes of thumbnails were copied or max_ms milliseconds
+    // have passed, so that loading does not stall frames. Return true if no textures are left.
+    bool add_pending_textures(size_t max_bytes, double max_ms);
+
+    // Called every frame after all WADs have been added and add_pending_textures() has returned true, until it returns
+    // true and loading is false. The first call starts sorting the WADs in search path order, building texture_index,
+    // the lowercase names and the thumbnail pages on thread_pool(). Once they are built, the thumbnail pages are
+    // uploaded until max_bytes were uploaded or max_ms milliseconds have passed, at least one page per frame.
+    bool finish_loading(size_t max_bytes, double max_ms);
+    // The part of finish_loading() which runs on thread_pool(). The main thread does not touch the WADs and the
+    // thumbnails until it is done.
+    void build_indices();
 
     // Render a new ImGui window. Must be called after ImGui::Frame().
     void render();
@@ -21,29 +63,147 @@ struct WAD3Display {
     // Clears the resources.
     void destroy();
 
-    struct TextureEntry {
-        std::string name;
+    // Recompute the matches of all WADs after filter_buffer has changed.
+    void update_filter();
+    // Recompute tree_rows after the filter or the open WADs have changed.
+    void update_tree_rows();
+    // Render the tree or the thumbnail grid of the matching textures into the current ImGui window.
+    void render_tree();
+    void render_grid();
+    // Return the view of the atlas page, uploading its smallest mip levels if it is not resident, and mark it as used
+    // in this frame.
+    sg_view use_page(uint32_t page);
+    // Recreate the image of the page from its mip level first_level and all the smaller ones.
+    void upload_page_stage(uint32_t page, int first_level);
+    // Upload the next stages of the streamed pages within the upload budget. Called before the ImGui frame is built,
+    // so that the replaced views are not referenced by draw commands.
+    void stream_pages();
+    // Release the pages which are over the GPU budget and were not used in this frame.
+    void evict_pages();
+
+    struct PageEntry {
         sg_image image = {0};
         sg_view image_view = {0};
-        uint32_t width = 0;
-        uint32_t height = 0;
+        // Index in sources and in its atlas pages.
+        uint32_t source = 0;
+        uint32_t source_page = 0;
+        // Finest mip level of the page in image, or -1 if it is not resident.
+        int uploaded_level = -1;
+        // The page could not be uploaded, it is not drawn.
+        bool failed = false;
 
+        // Create the image and its view. Return false and leave the entry empty if the backend could not create them.
+        bool create(const sg_image_desc& img_desc);
         // Clears the resources.
         void destroy();
     };
 
+    struct TextureEntry {
+        WAD3TextureName name;
+        // Content key, see WAD3ContentKeys, the key in texture_locations.
+        uint64_t hash = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+    };
+
+    // Where the pixels of a texture are, shared by all the byte-identical textures.
+    struct TextureLocation {
+        // Index in pages.
+        uint32_t page = 0;
+        float uv0[2] = {};
+        float uv1[2] = {};
+    };
+
     struct WADEntry {
         std::string name;
+        uint32_t search_order = 0;
         std::vector<TextureEntry> textures;
+        // Index of the first texture in lower_names.
+        uint32_t first_texture = 0;
+        // Indices in textures which match the filter.
+        std::vector<uint32_t> matches;
+        bool open = false;
+    };
 
-        // Clears the resources.
-        void destroy();
+    // Visible row of the tree: a WAD or one of its matching textures.
+    struct TreeRow {
+        int wad = 0;
+        // Index in WADEntry::textures, or -1 for the WAD row.
+        int texture = -1;
+    };
+
+    // WAD whose textures are not all added yet.
+    struct PendingWAD {
+        // Index in wads and in sources.
+        uint32_t wad = 0;
+        uint32_t source = 0;
+        // Index of the first page of the WAD in pages.
+        uint32_t first_page = 0;
+        uint32_t next_texture = 0;
+    };
+
+    // Cell of the thumbnail grid.
+    struct GridItem {
+        int wad = 0;
+        int texture = 0;
+        // Index in thumbnails.thumbnails, or -1 if the WAD storing the texture failed to load.
+        int thumbnail = -1;
     };
 
     bool loading = true;
+    // Set by the first finish_loading() call, finish_latch is done once build_indices() has finished.
+    bool finishing = false;
+    TaskLatch finish_latch;
+    // Most compact format supported by the backend: BC1 on desktop, ETC2 on GLES3 / WebGL2, RGBA8 otherwise.
+    TextureFormat texture_format = TextureFormat::RGBA8;
+    // Trilinear sampler for all textures, so that the scaled down previews use the mip chain.
+    sg_sampler sampler = {0};
+    // Atlas pages of all WADs, the index is also the id in page_residency.
+    std::vector<PageEntry> pages;
+    ResidencyLRU page_residency;
+    // Textures of the WADs in the order they were added, the CPU copy of the atlas pages.
+    std::vector<WAD3Textures> sources;
+    // Resident pages which do not have all their mip levels yet, in the order they were first used.
+    std::vector<uint32_t> streaming_pages;
+    size_t upload_budget = DEFAULT_UPLOAD_BUDGET;
+    // Bytes uploaded in the current frame.
+    size_t frame_upload_bytes = 0;
+    // Sorted by search_order once loading has finished.
     std::vector<WADEntry> wads;
+    // Texture names of all WADs, TextureRef::wad is the index in wads. Valid once loading has finished.
+    TextureNameIndex texture_index;
+    std::unordered_map<uint64_t, TextureLocation> texture_locations;
+    // WADs with textures left to add, in the order they were added.
+    std::vector<PendingWAD> pending_wads;
+    // Number of textures in all the added WADs, and the number of those added so far, including the copies.
+    size_t num_queued_textures = 0;
+    size_t num_textures = 0;
+    // Number of textures which share the pixels of another texture.
+    size_t num_shared_textures = 0;
+    // Size of all the atlas pages, and the memory saved by sharing textures instead of packing them again.
+    size_t page_bytes = 0;
+    size_t shared_bytes = 0;
+    // Total size of the uploads, including the pages uploaded again after eviction.
+    size_t uploaded_bytes = 0;
     int selected_wad_index = -1;
     int selected_texture_index = -1;
-    std::string filter_text;
+    // Lowercase names of the textures of all WADs in wads order, for the filter.
+    std::vector<WAD3TextureName> lower_names;
+    // Edited in place by ImGui, longer than any texture name.
+    char filter_buffer[64] = {};
+    // Texture which maps would use for the name in filter_buffer, if any.
+    bool has_filter_ref = false;
+    TextureRef filter_ref;
+    // Rows of the tree, only the visible ones are emitted each frame.
+    std::vector<TreeRow> tree_rows;
+    bool tree_rows_dirty = true;
+    // Show the thumbnail grid instead of the tree.
+    bool grid_view = false;
+    // Matching textures of all WADs in the grid.
+    std::vector<GridItem> grid_items;
+    int thumbnail_cell_size = 64;
+    // Thumbnails of all textures, collected from the WADs as they are added and packed when loading finishes.
+    WAD3Thumbnails thumbnails;
+    std::vector<PageEntry> thumbnail_pages;
     bool scale_image = false;
 };
@@ -0,0 +1,170 @@
+#include "wad_thumbnails.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "common/atlas.h"
+#include "common/image.h"
+#include "common/slog.h"
+#include "common/texture_compression.h"
+
+
+namespace {
+
+// Return the smallest mip level of the texture which still covers THUMBNAIL_SIZE, or 0 for smaller textures.
+int thumbnail_level(uint32_t width, uint32_t height, int num_levels) {
+    int level = 0;
+    while (level + 1 < num_levels && std::max(mip_level_dim(width, level + 1), mip_level_dim(height, level + 1)) >=
+                                         WAD3Thumbnails::THUMBNAIL_SIZE) {
+        level++;
+    }
+    return level;
+}
+
+// Copy width x height pixels at (x, y) of the page level into dst as RGBA8. For compressed pages only the blocks
+// covering the rectangle are decoded.
+void copy_page_rect(const WAD3AtlasPage& page, int level, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+                    uint8_t* dst) {
+    uint32_t page_width = mip_level_dim(page.width, level);
+    const uint8_t* src = page.levels[level].data();
+    if (!texture_format_is_compressed(page.format)) {
+        for (uint32_t row = 0; row < height; row++) {
+            memcpy(dst + size_t(row) * width * 4, src + ((size_t(y) + row) * page_width + x) * 4, size_t(width) * 4);
+        }
+        return;
+    }
+
+    size_t block_size = texture_image_size(page.format, 4, 4);
+    size_t page_blocks_x = (page_width + 3) / 4;
+    uint32_t block_x0 = x / 4;
+    uint32_t block_y0 = y / 4;
+    uint32_t num_blocks_x = (x + width + 3) / 4 - block_x0;
+    uint32_t num_blocks_y = (y + height + 3) / 4 - block_y0;
+    std::vector<uint8_t> blocks(num_blocks_x * num_blocks_y * block_size);
+    for (uint32_t row = 0; row < num_blocks_y; row++) {
+        memcpy(&blocks[row * num_blocks_x * block_size],
+               src + ((block_y0 + row) * page_blocks_x + block_x0) * block_size, num_blocks_x * block_size);
+    }
+    uint32_t decoded_width = num_blocks_x * 4;
+    std::vector<uint8_t> decoded(size_t(decoded_width) * num_blocks_y * 4 * 4);
+    decompress_rgba8(page.format, blocks.data(), decoded_width, num_blocks_y * 4, decoded.data());
+    for (uint32_t row = 0; row < height; row++) {
+        memcpy(dst + size_t(row) * width * 4,
+               &decoded[((size_t(y - block_y0 * 4) + row) * decoded_width + (x - block_x0 * 4)) * 4],
+               size_t(width) * 4);
+    }
+}
+
+}  // namespace
+
+void WAD3Thumbnails::add(WAD3Textures& textures) {
+    for (size_t texture_idx = 0; texture_idx < textures.textures.size(); texture_idx++) {
+        add_texture(textures, texture_idx);
+    }
+}
+
+size_t WAD3Thumbnails::add_texture(WAD3Textures& textures, size_t texture_idx) {
+    const WAD3TextureInfo& texture = textures.textures[texture_idx];
+    if (texture.rect < 0 || thumbnail_indices.count(texture.hash) != 0) {
+        return 0;
+    }
+    const WAD3Atlas& atlas = textures.atlas;
+    const AtlasRect& rect = atlas.rects[texture.rect];
+    const WAD3AtlasPage& page = atlas.pages[rect.page];
+    int level = thumbnail_level(rect.width, rect.height, page.num_texture_levels);
+    if (!textures.verify_level(rect.page, level)) {
+        return 0;
+    }
+
+    WAD3Thumbnail thumbnail;
+    thumbnail.width = mip_level_dim(rect.width, level);
+    thumbnail.height = mip_level_dim(rect.height, level);
+    size_t offset = staging.size();
+    size_t size = size_t(thumbnail.width) * thumbnail.height * 4;
+    staging.resize(offset + size);
+    copy_page_rect(page, level, rect.x >> level, rect.y >> level, thumbnail.width, thumbnail.height, &staging[offset]);
+    thumbnail_indices.emplace(texture.hash, uint32_t(thumbnails.size()));
+    thumbnails.push_back(thumbnail);
+    staging_offsets.push_back(offset);
+    return size;
+}
+
+bool WAD3Thumbnails::build(uint32_t page_size, size_t max_pages) {
+    AtlasPackOptions options;
+    options.page_width = page_size;
+    options.page_height = page_size;
+    options.padding = PADDING;
+    AtlasLayout layout;
+    std::vector<AtlasSize> sizes(thumbnails.size());
+    uint64_t page_area = uint64_t(page_size) * page_size;
+    while (true) {
+        uint64_t padded_area = 0;
+        for (size_t i = 0; i < thumbnails.size(); i++) {
+            sizes[i] = {thumbnails[i].width, thumbnails[i].height};
+            padded_area += uint64_t(thumbnails[i].width + PADDING * 2) * (thumbnails[i].height + PADDING * 2);
+        }
+        // The area is checked first, so that the thumbnails which cannot fit are not packed.
+        bool may_fit = (padded_area + page_area - 1) / page_area <= max_pages;
+        if (may_fit && !pack_atlas(sizes, options, layout)) {
+            SLOG_ERROR("Could not pack %zu thumbnails into %ux%u pages", thumbnails.size(), page_size, page_size);
+            return false;
+        }
+        if (may_fit && layout.pages.size() <= max_pages) {
+            break;
+        }
+        if (!downsample()) {
+            SLOG_ERROR("Could not fit %zu thumbnails into %zu pages", thumbnails.size(), max_pages);
+            return false;
+        }
+    }
+
+    pages.resize(layout.pages.size());
+    for (size_t i = 0; i < layout.pages.size(); i++) {
+        pages[i].width = layout.pages[i].width;
+        pages[i].height = layout.pages[i].height;
+        pages[i].pixels.assign(size_t(pages[i].width) * pages[i].height * 4, 0);
+    }
+    for (size_t i = 0; i < thumbnails.size(); i++) {
+        WAD3Thumbnail& thumbnail = thumbnails[i];
+        const AtlasRect& rect = layout.rects[i];
+        WAD3ThumbnailPage& page = pages[rect.page];
+        copy_rgba8_padded(&staging[staging_offsets[i]], thumbnail.width, thumbnail.height, page.pixels.data(),
+                          page.width, rect.x, rect.y, PADDING);
+        thumbnail.page = rect.page;
+        thumbnail.uv0[0] = float(rect.x) / float(page.width);
+        thumbnail.uv0[1] = float(rect.y) / float(page.height);
+        thumbnail.uv1[0] = float(rect.x + rect.width) / float(page.width);
+        thumbnail.uv1[1] = float(rect.y + rect.height) / float(page.height);
+    }
+    staging = {};
+    staging_offsets = {};
+    return true;
+}
+
+bool WAD3Thumbnails::downsample() {
+    std::vector<uint8_t> downsampled;
+    std::vector<size_t> downsampled_offsets(thumbnails.size());
+    bool changed = false;
+    for (size_t i = 0; i < thumbnails.size(); i++) {
+        WAD3Thumbnail& thumbnail = thumbnails[i];
+        uint32_t width = mip_level_dim(thumbnail.width, 1);
+        uint32_t height = mip_level_dim(thumbnail.height, 1);
+        downsampled_offsets[i] = downsampled.size();
+        downsampled.resize(downsampled.size() + size_t(width) * height * 4);
+        // Gamma-correct like the mip levels of the atlas pages.
+        downsample_rgba8(&staging[staging_offsets[i]], thumbnail.width, thumbnail.height,
+                         &downsampled[downsampled_offsets[i]], true);
+        changed = changed || width != thumbnail.width || height != thumbnail.height;
+        thumbnail.width = width;
+        thumbnail.height = height;
+    }
+    staging = std::move(downsampled);
+    staging_offsets = std::move(downsampled_offsets);
+    return changed;
+}
+
+const WAD3Thumbnail* WAD3Thumbnails::find(uint64_t hash) const {
+    auto it = thumbnail_indices.find(hash);
+    return it != thumbnail_indices.end() ? &thumbnails[it->second] : nullptr;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "wad_cache.h"
+
+
+// One thumbnail of WAD3Thumbnails.
+struct WAD3Thumbnail {
+    // Index in WAD3Thumbnails::pages.
+    uint32_t page = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    float uv0[2] = {};
+    float uv1[2] = {};
+};
+
+// RGBA8 page of WAD3Thumbnails, a single mip level.
+struct WAD3ThumbnailPage {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+// Thumbnails of the textures of all WADs packed into shared RGBA8 pages, so that a grid of thumbnails is drawn from
+// one or two images. Each thumbnail is the smallest mip level in the atlas pages which still covers THUMBNAIL_SIZE, so
+// thousands of thumbnails fit into a single page.
+struct WAD3Thumbnails {
+    static constexpr uint32_t THUMBNAIL_SIZE = 32;
+    static constexpr uint32_t PADDING = 1;
+
+    // Copy the thumbnails of the textures stored by the WAD (rect >= 0) out of its atlas pages, decoding compressed
+    // pages. Textures with the key of an added thumbnail are skipped, and so are the ones whose page level does not
+    // pass WAD3Textures::verify_level().
+    void add(WAD3Textures& textures);
+    // Same as add() for one texture of the WAD. Return the size of the copied RGBA8 thumbnail, 0 if it was skipped.
+    size_t add_texture(WAD3Textures& textures, size_t texture_idx);
+
+    // Pack the added thumbnails into at most max_pages pages of up to page_size x page_size pixels. If they do not fit,
+    // all the thumbnails are downsampled by 2 until they do, so that no thumbnail is dropped. Return false if packing
+    // failed.
+    bool build(uint32_t page_size = 2048, size_t max_pages = SIZE_MAX);
+
+    // Return the thumbnail of the texture with the content key or nullptr if there is none. Valid after build().
+    const WAD3Thumbnail* find(uint64_t hash) const;
+
+    // Downsample all the added thumbnails by 2. Return false if all of them are 1x1 already.
+    bool downsample();
+
+    std::vector<WAD3ThumbnailPage> pages;
+    std::vector<WAD3Thumbnail> thumbnails;
+    // Content key -> index in thumbnails.
+    std::unordered_map<uint64_t, uint32_t> thumbnail_indices;
+    // RGBA8 pixels of the added thumbnails until build().
+    std::vector<uint8_t> staging;
+    std::vector<size_t> staging_offsets;
+};
@@ -7,7 +7,9 @@
 #include <util/sokol_debugtext.h>
 #include <util/sokol_imgui.h>
 
+#include <algorithm>
 #include <memory>
+#include <vector>
 
 #include "common/defer.h"
 #include "common/io.h"
@@ -15,21 +17,66 @@
 #include "common/sync.h"
 #include "common/thread.h"
 #include "hl1/wad3.h"
+#include "hl1/wad_atlas.h"
+#include "hl1/wad_cache.h"
 #include "hl1/wad_display.h"
 
 
 const char* wads_list_path = "data/hl1/wads.txt";
 
+struct ParsedWAD {
+    // Position in wads.txt.
+    uint32_t search_order = 0;
+    WAD3Textures textures;
+};
+
 struct DisplayState {
     WAD3Display wad_display;
 
-    MPMCQueue<WAD3Parser> parsed_wads;
+    MPMCQueue<ParsedWAD> parsed_wads;
     TaskLatch parsed_wads_latch;
     bool finished_loading = false;
+    // Start of loading, the end of the last frame and the longest frame while loading.
+    uint64_t load_start_time = 0;
+    uint64_t last_frame_time = 0;
+    double worst_frame_ms = 0.0;
 };
 
+// Work done on the main thread per frame while loading: bytes of thumbnails copied or uploaded and milliseconds.
+const size_t LOAD_BYTES_PER_FRAME = 1 << 20;
+const double LOAD_MS_PER_FRAME = 4.0;
+
+// Images and views created outside of WAD3Display.
+const int NUM_OTHER_IMAGES = 16;
+
 std::unique_ptr<DisplayState> g_state;
 
+// Pack the textures of the WAD which are not stored by other WADs, write its cache file and push the result to
+// parsed_wads.
+void build_wad(uint32_t search_order, const FileContents& wad_contents, const WAD3SharedTextures& shared,
+               TextureFormat texture_format) {
+    ParsedWAD parsed;
+    parsed.search_order = search_order;
+    WAD3Textures& textures = parsed.textures;
+    // A single large WAD (e.g. halflife.wad) would otherwise be decoded on one core.
+    WAD3ParseOptions options;
+    options.parallel = true;
+    options.full_mip_chain = true;
+    options.max_levels = WAD3Atlas::MAX_PAGE_LEVELS;
+    options.gamma_correct_mips = true;
+    WAD3AtlasOptions atlas_options;
+    atlas_options.parallel = true;
+    atlas_options.format = texture_format;
+    atlas_options.gamma_correct_mips = true;
+    if (textures.build(wad_contents, options, atlas_options, shared)) {
+        WAD3CacheKey cache_key;
+        if (cache_key.init(wad_contents, texture_format)) {
+            textures.save_cache(wad3_cache_path(wad_contents.name.c_str()).c_str(), cache_key);
+        }
+        g_state->parsed_wads.push(std::move(parsed));
+    }
+}
+
 bool start_parsing() {
     std::vector<std::string> wad_file_list;
     if (!file_read_lines(wads_list_path, wad_file_list)) {
@@ -38,18 +85,50 @@ bool start_parsing() {
     g_state->parsed_wads_latch.reset(wad_file_list.size());
 
     std::string wad_dir = path_get_directory(wads_list_path);
-    for (const std::string& wad_file : wad_file_list) {
-        std::string wad_path = path_join(wad_dir.c_str(), wad_file.c_str());
-        thread_pool().submit([wad_path]() mutable {
-            DEFER(g_state->parsed_wads_latch.count_down());
-            FileContents wad_contents;
-            if (file_read_contents(wad_path.c_str(), wad_contents)) {
-                WAD3Parser wad;
-                wad.parse(wad_contents);
-                g_state->parsed_wads.push(std::move(wad));
+    TextureFormat texture_format = g_state->wad_display.texture_format;
+    thread_pool().submit([wad_dir, wad_file_list, texture_format]() {
+        // Byte-identical textures are stored only by the first WAD in the list which has them, so the owner does not
+        // depend on which WAD finishes first. The scan is sequential: WADs with a valid cache file give their keys
+        // without being read, and indexing the others is cheap compared to decoding them.
+        // The keys point into the files, which are kept until all the keys are assigned.
+        WAD3ContentKeys content_keys;
+        std::vector<std::shared_ptr<FileContents>> all_contents;
+        for (uint32_t search_order = 0; search_order < uint32_t(wad_file_list.size()); search_order++) {
+            std::string wad_path = path_join(wad_dir.c_str(), wad_file_list[search_order].c_str());
+            ParsedWAD parsed;
+            parsed.search_order = search_order;
+            // Filled by load_cache() if it had to read the WAD to compare it with a stale cache file.
+            auto wad_contents = std::make_shared<FileContents>();
+            WAD3CacheKey cache_key;
+            bool cached =
+                cache_key.init(wad_path.c_str(), texture_format) &&
+                parsed.textures.load_cache(wad3_cache_path(wad_path.c_str()).c_str(), cache_key, wad_contents.get());
+            WAD3SharedTextures shared;
+            if (cached && content_keys.add_cached_wad(parsed.textures.textures, parsed.textures.shared_hash, shared)) {
+                g_state->parsed_wads.push(std::move(parsed));
+                g_state->parsed_wads_latch.count_down();
+                continue;
             }
-        });
-    }
+            // There is no cache, or it was built with other keys: the WAD is unchanged, but the textures stored by the
+            // WADs before have changed. A rejected cache added no keys, so they are computed from the pixels.
+            if (wad_contents->name.empty() && !file_read_contents(wad_path.c_str(), *wad_contents)) {
+                g_state->parsed_wads_latch.count_down();
+                continue;
+            }
+            WAD3View view;
+            if (!view.parse(*wad_contents)) {
+                g_state->parsed_wads_latch.count_down();
+                continue;
+            }
+            content_keys.add_wad(view.entries, shared);
+            all_contents.push_back(wad_contents);
+
+            thread_pool().submit([search_order, wad_contents, shared, texture_format]() {
+                DEFER(g_state->parsed_wads_latch.count_down());
+                build_wad(search_order, *wad_contents, shared, texture_format);
+            });
+        }
+    });
     return true;
 }
 
@@ -57,13 +136,31 @@ void process_parsed() {
     if (g_state->finished_loading) {
         return;
     }
-    WAD3Parser wad;
-    while (g_state->parsed_wads.try_pop(wad)) {
-        g_state->wad_display.add_wad(wad);
-    }
-    if (g_state->parsed_wads_latch.done()) {
-        g_state->wad_display.loading = false;
+    // The first call only starts the lap. A lap ends when the next frame starts, so the frame which did the last
+    // loading step is measured by the call after it.
+    double frame_ms = stm_ms(stm_laptime(&g_state->last_frame_time));
+    g_state->worst_frame_ms = std::max(g_state->worst_frame_ms, frame_ms);
+    if (!g_state->wad_display.loading) {
+        const WAD3Display& display = g_state->wad_display;
+        SLOG_INFO("Loaded %zu textures, %zu shared: %.1f MiB of atlas pages, %.1f MiB saved by sharing",
+                  display.num_textures, display.num_shared_textures, double(display.page_bytes) / (1024 * 1024),
+                  double(display.shared_bytes) / (1024 * 1024));
+        SLOG_INFO("Loading took %.1f ms, worst frame %.1f ms", stm_ms(stm_since(g_state->load_start_time)),
+                  g_state->worst_frame_ms);
         g_state->finished_loading = true;
+        return;
+    }
+
+    // Adding a WAD only registers its pages, its textures are added within the frame budget.
+    ParsedWAD parsed;
+    while (g_state->parsed_wads.try_pop(parsed)) {
+        g_state->wad_display.add_wad(std::move(parsed.textures), parsed.search_order);
+    }
+    bool all_added = g_state->wad_display.add_pending_textures(LOAD_BYTES_PER_FRAME, LOAD_MS_PER_FRAME);
+    // The latch is checked before the queue, so that WADs pushed in between are not missed. The indices and the
+    // thumbnail pages are then built and uploaded within the same budget.
+    if (g_state->parsed_wads_latch.done() && g_state->parsed_wads.empty() && all_added) {
+        g_state->wad_display.finish_loading(LOAD_BYTES_PER_FRAME, LOAD_MS_PER_FRAME);
     }
 }
 
@@ -71,8 +168,10 @@ void init_cb() {
     sg_desc desc = {};
     desc.environment = sglue_environment();
     desc.logger.func = slog_func;
-    desc.image_pool_size = 10000;  // Increased to accommodate many WAD textures
-    desc.view_pool_size = 10000;
+    // WAD textures are packed into atlas pages: one image and one view per page rather than per texture, and only a
+    // bounded number of pages is resident. The rest is for the ImGui and debug text fonts.
+    desc.image_pool_size = WAD3Display::NUM_IMAGES + NUM_OTHER_IMAGES;
+    desc.view_pool_size = WAD3Display::NUM_IMAGES + NUM_OTHER_IMAGES;
     sg_setup(desc);
 
     sdtx_desc_t sdtx_desc = {};
@@ -90,6 +189,8 @@ void init_cb() {
     simgui_setup(simgui_desc);
 
     g_state = std::make_unique<DisplayState>();
+    g_state->wad_display.init();
+    g_state->load_start_time = stm_now();
 
     if (!start_parsing()) {
 #if !defined(__EMSCRIPTEN__)
@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "common/defer.h"
+#include "common/inline_string.h"
 #include "common/io.h"
 
 namespace {
@@ -68,26 +69,28 @@ bool unpack_pak_file(const char* pak_path, const char* output_dir) {
     }
 
     for (const PakFileEntry& entry : file_entries) {
-        std::string output_file = path_join(output_dir, entry.name);
+        // The name field is not NUL-terminated when the name takes all 56 bytes.
+        InlineString<sizeof(entry.name)> name(std::string_view(entry.name, strnlen(entry.name, sizeof(entry.name))));
+        std::string output_file = path_join(output_dir, name.c_str());
         if (!create_directory_for_file(output_file)) {
             return false;
         }
 
         if (fseek(pak_f, entry.offset, SEEK_SET) != 0) {
-            printf("Failed to seek to file data for: %s\n", entry.name);
+            printf("Failed to seek to file data for: %s\n", name.c_str());
             return false;
         }
 
         std::vector<uint8_t> file_data(entry.size);
         if (fread(file_data.data(), 1, entry.size, pak_f) != entry.size) {
-            printf("Failed to read file data for: %s\n", entry.name);
+            printf("Failed to read file data for: %s\n", name.c_str());
             return false;
         }
 
         if (!file_write_contents(output_file.c_str(), file_data.data(), entry.size)) {
             return false;
         }
-        printf("Extracted: %s\n", entry.name);
+        printf("Extracted: %s\n", name.c_str());
     }
 
     printf("Successfully extracted %zu files\n", file_count);